@@ -55,10 +55,24 @@ dashmm::Evaluator<SourceData, TargetData,
                   dashmm::Laplace, dashmm::FMM> laplace_fmm{};
 dashmm::Evaluator<SourceData, TargetData,
                   dashmm::Laplace, dashmm::FMM97> laplace_fmm97{};
+dashmm::Evaluator<SourceData, TargetData, dashmm::Laplace,
+                  dashmm::WithDistro<dashmm::FMM97,
+                                     dashmm::PartitionDistro>::type>
+    laplace_fmm97_partition{};
+dashmm::Evaluator<SourceData, TargetData, dashmm::Laplace,
+                  dashmm::WithDistro<dashmm::FMM97,
+                                     dashmm::FMM97PartialDistro>::type>
+    laplace_fmm97_partial{};
+dashmm::Evaluator<SourceData, TargetData,
+                  dashmm::LaplaceMixed, dashmm::FMM> laplace_mixed_fmm{};
+dashmm::Evaluator<SourceData, TargetData,
+                  dashmm::LaplaceMixed, dashmm::FMM97> laplace_mixed_fmm97{};
 dashmm::Evaluator<SourceData, TargetData,
                   dashmm::Yukawa, dashmm::Direct> yukawa_direct{};
 dashmm::Evaluator<SourceData, TargetData,
                   dashmm::Yukawa, dashmm::FMM97> yukawa_fmm97{};
+dashmm::Evaluator<SourceData, TargetData,
+                  dashmm::YukawaMixed, dashmm::FMM97> yukawa_mixed_fmm97{};
 dashmm::Evaluator<SourceData, TargetData,
                   dashmm::Helmholtz, dashmm::Direct> helmholtz_direct{};
 dashmm::Evaluator<SourceData, TargetData,
@@ -73,6 +87,12 @@ struct InputArguments {
   int refinement_limit;
   std::string method;
   std::string kernel;
+  std::string precision;
+  std::string distro;
+  std::string partition;
+  std::string accumulate;
+  int coarsen;
+  std::string executor;
   bool verify;
   int accuracy;
 };
@@ -98,6 +118,19 @@ void print_usage(char *progname) {
           "perform an accuracy test comparing to direct summation (yes)\n"
           "--kernel=[laplace/yukawa/helmholtz]   "
           "particle interaction type (laplace)\n"
+          "--precision=[double/mixed]  "
+          "storage precision of expansion coefficients (double)\n"
+          "--distro=[default/partition/partial]\n"
+          "                            DAG distribution policy (default)\n"
+          "--partition=[points/work]   "
+          "division of the tree among the ranks (points)\n"
+          "--accumulate=[locked/concurrent]\n"
+          "                            accumulation of target contributions"
+          " (locked)\n"
+          "--coarsen=num               "
+          "largest weight of a fused source subtree, 0 disables (0)\n"
+          "--executor=[dataflow/bulk]  "
+          "execution of the DAG (dataflow)\n"
           , progname);
 }
 
@@ -112,6 +145,12 @@ int read_arguments(int argc, char **argv, InputArguments &retval) {
   retval.refinement_limit = 40;
   retval.method = std::string{"fmm97"};
   retval.kernel = std::string{"laplace"};
+  retval.precision = std::string{"double"};
+  retval.distro = std::string{"default"};
+  retval.partition = std::string{"points"};
+  retval.accumulate = std::string{"locked"};
+  retval.coarsen = 0;
+  retval.executor = std::string{"dataflow"};
   retval.verify = true;
   retval.accuracy = 3;
 
@@ -126,12 +165,18 @@ int read_arguments(int argc, char **argv, InputArguments &retval) {
     {"verify", required_argument, 0, 'v'},
     {"accuracy", required_argument, 0, 'a'},
     {"kernel", required_argument, 0, 'k'},
+    {"precision", required_argument, 0, 'p'},
+    {"distro", required_argument, 0, 'd'},
+    {"partition", required_argument, 0, 'r'},
+    {"accumulate", required_argument, 0, 'c'},
+    {"coarsen", required_argument, 0, 'f'},
+    {"executor", required_argument, 0, 'x'},
     {"help", no_argument, 0, 'h'},
     {0, 0, 0, 0}
   };
 
   int long_index = 0;
-  while ((opt = getopt_long(argc, argv, "m:s:w:t:g:l:v:a:k:h",
+  while ((opt = getopt_long(argc, argv, "m:s:w:t:g:l:v:a:k:p:d:r:c:f:x:h",
                             long_options, &long_index)) != -1) {
     std::string verifyarg{};
     switch (opt) {
@@ -163,6 +208,24 @@ int read_arguments(int argc, char **argv, InputArguments &retval) {
     case 'k':
       retval.kernel = optarg;
       break;
+    case 'p':
+      retval.precision = optarg;
+      break;
+    case 'd':
+      retval.distro = optarg;
+      break;
+    case 'r':
+      retval.partition = optarg;
+      break;
+    case 'c':
+      retval.accumulate = optarg;
+      break;
+    case 'f':
+      retval.coarsen = atoi(optarg);
+      break;
+    case 'x':
+      retval.executor = optarg;
+      break;
     case 'h':
       print_usage(argv[0]);
       return -1;
@@ -203,6 +266,60 @@ int read_arguments(int argc, char **argv, InputArguments &retval) {
     return -1;
   }
 
+  if (retval.precision != "double" && retval.precision != "mixed") {
+    fprintf(stderr, "Usage ERROR: unknown precision '%s'\n",
+            retval.precision.c_str());
+    return -1;
+  }
+
+  if (retval.precision == "mixed") {
+    if (retval.kernel == "helmholtz" || retval.method == "bh") {
+      fprintf(stderr, "Usage ERROR: mixed precision is only available for"
+              " the laplace and yukawa kernels using fmm or fmm97\n");
+      return -1;
+    }
+  }
+
+  if (retval.distro != "default" && retval.distro != "partition"
+      && retval.distro != "partial") {
+    fprintf(stderr, "Usage ERROR: unknown distro '%s'\n",
+            retval.distro.c_str());
+    return -1;
+  }
+
+  if (retval.partition != "points" && retval.partition != "work") {
+    fprintf(stderr, "Usage ERROR: unknown partition '%s'\n",
+            retval.partition.c_str());
+    return -1;
+  }
+
+  if (retval.accumulate != "locked" && retval.accumulate != "concurrent") {
+    fprintf(stderr, "Usage ERROR: unknown accumulation '%s'\n",
+            retval.accumulate.c_str());
+    return -1;
+  }
+
+  if (retval.coarsen < 0) {
+    fprintf(stderr, "Usage ERROR: coarsen must not be negative\n");
+    return -1;
+  }
+
+  if (retval.executor != "dataflow" && retval.executor != "bulk") {
+    fprintf(stderr, "Usage ERROR: unknown executor '%s'\n",
+            retval.executor.c_str());
+    return -1;
+  }
+
+  if (retval.distro != "default") {
+    if (retval.kernel != "laplace" || retval.method != "fmm97"
+        || retval.precision != "double") {
+      fprintf(stderr, "Usage ERROR: the %s distro is only available"
+              " for the laplace kernel using fmm97 in double precision\n",
+              retval.distro.c_str());
+      return -1;
+    }
+  }
+
   if (retval.kernel == "laplace" && retval.method == "fmm97") {
     if (retval.accuracy != 3 && retval.accuracy != 6) {
       fprintf(stderr, "Usage ERROR: only 3-/6-digit accuracy supported"
@@ -240,9 +357,14 @@ int read_arguments(int argc, char **argv, InputArguments &retval) {
             retval.source_count, retval.source_type.c_str());
     fprintf(stdout, "%d targets in a %s distribution\n",
             retval.target_count, retval.target_type.c_str());
-    fprintf(stdout, "method: %s \nthreshold: %d\nkernel: %s\n\n",
+    fprintf(stdout, "method: %s \nthreshold: %d\nkernel: %s\n"
+            "precision: %s\ndistro: %s\npartition: %s\naccumulate: %s\n"
+            "coarsen: %d\nexecutor: %s\n\n",
             retval.method.c_str(), retval.refinement_limit,
-            retval.kernel.c_str());
+            retval.kernel.c_str(), retval.precision.c_str(),
+            retval.distro.c_str(), retval.partition.c_str(),
+            retval.accumulate.c_str(), retval.coarsen,
+            retval.executor.c_str());
   }
 
   // Dole out sources and targets equally
@@ -425,9 +547,10 @@ dashmm::Array<TargetData> prepare_targets(InputArguments &args) {
 }
 
 // Compute an error characteristic for the values computed with a multipole
-// method, and the values computed with direct summation.
+// method, and the values computed with direct summation, and report whether
+// it meets the requested number of digits.
 void compare_results(TargetData *targets, int target_count,
-                     TargetData *exacts, int exact_count) {
+                     TargetData *exacts, int exact_count, int accuracy) {
   if (dashmm::get_my_rank()) return;
 
   //create a map from index into offset for targets
@@ -452,14 +575,99 @@ void compare_results(TargetData *targets, int target_count,
       maxrel = sqrt(relerr / exnorm);
     }
   }
+  double l2err = sqrt(numerator / denominator);
   fprintf(stdout, "Error for %d test points: %4.3e (max %4.3e)\n",
-                  exact_count, sqrt(numerator / denominator), maxrel);
+                  exact_count, l2err, maxrel);
+  fprintf(stdout, "Requested %d digits (%4.3e): %s\n", accuracy,
+          pow(10.0, -accuracy),
+          l2err <= pow(10.0, -accuracy) ? "met" : "NOT met");
+}
+
+// Select how the trees of every evaluator are divided among the ranks
+void set_tree_partition(dashmm::TreePartition partition) {
+  laplace_bh.set_tree_partition(partition);
+  laplace_direct.set_tree_partition(partition);
+  laplace_fmm.set_tree_partition(partition);
+  laplace_fmm97.set_tree_partition(partition);
+  laplace_fmm97_partition.set_tree_partition(partition);
+  laplace_fmm97_partial.set_tree_partition(partition);
+  laplace_mixed_fmm.set_tree_partition(partition);
+  laplace_mixed_fmm97.set_tree_partition(partition);
+  yukawa_direct.set_tree_partition(partition);
+  yukawa_fmm97.set_tree_partition(partition);
+  yukawa_mixed_fmm97.set_tree_partition(partition);
+  helmholtz_direct.set_tree_partition(partition);
+  helmholtz_fmm97.set_tree_partition(partition);
+}
+
+// Have every evaluator accumulate the contributions to the targets
+// concurrently
+void use_concurrent_accumulation() {
+  constexpr auto kConcurrent = dashmm::TargetAccumulation::Concurrent;
+  laplace_bh.set_target_accumulation<kConcurrent>();
+  laplace_direct.set_target_accumulation<kConcurrent>();
+  laplace_fmm.set_target_accumulation<kConcurrent>();
+  laplace_fmm97.set_target_accumulation<kConcurrent>();
+  laplace_fmm97_partition.set_target_accumulation<kConcurrent>();
+  laplace_fmm97_partial.set_target_accumulation<kConcurrent>();
+  laplace_mixed_fmm.set_target_accumulation<kConcurrent>();
+  laplace_mixed_fmm97.set_target_accumulation<kConcurrent>();
+  yukawa_direct.set_target_accumulation<kConcurrent>();
+  yukawa_fmm97.set_target_accumulation<kConcurrent>();
+  yukawa_mixed_fmm97.set_target_accumulation<kConcurrent>();
+  helmholtz_direct.set_target_accumulation<kConcurrent>();
+  helmholtz_fmm97.set_target_accumulation<kConcurrent>();
+}
+
+// Select how every evaluator coarsens its DAGs
+void set_DAG_coarsening(int threshold) {
+  laplace_bh.set_DAG_coarsening(threshold);
+  laplace_direct.set_DAG_coarsening(threshold);
+  laplace_fmm.set_DAG_coarsening(threshold);
+  laplace_fmm97.set_DAG_coarsening(threshold);
+  laplace_fmm97_partition.set_DAG_coarsening(threshold);
+  laplace_fmm97_partial.set_DAG_coarsening(threshold);
+  laplace_mixed_fmm.set_DAG_coarsening(threshold);
+  laplace_mixed_fmm97.set_DAG_coarsening(threshold);
+  yukawa_direct.set_DAG_coarsening(threshold);
+  yukawa_fmm97.set_DAG_coarsening(threshold);
+  yukawa_mixed_fmm97.set_DAG_coarsening(threshold);
+  helmholtz_direct.set_DAG_coarsening(threshold);
+  helmholtz_fmm97.set_DAG_coarsening(threshold);
+}
+
+// Select how every evaluator executes its DAGs
+void set_executor(dashmm::Executor executor) {
+  laplace_bh.set_executor(executor);
+  laplace_direct.set_executor(executor);
+  laplace_fmm.set_executor(executor);
+  laplace_fmm97.set_executor(executor);
+  laplace_fmm97_partition.set_executor(executor);
+  laplace_fmm97_partial.set_executor(executor);
+  laplace_mixed_fmm.set_executor(executor);
+  laplace_mixed_fmm97.set_executor(executor);
+  yukawa_direct.set_executor(executor);
+  yukawa_fmm97.set_executor(executor);
+  yukawa_mixed_fmm97.set_executor(executor);
+  helmholtz_direct.set_executor(executor);
+  helmholtz_fmm97.set_executor(executor);
 }
 
 // The main driver routine that performes the test of evaluate()
 void perform_evaluation_test(InputArguments args) {
   srand(123456 + dashmm::get_my_rank());
 
+  if (args.partition == std::string{"work"}) {
+    set_tree_partition(dashmm::TreePartition::Work);
+  }
+  if (args.accumulate == std::string{"concurrent"}) {
+    use_concurrent_accumulation();
+  }
+  set_DAG_coarsening(args.coarsen);
+  if (args.executor == std::string{"bulk"}) {
+    set_executor(dashmm::Executor::Bulk);
+  }
+
   dashmm::Array<SourceData> source_handle = prepare_sources(args);
   dashmm::Array<TargetData> target_handle = prepare_targets(args);
 
@@ -479,6 +687,52 @@ void perform_evaluation_test(InputArguments args) {
                                 args.accuracy, &kparm);
       assert(err == dashmm::kSuccess);
       tf = getticks();
+    } else if (args.method == std::string{"fmm"}
+               && args.precision == std::string{"mixed"}) {
+      dashmm::FMM<SourceData, TargetData, dashmm::LaplaceMixed> method{};
+
+      t0 = getticks();
+      std::vector<double> kparm{};
+      err = laplace_mixed_fmm.evaluate(source_handle, target_handle,
+                                       args.refinement_limit, &method,
+                                       args.accuracy, &kparm);
+      assert(err == dashmm::kSuccess);
+      tf = getticks();
+    } else if (args.method == std::string{"fmm97"}
+               && args.precision == std::string{"mixed"}) {
+      dashmm::FMM97<SourceData, TargetData, dashmm::LaplaceMixed> method{};
+
+      t0 = getticks();
+      std::vector<double> kparm{};
+      err = laplace_mixed_fmm97.evaluate(source_handle, target_handle,
+                                         args.refinement_limit, &method,
+                                         args.accuracy, &kparm);
+      assert(err == dashmm::kSuccess);
+      tf = getticks();
+    } else if (args.method == std::string{"fmm97"}
+               && args.distro == std::string{"partition"}) {
+      dashmm::WithDistro<dashmm::FMM97, dashmm::PartitionDistro>::type<
+          SourceData, TargetData, dashmm::Laplace> method{};
+
+      t0 = getticks();
+      std::vector<double> kparm{};
+      err = laplace_fmm97_partition.evaluate(source_handle, target_handle,
+                                             args.refinement_limit, &method,
+                                             args.accuracy, &kparm);
+      assert(err == dashmm::kSuccess);
+      tf = getticks();
+    } else if (args.method == std::string{"fmm97"}
+               && args.distro == std::string{"partial"}) {
+      dashmm::WithDistro<dashmm::FMM97, dashmm::FMM97PartialDistro>::type<
+          SourceData, TargetData, dashmm::Laplace> method{};
+
+      t0 = getticks();
+      std::vector<double> kparm{};
+      err = laplace_fmm97_partial.evaluate(source_handle, target_handle,
+                                           args.refinement_limit, &method,
+                                           args.accuracy, &kparm);
+      assert(err == dashmm::kSuccess);
+      tf = getticks();
     } else if (args.method == std::string{"fmm"}) {
       dashmm::FMM<SourceData, TargetData, dashmm::Laplace> method{};
 
@@ -501,7 +755,18 @@ void perform_evaluation_test(InputArguments args) {
       tf = getticks();
     }
   } else if (args.kernel == std::string{"yukawa"}) {
-    if (args.method == std::string{"fmm97"}) {
+    if (args.method == std::string{"fmm97"}
+        && args.precision == std::string{"mixed"}) {
+      dashmm::FMM97<SourceData, TargetData, dashmm::YukawaMixed> method{};
+      std::vector<double> kernelparms(1, 0.1);
+
+      t0 = getticks();
+      err = yukawa_mixed_fmm97.evaluate(source_handle, target_handle,
+                                        args.refinement_limit, &method,
+                                        args.accuracy, &kernelparms);
+      assert(err == dashmm::kSuccess);
+      tf = getticks();
+    } else if (args.method == std::string{"fmm97"}) {
       dashmm::FMM97<SourceData, TargetData, dashmm::Yukawa> method{};
       std::vector<double> kernelparms(1, 0.1);
 
@@ -598,7 +863,7 @@ void perform_evaluation_test(InputArguments args) {
 
     //Test error
     compare_results(targets.get(), args.target_count,
-                    test_results.get(), test_count);
+                    test_results.get(), test_count, args.accuracy);
 
     err = test_handle.destroy();
     assert(err == dashmm::kSuccess);
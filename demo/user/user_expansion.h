@@ -206,14 +206,16 @@ class User {
 
   // This routine will set this expansion to the multipole moments generated
   // by the given sources.
-  std::unique_ptr<User> S_to_M(Source *first, Source *last) const {
+  std::unique_ptr<User> S_to_M(const Source *first,
+                               const Source *last) const {
     fprintf(stdout, "S->M for %ld sources\n", last - first);
     return std::unique_ptr<User>{new User{dashmm::kSourcePrimary}};
   }
 
   // This will generate a local expansion at the given center for the
   // given points.
-  std::unique_ptr<User> S_to_L(Source *first, Source *last) const {
+  std::unique_ptr<User> S_to_L(const Source *first,
+                               const Source *last) const {
     fprintf(stdout, "S->L for %ld sources\n", last - first);
     return std::unique_ptr<User>{new User{dashmm::kTargetPrimary}};
   }
@@ -251,7 +253,7 @@ class User {
   }
 
   // This will compute the effect of a set of sources on a set of target points.
-  void S_to_T(source_t *s_first, source_t *s_last,
+  void S_to_T(const source_t *s_first, const source_t *s_last,
               target_t *t_first, target_t *t_last) const {
     fprintf(stdout, "S->T for %ld sources and %ld targets\n",
             s_last - s_first, t_last - t_first);
@@ -45,12 +45,24 @@ class BHDistro {
  private:
   static void sort(DAG &dag);
   static bool color_comparison(const DAGNode *a, const DAGNode *b);
-  static void assign_localities(std::vector<DAGNode *> &nodes);
-  static void compute_locality(DAGNode *node);
   bool distribution_complete(DAG &dag);
 };
 
 
+/// BHDistro working on a partial DAG
+///
+/// Each locality discovers only the part of the DAG it owns, and every node
+/// stays with the branch of the tree it belongs to. The nodes above the
+/// uniform level are placed on locality 0. This saves the memory and time of
+/// discovering the full DAG on each locality, at the cost of the
+/// communication-driven placement of BHDistro. Select it with
+/// WithDistro<BH, BHPartialDistro>::type.
+class BHPartialDistro : public BHDistro {
+ public:
+  static constexpr bool kPartialDAG = true;
+};
+
+
 } // dashmm
 
 
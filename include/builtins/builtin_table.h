@@ -17,26 +17,34 @@
 
 
 /// \file
-/// \brief Declaration of comparator for builtin tables
+/// \brief Declarations shared by the precomputed tables of the builtins
+
+
+#include <cmath>
 
 
 namespace dashmm {
 
 
-struct builtin_cmp {
-  bool operator()(const double &a, const double &b) const {
-    // For builtin kernels, the smallest gap between key values of the
-    // rotation matrix map is 0.01. This operator compares the first 6
-    // digits and should be sufficient.
-    double aa = floor(a * 1000000.0) / 100000.0;
-    double bb = floor(b * 1000000.0) / 100000.0;
-    if (aa == bb)
-      return false;
-    return aa < bb;
-  }
+/// Slots of the Wigner d-matrices held by every builtin table
+///
+/// The tables store their d-matrices in a flat array so that the translation
+/// operators address them directly rather than by key. kDMatDiagonal and
+/// kDMatAntiDiagonal rotate by the polar angle with cosine 1/sqrt(3) and
+/// -1/sqrt(3) respectively, which takes the offset between a box and its
+/// children onto the z axis. kDMatEquator rotates by pi/2.
+enum DMatSlot : int {
+  kDMatDiagonal = 0,
+  kDMatAntiDiagonal = 1,
+  kDMatEquator = 2,
+  kDMatSlots = 3
 };
 
-using builtin_map_t = std::map<double, double *, builtin_cmp>;
+/// The cosine of the rotation angle of each DMatSlot
+inline double dmat_slot_cbeta(int slot) {
+  const double cbeta[kDMatSlots] = {1.0 / sqrt(3.0), -1.0 / sqrt(3.0), 0.0};
+  return cbeta[slot];
+}
 
 
 } // namespace dashmm
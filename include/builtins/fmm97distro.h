@@ -35,7 +35,19 @@ class FMM97Distro {
 
  private:
   static bool color_comparison(const DAGNode *a, const DAGNode *b);
-  static void compute_locality(DAGNode *node);
+};
+
+
+/// FMM97Distro working on a partial DAG
+///
+/// Each locality discovers only the part of the DAG it owns, and every node
+/// stays with the branch of the tree it belongs to, including the
+/// intermediate target nodes that FMM97Distro would otherwise place by edge
+/// weight. The nodes above the uniform level are placed on locality 0.
+/// Select it with WithDistro<FMM97, FMM97PartialDistro>::type.
+class FMM97PartialDistro : public FMM97Distro {
+ public:
+  static constexpr bool kPartialDAG = true;
 };
 
 
@@ -27,8 +27,11 @@
 
 #include "dashmm/index.h"
 #include "builtins/helmholtz_table.h"
+#include "builtins/nearfield.h"
+#include "builtins/scratch.h"
 #include "dashmm/point.h"
 #include "dashmm/types.h"
+#include "dashmm/viewpool.h"
 #include "dashmm/viewset.h"
 
 namespace dashmm {
@@ -59,11 +62,11 @@ public:
 
     if (role == kSourcePrimary) {
       size_t bytes = sizeof(dcomplex_t) * (p + 1) * (p + 2) / 2;
-      char *data = new char[bytes]();
+      char *data = ViewPool::allocate(bytes);
       views_.add_view(0, bytes, data);
     } else if (role == kTargetPrimary) {
       size_t bytes = sizeof(dcomplex_t) * (p + 1) * (p + 1);
-      char *data = new char[bytes]();
+      char *data = ViewPool::allocate(bytes);
       views_.add_view(0, bytes, data);
     } else if (role == kSourceIntermediate) {
       // On the source side, propagating waves along the positive and negative
@@ -72,34 +75,36 @@ public:
       size_t bytes_p = sizeof(dcomplex_t) * n_p;
       size_t bytes_e = sizeof(dcomplex_t) * n_e;
 
+      views_.reserve(9);
       for (int i = 0; i < 3; ++i) {
         int j = 3 * i;
 
         // Propagating wave
-        char *data1 = new char[bytes_p]();
+        char *data1 = ViewPool::allocate(bytes_p);
         views_.add_view(j, bytes_p, data1);
 
         // Evanescent wave positive axis
-        char *data2 = new char[bytes_e]();
+        char *data2 = ViewPool::allocate(bytes_e);
         views_.add_view(j + 1, bytes_e, data2);
 
         // Evanescent wave negative axis
-        char *data3 = new char[bytes_e]();
+        char *data3 = ViewPool::allocate(bytes_e);
         views_.add_view(j + 2, bytes_e, data3);
       }
     } else if (role == kTargetIntermediate) {
       size_t bytes_p = sizeof(dcomplex_t) * n_p;
       size_t bytes_e = sizeof(dcomplex_t) * n_e;
 
+      views_.reserve(56);
       for (int i = 0; i < 28; ++i) {
         int j = 2 * i;
 
         // Propagating wave
-        char *data1 = new char[bytes_p]();
+        char *data1 = ViewPool::allocate(bytes_p);
         views_.add_view(j, bytes_p, data1);
 
         // Evanescent wave
-        char *data2 = new char[bytes_e]();
+        char *data2 = ViewPool::allocate(bytes_e);
         views_.add_view(j + 1, bytes_e, data2);
       }
     }
@@ -111,7 +116,7 @@ public:
     int count = views_.count();
     if (count) {
       for (int i = 0; i < count; ++i) {
-        delete [] views_.view_data(i);
+        ViewPool::deallocate(views_.view_data(i));
       }
     }
   }
@@ -161,48 +166,39 @@ public:
     const double *sqf = builtin_helmholtz_table_->sqf();
     double omega = builtin_helmholtz_table_->omega();
 
-    double *legendre = new double[(p + 1) * (p + 2) / 2];
-    dcomplex_t *powers_ephi = new dcomplex_t[p + 1];
-    double *bessel = new double[p + 1];
-
-    for (auto i = first; i != last; ++i) {
-      Point dist = point_sub(i->position, center);
-      double q = i->charge;
-      double proj = sqrt(dist.x() * dist.x() + dist.y() * dist.y());
-      double r = dist.norm();
-
-      // Compute cosine of the polar angle theta
-      double ctheta = (r <= 1.0e-14 ? 1.0 : dist.z() / r);
-
-      // Compute exp(-i * phi) for the azimuthal angle phi
-      dcomplex_t ephi = (proj / r <= 1.0e-14 ? dcomplex_t{1.0, 0.0} :
-                         dcomplex_t{dist.x() / proj, -dist.y() / proj});
-
-      // Compute powers of exp(-i * phi)
-      powers_ephi[0] = 1.0;
-      for (int j = 1; j <= p; ++j) {
-        powers_ephi[j] = powers_ephi[j - 1] * ephi;
-      }
-
-      // Compute scaled modified spherical bessel function
-      bessel_jn_scaled(p, omega * r, scale, bessel);
-
-      // Compute legendre polynomial
-      legendre_Plm(p, ctheta, legendre);
-
-      // Compute multipole expansion M_n^m
-      for (int n = 0; n <= p; ++n) {
-        for (int m = 0; m <= n; ++m) {
-          int idx = midx(n, m);
-          M[idx] += q * bessel[n] * sqf[idx] * legendre[idx] * powers_ephi[m];
+    // The sources are staged in tiles, and each tile is processed kSphLanes
+    // sources at a time.
+    constexpr int L = kSphLanes;
+    BuiltinScratch scratch{};
+    double *legendre = scratch.doubles((p + 1) * (p + 2) / 2 * L);
+    double *ephi_re = scratch.doubles((p + 1) * L);
+    double *ephi_im = scratch.doubles((p + 1) * L);
+    double *rad = scratch.doubles((p + 1) * L);
+    double *bessel = scratch.doubles(p + 1);
+    double dx[L], dy[L], dz[L], q[L], r[L];
+
+    auto coef = [sqf](int n, int m) { return sqf[midx(n, m)]; };
+
+    NearFieldSources tile;
+    for (auto i = first; i < last; i += kNearFieldTile) {
+      nf_stage_sources(i, last, tile);
+      for (int base = 0; base < tile.count; base += L) {
+        nf_source_lanes(tile, base, center, dx, dy, dz, q);
+        sph_coords_lanes(p, dx, dy, dz, -1.0, r, legendre, ephi_re, ephi_im);
+
+        // Compute scaled spherical bessel function
+        for (int k = 0; k < L; ++k) {
+          bessel_jn_scaled(p, omega * r[k], scale, bessel);
+          for (int n = 0; n <= p; ++n) {
+            rad[n * L + k] = q[k] * bessel[n];
+          }
         }
+
+        // Compute multipole expansion M_n^m
+        sph_accumulate_lanes(p, rad, legendre, ephi_re, ephi_im, coef, M);
       }
     }
 
-    delete [] legendre;
-    delete [] powers_ephi;
-    delete [] bessel;
-
     return std::unique_ptr<expansion_t>{retval};
   }
 
@@ -270,11 +266,11 @@ public:
 
     // Get precomputed Wigner d-matrix for rotation about the y-axis
     const double *d1 = (from_child < 4 ?
-                        builtin_helmholtz_table_->dmat_plus(1.0 / sqrt(3.0)) :
-                        builtin_helmholtz_table_->dmat_plus(-1.0 / sqrt(3.0)));
+                        builtin_helmholtz_table_->dmat_plus(kDMatDiagonal) :
+                        builtin_helmholtz_table_->dmat_plus(kDMatAntiDiagonal));
     const double *d2 = (from_child < 4 ?
-                        builtin_helmholtz_table_->dmat_minus(1.0 / sqrt(3.0)) :
-                        builtin_helmholtz_table_->dmat_minus(-1.0 / sqrt(3.0)));
+                        builtin_helmholtz_table_->dmat_minus(kDMatDiagonal) :
+                        builtin_helmholtz_table_->dmat_minus(kDMatAntiDiagonal));
 
     // Get precomputed coefficients for shifting along z-axis
     const double *coeff = builtin_helmholtz_table_->m2m(scale);
@@ -333,11 +329,11 @@ public:
 
     // Get precomputed Wigner d-matrix for rotation about the y-axis
     const double *d1 = (to_child < 4 ?
-                        builtin_helmholtz_table_->dmat_plus(-1.0 / sqrt(3)) :
-                        builtin_helmholtz_table_->dmat_plus(1.0 / sqrt(3)));
+                        builtin_helmholtz_table_->dmat_plus(kDMatAntiDiagonal) :
+                        builtin_helmholtz_table_->dmat_plus(kDMatDiagonal));
     const double *d2 = (to_child < 4 ?
-                        builtin_helmholtz_table_->dmat_minus(-1.0 / sqrt(3)) :
-                        builtin_helmholtz_table_->dmat_minus(1.0 / sqrt(3)));
+                        builtin_helmholtz_table_->dmat_minus(kDMatAntiDiagonal) :
+                        builtin_helmholtz_table_->dmat_minus(kDMatDiagonal));
 
     // Get precomputed coefficients for shifting along z-axis
     const double *coeff = builtin_helmholtz_table_->l2l(scale);
@@ -520,8 +516,8 @@ public:
       builtin_helmholtz_table_->size(scale);
 
     // Get precomputed Wigner d-matrix
-    const double *d1 = builtin_helmholtz_table_->dmat_plus(0.0);
-    const double *d2 = builtin_helmholtz_table_->dmat_minus(0.0);
+    const double *d1 = builtin_helmholtz_table_->dmat_plus(kDMatEquator);
+    const double *d2 = builtin_helmholtz_table_->dmat_minus(kDMatEquator);
 
     // Allocate temporary space to handle x-/y-direction expansion
     dcomplex_t *W1 = new dcomplex_t[(p + 1) * (p + 2) / 2];
@@ -685,18 +681,18 @@ public:
     size_t bytes_e = n_e * sizeof(dcomplex_t);
     size_t bytes_p = n_p * sizeof(dcomplex_t);
 
-    dcomplex_t *T1 = new dcomplex_t[n_p]();
-    dcomplex_t *T2 = new dcomplex_t[n_e]();
-    dcomplex_t *T3 = new dcomplex_t[n_p]();
-    dcomplex_t *T4 = new dcomplex_t[n_e]();
-    dcomplex_t *T5 = new dcomplex_t[n_p]();
-    dcomplex_t *T6 = new dcomplex_t[n_e]();
-    char *C1 = reinterpret_cast<char *>(T1);
-    char *C2 = reinterpret_cast<char *>(T2);
-    char *C3 = reinterpret_cast<char *>(T3);
-    char *C4 = reinterpret_cast<char *>(T4);
-    char *C5 = reinterpret_cast<char *>(T5);
-    char *C6 = reinterpret_cast<char *>(T6);
+    char *C1 = ViewPool::allocate(bytes_p);
+    char *C2 = ViewPool::allocate(bytes_e);
+    char *C3 = ViewPool::allocate(bytes_p);
+    char *C4 = ViewPool::allocate(bytes_e);
+    char *C5 = ViewPool::allocate(bytes_p);
+    char *C6 = ViewPool::allocate(bytes_e);
+    dcomplex_t *T1 = reinterpret_cast<dcomplex_t *>(C1);
+    dcomplex_t *T2 = reinterpret_cast<dcomplex_t *>(C2);
+    dcomplex_t *T3 = reinterpret_cast<dcomplex_t *>(C3);
+    dcomplex_t *T4 = reinterpret_cast<dcomplex_t *>(C4);
+    dcomplex_t *T5 = reinterpret_cast<dcomplex_t *>(C5);
+    dcomplex_t *T6 = reinterpret_cast<dcomplex_t *>(C6);
     dcomplex_t *T[6] = {T1, T2, T3, T4, T5, T6};
     char *C[6] = {C1, C2, C3, C4, C5, C6};
     bool used[3] = {false, false, false};
@@ -735,13 +731,13 @@ public:
     }
 
     if (used[1] == false) {
-      delete [] T3;
-      delete [] T4;
+      ViewPool::deallocate(C3);
+      ViewPool::deallocate(C4);
     }
 
     if (used[2] == false) {
-      delete [] T5;
-      delete [] T6;
+      ViewPool::deallocate(C5);
+      ViewPool::deallocate(C6);
     }
 
     expansion_t *retval = new expansion_t{views};
@@ -1058,9 +1054,33 @@ public:
     }
   }
 
+  static void clear_targets(Target *first, Target *last) {
+    for (auto i = first; i != last; ++i) {
+      i->phi = dcomplex_t{};
+    }
+  }
+
+  static void add_targets(const Target *first, const Target *last,
+                          Target *dest) {
+    for (auto i = first; i != last; ++i, ++dest) {
+      dest->phi += i->phi;
+    }
+  }
+
   static void update_table(int n_digits, double domain_size,
                            const std::vector<double> &kernel_params) {
     update_helmholtz_table(n_digits, domain_size, kernel_params[0]);
+
+    // The sizes of the views, which for the exponential expansions depend on
+    // the level
+    const HelmholtzTable *table = builtin_helmholtz_table_.get();
+    int p = table->p();
+    ViewPool::add_size(sizeof(dcomplex_t) * (p + 1) * (p + 2) / 2);
+    ViewPool::add_size(sizeof(dcomplex_t) * (p + 1) * (p + 1));
+    for (int lev = 0; lev <= HelmholtzTable::maxlev; ++lev) {
+      ViewPool::add_size(sizeof(dcomplex_t) * table->n_e(table->scale(lev)));
+      ViewPool::add_size(sizeof(dcomplex_t) * table->n_p(table->scale(lev)));
+    }
   }
 
   static void delete_table() { }
@@ -1419,12 +1439,12 @@ private:
     if (dir == 'z') {
       contrib = W1;
     } else if (dir == 'y') {
-      const double *d = builtin_helmholtz_table_->dmat_plus(0.0);
+      const double *d = builtin_helmholtz_table_->dmat_plus(kDMatEquator);
       rotate_sph_y(W1, d, W2, true);
       rotate_sph_z(W2, M_PI / 2, W1, true);
       contrib = W1;
     } else if (dir == 'x') {
-      const double *d = builtin_helmholtz_table_->dmat_minus(0.0);
+      const double *d = builtin_helmholtz_table_->dmat_minus(kDMatEquator);
       rotate_sph_y(W1, d, W2, true);
       contrib = W2;
     }
@@ -19,7 +19,6 @@
 
 #include <cmath>
 #include <complex>
-#include <map>
 #include <memory>
 #include <vector>
 #include "dashmm/types.h"
@@ -39,8 +38,12 @@ public:
   double scale(int lev) const {return scale_ / pow(2, lev);}
   double omega() const {return omega_;}
   const double *sqf() const {return sqf_;}
-  const double *dmat_plus(double v) const {return dmat_plus_->at(v);}
-  const double *dmat_minus(double v) const {return dmat_minus_->at(v);}
+  const double *dmat_plus(DMatSlot slot) const {
+    return &dmat_plus_[slot * dmat_size_];
+  }
+  const double *dmat_minus(DMatSlot slot) const {
+    return &dmat_minus_[slot * dmat_size_];
+  }
   const double *m2m(double scale) const {
     int offset = level(scale) - 3;
     assert(offset >= 0);
@@ -119,8 +122,9 @@ private:
   double size_;
   double scale_;
   double *sqf_;
-  builtin_map_t *dmat_plus_;
-  builtin_map_t *dmat_minus_;
+  int dmat_size_;      // number of entries of a single d-matrix
+  double *dmat_plus_;  // d-matrices indexed by DMatSlot
+  double *dmat_minus_;
   double *m2m_;
   double *l2l_;
   double *x_e_;
@@ -17,7 +17,7 @@
 
 
 /// \file
-/// \brief Declaration of Laplace
+/// \brief Declaration of LaplaceExpansion
 
 
 #include <cassert>
@@ -30,8 +30,12 @@
 #include "dashmm/index.h"
 #include "builtins/laplace_table.h"
 #include "builtins/merge_shift.h"
+#include "builtins/nearfield.h"
+#include "builtins/precision.h"
+#include "builtins/scratch.h"
 #include "dashmm/point.h"
 #include "dashmm/types.h"
+#include "dashmm/viewpool.h"
 #include "dashmm/viewset.h"
 
 
@@ -52,9 +56,15 @@ namespace dashmm {
 
 void lap_rotate_sph_z(const dcomplex_t *M, double alpha, dcomplex_t *MR);
 void lap_rotate_sph_y(const dcomplex_t *M, const double *d, dcomplex_t *MR);
+void lap_m_to_l(const LaplaceM2L &op, const dcomplex_t *M, double scale,
+                dcomplex_t *L);
 
 void lap_s_to_m(Point dist, double q, double scale, dcomplex_t *M);
 void lap_s_to_l(Point dist, double q, double scale, dcomplex_t *L);
+void lap_s_to_m(const NearFieldSources &sources, const Point &center,
+                double scale, dcomplex_t *M);
+void lap_s_to_l(const NearFieldSources &sources, const Point &center,
+                double scale, dcomplex_t *L);
 void lap_m_to_m(int from_child, const dcomplex_t *M, dcomplex_t *W);
 void lap_l_to_l(int to_child, const dcomplex_t *L, dcomplex_t *W);
 void lap_m_to_i(const dcomplex_t *M, ViewSet &views, int id);
@@ -70,21 +80,43 @@ std::vector<double> lap_m_to_t(Point dist, double scale,
 std::vector<double> lap_l_to_t(Point dist, double scale,
                                const dcomplex_t *L, bool g = false);
 
+/// Evaluate a multipole expansion at a tile of targets
+///
+/// The potential at target i is added to phi[i]. If field is not null, the
+/// three components of the gradient are added to field[i], field[i +
+/// kNearFieldTile] and field[i + 2 * kNearFieldTile].
+void lap_m_to_t(const NearFieldTargets &targets, const Point &center,
+                double scale, const dcomplex_t *M, double *phi,
+                double *field = nullptr);
+
+/// Evaluate a local expansion at a tile of targets
+///
+/// The outputs are as for the batched lap_m_to_t.
+void lap_l_to_t(const NearFieldTargets &targets, const Point &center,
+                double scale, const dcomplex_t *L, double *phi,
+                double *field = nullptr);
+
 
 /// This class is a template with parameters for the source and target
-/// types.
+/// types, and for the precision in which the coefficients are stored.
 ///
 /// Source must define a double valued 'charge' member to be used with
 /// Laplace. Target must define a std::complex<double> valued 'phi' member
 /// to be used with Laplace.
-template <typename Source, typename Target>
-class Laplace {
+///
+/// Precision is one of DoublePrecision or MixedPrecision. Users will
+/// typically refer to this class through the Laplace and LaplaceMixed
+/// aliases below.
+template <typename Source, typename Target, typename Precision>
+class LaplaceExpansion {
  public:
   using source_t = Source;
   using target_t = Target;
-  using expansion_t = Laplace<Source, Target>;
+  using expansion_t = LaplaceExpansion<Source, Target, Precision>;
+  using coefficient_t = typename Precision::coefficient_t;
 
-  Laplace(ExpansionRole role, double scale = 1.0, Point center = Point{})
+  LaplaceExpansion(ExpansionRole role, double scale = 1.0,
+                   Point center = Point{})
     : views_{ViewSet{role, center, scale}} {
     // View size for each spherical harmonic expansion
     int p = builtin_laplace_table_->p();
@@ -94,31 +126,33 @@ class Laplace {
     int nexp = builtin_laplace_table_->nexp();
 
     if (role == kSourcePrimary || role == kTargetPrimary) {
-      size_t bytes = sizeof(dcomplex_t) * nsh;
-      char *data = new char[bytes]();
+      size_t bytes = sizeof(coefficient_t) * nsh;
+      char *data = ViewPool::allocate(bytes);
       views_.add_view(0, bytes, data);
     } else if (role == kSourceIntermediate) {
-      size_t bytes = sizeof(dcomplex_t) * nexp;
+      size_t bytes = sizeof(coefficient_t) * nexp;
+      views_.reserve(6);
       for (int i = 0; i < 6; ++i) {
-        char *data = new char[bytes]();
+        char *data = ViewPool::allocate(bytes);
         views_.add_view(i, bytes, data);
       }
     } else if (role == kTargetIntermediate) {
-      size_t bytes = sizeof(dcomplex_t) * nexp;
+      size_t bytes = sizeof(coefficient_t) * nexp;
+      views_.reserve(28);
       for (int i = 0; i < 28; ++i) {
-        char *data = new char[bytes]();
+        char *data = ViewPool::allocate(bytes);
         views_.add_view(i, bytes, data);
       }
     }
   }
 
-  Laplace(const ViewSet &views) : views_{views} { }
+  LaplaceExpansion(const ViewSet &views) : views_{views} { }
 
-  ~Laplace() {
+  ~LaplaceExpansion() {
     int count = views_.count();
     if (count) {
       for (int i = 0; i < count; ++i) {
-        delete [] views_.view_data(i);
+        ViewPool::deallocate(views_.view_data(i));
       }
     }
   }
@@ -150,12 +184,13 @@ class Laplace {
   Point center() const {return views_.center();}
 
   size_t view_size(int view) const {
-    return views_.view_bytes(view) / sizeof(dcomplex_t);
+    return views_.view_bytes(view) / sizeof(coefficient_t);
   }
 
   dcomplex_t view_term(int view, size_t i) const {
-    dcomplex_t *data = reinterpret_cast<dcomplex_t *>(views_.view_data(view));
-    return data[i];
+    coefficient_t *data =
+      reinterpret_cast<coefficient_t *>(views_.view_data(view));
+    return dcomplex_t{data[i]};
   }
 
   std::unique_ptr<expansion_t> S_to_M(const Source *first,
@@ -163,12 +198,17 @@ class Laplace {
     double scale = views_.scale();
     Point center = views_.center();
     expansion_t *retval{new expansion_t{kSourcePrimary, scale, center}};
-    dcomplex_t *M = reinterpret_cast<dcomplex_t *>(retval->views_.view_data(0));
-    for (auto i = first; i != last; ++i) {
-      Point dist = point_sub(i->position, center);
-      lap_s_to_m(dist, i->charge, scale, M);
+    BuiltinScratch scratch;
+    size_t n = retval->view_size(0);
+    char *data = retval->views_.view_data(0);
+    dcomplex_t *M = Precision::output(data, n, scratch);
+    NearFieldSources tile;
+    for (auto i = first; i < last; i += kNearFieldTile) {
+      nf_stage_sources(i, last, tile);
+      lap_s_to_m(tile, center, scale, M);
     }
-   return std::unique_ptr<expansion_t>{retval};
+    Precision::store(M, n, data);
+    return std::unique_ptr<expansion_t>{retval};
   }
 
   std::unique_ptr<expansion_t> S_to_L(const Source *first,
@@ -176,19 +216,28 @@ class Laplace {
     double scale = views_.scale();
     Point center = views_.center();
     expansion_t *retval{new expansion_t{kTargetPrimary}};
-    dcomplex_t *L = reinterpret_cast<dcomplex_t *>(retval->views_.view_data(0));
-    for (auto i = first; i != last; ++i) {
-      Point dist = point_sub(i->position, center);
-      lap_s_to_l(dist, i->charge, scale, L);
+    BuiltinScratch scratch;
+    size_t n = retval->view_size(0);
+    char *data = retval->views_.view_data(0);
+    dcomplex_t *L = Precision::output(data, n, scratch);
+    NearFieldSources tile;
+    for (auto i = first; i < last; i += kNearFieldTile) {
+      nf_stage_sources(i, last, tile);
+      lap_s_to_l(tile, center, scale, L);
     }
+    Precision::store(L, n, data);
     return std::unique_ptr<expansion_t>{retval};
   }
 
   std::unique_ptr<expansion_t> M_to_M(int from_child) const {
     expansion_t *retval{new expansion_t{kSourcePrimary}};
-    dcomplex_t *M = reinterpret_cast<dcomplex_t *>(views_.view_data(0));
-    dcomplex_t *W = reinterpret_cast<dcomplex_t *>(retval->views_.view_data(0));
+    BuiltinScratch scratch;
+    size_t n = view_size(0);
+    char *data = retval->views_.view_data(0);
+    const dcomplex_t *M = Precision::load(views_.view_data(0), n, scratch);
+    dcomplex_t *W = Precision::output(data, n, scratch);
     lap_m_to_m(from_child, M, W);
+    Precision::store(W, n, data);
     return std::unique_ptr<expansion_t>{retval};
   }
 
@@ -198,114 +247,92 @@ class Laplace {
     int t2s_x = s_index.x() - t_index.x();
     int t2s_y = s_index.y() - t_index.y();
     int t2s_z = s_index.z() - t_index.z();
-    int p = builtin_laplace_table_->p();
-
-    // Shifting distance
-    double rho = sqrt(t2s_x * t2s_x + t2s_y * t2s_y + t2s_z * t2s_z);
-
-    // Compute powers of rho
-    double *powers_rho = new double[p * 2 + 1];
-    powers_rho[0] = 1.0 / rho;
-    for (int i = 1; i <= p * 2; i++) {
-      powers_rho[i] = powers_rho[i - 1] / rho;
-    }
-
-    // Temporary space to hold rotated spherical harmonic
-    dcomplex_t *W1 =
-      reinterpret_cast<dcomplex_t *>(retval->views_.view_data(0));
-    dcomplex_t *W2 = new dcomplex_t[(p + 1) * (p + 2) / 2];
-
-    // Compute the projection of t2s on the x-y plane
-    const double proj = sqrt(t2s_x * t2s_x + t2s_y * t2s_y);
 
-    // Handle of the multipole expansion
-    dcomplex_t *M = reinterpret_cast<dcomplex_t *>(views_.view_data(0));
+    BuiltinScratch scratch;
+    size_t n = view_size(0);
+    char *data = retval->views_.view_data(0);
+    const dcomplex_t *M = Precision::load(views_.view_data(0), n, scratch);
+    dcomplex_t *L = Precision::output(data, n, scratch);
+    lap_m_to_l(builtin_laplace_table_->m2l(t2s_x, t2s_y, t2s_z), M,
+               views_.scale(), L);
+    Precision::store(L, n, data);
 
-    if (proj < 1e-14) {
-      if (t2s_z > 0) {
-        M_to_L_zp(M, powers_rho, W1);
-      } else {
-        M_to_L_zm(M, powers_rho, W1);
-      }
-    } else {
-      // azimuthal angle
-      double beta = acos(t2s_x / proj);
-      if (t2s_y < 0) {
-        beta = 2 * M_PI - beta;
-      }
-
-      // Get precomputed Wigner d-matrix for rotation about y-axis
-      const double *d1 = builtin_laplace_table_->dmat_plus(t2s_z / rho);
-      const double *d2 = builtin_laplace_table_->dmat_minus(t2s_z / rho);
-      lap_rotate_sph_z(M, beta, W1);
-      lap_rotate_sph_y(W1, d1, W2);
-      M_to_L_zp(W2, powers_rho, W1);
-      lap_rotate_sph_y(W1, d2, W2);
-      lap_rotate_sph_z(W2, -beta, W1);
-    }
-
-    delete [] W2;
-    delete [] powers_rho;
     return std::unique_ptr<expansion_t>{retval};
   }
 
   std::unique_ptr<expansion_t> L_to_L(int to_child) const {
     expansion_t *retval{new expansion_t{kTargetPrimary}};
-    dcomplex_t *L = reinterpret_cast<dcomplex_t *>(views_.view_data(0));
-    dcomplex_t *W = reinterpret_cast<dcomplex_t *>(retval->views_.view_data(0));
+    BuiltinScratch scratch;
+    size_t n = view_size(0);
+    char *data = retval->views_.view_data(0);
+    const dcomplex_t *L = Precision::load(views_.view_data(0), n, scratch);
+    dcomplex_t *W = Precision::output(data, n, scratch);
     lap_l_to_l(to_child, L, W);
+    Precision::store(W, n, data);
     return std::unique_ptr<expansion_t>{retval};
   }
 
   void M_to_T(Target *first, Target *last) const {
     double scale = views_.scale();
-    dcomplex_t *M = reinterpret_cast<dcomplex_t *>(views_.view_data(0));
-
-    for (auto i = first; i != last; ++i) {
-      Point dist = point_sub(i->position, views_.center());
-      auto result = lap_m_to_t(dist, scale, M);
-      i->phi += result[0];
-    }
+    Point center = views_.center();
+    BuiltinScratch scratch;
+    const dcomplex_t *M =
+      Precision::load(views_.view_data(0), view_size(0), scratch);
+
+    nf_apply_targets<1>(first, last,
+                        [&](const NearFieldTargets &t, double *phi) {
+                          lap_m_to_t(t, center, scale, M, phi);
+                        },
+                        [](Target &targ, const double *phi, int i) {
+                          targ.phi += dcomplex_t{phi[i]};
+                        });
   }
 
   void L_to_T(Target *first, Target *last) const {
     double scale = views_.scale();
-    dcomplex_t *L = reinterpret_cast<dcomplex_t *>(views_.view_data(0));
-
-    for (auto i = first; i != last; ++i) {
-      Point dist = point_sub(i->position, views_.center());
-      auto result = lap_l_to_t(dist, scale, L);
-      i->phi += result[0];
-    }
+    Point center = views_.center();
+    BuiltinScratch scratch;
+    const dcomplex_t *L =
+      Precision::load(views_.view_data(0), view_size(0), scratch);
+
+    nf_apply_targets<1>(first, last,
+                        [&](const NearFieldTargets &t, double *phi) {
+                          lap_l_to_t(t, center, scale, L, phi);
+                        },
+                        [](Target &targ, const double *phi, int i) {
+                          targ.phi += dcomplex_t{phi[i]};
+                        });
   }
 
   void S_to_T(const Source *s_first,
               const Source *s_last,
               Target *t_first,
               Target *t_last) const {
-    for (auto i = t_first; i != t_last; ++i) {
-      dcomplex_t potential{0.0, 0.0};
-      for (auto j = s_first; j != s_last; ++j) {
-        Point s2t = point_sub(i->position, j->position);
-        double dist = s2t.norm();
-        if (dist > 0) {
-          potential += j->charge / dist;
-        }
-      }
-      i->phi += potential;
-    }
+    nf_evaluate<1>(s_first, s_last, t_first, t_last, nf_lap_potential,
+                   [](Target &targ, const double *phi, int i) {
+                     targ.phi += dcomplex_t{phi[i]};
+                   });
   }
 
   std::unique_ptr<expansion_t> M_to_I() const {
     expansion_t *retval{new expansion_t{kSourceIntermediate}};
-    dcomplex_t *M = reinterpret_cast<dcomplex_t *>(views_.view_data(0));
-    lap_m_to_i(M, retval->views_, 0);
+    BuiltinScratch scratch;
+    const dcomplex_t *M =
+      Precision::load(views_.view_data(0), view_size(0), scratch);
+    ViewSet wide = Precision::widen(retval->views_, scratch);
+    lap_m_to_i(M, wide, 0);
+    Precision::narrow(wide, retval->views_);
     return std::unique_ptr<expansion_t>(retval);
   }
 
   std::unique_ptr<expansion_t> I_to_I(Index s_index, Index t_index) const {
     ViewSet views{kTargetIntermediate};
-    lap_i_to_i(s_index, t_index, views_, 0, 0, views);
+    {
+      BuiltinScratch scratch;
+      ViewSet wide = Precision::widen(views_, scratch);
+      lap_i_to_i(s_index, t_index, wide, 0, 0, views);
+    }
+    Precision::narrow_owned(views);
     expansion_t *retval = new expansion_t{views};
     return std::unique_ptr<expansion_t>{retval};
   }
@@ -313,9 +340,14 @@ class Laplace {
   std::unique_ptr<expansion_t> I_to_L(Index t_index) const {
     // t_index is the index of the child
     expansion_t *retval{new expansion_t{kTargetPrimary}};
-    dcomplex_t *L = reinterpret_cast<dcomplex_t *>(retval->views_.view_data(0));
+    BuiltinScratch scratch;
+    size_t n = retval->view_size(0);
+    char *data = retval->views_.view_data(0);
+    ViewSet wide = Precision::widen(views_, scratch);
+    dcomplex_t *L = Precision::output(data, n, scratch);
     double scale = views_.scale() * 2;
-    lap_i_to_l(views_, 0, t_index, scale, L);
+    lap_i_to_l(wide, 0, t_index, scale, L);
+    Precision::store(L, n, data);
     return std::unique_ptr<expansion_t>(retval);
   }
 
@@ -325,10 +357,11 @@ class Laplace {
     int count = temp1->views_.count();
     for (int i = 0; i < count; ++i) {
       int idx = temp1->views_.view_index(i);
-      int size = temp1->views_.view_bytes(i) / sizeof(dcomplex_t);
-      dcomplex_t *lhs = reinterpret_cast<dcomplex_t *>(views_.view_data(idx));
-      dcomplex_t *rhs =
-        reinterpret_cast<dcomplex_t *>(temp1->views_.view_data(i));
+      int size = temp1->views_.view_bytes(i) / sizeof(coefficient_t);
+      coefficient_t *lhs =
+        reinterpret_cast<coefficient_t *>(views_.view_data(idx));
+      coefficient_t *rhs =
+        reinterpret_cast<coefficient_t *>(temp1->views_.view_data(i));
 
       for (int j = 0; j < size; ++j) {
         lhs[j] += rhs[j];
@@ -336,9 +369,29 @@ class Laplace {
     }
   }
 
+  static void clear_targets(Target *first, Target *last) {
+    for (auto i = first; i != last; ++i) {
+      i->phi = dcomplex_t{};
+    }
+  }
+
+  static void add_targets(const Target *first, const Target *last,
+                          Target *dest) {
+    for (auto i = first; i != last; ++i, ++dest) {
+      dest->phi += i->phi;
+    }
+  }
+
   static void update_table(int n_digits, double domain_size,
                            const std::vector<double> &kernel_params) {
     update_laplace_table(n_digits, domain_size);
+
+    // The sizes of the views, and of the wide views formed by I->I
+    int p = builtin_laplace_table_->p();
+    int nexp = builtin_laplace_table_->nexp();
+    ViewPool::add_size(sizeof(coefficient_t) * (p + 1) * (p + 2) / 2);
+    ViewPool::add_size(sizeof(coefficient_t) * nexp);
+    ViewPool::add_size(sizeof(dcomplex_t) * nexp);
   }
 
   static void delete_table() { }
@@ -372,44 +425,18 @@ class Laplace {
 
  private:
   ViewSet views_;
-  void M_to_L_zp(const dcomplex_t *M, const double *rho, dcomplex_t *L) const {
-    int p = builtin_laplace_table_->p();
-    const double *sqbinom = builtin_laplace_table_->sqbinom();
-    double scale = views_.scale();
+};
 
-    int offset = 0;
-    for (int j = 0; j <= p; ++j) {
-      for (int k = 0; k <= j; ++k) {
-        L[offset] = 0;
-        for (int n = k; n <= p; ++n) {
-          L[offset] += M[midx(n, k)] * pow_m1(n + k) * rho[j + n] *
-            sqbinom[midx(n + j, n - k)] * sqbinom[midx(n + j, n + k)];
-        }
-        L[offset] *= scale;
-        offset++;
-      }
-    }
-  }
 
-  void M_to_L_zm(const dcomplex_t *M, const double *rho, dcomplex_t *L) const {
-    int p = builtin_laplace_table_->p();
-    const double *sqbinom = builtin_laplace_table_->sqbinom();
-    double scale = views_.scale();
+/// Laplace expansion with coefficients stored in double precision
+template <typename Source, typename Target>
+using Laplace = LaplaceExpansion<Source, Target, DoublePrecision>;
 
-    int offset = 0;
-    for (int j = 0; j <= p; ++j) {
-      for (int k = 0; k <= j; ++k) {
-        L[offset] = 0;
-        for (int n = k; n <= p; ++n) {
-          L[offset] += M[midx(n, k)] * pow_m1(k + j) * rho[j + n] *
-            sqbinom[midx(n + j, n - k)] * sqbinom[midx(n + j, n + k)];
-        }
-        L[offset] *= scale;
-        offset++;
-      }
-    }
-  }
-};
+/// Laplace expansion with coefficients stored in single precision
+///
+/// The operators still compute in double precision; see MixedPrecision.
+template <typename Source, typename Target>
+using LaplaceMixed = LaplaceExpansion<Source, Target, MixedPrecision>;
 
 
 } // namespace dashmm
@@ -26,9 +26,11 @@
 #include <memory>
 #include <vector>
 
+#include "builtins/nearfield.h"
 #include "dashmm/index.h"
 #include "dashmm/point.h"
 #include "dashmm/types.h"
+#include "dashmm/viewpool.h"
 #include "dashmm/viewset.h"
 
 
@@ -71,7 +73,7 @@ class LaplaceCOM {
 
   LaplaceCOM(ExpansionRole role, double scale = 1.0, Point center = Point{}) {
     bytes_ = sizeof(LaplaceCOMData);
-    data_ = reinterpret_cast<LaplaceCOMData *>(new char [bytes_]);
+    data_ = reinterpret_cast<LaplaceCOMData *>(ViewPool::allocate(bytes_));
     assert(valid(ViewSet{}));
     data_->mtot = 0.0;
     data_->xcom[0] = 0.0;
@@ -97,7 +99,7 @@ class LaplaceCOM {
 
   ~LaplaceCOM() {
     if (valid(ViewSet{})) {
-      delete [] data_;
+      ViewPool::deallocate(reinterpret_cast<char *>(data_));
       data_ = nullptr;
     }
   }
@@ -220,20 +222,10 @@ class LaplaceCOM {
               const Source *s_last,
               Target *t_first,
               Target *t_last) const {
-    for (auto targ = t_first; targ != t_last; ++targ) {
-      Point pos = targ->position;
-      double sum{0.0};
-      for (auto i = s_first; i != s_last; ++i) {
-        double diff[3] {pos.x() - i->position.x(),
-               pos.y() - i->position.y(), pos.z() - i->position.z()};
-        double mag{diff[0] * diff[0] + diff[1] * diff[1] + diff[2] * diff[2]};
-        if (mag > 0) {
-          sum += i->charge / sqrt(mag);
-        }
-      }
-
-      targ->phi += dcomplex_t{sum};
-    }
+    nf_evaluate<1>(s_first, s_last, t_first, t_last, nf_lap_potential,
+                   [](Target &targ, const double *phi, int i) {
+                     targ.phi += dcomplex_t{phi[i]};
+                   });
   }
 
   std::unique_ptr<expansion_t> M_to_I() const {
@@ -297,8 +289,23 @@ class LaplaceCOM {
     set_Q(Qprime);
   }
 
+  static void clear_targets(Target *first, Target *last) {
+    for (auto i = first; i != last; ++i) {
+      i->phi = dcomplex_t{};
+    }
+  }
+
+  static void add_targets(const Target *first, const Target *last,
+                          Target *dest) {
+    for (auto i = first; i != last; ++i, ++dest) {
+      dest->phi += i->phi;
+    }
+  }
+
   static void update_table(int n_digits, double domain_size,
-                           const std::vector<double> &kernel_params) { }
+                           const std::vector<double> &kernel_params) {
+    ViewPool::add_size(sizeof(LaplaceCOMData));
+  }
 
   static void delete_table() { }
 
@@ -25,9 +25,11 @@
 #include <memory>
 #include <vector>
 
+#include "builtins/nearfield.h"
 #include "dashmm/index.h"
 #include "dashmm/point.h"
 #include "dashmm/types.h"
+#include "dashmm/viewpool.h"
 #include "dashmm/viewset.h"
 
 
@@ -71,7 +73,7 @@ class LaplaceCOMAcc {
   LaplaceCOMAcc(ExpansionRole role, double scale = 1.0,
                 Point center = Point{}) {
     bytes_ = sizeof(LaplaceCOMAccData);
-    data_ = reinterpret_cast<LaplaceCOMAccData *>(new char [bytes_]);
+    data_ = reinterpret_cast<LaplaceCOMAccData *>(ViewPool::allocate(bytes_));
     assert(valid(ViewSet{}));
     data_->mtot = 0.0;
     data_->xcom[0] = 0.0;
@@ -97,7 +99,7 @@ class LaplaceCOMAcc {
 
   ~LaplaceCOMAcc() {
     if (valid(ViewSet{})) {
-      delete [] data_;
+      ViewPool::deallocate(reinterpret_cast<char *>(data_));
       data_ = nullptr;
     }
   }
@@ -242,25 +244,12 @@ class LaplaceCOMAcc {
               const Source *s_last,
               Target *t_first,
               Target *t_last) const {
-    for (auto targ = t_first; targ != t_last; ++targ) {
-      Point pos = targ->position;
-      double sum[3] = {0.0, 0.0, 0.0};
-      for (auto i = s_first; i != s_last; ++i) {
-        double diff[3] {pos.x() - i->position.x(),
-               pos.y() - i->position.y(), pos.z() - i->position.z()};
-        double mag{diff[0] * diff[0] + diff[1] * diff[1] + diff[2] * diff[2]};
-        double sqrtmag{sqrt(mag)};
-        if (mag > 0) {
-          sum[0] += i->charge * diff[0] / (mag * sqrtmag);
-          sum[1] += i->charge * diff[1] / (mag * sqrtmag);
-          sum[2] += i->charge * diff[2] / (mag * sqrtmag);
-        }
-      }
-
-      targ->acceleration[0] += sum[0];
-      targ->acceleration[1] += sum[1];
-      targ->acceleration[2] += sum[2];
-    }
+    nf_evaluate<3>(s_first, s_last, t_first, t_last, nf_lap_field,
+                   [](Target &targ, const double *field, int i) {
+                     targ.acceleration[0] += field[i];
+                     targ.acceleration[1] += field[i + kNearFieldTile];
+                     targ.acceleration[2] += field[i + 2 * kNearFieldTile];
+                   });
   }
 
   std::unique_ptr<expansion_t> M_to_I() const {
@@ -326,8 +315,27 @@ class LaplaceCOMAcc {
     set_Q(Qprime);
   }
 
+  static void clear_targets(Target *first, Target *last) {
+    for (auto i = first; i != last; ++i) {
+      i->acceleration[0] = 0.0;
+      i->acceleration[1] = 0.0;
+      i->acceleration[2] = 0.0;
+    }
+  }
+
+  static void add_targets(const Target *first, const Target *last,
+                          Target *dest) {
+    for (auto i = first; i != last; ++i, ++dest) {
+      dest->acceleration[0] += i->acceleration[0];
+      dest->acceleration[1] += i->acceleration[1];
+      dest->acceleration[2] += i->acceleration[2];
+    }
+  }
+
   static void update_table(int n_digits, double domain_size,
-                           const std::vector<double> &kernel_params) { }
+                           const std::vector<double> &kernel_params) {
+    ViewPool::add_size(sizeof(LaplaceCOMAccData));
+  }
 
   static void delete_table() { }
 
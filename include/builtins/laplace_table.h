@@ -20,9 +20,10 @@
 /// \brief Declaration of precomputed tables for Laplace
 
 
+#include <cassert>
 #include <cmath>
+#include <cstdlib>
 #include <complex>
-#include <map>
 #include <memory>
 #include <vector>
 #include "dashmm/types.h"
@@ -33,6 +34,42 @@
 namespace dashmm {
 
 
+/// Precomputed M->L translation for one offset of the interaction list
+///
+/// The translation rotates the offset onto the z axis, shifts along z and
+/// rotates back. Everything that depends only on the offset (measured in
+/// boxes, so that it is the same on every level) is held here, so that
+/// applying the operator with lap_m_to_l() needs no trigonometry, table
+/// lookup or allocation. For offsets along the z axis no rotation is needed
+/// and r1, r2 and ephi are nullptr.
+struct LaplaceM2L {
+  const double *r1;       ///< rotation of the offset onto the z axis
+  const double *r2;       ///< the inverse rotation
+  const dcomplex_t *ephi; ///< exp(i m beta) for m in [0, p]
+  const double *shift;    ///< coefficients of the shift along z
+};
+
+
+/// Translation operators specialized for one expansion order
+///
+/// With the order fixed at compile time the loops over the expansion
+/// coefficients have constant bounds and can be unrolled. LaplaceTable picks
+/// the set for its order when it is constructed, so that the order is
+/// dispatched on once for each update_laplace_table() rather than in every
+/// operator. lap_m_to_m(), lap_l_to_l() and lap_m_to_l() forward to the
+/// selected set.
+struct LaplaceKernels {
+  int p;  ///< The order specialized for, or 0 for any order
+  void (*m_to_m)(int from_child, const dcomplex_t *M, dcomplex_t *W);
+  void (*l_to_l)(int to_child, const dcomplex_t *L, dcomplex_t *W);
+  void (*m_to_l)(const LaplaceM2L &op, const dcomplex_t *M, double scale,
+                 dcomplex_t *L);
+};
+
+/// The operators specialized for order p; the generic ones if there are none
+const LaplaceKernels *lap_kernels(int p);
+
+
 class LaplaceTable {
  public:
   LaplaceTable(int n_digits, double size);
@@ -41,11 +78,33 @@ class LaplaceTable {
   int p() const {return p_;}
   int s() const {return s_;}
   int nexp() const {return nexp_;}
+  const LaplaceKernels *kernels() const {return kernels_;}
   double scale(int lev) const {return scale_ * pow(2, lev);}
   const double *sqf() const {return sqf_;}
   const double *sqbinom() const {return sqbinom_;}
-  const double *dmat_plus(double v) const {return dmat_plus_->at(v);}
-  const double *dmat_minus(double v) const {return dmat_minus_->at(v);}
+  const double *dmat_plus(DMatSlot slot) const {
+    return &dmat_plus_[slot * dmat_size_];
+  }
+  const double *dmat_minus(DMatSlot slot) const {
+    return &dmat_minus_[slot * dmat_size_];
+  }
+
+  /// The rotation of dmat_plus(slot) in the form applied by the operators
+  ///
+  /// For each degree n in [0, p] this holds two (n + 1) x (n + 1) blocks,
+  /// A and B, with the rotated coefficient of order mp given by the sums
+  /// over m of A[m][mp] Re(M_n^m) and B[m][mp] Im(M_n^m).
+  const double *rotation_plus(DMatSlot slot) const {
+    return &rotation_plus_[slot * rotation_size_];
+  }
+  const double *rotation_minus(DMatSlot slot) const {
+    return &rotation_minus_[slot * rotation_size_];
+  }
+
+  /// Compute the d-matrices for the rotation by beta about the y axis
+  void dmatrix_of_beta(double beta, double *dp, double *dm) const {
+    generate_dmatrix_of_beta(beta, dp, dm);
+  }
   const double *lambda() const {return lambda_;}
   const double *weight() const {return weight_;}
   const dcomplex_t *xs() const {return xs_;}
@@ -57,6 +116,14 @@ class LaplaceTable {
   const int *sm() const {return sm_;}
   const int *f() const {return f_;}
   const int *smf() const {return smf_;}
+
+  /// The M->L operator for a source box offset (dx, dy, dz) from the target
+  const LaplaceM2L &m2l(int dx, int dy, int dz) const {
+    assert(abs(dx) <= kM2LRange && abs(dy) <= kM2LRange
+           && abs(dz) <= kM2LRange);
+    return m2l_[((dx + kM2LRange) * kM2LWidth + dy + kM2LRange) * kM2LWidth
+                + dz + kM2LRange];
+  }
   
   int n_digits() const {return n_digits_;} 
   double size() const {return size_;} 
@@ -69,11 +136,16 @@ class LaplaceTable {
   int n_digits_;  // store the last input to the constructor 
   double size_;   // store the last input to the constructor
   int p_;
+  const LaplaceKernels *kernels_;
   double scale_; // scaling factor of level 0 to normalize box size to 1
   double *sqf_;
   double *sqbinom_;
-  builtin_map_t *dmat_plus_;
-  builtin_map_t *dmat_minus_;
+  int dmat_size_;      // number of entries of a single d-matrix
+  double *dmat_plus_;  // d-matrices indexed by DMatSlot
+  double *dmat_minus_;
+  int rotation_size_;
+  std::vector<double> rotation_plus_;
+  std::vector<double> rotation_minus_;
 
   int s_;
   int nexp_;
@@ -89,15 +161,25 @@ class LaplaceTable {
   double *lambdaknm_;
   dcomplex_t *ealphaj_;
 
+  // M->L operators indexed by offset; offsets of adjacent boxes are unused
+  static constexpr int kM2LRange = 3;
+  static constexpr int kM2LWidth = 2 * kM2LRange + 1;
+  LaplaceM2L m2l_[kM2LWidth * kM2LWidth * kM2LWidth];
+  std::vector<dcomplex_t> m2l_ephi_;
+  std::vector<double> m2l_shift_;
+  std::vector<double> m2l_rotation_;
+
   void generate_sqf();
   void generate_sqbinom();
   void generate_wigner_dmatrix();
-  void generate_dmatrix_of_beta(double beta, double *dp, double *dm);
+  void generate_dmatrix_of_beta(double beta, double *dp, double *dm) const;
+  void generate_rotation(const double *d, double *rot);
   void generate_xs();
   void generate_ys();
   void generate_zs();
   void generate_lambdaknm();
   void generate_ealphaj();
+  void generate_m2l();
 };
 
 extern std::unique_ptr<LaplaceTable> builtin_laplace_table_;
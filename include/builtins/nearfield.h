@@ -0,0 +1,237 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+#ifndef __DASHMM_NEAR_FIELD_H__
+#define __DASHMM_NEAR_FIELD_H__
+
+
+/// \file
+/// \brief Tiled near-field (S->T) evaluation engine used by the builtins
+
+
+#include <algorithm>
+
+#include "builtins/special_function.h"
+#include "dashmm/point.h"
+
+
+namespace dashmm {
+
+
+/// Number of sources or targets staged into a single near-field tile
+constexpr int kNearFieldTile = 64;
+
+/// Number of lanes the staged source arrays are padded to
+constexpr int kNearFieldLanes = 8;
+
+static_assert(kNearFieldTile % kSphLanes == 0,
+              "near-field tiles must hold a whole number of lane groups");
+
+
+/// Instruction set used by the near-field kernels
+///
+/// The widest set supported by the running processor is selected at runtime
+/// unless overridden with nf_force_isa().
+enum class NearFieldISA : int {
+  kScalar = 0,
+  kAVX2 = 1,
+  kAVX512 = 2
+};
+
+
+/// Structure-of-arrays staging of a block of sources
+///
+/// Entries in [count, padded count) are zero charge at the origin so that the
+/// vector kernels do not need a remainder loop.
+struct NearFieldSources {
+  alignas(64) double x[kNearFieldTile];
+  alignas(64) double y[kNearFieldTile];
+  alignas(64) double z[kNearFieldTile];
+  alignas(64) double q[kNearFieldTile];
+  int count;
+};
+
+/// Structure-of-arrays staging of a block of targets
+struct NearFieldTargets {
+  alignas(64) double x[kNearFieldTile];
+  alignas(64) double y[kNearFieldTile];
+  alignas(64) double z[kNearFieldTile];
+  int count;
+};
+
+
+/// The instruction set currently used by the near-field kernels
+NearFieldISA nf_isa();
+
+/// Override the instruction set used by the near-field kernels
+///
+/// Requests for an instruction set not supported by the processor are
+/// lowered to the widest one that is supported. The selection actually made
+/// is returned.
+NearFieldISA nf_force_isa(NearFieldISA isa);
+
+/// A printable name for the given instruction set
+const char *nf_isa_name(NearFieldISA isa);
+
+/// Accumulate sum_j q_j / |t_i - s_j| into phi[i]
+///
+/// Coincident source and target pairs are masked out.
+void nf_lap_potential(const NearFieldSources &s, const NearFieldTargets &t,
+                      double *phi);
+
+/// Accumulate sum_j q_j (t_i - s_j) / |t_i - s_j|^3 into field
+///
+/// The three components are stored at field[i], field[i + kNearFieldTile] and
+/// field[i + 2 * kNearFieldTile]. Coincident pairs are masked out.
+void nf_lap_field(const NearFieldSources &s, const NearFieldTargets &t,
+                  double *field);
+
+/// Accumulate sum_j q_j exp(-lambda r_ij) / (lambda r_ij) into phi[i]
+///
+/// Coincident source and target pairs are masked out.
+void nf_yuk_potential(const NearFieldSources &s, const NearFieldTargets &t,
+                      double lambda, double *phi);
+
+
+/// Stage up to kNearFieldTile sources starting at first
+///
+/// Source must provide position and charge members.
+template <typename Source>
+void nf_stage_sources(const Source *first, const Source *last,
+                      NearFieldSources &tile) {
+  int n = std::min<long>(last - first, kNearFieldTile);
+  for (int j = 0; j < n; ++j) {
+    tile.x[j] = first[j].position.x();
+    tile.y[j] = first[j].position.y();
+    tile.z[j] = first[j].position.z();
+    tile.q[j] = first[j].charge;
+  }
+  int padded = (n + kNearFieldLanes - 1) / kNearFieldLanes * kNearFieldLanes;
+  for (int j = n; j < padded; ++j) {
+    tile.x[j] = 0.0;
+    tile.y[j] = 0.0;
+    tile.z[j] = 0.0;
+    tile.q[j] = 0.0;
+  }
+  tile.count = n;
+}
+
+/// Stage up to kNearFieldTile target positions starting at first
+template <typename Target>
+void nf_stage_targets(const Target *first, const Target *last,
+                      NearFieldTargets &tile) {
+  int n = std::min<long>(last - first, kNearFieldTile);
+  for (int i = 0; i < n; ++i) {
+    tile.x[i] = first[i].position.x();
+    tile.y[i] = first[i].position.y();
+    tile.z[i] = first[i].position.z();
+  }
+  tile.count = n;
+}
+
+
+/// Displacements from center of kSphLanes staged sources starting at base
+///
+/// Lanes past the end of the tile are given zero charge and a unit
+/// displacement, so that they contribute nothing to an expansion.
+inline void nf_source_lanes(const NearFieldSources &tile, int base,
+                            const Point &center, double *dx, double *dy,
+                            double *dz, double *q) {
+  for (int k = 0; k < kSphLanes; ++k) {
+    int j = base + k;
+    bool live = (j < tile.count);
+    dx[k] = live ? tile.x[j] - center.x() : 0.0;
+    dy[k] = live ? tile.y[j] - center.y() : 0.0;
+    dz[k] = live ? tile.z[j] - center.z() : 1.0;
+    q[k] = live ? tile.q[j] : 0.0;
+  }
+}
+
+
+/// Displacements from center of kSphLanes staged targets starting at base
+///
+/// Lanes past the end of the tile are given a unit displacement; their
+/// results are to be discarded.
+inline void nf_target_lanes(const NearFieldTargets &tile, int base,
+                            const Point &center, double *dx, double *dy,
+                            double *dz) {
+  for (int k = 0; k < kSphLanes; ++k) {
+    int i = base + k;
+    bool live = (i < tile.count);
+    dx[k] = live ? tile.x[i] - center.x() : 0.0;
+    dy[k] = live ? tile.y[i] - center.y() : 0.0;
+    dz[k] = live ? tile.z[i] - center.z() : 1.0;
+  }
+}
+
+
+/// Evaluate a near-field interaction over all pairs of two ranges
+///
+/// The targets are processed one tile at a time. For each target tile every
+/// source tile is staged and passed to \p kernel together with an accumulator
+/// array of ncomp * kNearFieldTile doubles, which starts at zero. Once all
+/// sources are done, \p store is invoked as store(target, acc, i) for each
+/// target of the tile, and should fold acc[i + c * kNearFieldTile] into the
+/// target record.
+///
+/// All staging is on the stack, so this performs no dynamic allocation.
+template <int ncomp, typename Source, typename Target,
+          typename Kernel, typename Store>
+void nf_evaluate(const Source *s_first, const Source *s_last,
+                 Target *t_first, Target *t_last,
+                 Kernel kernel, Store store) {
+  NearFieldSources sources;
+  NearFieldTargets targets;
+  alignas(64) double acc[ncomp * kNearFieldTile];
+
+  for (Target *tb = t_first; tb < t_last; tb += kNearFieldTile) {
+    nf_stage_targets(tb, t_last, targets);
+    std::fill(acc, acc + ncomp * kNearFieldTile, 0.0);
+    for (const Source *sb = s_first; sb < s_last; sb += kNearFieldTile) {
+      nf_stage_sources(sb, s_last, sources);
+      kernel(sources, targets, acc);
+    }
+    for (int i = 0; i < targets.count; ++i) {
+      store(tb[i], acc, i);
+    }
+  }
+}
+
+
+/// Evaluate an expansion at a range of targets
+///
+/// The targets are staged one tile at a time and passed to \p kernel together
+/// with an accumulator array of ncomp * kNearFieldTile doubles, which starts
+/// at zero. \p store is then invoked as for nf_evaluate().
+template <int ncomp, typename Target, typename Kernel, typename Store>
+void nf_apply_targets(Target *t_first, Target *t_last,
+                      Kernel kernel, Store store) {
+  NearFieldTargets targets;
+  alignas(64) double acc[ncomp * kNearFieldTile];
+
+  for (Target *tb = t_first; tb < t_last; tb += kNearFieldTile) {
+    nf_stage_targets(tb, t_last, targets);
+    std::fill(acc, acc + ncomp * kNearFieldTile, 0.0);
+    kernel(targets, acc);
+    for (int i = 0; i < targets.count; ++i) {
+      store(tb[i], acc, i);
+    }
+  }
+}
+
+
+} // namespace dashmm
+
+
+#endif // __DASHMM_NEAR_FIELD_H__
@@ -0,0 +1,80 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+#ifndef __DASHMM_PARTITION_DISTRO_H__
+#define __DASHMM_PARTITION_DISTRO_H__
+
+
+/// \file
+/// \brief Declaration of Graph Partitioning Distribution Policy
+
+
+#include "dashmm/dag.h"
+
+
+namespace dashmm {
+
+
+/// This distribution policy partitions the DAG as a weighted graph
+///
+/// The DAG is treated as an undirected graph. The weight of a vertex is the
+/// compute cost of the node, which is a fixed cost per node plus the weight
+/// of the edges into the node, as those operations are performed where the
+/// node is placed. The weight of a graph edge is the weight of the DAG edges
+/// between its ends. The nodes are then placed with a multilevel partitioner
+/// that minimizes the weight of the edges between localities while keeping
+/// the compute cost of each locality within a tolerance of the mean. The
+/// source and target nodes of the DAG keep the locality of their data.
+///
+/// The graph is coarsened by heavy edge matching, the coarsest graph is
+/// partitioned by greedy growing from the source and target nodes, and the
+/// partition is refined with greedy boundary moves at each level while it is
+/// projected back to the DAG.
+///
+/// Every locality discovers the full DAG and computes the same partition.
+/// Optionally, the predicted cut and compute cost of each locality are
+/// printed by locality 0.
+class PartitionDistro {
+ public:
+  /// Construct the policy
+  ///
+  /// \param imbalance - the allowed excess of the compute cost of a locality
+  ///                    over the mean, as a fraction of the mean
+  /// \param node_cost - the compute cost of a node in addition to that of
+  ///                    its incoming edges
+  /// \param bytes_per_weight - the number of bytes represented by a unit of
+  ///                           edge weight when reporting the cut; the
+  ///                           default reports the cut in units of weight
+  /// \param report - print the predicted cut and load of each locality
+  PartitionDistro(double imbalance = 0.05, int node_cost = 1,
+                  int bytes_per_weight = 1, bool report = true)
+      : imbalance_{imbalance}, node_cost_{node_cost},
+        bytes_per_weight_{bytes_per_weight}, report_{report} { }
+
+  void compute_distribution(DAG &dag);
+  static void assign_for_source(DAGInfo &dag, int locality) { }
+  static void assign_for_target(DAGInfo &dag, int locality) { }
+
+ private:
+  double imbalance_;
+  int node_cost_;
+  int bytes_per_weight_;
+  bool report_;
+};
+
+
+} // dashmm
+
+
+#endif // __DASHMM_PARTITION_DISTRO_H__
@@ -0,0 +1,100 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+#ifndef __DASHMM_PLACEMENT_H__
+#define __DASHMM_PLACEMENT_H__
+
+
+/// \file
+/// \brief Placement of DAG nodes with the bulk of their outgoing work
+
+
+#include <vector>
+
+#include <hpx/hpx.h>
+
+#include "dashmm/dag.h"
+
+
+namespace dashmm {
+
+
+/// The action placing a contiguous range of DAG nodes
+extern hpx_action_t place_node_range_action;
+
+
+/// Accumulated edge weight per locality
+///
+/// This is a sparse bin: only the localities that have received a weight
+/// since the last call to best() are visited when finding the maximum and
+/// when clearing the bins. A single object can thus be reused for every node
+/// placed by one thread, at a cost proportional to the out edges of the node
+/// rather than to the number of ranks.
+class LocalityBins {
+ public:
+  /// Construct bins for n_ranks localities
+  explicit LocalityBins(int n_ranks) : weight_(n_ranks, -1) { }
+
+  /// Add weight to the given locality
+  void add(int loc, long weight) {
+    if (weight_[loc] < 0) {
+      weight_[loc] = 0;
+      touched_.push_back(loc);
+    }
+    weight_[loc] += weight;
+  }
+
+  /// The weight accumulated for the given locality
+  long weight(int loc) const {return weight_[loc] < 0 ? 0 : weight_[loc];}
+
+  /// The localities that received weight, in the order they first did
+  const std::vector<int> &touched() const {return touched_;}
+
+  /// Clear the bins
+  void clear() {
+    for (size_t i = 0; i < touched_.size(); ++i) {
+      weight_[touched_[i]] = -1;
+    }
+    touched_.clear();
+  }
+
+  /// The locality with the most weight; this also clears the bins
+  ///
+  /// In a tie the lowest locality wins. If no locality received any weight,
+  /// locality 0 is returned.
+  int best();
+
+ private:
+  std::vector<long> weight_;
+  std::vector<int> touched_;
+};
+
+
+/// Place each unplaced node on the locality receiving most of its out edges
+///
+/// Upon entry, the nodes must be sorted from highest to lowest color, and the
+/// targets of the out edges of a node must either have a higher color, or
+/// appear in a vector already placed. Nodes of equal color must not have edges
+/// between them. Each run of nodes with the same color is then placed in
+/// parallel over the worker threads of this locality.
+///
+/// \param nodes - the nodes to place
+/// \param interm_only - only place the nodes for intermediate expansions
+void place_by_out_edges(std::vector<DAGNode *> &nodes, bool interm_only);
+
+
+} // dashmm
+
+
+#endif // __DASHMM_PLACEMENT_H__
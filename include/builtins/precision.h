@@ -0,0 +1,144 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+#ifndef __DASHMM_PRECISION_H__
+#define __DASHMM_PRECISION_H__
+
+
+/// \file
+/// \brief Coefficient storage policies for the builtin expansions
+
+
+#include <complex>
+
+#include "builtins/scratch.h"
+#include "dashmm/types.h"
+#include "dashmm/viewpool.h"
+#include "dashmm/viewset.h"
+
+
+namespace dashmm {
+
+
+/// Single precision complex coefficient
+using fcomplex_t = std::complex<float>;
+
+
+/// Expansion coefficients are stored in double precision
+///
+/// This is the default policy of the builtin expansions. The operators work
+/// directly on the stored views, and all of the conversions below are
+/// pass-through.
+struct DoublePrecision {
+  using coefficient_t = dcomplex_t;
+
+  /// The n coefficients at data as double precision values
+  static const dcomplex_t *load(const char *data, size_t n,
+                                BuiltinScratch &scratch) {
+    return reinterpret_cast<const dcomplex_t *>(data);
+  }
+
+  /// Space for the n double precision results destined for data
+  ///
+  /// The returned space initially holds the contents of data, which for a
+  /// newly created view is zero.
+  static dcomplex_t *output(char *data, size_t n, BuiltinScratch &scratch) {
+    return reinterpret_cast<dcomplex_t *>(data);
+  }
+
+  /// Write back results obtained from output()
+  static void store(const dcomplex_t *values, size_t n, char *data) { }
+
+  /// A view set presenting the views of \p views in double precision
+  static ViewSet widen(const ViewSet &views, BuiltinScratch &scratch) {
+    return views;
+  }
+
+  /// Write back the views of a set obtained from widen()
+  static void narrow(const ViewSet &wide, ViewSet &views) { }
+
+  /// Convert heap allocated double precision views to storage precision
+  static void narrow_owned(ViewSet &views) { }
+};
+
+
+/// Expansion coefficients are stored in single precision
+///
+/// Operators widen their inputs into double precision scratch space, compute
+/// in double precision, and round the results once when storing them. This
+/// halves the memory footprint of the expansions and the size of the parcels
+/// that carry them between localities. The stored coefficients retain about
+/// seven significant digits, which is sufficient for 3 and 6 digit requests.
+struct MixedPrecision {
+  using coefficient_t = fcomplex_t;
+
+  static const dcomplex_t *load(const char *data, size_t n,
+                                BuiltinScratch &scratch) {
+    const fcomplex_t *in = reinterpret_cast<const fcomplex_t *>(data);
+    dcomplex_t *retval = scratch.complexes(n);
+    for (size_t i = 0; i < n; ++i) {
+      retval[i] = dcomplex_t{in[i].real(), in[i].imag()};
+    }
+    return retval;
+  }
+
+  static dcomplex_t *output(char *data, size_t n, BuiltinScratch &scratch) {
+    return const_cast<dcomplex_t *>(load(data, n, scratch));
+  }
+
+  static void store(const dcomplex_t *values, size_t n, char *data) {
+    fcomplex_t *out = reinterpret_cast<fcomplex_t *>(data);
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = fcomplex_t{static_cast<float>(values[i].real()),
+                          static_cast<float>(values[i].imag())};
+    }
+  }
+
+  static ViewSet widen(const ViewSet &views, BuiltinScratch &scratch) {
+    ViewSet retval{views.role(), views.center(), views.scale()};
+    for (int i = 0; i < views.count(); ++i) {
+      size_t n = views.view_bytes(i) / sizeof(fcomplex_t);
+      const dcomplex_t *data = load(views.view_data(i), n, scratch);
+      retval.add_view(views.view_index(i), n * sizeof(dcomplex_t),
+                      reinterpret_cast<char *>(const_cast<dcomplex_t *>(data)));
+    }
+    return retval;
+  }
+
+  static void narrow(const ViewSet &wide, ViewSet &views) {
+    for (int i = 0; i < views.count(); ++i) {
+      size_t n = views.view_bytes(i) / sizeof(fcomplex_t);
+      store(reinterpret_cast<const dcomplex_t *>(wide.view_data(i)), n,
+            views.view_data(i));
+    }
+  }
+
+  static void narrow_owned(ViewSet &views) {
+    for (int i = 0; i < views.count(); ++i) {
+      size_t n = views.view_bytes(i) / sizeof(dcomplex_t);
+      dcomplex_t *wide = reinterpret_cast<dcomplex_t *>(views.view_data(i));
+      char *data = ViewPool::allocate(n * sizeof(fcomplex_t));
+      store(wide, n, data);
+      ViewPool::deallocate(reinterpret_cast<char *>(wide));
+      views.set_bytes(i, n * sizeof(fcomplex_t));
+      views.set_data(i, data);
+    }
+  }
+};
+
+
+} // namespace dashmm
+
+
+#endif // __DASHMM_PRECISION_H__
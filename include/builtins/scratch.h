@@ -0,0 +1,71 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+#ifndef __DASHMM_SCRATCH_H__
+#define __DASHMM_SCRATCH_H__
+
+
+/// \file
+/// \brief Per-worker scratch space for the builtin expansion operators
+
+
+#include <cstddef>
+
+#include "dashmm/types.h"
+
+
+namespace dashmm {
+
+
+/// A frame of per-worker scratch space
+///
+/// Each worker thread owns a stack of scratch memory. Constructing a
+/// BuiltinScratch marks the current top of that stack, the allocation methods
+/// carve space off the top, and destruction releases everything allocated
+/// through this frame. Frames nest, so an operator holding scratch may call
+/// another that also uses scratch.
+///
+/// The memory is owned by the worker thread, so a frame must not be held
+/// across any operation that might suspend the current HPX thread, and must
+/// not be passed to another thread. The builtin operators are pure
+/// computation and satisfy this.
+///
+/// Space is never returned to the system; after the first few operators on a
+/// given worker, no further allocation is performed.
+class BuiltinScratch {
+ public:
+  BuiltinScratch();
+  ~BuiltinScratch();
+
+  BuiltinScratch(const BuiltinScratch &) = delete;
+  BuiltinScratch &operator=(const BuiltinScratch &) = delete;
+
+  /// Space for count doubles, aligned to 64 bytes. Contents are undefined.
+  double *doubles(size_t count);
+
+  /// Space for count complex values, aligned to 64 bytes.
+  dcomplex_t *complexes(size_t count) {
+    return reinterpret_cast<dcomplex_t *>(doubles(2 * count));
+  }
+
+ private:
+  size_t block_;
+  size_t offset_;
+};
+
+
+} // namespace dashmm
+
+
+#endif // __DASHMM_SCRATCH_H__
@@ -56,6 +56,49 @@ inline double pow_m1(const int m) {
 /// Compute Legendre polynomial P_n^m(x), where |x| <= 1, 0 <= m <= n
 void legendre_Plm(int n, double x, double *P);
 
+/// Number of points processed together by the lane-batched routines
+constexpr int kSphLanes = 8;
+
+/// Compute the spherical coordinates of kSphLanes displacements (dx, dy, dz)
+///
+/// On return r[k] is the length of displacement k, P[midx(l, m) * kSphLanes +
+/// k] is P_l^m(cos theta_k) for 0 <= m <= l <= n, and (ephi_re, ephi_im)[m *
+/// kSphLanes + k] is exp(i * sign * m * phi_k) for 0 <= m <= n. P must have
+/// room for (n + 1) * (n + 2) / 2 * kSphLanes values, and each of ephi_re and
+/// ephi_im for (n + 1) * kSphLanes values. Points on the z axis are given
+/// phi = 0, and the origin is given theta = 0 as well.
+void sph_coords_lanes(int n, const double *dx, const double *dy,
+                      const double *dz, double sign, double *r, double *P,
+                      double *ephi_re, double *ephi_im);
+
+/// Accumulate a lane-batched set of sources into a spherical expansion
+///
+/// For 0 <= m <= n <= p, E[midx(n, m)] is incremented by coef(n, m) times the
+/// sum over lanes k of rad[n * kSphLanes + k] * P_n^m(k) * ephi_m(k), with P
+/// and ephi laid out as produced by sph_coords_lanes.
+template <typename Coef>
+void sph_accumulate_lanes(int p, const double *rad, const double *P,
+                          const double *ephi_re, const double *ephi_im,
+                          Coef coef, dcomplex_t *E) {
+  constexpr int L = kSphLanes;
+  for (int n = 0; n <= p; ++n) {
+    const double *rn = &rad[n * L];
+    for (int m = 0; m <= n; ++m) {
+      const double *pnm = &P[midx(n, m) * L];
+      const double *er = &ephi_re[m * L];
+      const double *ei = &ephi_im[m * L];
+      double re = 0.0;
+      double im = 0.0;
+      for (int k = 0; k < L; ++k) {
+        double w = rn[k] * pnm[k];
+        re += w * er[k];
+        im += w * ei[k];
+      }
+      E[midx(n, m)] += coef(n, m) * dcomplex_t{re, im};
+    }
+  }
+}
+
 /// Compute scaled Legendre polynomial scale^n P_n^m(x) where |x| > 1
 void legendre_Plm_gt1_scaled(int nb, double x, double scale, double *P);
 
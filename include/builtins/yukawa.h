@@ -17,7 +17,7 @@
 
 
 /// \file
-/// \brief Declaration of Yukawa
+/// \brief Declaration of YukawaExpansion
 
 
 #include <cassert>
@@ -30,8 +30,12 @@
 #include "dashmm/index.h"
 #include "builtins/yukawa_table.h"
 #include "builtins/merge_shift.h"
+#include "builtins/nearfield.h"
+#include "builtins/precision.h"
+#include "builtins/scratch.h"
 #include "dashmm/point.h"
 #include "dashmm/types.h"
+#include "dashmm/viewpool.h"
 #include "dashmm/viewset.h"
 
 
@@ -55,6 +59,10 @@ void yuk_rotate_sph_y(const dcomplex_t *M, const double *d, dcomplex_t *MR);
 
 void yuk_s_to_m(Point dist, double q, double scale, dcomplex_t *M);
 void yuk_s_to_l(Point dist, double q, double scale, dcomplex_t *L);
+void yuk_s_to_m(const NearFieldSources &sources, const Point &center,
+                double scale, dcomplex_t *M);
+void yuk_s_to_l(const NearFieldSources &sources, const Point &center,
+                double scale, dcomplex_t *L);
 void yuk_m_to_m(int from_child, const dcomplex_t *M, double scale,
                 dcomplex_t *W);
 void yuk_l_to_l(int to_child, const dcomplex_t *L, double scale,
@@ -74,56 +82,80 @@ std::vector<double> yuk_m_to_t(Point dist, double scale,
 std::vector<double> yuk_l_to_t(Point dist, double scale,
                                const dcomplex_t *L, bool g = false);
 
+/// Evaluate a multipole expansion at a tile of targets
+///
+/// The potential at target i is added to phi[i]. If field is not null, the
+/// three components of the field are added to field[i], field[i +
+/// kNearFieldTile] and field[i + 2 * kNearFieldTile].
+void yuk_m_to_t(const NearFieldTargets &targets, const Point &center,
+                double scale, const dcomplex_t *M, double *phi,
+                double *field = nullptr);
+
+/// Evaluate a local expansion at a tile of targets
+///
+/// The outputs are as for the batched yuk_m_to_t.
+void yuk_l_to_t(const NearFieldTargets &targets, const Point &center,
+                double scale, const dcomplex_t *L, double *phi,
+                double *field = nullptr);
+
 /// This class is a template with parameters for the source and target
-/// types.
+/// types, and for the precision in which the coefficients are stored.
 ///
 /// Source must define a double valued 'charge' member to be used with
 /// Yukawa. Target must define a std::complex<double> valued 'phi' member
 /// to be used with Yukawa.
-template <typename Source, typename Target>
-class Yukawa {
+///
+/// Precision is one of DoublePrecision or MixedPrecision. Users will
+/// typically refer to this class through the Yukawa and YukawaMixed aliases
+/// below.
+template <typename Source, typename Target, typename Precision>
+class YukawaExpansion {
 public:
   using source_t = Source;
   using target_t = Target;
-  using expansion_t = Yukawa<Source, Target>;
+  using expansion_t = YukawaExpansion<Source, Target, Precision>;
+  using coefficient_t = typename Precision::coefficient_t;
 
-  Yukawa(ExpansionRole role, double scale = 1.0, Point center = Point{})
+  YukawaExpansion(ExpansionRole role, double scale = 1.0,
+                  Point center = Point{})
     : views_{ViewSet{role, center, scale}} {
     // View size for each spherical harmonic expansion
     int p = builtin_yukawa_table_->p();
     int nsh = (p + 1) * (p + 2) / 2;
 
     if (role == kSourcePrimary || role == kTargetPrimary) {
-      size_t bytes = sizeof(dcomplex_t) * nsh;
-      char *data = new char[bytes]();
+      size_t bytes = sizeof(coefficient_t) * nsh;
+      char *data = ViewPool::allocate(bytes);
       views_.add_view(0, bytes, data);
     } else {
       // View size for each exponential expansion at the current scale level
       int nexp = builtin_yukawa_table_->nexp(scale);
 
       if (role == kSourceIntermediate) {
-        size_t bytes = sizeof(dcomplex_t) * nexp;
+        size_t bytes = sizeof(coefficient_t) * nexp;
+        views_.reserve(6);
         for (int i = 0; i < 6; ++i) {
-          char *data = new char[bytes]();
+          char *data = ViewPool::allocate(bytes);
           views_.add_view(i, bytes, data);
         }
       } else { // role == kTargetIntermediate
-        size_t bytes = sizeof(dcomplex_t) * nexp;
+        size_t bytes = sizeof(coefficient_t) * nexp;
+        views_.reserve(28);
         for (int i = 0; i < 28; ++i) {
-          char *data = new char[bytes]();
+          char *data = ViewPool::allocate(bytes);
           views_.add_view(i, bytes, data);
         }
       }
     }
   }
 
-  Yukawa(const ViewSet &views) : views_{views} { }
+  YukawaExpansion(const ViewSet &views) : views_{views} { }
 
-  ~Yukawa() {
+  ~YukawaExpansion() {
     int count = views_.count();
     if (count) {
       for (int i = 0; i < count; ++i) {
-        delete [] views_.view_data(i);
+        ViewPool::deallocate(views_.view_data(i));
       }
     }
   }
@@ -155,12 +187,13 @@ public:
   Point center() const {return views_.center();}
 
   size_t view_size(int view) const {
-    return views_.view_bytes(view) / sizeof(dcomplex_t);
+    return views_.view_bytes(view) / sizeof(coefficient_t);
   }
 
   dcomplex_t view_term(int view, size_t i) const {
-    dcomplex_t *data = reinterpret_cast<dcomplex_t *>(views_.view_data(view));
-    return data[i];
+    coefficient_t *data =
+      reinterpret_cast<coefficient_t *>(views_.view_data(view));
+    return dcomplex_t{data[i]};
   }
 
   std::unique_ptr<expansion_t> S_to_M(const Source *first,
@@ -168,11 +201,16 @@ public:
     double scale = views_.scale();
     Point center = views_.center();
     expansion_t *retval{new expansion_t{kSourcePrimary, scale, center}};
-    dcomplex_t *M = reinterpret_cast<dcomplex_t *>(retval->views_.view_data(0));
-    for (auto i = first; i != last; ++i) {
-      Point dist = point_sub(i->position, center);
-      yuk_s_to_m(dist, i->charge, scale, M);
+    BuiltinScratch scratch;
+    size_t n = retval->view_size(0);
+    char *data = retval->views_.view_data(0);
+    dcomplex_t *M = Precision::output(data, n, scratch);
+    NearFieldSources tile;
+    for (auto i = first; i < last; i += kNearFieldTile) {
+      nf_stage_sources(i, last, tile);
+      yuk_s_to_m(tile, center, scale, M);
     }
+    Precision::store(M, n, data);
     return std::unique_ptr<expansion_t>{retval};
   }
 
@@ -181,20 +219,29 @@ public:
     double scale = views_.scale();
     Point center = views_.center();
     expansion_t *retval{new expansion_t{kTargetPrimary}};
-    dcomplex_t *L = reinterpret_cast<dcomplex_t *>(retval->views_.view_data(0));
-    for (auto i = first; i != last; ++i) {
-      Point dist = point_sub(i->position, center);
-      lap_s_to_l(dist, i->charge, scale, L);
+    BuiltinScratch scratch;
+    size_t n = retval->view_size(0);
+    char *data = retval->views_.view_data(0);
+    dcomplex_t *L = Precision::output(data, n, scratch);
+    NearFieldSources tile;
+    for (auto i = first; i < last; i += kNearFieldTile) {
+      nf_stage_sources(i, last, tile);
+      yuk_s_to_l(tile, center, scale, L);
     }
+    Precision::store(L, n, data);
     return std::unique_ptr<expansion_t>{retval};
   }
 
   std::unique_ptr<expansion_t> M_to_M(int from_child) const {
     expansion_t *retval{new expansion_t{kSourcePrimary}};
     double scale = views_.scale();
-    dcomplex_t *M = reinterpret_cast<dcomplex_t *>(views_.view_data(0));
-    dcomplex_t *W = reinterpret_cast<dcomplex_t *>(retval->views_.view_data(0));
+    BuiltinScratch scratch;
+    size_t n = view_size(0);
+    char *data = retval->views_.view_data(0);
+    const dcomplex_t *M = Precision::load(views_.view_data(0), n, scratch);
+    dcomplex_t *W = Precision::output(data, n, scratch);
     yuk_m_to_m(from_child, M, scale, W);
+    Precision::store(W, n, data);
     return std::unique_ptr<expansion_t>{retval};
   }
 
@@ -205,32 +252,46 @@ public:
   std::unique_ptr<expansion_t> L_to_L(int to_child) const {
     expansion_t *retval{new expansion_t{kTargetPrimary}};
     double scale = views_.scale();
-    dcomplex_t *L = reinterpret_cast<dcomplex_t *>(views_.view_data(0));
-    dcomplex_t *W = reinterpret_cast<dcomplex_t *>(retval->views_.view_data(0));
+    BuiltinScratch scratch;
+    size_t n = view_size(0);
+    char *data = retval->views_.view_data(0);
+    const dcomplex_t *L = Precision::load(views_.view_data(0), n, scratch);
+    dcomplex_t *W = Precision::output(data, n, scratch);
     yuk_l_to_l(to_child, L, scale, W);
+    Precision::store(W, n, data);
     return std::unique_ptr<expansion_t>{retval};
   }
 
   void M_to_T(Target *first, Target *last) const {
     double scale = views_.scale();
-    dcomplex_t *M = reinterpret_cast<dcomplex_t *>(views_.view_data(0));
-
-    for (auto i = first; i != last; ++i) {
-      Point dist = point_sub(i->position, views_.center());
-      auto result = yuk_m_to_t(dist, scale, M);
-      i->phi += result[0];
-    }
+    Point center = views_.center();
+    BuiltinScratch scratch;
+    const dcomplex_t *M =
+      Precision::load(views_.view_data(0), view_size(0), scratch);
+
+    nf_apply_targets<1>(first, last,
+                        [&](const NearFieldTargets &t, double *phi) {
+                          yuk_m_to_t(t, center, scale, M, phi);
+                        },
+                        [](Target &targ, const double *phi, int i) {
+                          targ.phi += dcomplex_t{phi[i]};
+                        });
   }
 
   void L_to_T(Target *first, Target *last) const {
     double scale = views_.scale();
-    dcomplex_t *L = reinterpret_cast<dcomplex_t *>(views_.view_data(0));
-
-    for (auto i = first; i != last; ++i) {
-      Point dist = point_sub(i->position, views_.center());
-      auto result = yuk_l_to_t(dist, scale, L);
-      i->phi += result[0];
-    }
+    Point center = views_.center();
+    BuiltinScratch scratch;
+    const dcomplex_t *L =
+      Precision::load(views_.view_data(0), view_size(0), scratch);
+
+    nf_apply_targets<1>(first, last,
+                        [&](const NearFieldTargets &t, double *phi) {
+                          yuk_l_to_t(t, center, scale, L, phi);
+                        },
+                        [](Target &targ, const double *phi, int i) {
+                          targ.phi += dcomplex_t{phi[i]};
+                        });
   }
 
   void S_to_T(const Source *s_first,
@@ -238,31 +299,37 @@ public:
               Target *t_first,
               Target *t_last) const {
     double lambda = builtin_yukawa_table_->lambda();
-    for (auto i = t_first; i != t_last; ++i) {
-      dcomplex_t potential{0.0, 0.0};
-      for (auto j = s_first; j != s_last; ++j) {
-        Point s2t = point_sub(i->position, j->position);
-        double dist = lambda * s2t.norm();
-        if (dist > 0) {
-          potential += j->charge * exp(-dist) / dist;
-        }
-      }
-      i->phi += potential * M_PI_2;
-    }
+    nf_evaluate<1>(s_first, s_last, t_first, t_last,
+                   [lambda](const NearFieldSources &s,
+                            const NearFieldTargets &t, double *phi) {
+                     nf_yuk_potential(s, t, lambda, phi);
+                   },
+                   [](Target &targ, const double *phi, int i) {
+                     targ.phi += dcomplex_t{phi[i] * M_PI_2};
+                   });
   }
 
   std::unique_ptr<expansion_t> M_to_I() const {
     double scale = views_.scale();
     expansion_t *retval{new expansion_t{kSourceIntermediate, scale}};
-    dcomplex_t *M = reinterpret_cast<dcomplex_t *>(views_.view_data(0));
-    yuk_m_to_i(M, retval->views_, scale, 0);
+    BuiltinScratch scratch;
+    const dcomplex_t *M =
+      Precision::load(views_.view_data(0), view_size(0), scratch);
+    ViewSet wide = Precision::widen(retval->views_, scratch);
+    yuk_m_to_i(M, wide, scale, 0);
+    Precision::narrow(wide, retval->views_);
     return std::unique_ptr<expansion_t>(retval);
   }
 
   std::unique_ptr<expansion_t> I_to_I(Index s_index, Index t_index) const {
     ViewSet views{kTargetIntermediate};
     double scale = views_.scale();
-    yuk_i_to_i(s_index, t_index, views_, 0, 0, scale, views);
+    {
+      BuiltinScratch scratch;
+      ViewSet wide = Precision::widen(views_, scratch);
+      yuk_i_to_i(s_index, t_index, wide, 0, 0, scale, views);
+    }
+    Precision::narrow_owned(views);
     expansion_t *retval = new expansion_t{views};
     return std::unique_ptr<expansion_t>{retval};
   }
@@ -270,9 +337,14 @@ public:
   std::unique_ptr<expansion_t> I_to_L(Index t_index) const {
     // t_index is the index of the child
     expansion_t *retval{new expansion_t{kTargetPrimary}};
-    dcomplex_t *L = reinterpret_cast<dcomplex_t *>(retval->views_.view_data(0));
+    BuiltinScratch scratch;
+    size_t n = retval->view_size(0);
+    char *data = retval->views_.view_data(0);
+    ViewSet wide = Precision::widen(views_, scratch);
+    dcomplex_t *L = Precision::output(data, n, scratch);
     double scale = views_.scale() / 2.0;
-    yuk_i_to_l(views_, 0, t_index, scale, L);
+    yuk_i_to_l(wide, 0, t_index, scale, L);
+    Precision::store(L, n, data);
     return std::unique_ptr<expansion_t>(retval);
   }
 
@@ -282,10 +354,11 @@ public:
     int count = temp1->views_.count();
     for (int i = 0; i < count; ++i) {
       int idx = temp1->views_.view_index(i);
-      int size = temp1->views_.view_bytes(i) / sizeof(dcomplex_t);
-      dcomplex_t *lhs = reinterpret_cast<dcomplex_t *>(views_.view_data(idx));
-      dcomplex_t *rhs =
-        reinterpret_cast<dcomplex_t *>(temp1->views_.view_data(i));
+      int size = temp1->views_.view_bytes(i) / sizeof(coefficient_t);
+      coefficient_t *lhs =
+        reinterpret_cast<coefficient_t *>(views_.view_data(idx));
+      coefficient_t *rhs =
+        reinterpret_cast<coefficient_t *>(temp1->views_.view_data(i));
 
       for (int j = 0; j < size; ++j) {
         lhs[j] += rhs[j];
@@ -293,9 +366,32 @@ public:
     }
   }
 
+  static void clear_targets(Target *first, Target *last) {
+    for (auto i = first; i != last; ++i) {
+      i->phi = dcomplex_t{};
+    }
+  }
+
+  static void add_targets(const Target *first, const Target *last,
+                          Target *dest) {
+    for (auto i = first; i != last; ++i, ++dest) {
+      dest->phi += i->phi;
+    }
+  }
+
   static void update_table(int n_digits, double domain_size,
                            const std::vector<double> &kernel_params) {
     update_yukawa_table(n_digits, domain_size, kernel_params[0]);
+
+    // The sizes of the views, and of the wide views formed by I->I, which
+    // for the exponential expansions depend on the level
+    int p = builtin_yukawa_table_->p();
+    ViewPool::add_size(sizeof(coefficient_t) * (p + 1) * (p + 2) / 2);
+    for (int lev = 0; lev <= YukawaTable::maxlev; ++lev) {
+      int nexp = builtin_yukawa_table_->nexp(builtin_yukawa_table_->scale(lev));
+      ViewPool::add_size(sizeof(coefficient_t) * nexp);
+      ViewPool::add_size(sizeof(dcomplex_t) * nexp);
+    }
   }
 
   static void delete_table() { }
@@ -332,6 +428,17 @@ private:
 };
 
 
+/// Yukawa expansion with coefficients stored in double precision
+template <typename Source, typename Target>
+using Yukawa = YukawaExpansion<Source, Target, DoublePrecision>;
+
+/// Yukawa expansion with coefficients stored in single precision
+///
+/// The operators still compute in double precision; see MixedPrecision.
+template <typename Source, typename Target>
+using YukawaMixed = YukawaExpansion<Source, Target, MixedPrecision>;
+
+
 } // namespace dashmm
 
 #endif // __DASHMM_YUKAWA_EXPANSION_H__
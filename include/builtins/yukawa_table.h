@@ -22,7 +22,6 @@
 
 #include <cmath>
 #include <complex>
-#include <map>
 #include <memory>
 #include <vector>
 #include "dashmm/types.h"
@@ -43,8 +42,12 @@ class YukawaTable {
   double scale(int lev) const {return scale_ / pow(2, lev);}
   double lambda() const {return lambda_;}
   const double *sqf() const {return sqf_;}
-  const double *dmat_plus(double v) const {return dmat_plus_->at(v);}
-  const double *dmat_minus(double v) const {return dmat_minus_->at(v);}
+  const double *dmat_plus(DMatSlot slot) const {
+    return &dmat_plus_[slot * dmat_size_];
+  }
+  const double *dmat_minus(DMatSlot slot) const {
+    return &dmat_minus_[slot * dmat_size_];
+  }
   const double *m2m(double scale) const {
     return &m2m_[(p_ + 1) * (p_ + 1) * (p_ + 2) / 2 * level(scale)];
   }
@@ -78,8 +81,9 @@ private:
   double size_;
   double scale_; // scaling factor of level 0 to avoid under-/over-flow
   double *sqf_;
-  builtin_map_t *dmat_plus_;
-  builtin_map_t *dmat_minus_;
+  int dmat_size_;      // number of entries of a single d-matrix
+  double *dmat_plus_;  // d-matrices indexed by DMatSlot
+  double *dmat_minus_;
   double *m2m_;
   double *l2l_;
   double *x_;
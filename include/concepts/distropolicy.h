@@ -30,6 +30,20 @@ public:
   /// arguments having a default value.
   DistroPolicy();
 
+  /// Does the policy work on a partial DAG
+  ///
+  /// This member is optional; a policy that does not declare it works on the
+  /// full DAG.
+  ///
+  /// If true, each locality discovers only the part of the DAG it owns, plus
+  /// the halo of nodes owned by other localities that its nodes send to.
+  /// Every node is placed on the locality owning the associated tree node
+  /// before compute_distribution() is called, which is then left to order
+  /// the nodes. The nodes above the uniform level of the tree are owned by
+  /// locality 0. If false, each locality discovers the full DAG, and the
+  /// policy is free to place any node that does not yet have a locality.
+  static constexpr bool kPartialDAG = false;
+
   /// Computes the distribution of the work represented by the given nodes.
   ///
   /// The only required element of a distribution policy is this one.
@@ -275,6 +275,31 @@ class Expansion {
   /// Add an expansion to this expansion
   void add_expansion(const expansion_t *temp);
 
+  /// Clear the results of a set of targets
+  ///
+  /// This sets to zero the members of the targets that M_to_T, L_to_T and
+  /// S_to_T add to, and leaves the other members alone. Together with
+  /// add_targets(), this allows the contributions to a set of targets to be
+  /// computed into a private copy of the targets.
+  ///
+  /// This member, and add_targets(), are optional. They are only required
+  /// to select TargetAccumulation::Concurrent.
+  ///
+  /// \param first - the first target point
+  /// \param last - one past the last target point
+  static void clear_targets(target_t *first, target_t *last);
+
+  /// Add the results of one set of targets to another
+  ///
+  /// The members that clear_targets() sets to zero are added from each
+  /// target in [first, last) to the corresponding target of @p dest.
+  ///
+  /// \param first - the first target point to add
+  /// \param last - one past the last target point to add
+  /// \param dest - the first target point added to
+  static void add_targets(const target_t *first, const target_t *last,
+                          target_t *dest);
+
 
   /// Update a kernel table
   ///
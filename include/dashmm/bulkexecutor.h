@@ -0,0 +1,384 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+#ifndef __DASHMM_BULK_EXECUTOR_H__
+#define __DASHMM_BULK_EXECUTOR_H__
+
+
+/// \file
+/// \brief Level-synchronous execution of the DAG
+
+
+#include <cassert>
+#include <cstdint>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <hpx/hpx.h>
+
+#include "dashmm/costmodel.h"
+#include "dashmm/dag.h"
+#include "dashmm/domaingeometry.h"
+#include "dashmm/index.h"
+#include "dashmm/node.h"
+#include "dashmm/point.h"
+#include "dashmm/types.h"
+#include "dashmm/viewset.h"
+
+
+namespace dashmm {
+
+
+/// Forward declaration of registrar so that we can become friends
+template <typename Source, typename Target,
+          template <typename, typename> class Expansion,
+          template <typename, typename,
+                    template <typename, typename> class> class Method>
+class BulkExecutorRegistrar;
+
+
+/// Level-synchronous execution of the DAG
+///
+/// This is the alternative to the dataflow execution of the DAG by the
+/// Expansion and Target LCOs, selected with Executor::Bulk. The nodes of the
+/// DAG are grouped into stages by the number of edges on the longest path
+/// reaching them from the sources, so that each stage depends only on the
+/// stages before it. For the usual methods, the stages are the levels of the
+/// upward pass, then the intermediate expansions, then the levels of the
+/// downward pass, with the targets last. Each stage is computed by a parallel
+/// loop over its nodes, and the next stage starts once the loop is complete.
+///
+/// Each node pulls its inputs along its in edges. So no two threads write to
+/// the same expansion or the same targets, and no lock is needed. The
+/// expansion of a node is deleted once every node using it is computed.
+///
+/// The DAG of a rank holds the full computation only when there is a single
+/// rank, and so this executor can only be used then. The LCOs of the DAG are
+/// not used, and are left as they are.
+template <typename Source, typename Target,
+          template <typename, typename> class Expansion,
+          template <typename, typename,
+                    template <typename, typename> class> class Method>
+class BulkExecutor {
+ public:
+  using source_t = Source;
+  using target_t = Target;
+  using expansion_t = Expansion<Source, Target>;
+  using sourcenode_t = Node<Source>;
+  using targetnode_t = Node<Target>;
+
+  /// Execute the DAG
+  ///
+  /// This is a synchronous operation, to be called from an HPX thread when
+  /// there is a single rank. The results are added to the target records.
+  ///
+  /// \param domain - the domain geometry of the tree of the DAG
+  /// \param dag - the DAG to execute
+  static void execute(const DomainGeometry &domain, DAG *dag) {
+    assert(hpx_get_num_ranks() == 1);
+    Plan plan{domain, dag};
+    Plan *planaddx = &plan;
+
+    // A few chunks per worker even out the varying cost of the nodes
+    size_t n_chunks = 4 * hpx_get_num_threads();
+    for (size_t s = 0; s < plan.stages.size(); ++s) {
+      std::vector<DAGNode *> &stage = plan.stages[s];
+      size_t count = stage.size();
+      if (count == 0) {
+        continue;
+      }
+      size_t delta = std::max(count / n_chunks, size_t{1});
+      size_t n_calls = (count + delta - 1) / delta;
+
+      hpx_addr_t done = hpx_lco_and_new(n_calls);
+      assert(done != HPX_NULL);
+      for (size_t start = 0; start < count; start += delta) {
+        size_t end = std::min(start + delta, count);
+        DAGNode **first = &stage[start];
+        DAGNode **last = &stage[end];
+        hpx_call(HPX_HERE, stage_chunk_, done, &planaddx, &first, &last);
+      }
+      hpx_lco_wait(done);
+      hpx_lco_delete_sync(done);
+    }
+  }
+
+ private:
+  friend class BulkExecutorRegistrar<Source, Target, Expansion, Method>;
+
+  /// An edge into a node of the DAG
+  struct InEdge {
+    uint32_t source;        /// the id of the node at the other end
+    Operation op;
+  };
+
+  /// The schedule and the working data of one execution
+  struct Plan {
+    Plan(const DomainGeometry &geometry, DAG *dag)
+        : domain{&geometry}, nodes(dag->node_count(), nullptr),
+          roles(dag->node_count(), kNoRoleNeeded),
+          in_offsets(dag->node_count() + 1, 0), in_edges{},
+          users{new std::atomic<int>[dag->node_count()]},
+          expansions(dag->node_count(), nullptr), stages{} {
+      size_t n_nodes = nodes.size();
+      collect(dag->source_leaves, kNoRoleNeeded, kNoRoleNeeded);
+      collect(dag->source_nodes, kSourcePrimary, kSourceIntermediate);
+      collect(dag->target_nodes, kTargetPrimary, kTargetIntermediate);
+      collect(dag->target_leaves, kNoRoleNeeded, kNoRoleNeeded);
+
+      // Gather the in edges of each node
+      for (size_t i = 0; i < n_nodes; ++i) {
+        DAGNode *node = nodes[i];
+        users[i] = node->out_count();
+        for (size_t j = 0; j < node->out_count(); ++j) {
+          ++in_offsets[node->out_edge(j).target() + 1];
+        }
+      }
+      for (size_t i = 0; i < n_nodes; ++i) {
+        in_offsets[i + 1] += in_offsets[i];
+      }
+      in_edges.resize(in_offsets[n_nodes]);
+      std::vector<uint32_t> fill(in_offsets.begin(), in_offsets.end() - 1);
+      for (size_t i = 0; i < n_nodes; ++i) {
+        DAGNode *node = nodes[i];
+        for (size_t j = 0; j < node->out_count(); ++j) {
+          const DAGEdge &edge = node->out_edge(j);
+          in_edges[fill[edge.target()]++] = InEdge{static_cast<uint32_t>(i),
+                                                   edge.op()};
+        }
+      }
+
+      // Visit the nodes in topological order to find their stage
+      std::vector<int> stage(n_nodes, 0);
+      std::vector<uint32_t> pending(n_nodes);
+      std::vector<uint32_t> ready{};
+      for (size_t i = 0; i < n_nodes; ++i) {
+        pending[i] = in_offsets[i + 1] - in_offsets[i];
+        if (pending[i] == 0) {
+          ready.push_back(i);
+        }
+      }
+      while (!ready.empty()) {
+        uint32_t i = ready.back();
+        ready.pop_back();
+        DAGNode *node = nodes[i];
+        for (size_t j = 0; j < node->out_count(); ++j) {
+          uint32_t t = node->out_edge(j).target();
+          stage[t] = std::max(stage[t], stage[i] + 1);
+          if (--pending[t] == 0) {
+            ready.push_back(t);
+          }
+        }
+      }
+
+      // The source leaves, and any target leaves without inputs, have nothing
+      // to compute
+      for (size_t i = 0; i < n_nodes; ++i) {
+        if (nodes[i]->is_parts() && in_offsets[i + 1] == in_offsets[i]) {
+          continue;
+        }
+        if (stages.size() <= static_cast<size_t>(stage[i])) {
+          stages.resize(stage[i] + 1);
+        }
+        stages[stage[i]].push_back(nodes[i]);
+      }
+    }
+
+    ~Plan() {
+      for (size_t i = 0; i < expansions.size(); ++i) {
+        delete expansions[i];
+      }
+    }
+
+    /// Record the nodes of one of the lists of the DAG
+    void collect(std::vector<DAGNode *> &list, ExpansionRole normal,
+                 ExpansionRole interm) {
+      for (size_t i = 0; i < list.size(); ++i) {
+        DAGNode *node = list[i];
+        nodes[node->id()] = node;
+        roles[node->id()] = node->is_interm() ? interm : normal;
+      }
+    }
+
+    /// Note that a node has finished with the expansion of another
+    void release(uint32_t id) {
+      if (users[id].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete expansions[id];
+        expansions[id] = nullptr;
+      }
+    }
+
+    const DomainGeometry *domain;
+    std::vector<DAGNode *> nodes;           /// by id
+    std::vector<ExpansionRole> roles;       /// by id
+    std::vector<uint32_t> in_offsets;       /// the in edges of node i are
+    std::vector<InEdge> in_edges;           /// [in_offsets[i], in_offsets[i+1])
+    std::unique_ptr<std::atomic<int>[]> users;  /// nodes yet to use node i
+    std::vector<expansion_t *> expansions;  /// by id
+    std::vector<std::vector<DAGNode *>> stages;
+  };
+
+  /// Action computing a range of the nodes of a stage
+  ///
+  /// \param plan - the plan of the execution
+  /// \param first - the first node to compute
+  /// \param last - one past the last node to compute
+  ///
+  /// \returns - HPX_SUCCESS
+  static int stage_chunk_handler(Plan *plan, DAGNode **first,
+                                 DAGNode **last) {
+    for (DAGNode **iter = first; iter != last; ++iter) {
+      if ((*iter)->is_parts()) {
+        compute_targets(plan, *iter);
+      } else {
+        compute_expansion(plan, *iter);
+      }
+    }
+    return HPX_SUCCESS;
+  }
+
+  /// Form the expansion of a node from its inputs
+  static void compute_expansion(Plan *plan, DAGNode *node) {
+    uint32_t id = node->id();
+    Index idx = node->index();
+    double scale = expansion_t::compute_scale(idx);
+    Point center = plan->domain->center_from_index(idx);
+    expansion_t *total = new expansion_t{plan->roles[id], scale, center};
+
+    for (uint32_t e = plan->in_offsets[id]; e < plan->in_offsets[id + 1];
+         ++e) {
+      const InEdge &edge = plan->in_edges[e];
+      DAGNode *from = plan->nodes[edge.source];
+      const expansion_t *input = plan->expansions[edge.source];
+      std::unique_ptr<expansion_t> part{nullptr};
+      size_t size{1};
+
+      CostModel::Timer timer{costs()};
+      switch (edge.op) {
+        case Operation::StoM:
+        case Operation::StoL:
+          {
+            sourcenode_t *leaf = static_cast<sourcenode_t *>(from->tree_node());
+            const source_t *sources = leaf->parts.data();
+            size = leaf->parts.n();
+            ViewSet views{kNoRoleNeeded, center, scale};
+            expansion_t local{views};
+            if (edge.op == Operation::StoM) {
+              part = local.S_to_M(sources, &sources[size]);
+            } else {
+              part = local.S_to_L(sources, &sources[size]);
+            }
+          }
+          break;
+        case Operation::MtoM:
+          part = input->M_to_M(from->index().which_child());
+          break;
+        case Operation::MtoL:
+          part = input->M_to_L(from->index(), idx);
+          break;
+        case Operation::LtoL:
+          part = input->L_to_L(idx.which_child());
+          break;
+        case Operation::MtoI:
+          part = input->M_to_I();
+          break;
+        case Operation::ItoI:
+          part = input->I_to_I(from->index(), idx);
+          break;
+        case Operation::ItoL:
+          part = input->I_to_L(idx);
+          break;
+        default:
+          assert(0 && "Impossible operation into an expansion");
+          break;
+      }
+      timer.stop(edge.op, size);
+
+      total->add_expansion(part.get());
+      plan->release(edge.source);
+    }
+
+    plan->expansions[id] = total;
+    if (node->out_count() == 0) {
+      plan->expansions[id] = nullptr;
+      delete total;
+    }
+  }
+
+  /// Apply the inputs of a target leaf to its targets
+  static void compute_targets(Plan *plan, DAGNode *node) {
+    uint32_t id = node->id();
+    targetnode_t *leaf = static_cast<targetnode_t *>(node->tree_node());
+    target_t *first = leaf->parts.data();
+    target_t *last = &first[leaf->parts.n()];
+
+    for (uint32_t e = plan->in_offsets[id]; e < plan->in_offsets[id + 1];
+         ++e) {
+      const InEdge &edge = plan->in_edges[e];
+      if (first != last) {
+        CostModel::Timer timer{costs()};
+        switch (edge.op) {
+          case Operation::StoT:
+            {
+              DAGNode *from = plan->nodes[edge.source];
+              sourcenode_t *sleaf
+                  = static_cast<sourcenode_t *>(from->tree_node());
+              const source_t *sources = sleaf->parts.data();
+              size_t n_src = sleaf->parts.n();
+              if (n_src) {
+                expansion_t expand(ViewSet{});
+                expand.S_to_T(sources, &sources[n_src], first, last);
+              }
+              timer.stop(Operation::StoT, n_src * (last - first));
+            }
+            break;
+          case Operation::MtoT:
+            plan->expansions[edge.source]->M_to_T(first, last);
+            timer.stop(Operation::MtoT, last - first);
+            break;
+          case Operation::LtoT:
+            plan->expansions[edge.source]->L_to_T(first, last);
+            timer.stop(Operation::LtoT, last - first);
+            break;
+          default:
+            assert(0 && "Impossible operation into targets");
+            break;
+        }
+      }
+      plan->release(edge.source);
+    }
+  }
+
+  /// The cost model of evaluations with this executor
+  static CostModel &costs() {
+    return cost_model<Source, Target, Expansion, Method>();
+  }
+
+  static hpx_action_t stage_chunk_;
+};
+
+template <typename S, typename T,
+          template <typename, typename> class E,
+          template <typename, typename,
+                    template <typename, typename> class> class M>
+hpx_action_t BulkExecutor<S, T, E, M>::stage_chunk_ = HPX_ACTION_NULL;
+
+
+} // namespace dashmm
+
+
+#endif // __DASHMM_BULK_EXECUTOR_H__
@@ -0,0 +1,139 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+#ifndef __DASHMM_COALESCER_H__
+#define __DASHMM_COALESCER_H__
+
+
+/// \file
+/// \brief Coalescing of the messages sent to other ranks during evaluation
+
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <hpx/hpx.h>
+
+
+namespace dashmm {
+
+
+/// Action delivering a coalesced parcel at its destination
+extern hpx_action_t coalesced_delivery_action;
+
+
+/// Coalesces the messages sent to other ranks during evaluation
+///
+/// The out edges of the DAG that cross ranks are served by sending the
+/// expansion, or the sources, with the edge records for that rank as a single
+/// message. Many of these are small, and many are sent at nearly the same
+/// time. Instead of sending each as its own parcel, they are appended to a
+/// buffer for their destination rank, and each buffer is sent as one parcel.
+/// At the destination, each message is then spawned as a local parcel with
+/// its original action.
+///
+/// A buffer is sent once it holds kFlushBytes, once its oldest message has
+/// waited kFlushMicroseconds, or once no thread on this rank is producing
+/// messages. The threads that send messages bracket their work with a Scope,
+/// and the last Scope to end sends every buffer. So a message is never left
+/// waiting once the work that might add to it is finished. The age of the
+/// buffers is checked by send(), by the end of each Scope and by poll(),
+/// which threads doing long work inside a Scope should call now and then.
+///
+/// There is one Coalescer per rank, see coalescer().
+class Coalescer {
+ public:
+  /// Buffers holding this many bytes are sent
+  static constexpr size_t kFlushBytes = 64 * 1024;
+
+  /// Buffers whose oldest message waited this long are sent
+  static constexpr int64_t kFlushMicroseconds = 100;
+
+  explicit Coalescer(int num_ranks);
+
+  Coalescer(const Coalescer &other) = delete;
+  Coalescer &operator=(const Coalescer &other) = delete;
+
+  /// Marks a thread that may send messages
+  ///
+  /// Every call to send() must be made while a Scope exists.
+  class Scope {
+   public:
+    explicit Scope(Coalescer &coalescer) : coalescer_(coalescer) {
+      coalescer_.enter();
+    }
+    ~Scope() {coalescer_.leave();}
+
+    Scope(const Scope &other) = delete;
+    Scope &operator=(const Scope &other) = delete;
+
+   private:
+    Coalescer &coalescer_;
+  };
+
+  /// Send a message to another rank
+  ///
+  /// The message is copied, so @p data may be reused as soon as this returns.
+  /// At @p rank, @p action will be called with the message as its marshalled
+  /// argument.
+  ///
+  /// \param rank - the destination rank
+  /// \param action - the marshalled action receiving the message
+  /// \param data - the message
+  /// \param bytes - the size of the message
+  void send(int rank, hpx_action_t action, const void *data, size_t bytes);
+
+  /// Send every buffer that holds messages
+  void flush();
+
+  /// Send the buffers whose oldest message waited too long
+  ///
+  /// The buffers are checked at most once per kFlushMicroseconds, so this is
+  /// cheap to call often.
+  void poll();
+
+ private:
+  /// The messages waiting for one destination rank
+  struct Destination {
+    std::atomic_flag lock;
+    std::atomic<int64_t> since;   // the time of the oldest message, or 0
+    std::vector<char> buffer;
+  };
+
+  void enter() {active_.fetch_add(1, std::memory_order_acq_rel);}
+  void leave();
+
+  /// Send the buffer of the given rank, if it holds messages
+  void flush(int rank);
+
+  /// Make the parcel sending the given messages to the given rank
+  hpx_parcel_t *make_parcel(int rank, const std::vector<char> &buffer);
+
+  int num_ranks_;
+  std::unique_ptr<Destination[]> destinations_;
+  std::atomic<int> active_;
+  std::atomic<int64_t> last_poll_;
+};
+
+
+/// The Coalescer of this rank
+Coalescer &coalescer();
+
+
+} // namespace dashmm
+
+
+#endif // __DASHMM_COALESCER_H__
@@ -0,0 +1,171 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+#ifndef __DASHMM_COST_MODEL_H__
+#define __DASHMM_COST_MODEL_H__
+
+
+/// \file
+/// \brief Measured costs of the operations of the DAG
+
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#include <hpx/hpx.h>
+
+#include "dashmm/types.h"
+
+
+namespace dashmm {
+
+
+/// Action creating the reduction LCO used by CostModel::calibrate()
+extern hpx_action_t cost_reducer_new_action;
+
+/// Action deleting the reduction LCO used by CostModel::calibrate()
+extern hpx_action_t cost_reducer_delete_action;
+
+
+/// Measured costs of the operations of the DAG
+///
+/// When measuring, the operations performed by the Expansion and Target LCOs
+/// are timed, together with the size of the operation. The size is the number
+/// of sources for S->M and S->L, the number of targets for M->T and L->T, the
+/// product of the two for S->T, and one for operations between expansions.
+///
+/// calibrate() combines the measurements of all ranks and fits the time of
+/// each sort of operation to a fixed cost plus a cost proportional to the
+/// size. The fitted model is the same on every rank, and gives the weights of
+/// the DAG edges in place of the estimates of the Expansion. Operations that
+/// have not been measured keep their estimated weight.
+///
+/// The measurements accumulate over all evaluations since measuring was
+/// enabled, so that the model improves with each evaluation.
+class CostModel {
+ public:
+  /// One unit of edge weight is this many nanoseconds of measured time
+  static constexpr double kNanosecondsPerWeight = 100.0;
+
+  CostModel();
+
+  CostModel(const CostModel &other) = delete;
+  CostModel &operator=(const CostModel &other) = delete;
+
+  /// Start or stop measuring the operations
+  void set_measuring(bool measure) {
+    measuring_.store(measure, std::memory_order_relaxed);
+  }
+
+  /// Are the operations being measured
+  bool measuring() const {return measuring_.load(std::memory_order_relaxed);}
+
+  /// Does the model have measured costs
+  bool calibrated() const {return calibrated_;}
+
+  /// Record one operation
+  ///
+  /// This may be called concurrently.
+  ///
+  /// \param op - the operation
+  /// \param size - the size of the operation
+  /// \param us - the time the operation took in microseconds
+  void record(Operation op, size_t size, double us);
+
+  /// Fit the model to the measurements of all ranks
+  ///
+  /// This must be called on every rank with the same reduction LCO, created
+  /// with cost_reducer_new_action.
+  ///
+  /// \param reducer - the reduction LCO combining the measurements
+  void calibrate(hpx_addr_t reducer);
+
+  /// The weight of an edge performing the given operation
+  ///
+  /// \param op - the operation
+  /// \param size - the size of the operation
+  /// \param estimate - the weight to use if the operation has not been
+  ///                   measured
+  ///
+  /// \returns - the measured cost in units of kNanosecondsPerWeight
+  int weight(Operation op, size_t size, int estimate) const;
+
+  /// Print the fitted model
+  void print(FILE *fd) const;
+
+  /// Times one operation, if the model is measuring
+  class Timer {
+   public:
+    explicit Timer(CostModel &model)
+        : model_(model), measuring_{model.measuring()} {
+      if (measuring_) {
+        begin_ = hpx_time_now();
+      }
+    }
+
+    /// Record the time since construction
+    void stop(Operation op, size_t size) {
+      if (measuring_) {
+        model_.record(op, size, hpx_time_diff_us(begin_, hpx_time_now()));
+      }
+    }
+
+   private:
+    CostModel &model_;
+    bool measuring_;
+    hpx_time_t begin_;
+  };
+
+  /// The number of sorts of operation
+  static constexpr int kNumOps = static_cast<int>(Operation::ItoL) + 1;
+
+  /// The number of sums kept for each sort of operation
+  static constexpr int kNumSums = 5;
+
+ private:
+  /// The measurements are spread over a few stripes to limit contention
+  static constexpr int kStripes = 8;
+
+  /// The sums kept for each operation: the count, the sum of the sizes, the
+  /// sum of the times in nanoseconds, the sum of the squared sizes and the
+  /// sum of the size times the time
+  struct alignas(64) Stripe {
+    std::atomic<uint64_t> sums[kNumOps][kNumSums];
+  };
+
+  std::atomic<bool> measuring_;
+  bool calibrated_;
+  Stripe stripes_[kStripes];
+  uint64_t samples_[kNumOps];
+  double fixed_ns_[kNumOps];
+  double per_size_ns_[kNumOps];
+};
+
+
+/// The cost model of the evaluations with the given types
+template <typename Source, typename Target,
+          template <typename, typename> class Expansion,
+          template <typename, typename,
+                    template <typename, typename> class> class Method>
+CostModel &cost_model() {
+  static CostModel model{};
+  return model;
+}
+
+
+} // namespace dashmm
+
+
+#endif // __DASHMM_COST_MODEL_H__
@@ -20,7 +20,11 @@
 /// \brief Interface for intermediate representation of DAG
 
 
+#include <cstdint>
+#include <cstdio>
+
 #include <algorithm>
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -37,44 +41,130 @@ struct DAGNode;
 class DAGInfo;
 
 
-/// Edge in the explicit representation of the DAG
-struct DAGEdge {
+/// Link between DAG nodes recorded during DAG discovery
+///
+/// Methods create links concurrently while the DAG is discovered. These are
+/// converted into the compact DAGEdge form when the DAG is finalized.
+struct DAGLink {
   DAGNode *target;          /// Target node of the edge
   Operation op;             /// Operation to perform along edge
   int weight;               /// estimate of communication cost if it occurs
+};
+
+
+/// Largest weight that can be stored in a DAGEdge
+constexpr int kDAGEdgeMaxWeight = (1 << 24) - 1;
+
+
+/// Edge in the explicit representation of the DAG
+///
+/// The target of the edge is given as the position of the target node in
+/// the node array of the finalized DAG. The operation and the weight share a
+/// single word; larger weights are clamped to kDAGEdgeMaxWeight.
+class DAGEdge {
+ public:
+  DAGEdge() : target_{0}, op_{0}, weight_{0} { }
+  DAGEdge(uint32_t target, Operation op, int weight)
+    : target_{target}, op_{static_cast<uint32_t>(op)},
+      weight_{static_cast<uint32_t>(
+          std::max(0, std::min(weight, kDAGEdgeMaxWeight)))} { }
+
+  /// Position of the target node in the node array of the DAG
+  uint32_t target() const {return target_;}
+
+  /// Operation to perform along edge
+  Operation op() const {return static_cast<Operation>(op_);}
+
+  /// Estimate of communication cost if it occurs
+  int weight() const {return weight_;}
 
-  DAGEdge() : target{nullptr}, op{Operation::Nop}, weight{0} {}
-  DAGEdge(DAGNode *end, Operation inop, int w)
-    : target{end}, op{inop}, weight{w} {}
+  /// Replace the weight of the edge
+  void set_weight(int weight) {
+    weight_ = std::max(0, std::min(weight, kDAGEdgeMaxWeight));
+  }
+
+ private:
+  uint32_t target_;
+  uint32_t op_ : 8;
+  uint32_t weight_ : 24;
 };
 
+static_assert(sizeof(DAGEdge) == 8, "DAGEdge is expected to pack to 8 bytes");
+
 
 /// Node in the explicit representation of the DAG
+///
+/// While the DAG is being discovered, each node is individually allocated and
+/// keeps its out edges as a list of DAGLinks. Once DAG::finalize() has been
+/// called, the nodes are stored contiguously by the DAG, and the out edges
+/// of each node are a range of the single edge array of the DAG. The edge
+/// accessors below are only valid for a finalized DAG.
 class DAGNode {
  public:
-  DAGNode(const DAGInfo *p)
-    : out_edges{}, locality{-1}, color{0},
-      global_addx{HPX_NULL}, parent_{p}, in_count_{0} { }
+  DAGNode(DAGInfo *p)
+    : locality{-1}, color{0}, priority{0}, fused{false},
+      global_addx{HPX_NULL}, parent_{p}, links_{nullptr}, in_count_{0},
+      out_count_{0}, id_{0} { }
 
-  ~DAGNode() {
-    //parent_->remove_node(this);
-  }
+  /// Copy a node
+  ///
+  /// Nodes are only copied when the DAG is finalized, after their out edges
+  /// have been converted to the compact form.
+  DAGNode(const DAGNode &other)
+    : locality{other.locality}, color{other.color},
+      priority{other.priority}, fused{other.fused},
+      global_addx{other.global_addx}, parent_{other.parent_},
+      edges_{other.edges_},
+      in_count_{other.in_count_.load()}, out_count_{other.out_count_},
+      id_{other.id_} { }
+
+  DAGNode &operator=(const DAGNode &other) = delete;
 
   /// Utility routine to add an edge to the DAG
   void add_out_edge(DAGNode *end, Operation op, int weight) {
-    out_edges.push_back(DAGEdge{end, op, weight});
+    if (links_ == nullptr) {
+      links_ = new std::vector<DAGLink>{};
+    }
+    links_->push_back(DAGLink{end, op, weight});
+    ++out_count_;
   }
 
   /// Utility routine to track a new input edge
+  ///
+  /// This may be called concurrently for the same node.
   void add_in_edge() {
-    ++in_count_;
+    in_count_.fetch_add(1, std::memory_order_relaxed);
   }
 
   /// Return how many input edges we need
   size_t in_count() const {return in_count_;}
 
   /// Return the number of out edges
-  size_t out_count() const {return out_edges.size();}
+  size_t out_count() const {return out_count_;}
+
+  /// Return the given out edge
+  const DAGEdge &out_edge(size_t i) const {return edges_[i];}
+
+  /// Return the target node of the given out edge
+  DAGNode *out_target(size_t i) const {
+    DAGNode *base = const_cast<DAGNode *>(this) - id_;
+    return base + edges_[i].target();
+  }
+
+  /// Return the given out link
+  ///
+  /// This is only valid before the DAG is finalized.
+  const DAGLink &out_link(size_t i) const {return (*links_)[i];}
+
+  /// Sort the out edges by the locality of their targets
+  ///
+  /// The edges to the same locality are ordered by decreasing priority of
+  /// their targets, so that serving the edges in order starts the work on
+  /// the critical path first.
+  void sort_out_edges_by_locality();
+
+  /// Return the position of this node in the node array of the DAG
+  uint32_t id() const {return id_;}
 
   /// Return the index of the related tree node
   Index index() const;
@@ -93,16 +183,25 @@ class DAGNode {
   /// WARNING: Use with caution.
   void *tree_node() const;
 
-  std::vector<DAGEdge> out_edges;   /// these are out edges
-
   int locality;                  /// the locality where this will be placed
   int color;
+  int priority;                  /// the weight of the longest path to a sink
+  bool fused;                    /// computed by the task of a fused subtree,
+                                 /// without an LCO of its own
   hpx_addr_t global_addx;        /// global address of object serving this node
                                  /// or a source ref
 
  private:
-  const DAGInfo *parent_;
-  size_t in_count_;
+  friend class DAG;
+
+  DAGInfo *parent_;
+  union {
+    std::vector<DAGLink> *links_;  /// out edges during discovery
+    DAGEdge *edges_;               /// out edges once finalized
+  };
+  std::atomic<uint32_t> in_count_;
+  uint32_t out_count_;
+  uint32_t id_;
 };
 
 
@@ -121,32 +220,22 @@ class DAGNode {
 /// associated with the nodes of the source tree, and the nods of the DAG
 /// associated with the nodes of the target tree.
 ///
+/// After the nodes are collected, the DAG is finalized. This moves the nodes
+/// into a single array, and the out edges of all nodes into a single edge
+/// array in compressed sparse row form. The four vectors then refer to the
+/// nodes in that array.
+///
 /// Typically, DASHMM users implementing a new Method will work with DAGInfo
 /// objects rather than the DAG directly.
 class DAG {
  public:
-  DAG() : source_leaves{}, source_nodes{}, target_nodes{}, target_leaves{} { }
+  DAG() : source_leaves{}, source_nodes{}, target_nodes{}, target_leaves{},
+          fused_roots{}, nodes_{}, edges_{}, discovery_bytes_{0} { }
 
-  // TODO: improve this to use unique_ptr to make this automatic
-  ~DAG() {
-    for (size_t i = 0; i < source_leaves.size(); ++i) {
-      delete source_leaves[i];
-    }
-    for (size_t i = 0; i < source_nodes.size(); ++i) {
-      delete source_nodes[i];
-    }
-    for (size_t i = 0; i < target_nodes.size(); ++i) {
-      delete target_nodes[i];
-    }
-    for (size_t i = 0; i < target_leaves.size(); ++i) {
-      delete target_leaves[i];
-    }
-  }
+  ~DAG();
 
-  /// Comparison routine that will used to sort edges by locality
-  static bool compare_edge_locality(const DAGEdge &a, const DAGEdge &b) {
-    return (a.target->locality < b.target->locality);
-  }
+  DAG(const DAG &other) = delete;
+  DAG &operator=(const DAG &other) = delete;
 
   /// Determine if an edge is to a target Node
   static bool operation_to_target(Operation op) {
@@ -154,6 +243,96 @@ class DAG {
                                  || op == Operation::StoT;
   }
 
+  /// Determine if an edge starts at a node of the target tree
+  static bool operation_from_target_tree(Operation op) {
+    return op == Operation::LtoL || op == Operation::LtoT
+                                 || op == Operation::ItoL;
+  }
+
+  /// Determine if an edge ends at a node of the source tree
+  static bool operation_to_source_tree(Operation op) {
+    return op == Operation::StoM || op == Operation::MtoM
+                                 || op == Operation::MtoI;
+  }
+
+  /// Remove the edges that end at nodes placed on another locality
+  ///
+  /// When each locality discovers only part of the DAG, the edges into nodes
+  /// owned by other localities are discovered by those localities as well.
+  /// This removes the local copy of such edges. This must be called before
+  /// the DAG is finalized.
+  ///
+  /// \param locality - the locality of the calling rank
+  void prune_remote_edges(int locality);
+
+  /// Remove the halo of a partially discovered DAG
+  ///
+  /// Halo nodes are those placed on another locality. Once their edges have
+  /// been handed to the locality owning them, the out edges of the halo nodes
+  /// are removed, as are the halo nodes that no local node refers to. This
+  /// must be called before the DAG is finalized.
+  ///
+  /// \param locality - the locality of the calling rank
+  void remove_halo(int locality);
+
+  /// Convert the collected DAG into its compact form
+  ///
+  /// This must be called once all nodes have been collected into the four
+  /// vectors, and before any of the edges are examined. Any DAGNode pointers
+  /// obtained before this call are invalidated; the DAGInfo objects and the
+  /// four vectors are updated to refer to the new location of the nodes.
+  void finalize();
+
+  /// Has the DAG been finalized
+  bool finalized() const {return !nodes_.empty();}
+
+  /// Replace the weights of the edges of a finalized DAG
+  ///
+  /// \param weight - a callable taking the source node, the edge and the
+  ///                 target node of an edge, and returning its new weight
+  template <typename Weight>
+  void reweight(Weight weight) {
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+      DAGNode &node = nodes_[i];
+      for (size_t j = 0; j < node.out_count(); ++j) {
+        DAGEdge &edge = node.edges_[j];
+        edge.set_weight(weight(&node, edge, &nodes_[edge.target()]));
+      }
+    }
+  }
+
+  /// Compute the priority of every node of a finalized DAG
+  ///
+  /// The priority of a node is the weight of the longest path from the node
+  /// to a sink of the DAG. Each edge contributes its weight, and each node
+  /// contributes its in count, for the contributions it accumulates. Nodes
+  /// with a higher priority have more work waiting on them, so serving them
+  /// first shortens the evaluation. This should be called once the weights
+  /// of the edges are final. In a partially discovered DAG, only the local
+  /// part of the paths is counted.
+  void prioritize();
+
+  /// The number of nodes in the DAG
+  size_t node_count() const {return nodes_.size();}
+
+  /// The number of edges in the DAG
+  size_t edge_count() const {return edges_.size();}
+
+  /// The bytes used by the nodes and edges of the finalized DAG
+  size_t bytes() const {
+    return nodes_.capacity() * sizeof(DAGNode)
+           + edges_.capacity() * sizeof(DAGEdge);
+  }
+
+  /// The bytes used by the nodes and edges before finalization
+  ///
+  /// This does not include the overhead of the allocator for the individually
+  /// allocated nodes and edge lists.
+  size_t discovery_bytes() const {return discovery_bytes_;}
+
+  /// Print a summary of the memory used by the DAG
+  void print_memory_usage(FILE *fd) const;
+
   /// partition the nodes by local vs remote
   void partitionLocal(int locality) {
     auto loc_comp = [&locality](const DAGNode *a) -> bool {
@@ -171,6 +350,16 @@ class DAG {
   std::vector<DAGNode *> source_nodes;
   std::vector<DAGNode *> target_nodes;
   std::vector<DAGNode *> target_leaves;
+
+  /// The top node of each fused subtree of this locality
+  ///
+  /// See DualTree::coarsen_DAG().
+  std::vector<DAGNode *> fused_roots;
+
+ private:
+  std::vector<DAGNode> nodes_;
+  std::vector<DAGEdge> edges_;
+  size_t discovery_bytes_;
 };
 
 
@@ -187,36 +376,25 @@ class DAG {
 /// basis. Source and Target nodes will be created during tree construction.
 /// Intermediate nodes should be added by Methods that need them.
 ///
-/// This object uses HPX-5 to manage the concurrent modification of the DAG,
-/// so this object cannot be used outside of an HPX-5 thread. DASHMM users will
-/// have no reason to create these objects directly; the library will manage
-/// the creation of these objects.
+/// The nodes are created with an atomic compare-and-swap, and the in-edge
+/// counts of the nodes are atomic. Appending an out edge is guarded by a
+/// small spin lock held by each object, so that DAG discovery does not need
+/// any HPX-5 resources. DASHMM users will have no reason to create these
+/// objects directly; the library will manage the creation of these objects.
 class DAGInfo {
  public:
   /// Construct the DAGInfo
   DAGInfo(void *treenode)
       : idx_{0, 0, 0, 0}, normal_{nullptr}, interm_{nullptr}, parts_{nullptr},
         tree_node_{treenode} {
-    lock_ = hpx_lco_sema_new(1);
-    assert(lock_ != HPX_NULL);
+    lock_.clear();
   }
 
   /// Construct the DAGInfo
-  ///
-  /// This cannot be used outside of an HPX-5 thread.
   DAGInfo(void *treenode, Index idx)
       : idx_{idx}, normal_{nullptr}, interm_{nullptr}, parts_{nullptr},
         tree_node_{treenode} {
-    lock_ = hpx_lco_sema_new(1);
-    assert(lock_ != HPX_NULL);
-  }
-
-  /// Destroy the DAGInfo
-  ///
-  /// This will free any resources acquired by this object. This cannot be used
-  /// outside of an HPX-5 thread.
-  ~DAGInfo() {
-    hpx_lco_delete_sync(lock_);
+    lock_.clear();
   }
 
   /// Return the index of the associated Tree Node
@@ -236,14 +414,7 @@ class DAGInfo {
   ///
   /// \returns - true is DAGNode was allocated; false otherwise
   bool add_normal() {
-    bool retval = false;
-    lock();
-    if (normal_ == nullptr) {
-      normal_ = new DAGNode{this};
-      retval = true;
-    }
-    unlock();
-    return retval;
+    return add_node(normal_);
   }
 
   /// Add an intermediate node
@@ -253,14 +424,7 @@ class DAGInfo {
   ///
   /// \returns - true is the node was allocated; false otherwsie
   bool add_interm() {
-    bool retval = false;
-    lock();
-    if (interm_ == nullptr) {
-      interm_ = new DAGNode{this};
-      retval = true;
-    }
-    unlock();
-    return retval;
+    return add_node(interm_);
   }
 
   /// Add a particle node
@@ -268,10 +432,10 @@ class DAGInfo {
   /// This will add a particle DAG node for the tree node associated with this
   /// object. This will represent either sources in the source tree, or
   /// targets in the target tree.
-  void add_parts() {
-    assert(parts_ == nullptr);
-    parts_ = new DAGNode{this};
-    assert(parts_ != nullptr);
+  ///
+  /// \returns - true if the node was allocated; false otherwise
+  bool add_parts() {
+    return add_node(parts_);
   }
 
   DAGInfo(const DAGInfo &other) = delete;
@@ -280,22 +444,36 @@ class DAGInfo {
   DAGInfo &operator=(const DAGInfo &&other) = delete;
 
   /// Does the tree node have a normal DAG node?
-  bool has_normal() const {return normal_ != nullptr;}
+  bool has_normal() const {return normal() != nullptr;}
 
   /// Does the tree node have an intermediate DAG node?
-  bool has_interm() const {return interm_ != nullptr;}
+  bool has_interm() const {return interm() != nullptr;}
 
   /// Does the tree node have either a source or target DAG node?
-  bool has_parts() const {return parts_ != nullptr;}
+  bool has_parts() const {return parts() != nullptr;}
 
   /// Retrieve the normal DAG node
-  DAGNode *normal() const {return normal_;}
+  DAGNode *normal() const {return normal_.load(std::memory_order_acquire);}
 
   /// Retrieve the intermediate DAG node
-  DAGNode *interm() const {return interm_;}
+  DAGNode *interm() const {return interm_.load(std::memory_order_acquire);}
 
   /// Return the source or target DAG node
-  DAGNode *parts() const {return parts_;}
+  DAGNode *parts() const {return parts_.load(std::memory_order_acquire);}
+
+  /// Update the DAG node pointers after a node has been moved
+  ///
+  /// \param from - the previous address of the node
+  /// \param to - the new address of the node
+  void relocate_node(const DAGNode *from, DAGNode *to) {
+    if (normal_ == from) {
+      normal_ = to;
+    } else if (interm_ == from) {
+      interm_ = to;
+    } else if (parts_ == from) {
+      parts_ = to;
+    }
+  }
 
   /// Remove a DAG node
   void remove_node(DAGNode *child) {
@@ -319,7 +497,7 @@ class DAGInfo {
   /// \param expand - the expansion LCO represented by this object's normal
   ///                 DAG node.
   void set_normal_expansion(const hpx_addr_t addx) {
-    normal_->global_addx = addx;
+    normal()->global_addx = addx;
   }
 
   /// Sets the global data for the intermediate DAG node
@@ -331,8 +509,8 @@ class DAGInfo {
   /// \param expand - the expansion LCO represented by this object's
   ///                 intermediate DAG node.
   void set_interm_expansion(const hpx_addr_t addx) {
-    if (interm_ != nullptr) {
-      interm_->global_addx = addx;
+    if (has_interm()) {
+      interm()->global_addx = addx;
     }
   }
 
@@ -345,30 +523,30 @@ class DAGInfo {
   /// \param targs - the target LCO represented by this object's
   ///                particle DAG node.
   void set_targetlco(const hpx_addr_t addx) {
-    assert(parts_ != nullptr);
-    if (parts_ != nullptr) {
-      parts_->global_addx = addx;
+    assert(has_parts());
+    if (has_parts()) {
+      parts()->global_addx = addx;
     }
   }
 
   /// Sets locality on the particle node
   void set_parts_locality(int loc) {
-    if (parts_ != nullptr) {
-      parts_->locality = loc;
+    if (has_parts()) {
+      parts()->locality = loc;
     }
   }
 
   /// Sets locality on the normal node
   void set_normal_locality(int loc) {
-    if (normal_ != nullptr) {
-      normal_->locality = loc;
+    if (has_normal()) {
+      normal()->locality = loc;
     }
   }
 
   /// Sets locality on the intermediate node
   void set_interm_locality(int loc) {
-    if (interm_ != nullptr) {
-      interm_->locality = loc;
+    if (has_interm()) {
+      interm()->locality = loc;
     }
   }
 
@@ -380,9 +558,9 @@ class DAGInfo {
   /// \param source - the DAGInfo object containing the source node in question
   /// \param weight - estimate of communication cost if it occurs
   void StoM(DAGInfo *source, int weight) {
-    assert(source->has_parts());
     assert(has_normal());
-    link_nodes(source, source->parts_, this, normal_, Operation::StoM, weight);
+    link_nodes(source, source->halo(source->parts_),
+               this, normal(), Operation::StoM, weight);
   }
 
   /// Create an S->L link in the DAG
@@ -393,9 +571,9 @@ class DAGInfo {
   /// \param source - the DAGInfo object containing the source node in question
   /// \param weight - estimate of communication cost if it occurs
   void StoL(DAGInfo *source, int weight) {
-    assert(source->has_parts());
     assert(has_normal());
-    link_nodes(source, source->parts_, this, normal_, Operation::StoL, weight);
+    link_nodes(source, source->halo(source->parts_),
+               this, normal(), Operation::StoL, weight);
   }
 
   /// Create an M->M link in the DAG
@@ -406,10 +584,9 @@ class DAGInfo {
   /// \param source - the DAGInfo object containing the normal node in question
   /// \param weight -  estimate of communication cost if it occurs
   void MtoM(DAGInfo *source, int weight) {
-    assert(source->has_normal());
     assert(has_normal());
-    link_nodes(source, source->normal_, this, normal_, Operation::MtoM,
-               weight);
+    link_nodes(source, source->halo(source->normal_),
+               this, normal(), Operation::MtoM, weight);
   }
 
   /// Create an M->L link in the DAG
@@ -420,10 +597,9 @@ class DAGInfo {
   /// \param source - the DAGInfo object containing the normal node in question
   /// \param weight - estimate of communication cost if it occurs
   void MtoL(DAGInfo *source, int weight) {
-    assert(source->has_normal());
     assert(has_normal());
-    link_nodes(source, source->normal_, this, normal_, Operation::MtoL,
-               weight);
+    link_nodes(source, source->halo(source->normal_),
+               this, normal(), Operation::MtoL, weight);
   }
 
   /// Create an L->L link in the DAG
@@ -434,10 +610,9 @@ class DAGInfo {
   /// \param source - the DAGInfo object containing the normal node in question
   /// \param weight - estimate of communication cost if it occurs
   void LtoL(DAGInfo *source, int weight) {
-    assert(source->has_normal());
     assert(has_normal());
-    link_nodes(source, source->normal_, this, normal_, Operation::LtoL,
-               weight);
+    link_nodes(source, source->halo(source->normal_),
+               this, normal(), Operation::LtoL, weight);
   }
 
   /// Create an M->T link in the DAG
@@ -449,9 +624,8 @@ class DAGInfo {
   ///                 question
   /// \param weight - estimate of communication cost if it occurs
   void MtoT(DAGInfo *target, int weight) {
-    assert(has_normal());
     assert(target->has_parts());
-    link_nodes(this, normal_, target, target->parts_, Operation::MtoT,
+    link_nodes(this, halo(normal_), target, target->parts(), Operation::MtoT,
                weight);
   }
 
@@ -464,9 +638,8 @@ class DAGInfo {
   ///                 question
   /// \param weight - estimate of communication cost if it occurs
   void LtoT(DAGInfo *target, int weight) {
-    assert(has_normal());
     assert(target->has_parts());
-    link_nodes(this, normal_, target, target->parts_, Operation::LtoT,
+    link_nodes(this, halo(normal_), target, target->parts(), Operation::LtoT,
                weight);
   }
 
@@ -479,10 +652,9 @@ class DAGInfo {
   ///                 question
   /// \param weight - estimate of communication cost if it occurs
   void StoT(DAGInfo *source, int weight) {
-    assert(source->has_parts());
     assert(has_parts());
-    link_nodes(source, source->parts_, this, parts_, Operation::StoT,
-               weight);
+    link_nodes(source, source->halo(source->parts_),
+               this, parts(), Operation::StoT, weight);
   }
 
   /// Create an M->I link in the DAG
@@ -494,10 +666,9 @@ class DAGInfo {
   ///                 question
   /// \param weight - estimate of communication cost if it occurs
   void MtoI(DAGInfo *source, int weight) {
-    assert(source->has_normal());
     assert(has_interm());
-    link_nodes(source, source->normal_, this, interm_, Operation::MtoI,
-               weight);
+    link_nodes(source, source->halo(source->normal_),
+               this, interm(), Operation::MtoI, weight);
   }
 
   /// Create an I->I link in the DAG
@@ -510,9 +681,8 @@ class DAGInfo {
   /// \param weight - estimate of communication cost if it occurs
   void ItoI(DAGInfo *source, int weight) {
     assert(has_interm());
-    assert(source->has_interm());
-    link_nodes(source, source->interm_, this, interm_, Operation::ItoI,
-               weight);
+    link_nodes(source, source->halo(source->interm_),
+               this, interm(), Operation::ItoI, weight);
   }
 
   /// Create an I->L link in the DAG
@@ -524,12 +694,28 @@ class DAGInfo {
   ///                 question
   /// \param weight - estimate of communication cost if it occurs
   void ItoL(DAGInfo *source, int weight) {
-    assert(source->has_interm());
     assert(has_normal());
-    link_nodes(source, source->interm_, this, normal_, Operation::ItoL,
-               weight);
+    link_nodes(source, source->halo(source->interm_),
+               this, normal(), Operation::ItoL, weight);
   }
 
+  /// Return the DAG node at the source end of an edge
+  ///
+  /// \param op - the operation of the edge
+  ///
+  /// \returns - the particle, normal or intermediate node of this object;
+  ///            nullptr if that node has not been created
+  DAGNode *edge_source(Operation op) const;
+
+  /// Return the DAG node at the target end of an edge, creating it if needed
+  ///
+  /// This is used to add halo nodes for edges discovered by other localities.
+  ///
+  /// \param op - the operation of the edge
+  ///
+  /// \returns - the particle, normal or intermediate node of this object
+  DAGNode *add_edge_target(Operation op);
+
   /// Collect the DAG nodes from this object
   ///
   /// During the realization of the DAG as LCO objects, the nodes are collected
@@ -539,14 +725,14 @@ class DAGInfo {
   /// \param internals - the vector containing the rest of the nodes
   void collect_DAG_nodes(std::vector<DAGNode *> &terminals,
                          std::vector<DAGNode *> &internals) {
-    if (normal_) {
-      internals.push_back(normal_);
+    if (has_normal()) {
+      internals.push_back(normal());
     }
-    if (interm_) {
-      internals.push_back(interm_);
+    if (has_interm()) {
+      internals.push_back(interm());
     }
-    if (parts_) {
-      terminals.push_back(parts_);
+    if (has_parts()) {
+      terminals.push_back(parts());
     }
   }
 
@@ -563,9 +749,7 @@ class DAGInfo {
   static void link_nodes(DAGInfo *src_info, DAGNode *source,
                          DAGInfo *dest_info, DAGNode *dest,
                          Operation op, int weight) {
-    dest_info->lock();
     dest->add_in_edge();
-    dest_info->unlock();
 
     src_info->lock();
     source->add_out_edge(dest, op, weight);
@@ -575,19 +759,46 @@ class DAGInfo {
  private:
   /// Lock the node
   void lock() {
-    hpx_lco_sema_p(lock_);
+    while (lock_.test_and_set(std::memory_order_acquire)) { }
   }
 
   /// Unlock the node
   void unlock() {
-    hpx_lco_sema_v(lock_, HPX_NULL);
+    lock_.clear(std::memory_order_release);
+  }
+
+  /// Return the node in the given slot, creating it if needed
+  ///
+  /// When each locality discovers only its part of the DAG, the source end
+  /// of an edge may belong to a tree node owned by another locality. Such
+  /// halo nodes are created when they are first referred to.
+  DAGNode *halo(std::atomic<DAGNode *> &slot) {
+    add_node(slot);
+    return slot.load(std::memory_order_acquire);
+  }
+
+  /// Create the node in the given slot if it is not already present
+  ///
+  /// \returns - true if this call created the node; false otherwise
+  bool add_node(std::atomic<DAGNode *> &slot) {
+    if (slot.load(std::memory_order_acquire) != nullptr) {
+      return false;
+    }
+    DAGNode *node = new DAGNode{this};
+    DAGNode *expected = nullptr;
+    if (slot.compare_exchange_strong(expected, node,
+                                     std::memory_order_acq_rel)) {
+      return true;
+    }
+    delete node;
+    return false;
   }
 
   Index idx_;
-  hpx_addr_t lock_;
-  DAGNode *normal_;
-  DAGNode *interm_;
-  DAGNode *parts_;   // source or target
+  std::atomic_flag lock_;
+  std::atomic<DAGNode *> normal_;
+  std::atomic<DAGNode *> interm_;
+  std::atomic<DAGNode *> parts_;   // source or target
   void *tree_node_;
 };
 
@@ -22,6 +22,7 @@
 #include "dashmm/initfini.h"
 #include "dashmm/spmdutils.h"
 #include "dashmm/types.h"
+#include "dashmm/withdistro.h"
 
 // The built in methods
 #include "builtins/bh_method.h"
@@ -39,6 +40,7 @@
 // The built in distribution policies
 #include "builtins/bhdistro.h"
 #include "builtins/fmm97distro.h"
+#include "builtins/partitiondistro.h"
 #include "builtins/singlelocdistro.h"
 #include "builtins/randomdistro.h"
 
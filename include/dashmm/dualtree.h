@@ -24,12 +24,14 @@
 #include <cstdlib>
 #include <cmath>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <cassert>
 
 // C++ library
 #include <algorithm>
 #include <functional>
+#include <memory>
 #include <vector>
 
 // HPX-5
@@ -37,16 +39,21 @@
 
 // DASHMM
 #include "dashmm/array.h"
+#include "dashmm/coalescer.h"
+#include "dashmm/costmodel.h"
 #include "dashmm/dag.h"
 #include "dashmm/domaingeometry.h"
 #include "dashmm/expansionlco.h"
+#include "dashmm/ghostcache.h"
 #include "dashmm/hilbert.h"
 #include "dashmm/index.h"
 #include "dashmm/node.h"
 #include "dashmm/point.h"
 #include "dashmm/rankwise.h"
 #include "dashmm/reductionops.h"
+#include "dashmm/traceevents.h"
 #include "dashmm/tree.h"
+#include "dashmm/viewpool.h"
 
 
 namespace dashmm {
@@ -61,6 +68,38 @@ namespace dashmm {
 using DualTreeHandle = hpx_addr_t;
 
 
+/// Leaves may grow to this multiple of the refinement limit during re-binning
+///
+/// Beyond this, the tree is better rebuilt so that crowded leaves are split.
+constexpr int kRebinLeafFactor = 2;
+
+/// The padding added to each side of the domain of a tree that is re-binned
+///
+/// This is a fraction of the side of the bounding cube of the records. The
+/// records on the boundary of a tight cube would leave the domain with any
+/// outward move, forcing a rebuild; the padding leaves them room to move.
+constexpr double kRebinDomainPadding = 0.05;
+
+
+/// Does a distribution policy ask for the DAG to be discovered in parts
+///
+/// kPartialDAG is an optional member of a DistroPolicy. Policies that do not
+/// declare it have the full DAG discovered on every rank.
+template <typename Policy>
+class PartialDAGPolicy {
+  template <typename P>
+  static constexpr bool test(decltype(P::kPartialDAG) *) {
+    return P::kPartialDAG;
+  }
+
+  template <typename P>
+  static constexpr bool test(...) {return false;}
+
+ public:
+  static constexpr bool value = test<Policy>(nullptr);
+};
+
+
 // Forward declare registrar so we can become friends
 template <typename Source, typename Target,
           template <typename, typename> class Expansion,
@@ -95,8 +134,10 @@ class DualTree {
 
   /// Construction is always default
   DualTree()
-    : domain_{}, refinement_limit_{1}, unif_level_{1}, dim3_{8},
-      unif_count_{HPX_NULL}, unif_count_value_{nullptr},
+    : domain_{}, refinement_limit_{1}, partition_{TreePartition::Points},
+      unif_level_{1}, dim3_{8},
+      unif_count_{HPX_NULL}, unif_count_value_{nullptr}, ghosts_{nullptr},
+      self_{HPX_NULL}, halo_ready_{HPX_NULL}, halo_done_{HPX_NULL},
       method_{}, source_tree_{nullptr},
       target_tree_{nullptr} { }
 
@@ -126,6 +167,9 @@ class DualTree {
   /// Return the refinement limit used to build the tree.
   int refinement_limit() const {return refinement_limit_;}
 
+  /// Return how the uniform level of the tree is divided among the ranks.
+  TreePartition partition_kind() const {return partition_;}
+
   /// Return the method this object will use for DAG operations.
   const method_t &method() const {return method_;}
 
@@ -195,16 +239,57 @@ class DualTree {
     // the unif counts
     delete [] unif_count_value_;
     delete [] rank_map_;
+
+    delete ghosts_;
+    ghosts_ = nullptr;
+
+    hpx_lco_delete_sync(halo_ready_);
+    hpx_lco_delete_sync(halo_done_);
   }
 
   /// Return the rank owning the given unif grid node
   int rank_of_unif_grid(int idx) const {return rank_map_[idx];}
 
+  /// Is the DAG discovered in parts, with each rank building only its share
+  ///
+  /// This is selected by the distribution policy of the method, and is off
+  /// unless the policy declares kPartialDAG.
+  static constexpr bool partial_DAG() {
+    return PartialDAGPolicy<typename method_t::distropolicy_t>::value;
+  }
+
+  /// Return the rank owning the given tree node
+  ///
+  /// The nodes below the uniform level belong to the rank owning their
+  /// branch; those above it belong to rank 0.
+  int home_rank(const Index &idx) const {
+    if (idx.level() < unif_level_) {
+      return 0;
+    }
+    return rank_of_unif_grid(sourcetree_t::get_unif_grid_index(idx,
+                                                               unif_level_));
+  }
+
+  /// Is the given tree node left to another rank during DAG discovery
+  ///
+  /// When the DAG is discovered in parts, each rank traverses the nodes above
+  /// the uniform level, and the branches it owns.
+  bool owned_elsewhere(const Index &idx) const {
+    return partial_DAG() && idx.level() >= unif_level_
+           && home_rank(idx) != hpx_get_my_rank();
+  }
+
   // TODO: Get this out of DualTree
   /// Create the DAG for this tree using the method specified for this object.
   ///
   /// This will allocate and collect the DAG nodes into the returned object.
   ///
+  /// If the distribution policy asks for a partial DAG, each rank applies the
+  /// method only to the branches it owns, and to the nodes above the uniform
+  /// level. The returned DAG then holds the nodes owned by this rank, and the
+  /// halo of nodes owned by others that these nodes send to. In this case,
+  /// this must be called on every rank.
+  ///
   /// \returns - the resulting DAG.
   DAG *create_DAG() {
     // Do work on the source tree
@@ -251,6 +336,12 @@ class DualTree {
   /// nodes of the DAG, the target nodes of the DAG, and all other nodes.
   /// The source and target nodes are the input and output nodes respectively.
   /// The remainder are those nodes containing an intermediate computation.
+  /// The collected DAG is then finalized into its compact form.
+  ///
+  /// For a partial DAG, the edges discovered for nodes owned by other ranks
+  /// are first handed to those ranks, and those received from other ranks are
+  /// added. Every node is placed on the rank owning its tree node, so the
+  /// distribution policy has only to order the nodes.
   ///
   /// This is a synchronous operation.
   ///
@@ -267,6 +358,21 @@ class DualTree {
     collect_DAG_nodes_from_T_node(ttree->root(), retval->target_leaves,
                                   retval->target_nodes);
 
+    if (partial_DAG()) {
+      exchange_DAG_halo(retval);
+
+      // The exchange adds halo nodes to the trees, so we collect again
+      retval->source_leaves.clear();
+      retval->source_nodes.clear();
+      retval->target_nodes.clear();
+      retval->target_leaves.clear();
+      collect_DAG_nodes_from_S_node(stree->root(), retval->source_leaves,
+                                    retval->source_nodes);
+      collect_DAG_nodes_from_T_node(ttree->root(), retval->target_leaves,
+                                    retval->target_nodes);
+      retval->remove_halo(hpx_get_my_rank());
+    }
+
     // TODO: Note that these are non-binding requests, but this is the most
     // clear we can write this.
     retval->source_leaves.shrink_to_fit();
@@ -274,9 +380,41 @@ class DualTree {
     retval->target_nodes.shrink_to_fit();
     retval->target_leaves.shrink_to_fit();
 
+    retval->finalize();
+
     return retval;
   }
 
+  // TODO: Get this out of DualTree
+  /// Fuse the small rank-local subtrees of the upward pass
+  ///
+  /// A normal node of the source tree is fused if it is placed on this rank,
+  /// if every input comes from its own sources or from fused children, and if
+  /// the total weight of the edges of the subtree below it, including its own
+  /// out edges, is at most @p threshold. The expansions of a fused subtree are
+  /// then computed by a single task, with no LCO for any of its nodes: the
+  /// S->M and M->M edges inside the subtree are served in sequence by the
+  /// task, and the other out edges of each node as the LCO would have.
+  ///
+  /// This must be called after the DAG is distributed, and before the LCOs
+  /// are created. The top nodes of the fused subtrees are collected in the
+  /// fused_roots of @p dag.
+  ///
+  /// \param dag - the DAG
+  /// \param threshold - the largest weight of a fused subtree; if this is not
+  ///                    positive, no subtree is fused
+  void coarsen_DAG(DAG *dag, int threshold) {
+    dag->fused_roots.clear();
+    if (threshold <= 0) {
+      return;
+    }
+
+    sourcenode_t *root = source_tree_.here()->root();
+    if (coarsen_S_node(root, threshold, dag->fused_roots) >= 0) {
+      dag->fused_roots.push_back(root->dag.normal());
+    }
+  }
+
   // TODO: Get this out of DualTree
   /// Create the LCOs from the DAG
   ///
@@ -347,6 +485,13 @@ class DualTree {
   void start_DAG_evaluation(RankWise<dualtree_t> &global_tree, DAG *dag) {
     hpx_addr_t rwaddr = global_tree.data();
 
+    // The fused subtrees start first, as they lead the upward pass
+    dualtree_t *thetree = this;
+    for (size_t i = 0; i < dag->fused_roots.size(); ++i) {
+      DAGNode *top = dag->fused_roots[i];
+      hpx_call(HPX_HERE, fused_upward_, HPX_NULL, &thetree, &top, &rwaddr);
+    }
+
     // The DAG nodes are sorted local vs not. Find the partition point
     int rank = hpx_get_my_rank();
     auto partition_point = std::partition_point(
@@ -388,7 +533,8 @@ class DualTree {
   /// Destroys the LCOs associated with the DAG
   ///
   /// This is a synchronous operation. This destroys not only the expansion
-  /// LCOs, but also the target LCOs.
+  /// LCOs, but also the target LCOs. The view storage held by the ViewPool
+  /// is then returned to the system.
   ///
   /// \param dag - the DAG
   void destroy_DAG_LCOs(DAG &dag) {
@@ -412,6 +558,8 @@ class DualTree {
 
     hpx_lco_wait(done);
     hpx_lco_delete_sync(done);
+
+    ViewPool::trim();
   }
 
 
@@ -428,18 +576,25 @@ class DualTree {
   /// \param threshold - the partitioning threshold for the tree
   /// \param sources - the source data
   /// \param targets - the target data
+  /// \param partition - how the uniform level is divided among the ranks
+  /// \param padding - the fraction of the side of the bounding cube of the
+  ///                  records added to each side of the domain
   ///
   /// \returns - the RankWise object containing the dual tree
   static RankWise<dualtree_t> create(int threshold, 
                                      Array<Source> sources,
-                                     Array<Target> targets) {
+                                     Array<Target> targets,
+                                     TreePartition partition
+                                         = TreePartition::Points,
+                                     double padding = 0.0) {
     bool same_sandt{false};
     if (sources.data() == targets.data()) {
       same_sandt = true;
     }
     hpx_addr_t domain_geometry = compute_domain_geometry(sources, targets,
                                                          same_sandt);
-    RankWise<dualtree_t> retval = setup_basic_data(threshold, domain_geometry,
+    RankWise<dualtree_t> retval = setup_basic_data(threshold, partition,
+                                                   padding, domain_geometry,
                                                    same_sandt, sources,
                                                    targets);
     hpx_lco_delete_sync(domain_geometry);
@@ -472,6 +627,36 @@ class DualTree {
     return retval;
   }
 
+  /// Re-bin the records of the tree after their positions have changed
+  ///
+  /// Each rank moves the records of its own branches among the existing leaves
+  /// of those branches (see Tree::rebin()). The structure of the tree, and so
+  /// the DAG discovered from it, is unchanged. This fails if any record has
+  /// left the domain, has moved to a uniform level node owned by another rank,
+  /// falls in a part of the domain for which there is no node, or if any leaf
+  /// would grow to more than kRebinLeafFactor times the refinement limit. In
+  /// each of those cases the tree should be rebuilt.
+  ///
+  /// This should be called from an HPX thread, in a diffusive style.
+  ///
+  /// \param global_tree - the distributed tree
+  ///
+  /// \returns - true if every rank re-binned its records; false otherwise
+  static bool rebin(RankWise<dualtree_t> global_tree) {
+    hpx_addr_t failures = hpx_lco_reduce_new(hpx_get_num_ranks(), sizeof(int),
+                                             int_sum_ident_op, int_sum_op);
+    assert(failures != HPX_NULL);
+
+    hpx_addr_t rwtree = global_tree.data();
+    hpx_bcast_rsync(rebin_, &rwtree, &failures);
+
+    int n_failed{0};
+    hpx_lco_get(failures, sizeof(int), &n_failed);
+    hpx_lco_delete_sync(failures);
+
+    return n_failed == 0;
+  }
+
   /// Destroy a distributed tree.
   ///
   /// This cleans up all allocated resources used by the DualTree.
@@ -503,6 +688,30 @@ class DualTree {
     Index idx;
   };
 
+  // TODO: Get this out of DualTree
+  /// Header of the messages of DAG instigation
+  ///
+  /// This is followed by the serialized sources, unless they are cached at
+  /// the destination, and then by the count of edge records and the records.
+  struct DAGInstigationHeader {
+    hpx_addr_t tree;          // the global address of the DualTree
+    Index leaf;               // the index of the source leaf
+    uint64_t print;           // the fingerprint of the serialized sources
+    size_t n_src;             // the number of sources
+    int cached;               // are the sources omitted from the message
+  };
+
+  /// Edge record for the exchange of the DAG halo
+  ///
+  /// The operation determines the tree and the kind of DAG node at each end
+  /// of the edge.
+  struct DAGHaloRecord {
+    Index source;
+    Index target;
+    Operation op;
+    int weight;
+  };
+
   /// Action to set the domain geometry given the sources and targets
   ///
   /// This action is the target of a broadcast, and computes the domain for
@@ -615,6 +824,21 @@ class DualTree {
     return domain_geometry;
   }
 
+  /// The level of the uniform partition of the tree
+  ///
+  /// There are at least as many uniform nodes as ranks, and more when the
+  /// nodes are distributed by work, see kWorkPartitionLevels.
+  ///
+  /// \param num_ranks - the number of ranks
+  /// \param partition - how the uniform level is divided among the ranks
+  static int uniform_level(int num_ranks, TreePartition partition) {
+    int level = ceil(log(num_ranks) / log(8)) + 1;
+    if (partition == TreePartition::Work) {
+      level += kWorkPartitionLevels;
+    }
+    return level;
+  }
+
   /// Action to perform initializtion of basic data for the local tree
   ///
   /// This is the target of a broadcast, and it sets various data about the
@@ -623,6 +847,8 @@ class DualTree {
   /// \param rwdata - the global address of the global tree
   /// \param count - an LCO in which the uniform grid counting is reduced
   /// \param limit - the partitioning threshold for the tree
+  /// \param partition - the TreePartition dividing the uniform level
+  /// \param padding - the padding added to each side of the domain
   /// \param domain_geometry - the LCO in which the domain is reduced
   /// \param same_sandt - is S == T for this tree
   /// \param source_gas - the source records
@@ -634,6 +860,8 @@ class DualTree {
   static int init_partition_handler(hpx_addr_t rwdata,
                                     hpx_addr_t count,
                                     int limit,
+                                    int partition,
+                                    double padding,
                                     hpx_addr_t domain_geometry,
                                     int same_sandt,
                                     hpx_addr_t source_gas,
@@ -644,7 +872,8 @@ class DualTree {
     auto tree = global_tree.here();
 
     int num_ranks = hpx_get_num_ranks();
-    tree->unif_level_ = ceil(log(num_ranks) / log(8)) + 1;
+    tree->partition_ = static_cast<TreePartition>(partition);
+    tree->unif_level_ = uniform_level(num_ranks, tree->partition_);
     tree->dim3_ = pow(8, tree->unif_level_);
     tree->unif_count_ = count;
     tree->refinement_limit_ = limit;
@@ -653,6 +882,14 @@ class DualTree {
     tree->same_sandt_ = same_sandt;
     tree->source_gas = source_gas;
     tree->target_gas = target_gas;
+    tree->self_ = rwdata;
+    tree->ghosts_ = new GhostCache<Source>{};
+
+    // Every other rank sends its part of the DAG halo to this rank
+    tree->halo_ready_ = hpx_lco_future_new(0);
+    assert(tree->halo_ready_ != HPX_NULL);
+    tree->halo_done_ = hpx_lco_and_new(num_ranks - 1);
+    assert(tree->halo_done_ != HPX_NULL);
 
     // Call out to tree setup stuff
     hpx_addr_t setup_done = hpx_lco_and_new(2);
@@ -678,6 +915,7 @@ class DualTree {
     hpx_lco_get(domain_geometry, sizeof(double) * 6, &var);
     double length = fmax(var[1] - var[0],
                          fmax(var[3] - var[2], var[5] - var[4]));
+    length *= 1.0 + 2.0 * padding;
     DomainGeometry geo{Point{(var[1] + var[0] - length) / 2,
                              (var[3] + var[2] - length) / 2,
                              (var[5] + var[4] - length) / 2}, length};
@@ -695,6 +933,8 @@ class DualTree {
   /// This will both allocate and setup a dual tree.
   ///
   /// \param threshold - the partitioning threshold
+  /// \param partition - how the uniform level is divided among the ranks
+  /// \param padding - the padding added to each side of the domain
   /// \param domain_geometry - an LCO into which the domain is reduced
   /// \param same_sandt - is S == T for this tree
   /// \param sources - the source Array
@@ -702,6 +942,8 @@ class DualTree {
   ///
   /// \returns - the Dual Tree
   static RankWise<dualtree_t> setup_basic_data(int threshold,
+                                               TreePartition partition,
+                                               double padding,
                                                hpx_addr_t domain_geometry,
                                                bool same_sandt,
                                                Array<source_t> sources,
@@ -718,20 +960,21 @@ class DualTree {
 
     // Now the single things are created.
     int num_ranks = hpx_get_num_ranks();
-    int level = ceil(log(num_ranks) / log(8)) + 1;
+    int level = uniform_level(num_ranks, partition);
     int dim3 = pow(8, level);
     hpx_addr_t ucount = hpx_lco_reduce_new(num_ranks, sizeof(int) * (dim3 * 2),
                                            int_sum_ident_op,
                                            int_sum_op);
     hpx_addr_t rwdata = retval.data();
     int ssat = (same_sandt ? 1 : 0);
+    int part = static_cast<int>(partition);
     hpx_addr_t sgas = sources.data();
     hpx_addr_t tgas = targets.data();
     hpx_addr_t stree_addx = stree.data();
     hpx_addr_t ttree_addx = ttree.data();
-    hpx_bcast_rsync(init_partition_, &rwdata, &ucount, &threshold,
-                    &domain_geometry, &ssat, &sgas, &tgas, &stree_addx,
-                    &ttree_addx);
+    hpx_bcast_rsync(init_partition_, &rwdata, &ucount, &threshold, &part,
+                    &padding, &domain_geometry, &ssat, &sgas, &tgas,
+                    &stree_addx, &ttree_addx);
 
     return retval;
   }
@@ -755,6 +998,10 @@ class DualTree {
   /// described with three indices (ix, iy, iz). The order of each node in the
   /// input and output data is computed with: ix + iy * N  + iz * N * N.
   ///
+  /// With TreePartition::Work, the nodes are distributed by their estimated
+  /// work instead of their number of points, and rank 0 reports the estimated
+  /// imbalance of both distributions.
+  ///
   /// \param num_ranks - the number of ranks over which to distribute the nodes
   /// \param global - the source and target counts per node
   /// \param len - the number of uniform level nodes.
@@ -764,7 +1011,23 @@ class DualTree {
   ///            ownership of this array, and should destroy it when done with
   ///            the data.
   int *distribute_points(int num_ranks, const int *global, int len, int lvl) {
-    return distribute_points_hilbert(num_ranks, global, len, lvl);
+    if (partition_ == TreePartition::Points) {
+      return distribute_points_hilbert(num_ranks, global, len, lvl);
+    }
+
+    int *retval = distribute_work_hilbert(num_ranks, global, len, lvl,
+                                          refinement_limit_);
+    if (hpx_get_my_rank() == 0) {
+      std::vector<int64_t> work = estimate_work_uniform(global, len, lvl,
+                                                        refinement_limit_);
+      int *by_points = distribute_points_hilbert(num_ranks, global, len, lvl);
+      fprintf(stdout, "Evaluate: estimated work imbalance %5.3f "
+              "(%5.3f by points)\n",
+              work_imbalance(num_ranks, retval, work, len),
+              work_imbalance(num_ranks, by_points, work, len));
+      delete [] by_points;
+    }
+    return retval;
   }
 
   /// Count and sort the local points
@@ -1298,6 +1561,38 @@ class DualTree {
     return HPX_SUCCESS;
   }
 
+  /// Action to re-bin the local records of the tree
+  ///
+  /// This action is the target of a broadcast. The source tree is handled
+  /// first, as for S == T evaluations the target tree shares its records; the
+  /// target tree then only has the segments of its nodes updated.
+  ///
+  /// \param rwtree - the global address of the dual tree
+  /// \param failures - a reduction LCO counting the ranks that failed
+  ///
+  /// \returns - HPX_SUCCESS
+  static int rebin_handler(hpx_addr_t rwtree, hpx_addr_t failures) {
+    RankWise<dualtree_t> global_tree{rwtree};
+    auto tree = global_tree.here();
+    int limit = kRebinLeafFactor * tree->refinement_limit_;
+
+    bool success = tree->source_tree_.here()->rebin(&tree->domain_,
+                                                    tree->unif_level_,
+                                                    tree->dim3_,
+                                                    tree->rank_map_, limit);
+    if (success) {
+      success = tree->target_tree_.here()->rebin(&tree->domain_,
+                                                 tree->unif_level_,
+                                                 tree->dim3_,
+                                                 tree->rank_map_, limit);
+    }
+
+    int failed = success ? 0 : 1;
+    hpx_lco_set_lsync(failures, sizeof(int), &failed, HPX_NULL);
+
+    return HPX_SUCCESS;
+  }
+
   /// Action to destroy the tree
   ///
   /// This action is the target of a broadcast that is used to destroy the
@@ -1347,6 +1642,221 @@ class DualTree {
     root->dag.collect_DAG_nodes(targets, internals);
   }
 
+  // TODO: Get this out of DualTree
+  /// Fuse the small rank-local subtrees below a source tree node
+  ///
+  /// See coarsen_DAG. The fused subtrees whose parent is not fused are added
+  /// to @p roots.
+  ///
+  /// \param node - tree node
+  /// \param threshold - the largest weight of a fused subtree
+  /// \param roots [out] - the top nodes of the fused subtrees
+  ///
+  /// \returns - the weight of the subtree below @p node, if its normal node is
+  ///            fused; -1 otherwise
+  int64_t coarsen_S_node(sourcenode_t *node, int64_t threshold,
+                         std::vector<DAGNode *> &roots) {
+    int rank = hpx_get_my_rank();
+    if (home_rank(node->idx) != rank && node->idx.level() >= unif_level_) {
+      return -1;
+    }
+
+    DAGNode *normal = node->dag.normal();
+    bool fusible = (normal != nullptr && normal->locality == rank);
+    int64_t weight{0};
+    size_t n_fused{0};
+    for (int i = 0; i < 8; ++i) {
+      if (node->child[i] == nullptr) {
+        continue;
+      }
+      int64_t below = coarsen_S_node(node->child[i], threshold, roots);
+      if (below < 0) {
+        fusible = false;
+      } else {
+        weight += below;
+        ++n_fused;
+      }
+    }
+
+    // Every input must come from inside the subtree
+    if (fusible && node->is_leaf()) {
+      DAGNode *parts = node->dag.parts();
+      fusible = false;
+      if (parts != nullptr && parts->locality == rank
+          && normal->in_count() == 1) {
+        for (size_t i = 0; i < parts->out_count(); ++i) {
+          if (parts->out_target(i) == normal
+              && parts->out_edge(i).op() == Operation::StoM) {
+            weight += parts->out_edge(i).weight();
+            fusible = true;
+          }
+        }
+      }
+    } else if (fusible) {
+      fusible = (normal->in_count() == n_fused);
+    }
+
+    if (fusible) {
+      for (size_t i = 0; i < normal->out_count(); ++i) {
+        weight += normal->out_edge(i).weight();
+      }
+      fusible = (weight <= threshold);
+    }
+
+    if (!fusible) {
+      for (int i = 0; i < 8; ++i) {
+        if (node->child[i] != nullptr && node->child[i]->dag.has_normal()
+            && node->child[i]->dag.normal()->fused) {
+          roots.push_back(node->child[i]->dag.normal());
+        }
+      }
+      return -1;
+    }
+
+    normal->fused = true;
+    return weight;
+  }
+
+  // TODO: Get this out of DualTree
+  /// Exchange the halo of a partially discovered DAG
+  ///
+  /// Each node of the DAG is placed on the rank owning its tree node. The
+  /// edges into nodes owned by other ranks are removed, as those ranks
+  /// discover them as well. The edges out of nodes owned by other ranks are
+  /// sent to those ranks, which link them to halo copies of the targets. This
+  /// returns once the halo of every other rank has been added to the local
+  /// DAG.
+  ///
+  /// This must be called on every rank.
+  ///
+  /// \param dag - the nodes collected after DAG discovery
+  void exchange_DAG_halo(DAG *dag) {
+    int rank = hpx_get_my_rank();
+    int num_ranks = hpx_get_num_ranks();
+
+    std::vector<DAGNode *> *lists[4] = {&dag->source_leaves,
+                                        &dag->source_nodes,
+                                        &dag->target_nodes,
+                                        &dag->target_leaves};
+    for (auto list : lists) {
+      for (size_t i = 0; i < list->size(); ++i) {
+        DAGNode *node = (*list)[i];
+        node->locality = home_rank(node->index());
+      }
+    }
+    dag->prune_remote_edges(rank);
+
+    // Halo edges from other ranks may be linked from here on
+    hpx_lco_set(halo_ready_, 0, nullptr, HPX_NULL, HPX_NULL);
+
+    if (num_ranks == 1) {
+      hpx_lco_reset_sync(halo_ready_);
+      return;
+    }
+
+    std::vector<std::vector<DAGHaloRecord>> records(num_ranks);
+    for (auto list : lists) {
+      for (size_t i = 0; i < list->size(); ++i) {
+        DAGNode *node = (*list)[i];
+        if (node->locality == rank) {
+          continue;
+        }
+        for (size_t j = 0; j < node->out_count(); ++j) {
+          const DAGLink &link = node->out_link(j);
+          records[node->locality].push_back(
+              DAGHaloRecord{node->index(), link.target->index(),
+                            link.op, link.weight});
+        }
+      }
+    }
+
+    // Each rank is sent a message, even if empty, so that the receiver knows
+    // when it has the full halo.
+    for (int r = 0; r < num_ranks; ++r) {
+      if (r == rank) {
+        continue;
+      }
+      size_t n_records = records[r].size();
+      size_t bytes = sizeof(hpx_addr_t) + sizeof(size_t) + sizeof(int)
+                     + n_records * sizeof(DAGHaloRecord);
+      hpx_parcel_t *p = hpx_parcel_acquire(nullptr, bytes);
+      char *data = static_cast<char *>(hpx_parcel_get_data(p));
+      *reinterpret_cast<hpx_addr_t *>(data) = self_;
+      *reinterpret_cast<size_t *>(data + sizeof(hpx_addr_t)) = n_records;
+      *reinterpret_cast<int *>(data + sizeof(hpx_addr_t) + sizeof(size_t))
+          = rank;
+      if (n_records) {
+        memcpy(data + sizeof(hpx_addr_t) + sizeof(size_t) + sizeof(int),
+               records[r].data(), n_records * sizeof(DAGHaloRecord));
+      }
+      hpx_parcel_set_target(p, HPX_THERE(r));
+      hpx_parcel_set_action(p, recv_DAG_halo_);
+      hpx_parcel_send(p, HPX_NULL);
+    }
+
+    hpx_lco_wait(halo_done_);
+    // Every halo message to this rank has been linked, so the LCOs can be
+    // made ready for the next DAG built on this tree. Resetting them on entry
+    // instead could lose the message of a rank that finished discovery
+    // earlier. The next DAG is built in a later SPMD epoch, so no message for
+    // it can arrive before this point.
+    hpx_lco_reset_sync(halo_ready_);
+    hpx_lco_reset_sync(halo_done_);
+  }
+
+  // TODO: Get this out of DualTree
+  /// Action to add the halo edges sent by another rank to the local DAG
+  ///
+  /// The sources of the edges are owned by this rank, and the targets by the
+  /// sending rank. This is a marshalled action.
+  ///
+  /// \param message - the message data
+  /// \param bytes - the message size
+  ///
+  /// \returns - HPX_SUCCESS
+  static int recv_DAG_halo_handler(char *message, size_t bytes) {
+    hpx_addr_t rwaddr = *reinterpret_cast<hpx_addr_t *>(message);
+    size_t n_records
+        = *reinterpret_cast<size_t *>(message + sizeof(hpx_addr_t));
+    int sender = *reinterpret_cast<int *>(message + sizeof(hpx_addr_t)
+                                          + sizeof(size_t));
+    DAGHaloRecord *records = reinterpret_cast<DAGHaloRecord *>(
+        message + sizeof(hpx_addr_t) + sizeof(size_t) + sizeof(int));
+
+    RankWise<dualtree_t> global_tree{rwaddr};
+    auto tree = global_tree.here();
+    hpx_lco_wait(tree->halo_ready_);
+
+    auto stree = tree->source_tree_.here();
+    auto ttree = tree->target_tree_.here();
+    for (size_t i = 0; i < n_records; ++i) {
+      Operation op = records[i].op;
+      DAGInfo *src{nullptr};
+      if (DAG::operation_from_target_tree(op)) {
+        src = &ttree->lookup_node(records[i].source)->dag;
+      } else {
+        src = &stree->lookup_node(records[i].source)->dag;
+      }
+      DAGInfo *dest{nullptr};
+      if (DAG::operation_to_source_tree(op)) {
+        dest = &stree->lookup_node(records[i].target)->dag;
+      } else {
+        dest = &ttree->lookup_node(records[i].target)->dag;
+      }
+
+      DAGNode *src_node = src->edge_source(op);
+      assert(src_node != nullptr);
+      DAGNode *dest_node = dest->add_edge_target(op);
+      dest_node->locality = sender;
+      DAGInfo::link_nodes(src, src_node, dest, dest_node, op,
+                          records[i].weight);
+    }
+
+    hpx_lco_and_set(tree->halo_done_, HPX_NULL);
+
+    return HPX_SUCCESS;
+  }
+
   /// TODO: Get this out of DualTree
   /// Action to create LCOs from the DAG
   ///
@@ -1364,12 +1874,18 @@ class DualTree {
                                                   dualtree_t *tree,
                                                   sourcenode_t *node,
                                                   hpx_addr_t rwtree) {
+    if (tree->owned_elsewhere(node->idx)) {
+      hpx_lco_set(done, 0, nullptr, HPX_NULL, HPX_NULL);
+      return HPX_SUCCESS;
+    }
+
     Point n_center = tree->domain_.center_from_index(node->idx);
 
     int myrank = hpx_get_my_rank();
 
-    // create the normal expansion if needed
-    if (node->dag.has_normal() && node->dag.normal()->locality == myrank) {
+    // create the normal expansion if needed; fused nodes have none
+    if (node->dag.has_normal() && node->dag.normal()->locality == myrank
+        && !node->dag.normal()->fused) {
       expansionlco_t expand(node->dag.normal(),
                             node->idx, kSourcePrimary,
                             expansion_t::compute_scale(node->idx),
@@ -1431,6 +1947,11 @@ class DualTree {
                                                   dualtree_t *tree,
                                                   targetnode_t *node,
                                                   hpx_addr_t rwtree) {
+    if (tree->owned_elsewhere(node->idx)) {
+      hpx_lco_set(done, 0, nullptr, HPX_NULL, HPX_NULL);
+      return HPX_SUCCESS;
+    }
+
     Point n_center = tree->domain_.center_from_index(node->idx);
 
     int myrank = hpx_get_my_rank();
@@ -1496,6 +2017,12 @@ class DualTree {
   /// the DAG evaluation. This will cause the source DAG nodes to begin their
   /// out edges.
   ///
+  /// The leaves are served in order of decreasing priority. The messages for
+  /// other localities and the local S->M and S->L edges of every leaf are
+  /// served first, as the rest of the DAG waits on them. The local S->T
+  /// edges, which nothing waits on, are served after, yielding between the
+  /// leaves so that the work they made ready can run.
+  ///
   /// \param rwtree - the global address of the DualTree
   /// \param first - the first DAGNode in consideration
   /// \param last - the last DAGNode in consideration
@@ -1512,14 +2039,29 @@ class DualTree {
       manager = sarr.get_manager();
     }
 
+    std::sort(first, last, [](const DAGNode *a, const DAGNode *b) -> bool {
+      return a->priority > b->priority;
+    });
+
+    // The local S->T edges of each leaf, served once the rest is underway
+    struct Deferred {
+      Source *sources;
+      size_t n_src;
+      std::vector<DAGInstigationRecord> edges;
+    };
+    std::vector<Deferred> deferred{};
+    deferred.reserve(last - first);
+
+    // The messages for other localities are coalesced over the leaves
+    Coalescer::Scope sending{coalescer()};
+
     for (DAGNode **iter = first; iter != last; ++iter) {
       DAGNode *parts = *iter;
       sourcenode_t *node = static_cast<sourcenode_t *>(parts->tree_node());
       sourceref_t sources = node->parts;
 
       // We first sort the out edges by locality
-      std::sort(parts->out_edges.begin(), parts->out_edges.end(),
-                DAG::compare_edge_locality);
+      parts->sort_out_edges_by_locality();
 
       // Make scratch space for the sends
       size_t source_size{0};
@@ -1527,75 +2069,155 @@ class DualTree {
       for (size_t i = 0; i < sources.n(); ++i) {
         source_size += manager->size(&sref[i]);
       }
-      size_t header_size = source_size + sizeof(size_t)
-          + sizeof(hpx_addr_t);
-      size_t total_size = header_size + sizeof(size_t)
-          + parts->out_edges.size() * sizeof(DAGInstigationRecord);
-      char *scratch = new char [total_size];
+      size_t header_size = sizeof(DAGInstigationHeader) + source_size;
+      size_t edges_size = sizeof(size_t)
+          + parts->out_count() * sizeof(DAGInstigationRecord);
+      char *scratch = new char [header_size + edges_size];
 
       // Copy source data
+      DAGInstigationHeader *head
+          = reinterpret_cast<DAGInstigationHeader *>(scratch);
+      head->tree = rwtree;
+      head->leaf = node->idx;
+      head->print = 0;
+      head->n_src = sources.n();
+      head->cached = 0;
       {
-        hpx_addr_t *scratch_rw = reinterpret_cast<hpx_addr_t *>(scratch);
-        *scratch_rw = rwtree;
-
-        size_t *scratch_n = reinterpret_cast<size_t *>(scratch
-                                                       + sizeof(hpx_addr_t));
-        *scratch_n = sources.n();
-
-        char *scratch_ptr = scratch + sizeof(size_t) + sizeof(hpx_addr_t);
+        char *scratch_ptr = scratch + sizeof(DAGInstigationHeader);
         for (size_t i = 0; i < sources.n(); ++i) {
           scratch_ptr = (char *)manager->serialize(&sref[i], scratch_ptr);
         }
       }
 
+      // Ranks holding a current copy of the sources only get the edges
+      char *brief{nullptr};
+      bool printed{false};
+
+      // The edges of this locality are served once the messages for the
+      // others are on their way
       int my_rank = hpx_get_my_rank();
-      auto begin = parts->out_edges.begin();
-      auto end = parts->out_edges.end();
+      size_t local_begin{0};
+      size_t local_end{0};
+      size_t begin = 0;
+      size_t end = parts->out_count();
       while (begin != end) {
-        int curr_rank = begin->target->locality;
-        auto curr = begin;
-        while (curr != end && curr->target->locality == curr_rank) {
+        int curr_rank = parts->out_target(begin)->locality;
+        size_t curr = begin;
+        while (curr != end && parts->out_target(curr)->locality == curr_rank) {
           ++curr;
         }
 
-        //copy in edge data
-        char *edgedata = scratch + header_size;
-        size_t *edgecount = reinterpret_cast<size_t *>(edgedata);
-        *edgecount = curr - begin;
-
-        DAGInstigationRecord *edgerecords
-            = reinterpret_cast<DAGInstigationRecord *>(edgedata
-                                                        + sizeof(size_t));
-        int i = 0;
-        for (auto loop = begin; loop != curr; ++loop) {
-          edgerecords[i].op = loop->op;
-          edgerecords[i].target = loop->target->global_addx;
-          edgerecords[i].idx = loop->target->index();
-          ++i;
-        }
-
-        // Send parcel or do the work
         if (curr_rank == my_rank) {
-          instigate_dag_eval_work(sources.n(), sref, tree->domain_,
-                                  *edgecount, edgerecords);
+          local_begin = begin;
+          local_end = curr;
         } else {
-          size_t parcel_size = header_size + sizeof(size_t)
-                               + sizeof(DAGInstigationRecord) * (*edgecount);
-          hpx_parcel_t *parc = hpx_parcel_acquire(scratch, parcel_size);
-          hpx_parcel_set_action(parc, instigate_dag_eval_remote_);
-          hpx_parcel_set_target(parc, HPX_THERE(curr_rank));
-          hpx_parcel_send_sync(parc);
+          if (!printed) {
+            head->print = GhostCache<Source>::fingerprint(
+                scratch + sizeof(DAGInstigationHeader), source_size);
+            printed = true;
+          }
+
+          if (tree->ghosts_->sent(node->idx, curr_rank, head->print)) {
+            if (brief == nullptr) {
+              brief = new char [sizeof(DAGInstigationHeader) + edges_size];
+              memcpy(brief, head, sizeof(DAGInstigationHeader));
+              reinterpret_cast<DAGInstigationHeader *>(brief)->cached = 1;
+            }
+            size_t edgecount = write_instigation_records(
+                parts, begin, curr, brief + sizeof(DAGInstigationHeader));
+            size_t parcel_size = sizeof(DAGInstigationHeader) + sizeof(size_t)
+                                 + sizeof(DAGInstigationRecord) * edgecount;
+            coalescer().send(curr_rank, instigate_dag_eval_remote_, brief,
+                             parcel_size);
+          } else {
+            size_t edgecount = write_instigation_records(
+                parts, begin, curr, scratch + header_size);
+            size_t parcel_size = header_size + sizeof(size_t)
+                                 + sizeof(DAGInstigationRecord) * edgecount;
+            coalescer().send(curr_rank, instigate_dag_eval_remote_, scratch,
+                             parcel_size);
+          }
         }
 
         begin = curr;
       }
 
+      if (local_begin != local_end) {
+        char *edgedata = scratch + header_size;
+        size_t edgecount = write_instigation_records(parts, local_begin,
+                                                     local_end, edgedata);
+        DAGInstigationRecord *edgerecords
+            = reinterpret_cast<DAGInstigationRecord *>(edgedata
+                                                        + sizeof(size_t));
+        DAGInstigationRecord *direct = std::stable_partition(
+            edgerecords, edgerecords + edgecount,
+            [](const DAGInstigationRecord &rec) -> bool {
+              return rec.op != Operation::StoT;
+            });
+        instigate_dag_eval_work(sources.n(), sref, tree->domain_,
+                                direct - edgerecords, edgerecords);
+        if (direct != edgerecords + edgecount) {
+          deferred.push_back(Deferred{sref, sources.n(),
+              std::vector<DAGInstigationRecord>(direct,
+                                                edgerecords + edgecount)});
+        }
+      }
+
       delete [] scratch;
+      delete [] brief;
+
+      // The local work may be long, so let waiting messages go
+      coalescer().poll();
+    }
+
+    // Every message is on its way before the near field work begins
+    coalescer().flush();
+
+    for (size_t i = 0; i < deferred.size(); ++i) {
+      instigate_dag_eval_work(deferred[i].n_src, deferred[i].sources,
+                              tree->domain_, deferred[i].edges.size(),
+                              deferred[i].edges.data());
+      hpx_thread_yield();
     }
 
     return HPX_SUCCESS;
   }
 
+  // TODO: Get this out of DualTree
+  /// Write the records of some out edges of a source leaf
+  ///
+  /// The records are written after their count, in the form expected by
+  /// instigate_dag_eval_remote_handler. The edges to fused nodes are left to
+  /// the task computing the fused subtree, and are not written.
+  ///
+  /// \param parts - the DAG node of the source leaf
+  /// \param begin - the first out edge to write
+  /// \param end - one past the last out edge to write
+  /// \param edgedata - the destination of the count and the records
+  ///
+  /// \returns - the number of records written
+  static size_t write_instigation_records(DAGNode *parts, size_t begin,
+                                          size_t end, char *edgedata) {
+    size_t *edgecount = reinterpret_cast<size_t *>(edgedata);
+
+    DAGInstigationRecord *edgerecords
+        = reinterpret_cast<DAGInstigationRecord *>(edgedata + sizeof(size_t));
+    int i = 0;
+    for (size_t loop = begin; loop != end; ++loop) {
+      DAGNode *target = parts->out_target(loop);
+      if (target->fused) {
+        continue;
+      }
+      edgerecords[i].op = parts->out_edge(loop).op();
+      edgerecords[i].target = target->global_addx;
+      edgerecords[i].idx = target->index();
+      ++i;
+    }
+    *edgecount = i;
+
+    return *edgecount;
+  }
+
   // TODO: Get this out of DualTree
   /// Action on remote side for DAG instigation
   ///
@@ -1604,26 +2226,37 @@ class DualTree {
   /// each locality. This action handles the fan out once the data reaches
   /// the target locality.
   ///
+  /// The received sources are kept in the GhostCache of the tree. When a
+  /// later evaluation finds the sources of the leaf unchanged, the message
+  /// carries only the edges, and the cached sources are used.
+  ///
   /// \param message - the message data
   /// \param bytes - the message size
   ///
   /// \returns - HPX_SUCCESS
   static int instigate_dag_eval_remote_handler(char *message, size_t bytes) {
     // unpack message into arguments to the local work function
-    hpx_addr_t tree_addx = *(reinterpret_cast<hpx_addr_t *>(message));
-    RankWise<dualtree_t> global_tree{tree_addx};
+    DAGInstigationHeader *head
+        = reinterpret_cast<DAGInstigationHeader *>(message);
+    RankWise<dualtree_t> global_tree{head->tree};
     auto local_tree = global_tree.here();
 
-    size_t n_src = *(reinterpret_cast<size_t *>(message + sizeof(hpx_addr_t)));
-
-    Source *sources = new Source[n_src];
-    char *msg_ptr = message + sizeof(size_t) + sizeof(hpx_addr_t);
-    {
+    size_t n_src = head->n_src;
+    Source *sources{nullptr};
+    char *msg_ptr = message + sizeof(DAGInstigationHeader);
+    if (head->cached) {
+      sources = local_tree->ghosts_->find(head->leaf, head->print);
+      assert(sources != nullptr);
+    } else {
+      std::unique_ptr<Source[]> received{new Source[n_src]};
       Array<Source> sarr{local_tree->source_gas};
       Serializer *manager = sarr.get_manager();
       for (size_t i = 0; i < n_src; ++i) {
-        msg_ptr = (char *)manager->deserialize(msg_ptr, &sources[i]);
+        msg_ptr = (char *)manager->deserialize(msg_ptr, &received[i]);
       }
+      // The sources are kept for the later evaluations with this tree
+      sources = local_tree->ghosts_->store(head->leaf, head->print,
+                                           std::move(received));
     }
 
     size_t n_edges = *(reinterpret_cast<size_t *>(msg_ptr));
@@ -1642,8 +2275,6 @@ class DualTree {
     instigate_dag_eval_work(n_src, sources, local_tree->domain_,
                             n_edges, edges);
 
-    delete [] sources;
-
     return HPX_SUCCESS;
   }
 
@@ -1703,6 +2334,75 @@ class DualTree {
     }
   }
 
+  // TODO: Get this out of DualTree
+  /// Action computing a fused subtree of the upward pass
+  ///
+  /// See coarsen_DAG.
+  ///
+  /// \param tree - the DualTree
+  /// \param top - the top node of the fused subtree
+  /// \param rwtree - the global address of the DualTree
+  ///
+  /// \returns - HPX_SUCCESS
+  static int fused_upward_handler(dualtree_t *tree, DAGNode *top,
+                                  hpx_addr_t rwtree) {
+    sourcenode_t *node = static_cast<sourcenode_t *>(top->tree_node());
+    fused_upward(tree, node, rwtree);
+    return HPX_SUCCESS;
+  }
+
+  // TODO: Get this out of DualTree
+  /// Compute the expansions of a fused subtree
+  ///
+  /// The expansion of each node is formed from its sources, or from the
+  /// expansions of its children, and its out edges are served before it is
+  /// returned to the parent.
+  ///
+  /// \param tree - the DualTree
+  /// \param node - the top node of the fused subtree
+  /// \param rwtree - the global address of the DualTree
+  ///
+  /// \returns - the expansion of @p node
+  static std::unique_ptr<expansion_t> fused_upward(dualtree_t *tree,
+                                                   sourcenode_t *node,
+                                                   hpx_addr_t rwtree) {
+    CostModel &costs = cost_model<Source, Target, Expansion, Method>();
+    double scale = expansion_t::compute_scale(node->idx);
+    Point center = tree->domain_.center_from_index(node->idx);
+
+    std::unique_ptr<expansion_t> retval{nullptr};
+    if (node->is_leaf()) {
+      EVENT_TRACE_DASHMM_STOM_BEGIN();
+      ViewSet views{kNoRoleNeeded, center, scale};
+      expansion_t local{views};
+      sourceref_t sources = node->parts;
+      CostModel::Timer timer{costs};
+      retval = local.S_to_M(sources.data(), sources.data() + sources.n());
+      timer.stop(Operation::StoM, sources.n());
+      EVENT_TRACE_DASHMM_STOM_END();
+    } else {
+      retval.reset(new expansion_t{kSourcePrimary, scale, center});
+      for (int i = 0; i < 8; ++i) {
+        sourcenode_t *child = node->child[i];
+        if (child == nullptr || !child->dag.has_normal()
+            || !child->dag.normal()->fused) {
+          continue;
+        }
+        auto below = fused_upward(tree, child, rwtree);
+        EVENT_TRACE_DASHMM_MTOM_BEGIN();
+        CostModel::Timer timer{costs};
+        auto translated = below->M_to_M(child->idx.which_child());
+        timer.stop(Operation::MtoM, 1);
+        retval->add_expansion(translated.get());
+        EVENT_TRACE_DASHMM_MTOM_END();
+      }
+    }
+
+    expansionlco_t::serve_fused(node->dag.normal(), node->idx, center, scale,
+                                rwtree, retval.get());
+    return retval;
+  }
+
   // TODO: Get this out of DualTree
   /// Action to apply Method::aggregate
   ///
@@ -1717,7 +2417,10 @@ class DualTree {
   static int source_apply_method_child_done_handler(dualtree_t *tree,
                                                     sourcenode_t *node,
                                                     hpx_addr_t done) {
-    tree->method_.aggregate(node, &tree->domain_);
+    // In a partial DAG, only rank 0 aggregates above the uniform level
+    if (!partial_DAG() || tree->home_rank(node->idx) == hpx_get_my_rank()) {
+      tree->method_.aggregate(node, &tree->domain_);
+    }
     int loc{0};
     if (node->idx.level() >= tree->unif_level_) {
       int dag_idx = sourcetree_t::get_unif_grid_index(node->idx,
@@ -1745,6 +2448,11 @@ class DualTree {
   static int source_apply_method_handler(dualtree_t *tree,
                                          sourcenode_t *node,
                                          hpx_addr_t done) {
+    if (tree->owned_elsewhere(node->idx)) {
+      hpx_lco_and_set(done, HPX_NULL);
+      return HPX_SUCCESS;
+    }
+
     int n_children = node->n_children();
     if (n_children == 0) {
       tree->method_.generate(node, &tree->domain_);
@@ -1800,6 +2508,12 @@ class DualTree {
                                          std::vector<sourcenode_t *> *consider,
                                          int same_sandt,
                                          hpx_addr_t done) {
+    if (tree->owned_elsewhere(node->idx)) {
+      delete consider;
+      hpx_lco_set_lsync(done, 0, nullptr, HPX_NULL);
+      return HPX_SUCCESS;
+    }
+
     bool refine = false;
     if (node->idx.level() < tree->unif_level_) {
       refine = true;
@@ -1899,9 +2613,10 @@ class DualTree {
       }
     }
 
+    // Fused nodes have no LCO, and are done once their out edges are served
     for (size_t i = 0; i < n_sint; ++i) {
       assert((*sint)[i] != nullptr);
-      if ((*sint)[i]->locality == myrank) {
+      if ((*sint)[i]->locality == myrank && !(*sint)[i]->fused) {
         assert((*sint)[i]->global_addx != HPX_NULL);
         hpx_call_when((*sint)[i]->global_addx, done, hpx_lco_set_action,
                       HPX_NULL, nullptr, 0);
@@ -1928,7 +2643,7 @@ class DualTree {
                                       int type) {
     int myrank = hpx_get_my_rank();
     for (size_t i = 0; i < n_nodes; ++i) {
-      if (nodes[i]->locality == myrank) {
+      if (nodes[i]->locality == myrank && !nodes[i]->fused) {
         assert(nodes[i]->global_addx != HPX_NULL);
         if (type) {
           // NOTE: destroy() does not care about the second argument to the
@@ -1951,12 +2666,17 @@ class DualTree {
 
   DomainGeometry domain_;     /// domain size
   int refinement_limit_;      /// refinement threshold
+  TreePartition partition_;   /// how the uniform level is divided
   int unif_level_;            /// level of uniform partition
   int dim3_;                  /// number of uniform nodes
   int same_sandt_;            /// Made from the same sources and targets
   hpx_addr_t unif_count_;     /// LCO reducing the uniform counts
   int *unif_count_value_;     /// local data storing the uniform counts
   int *rank_map_;             /// map unif grid index to rank
+  GhostCache<Source> *ghosts_; /// source leaves sent to and from other ranks
+  hpx_addr_t self_;           /// the global address of the dual tree
+  hpx_addr_t halo_ready_;     /// set once the local DAG accepts halo edges
+  hpx_addr_t halo_done_;      /// set once the DAG halo of each rank arrived
   method_t method_;           /// method used during DAG discovery
 
   RankWise<sourcetree_t> source_tree_;
@@ -1974,6 +2694,7 @@ class DualTree {
   static hpx_action_t send_points_;
   static hpx_action_t create_dual_tree_;
   static hpx_action_t finalize_partition_;
+  static hpx_action_t rebin_;
   static hpx_action_t source_apply_method_;
   static hpx_action_t source_apply_method_child_done_;
   static hpx_action_t target_apply_method_;
@@ -1983,6 +2704,8 @@ class DualTree {
   static hpx_action_t create_T_expansions_from_DAG_;
   static hpx_action_t instigate_dag_eval_;
   static hpx_action_t instigate_dag_eval_remote_;
+  static hpx_action_t fused_upward_;
+  static hpx_action_t recv_DAG_halo_;
 };
 
 template <typename S, typename T,
@@ -2033,6 +2756,12 @@ template <typename S, typename T,
                     template <typename, typename> class> class M>
 hpx_action_t DualTree<S, T, E, M>::finalize_partition_ = HPX_ACTION_NULL;
 
+template <typename S, typename T,
+          template <typename, typename> class E,
+          template <typename, typename,
+                    template <typename, typename> class> class M>
+hpx_action_t DualTree<S, T, E, M>::rebin_ = HPX_ACTION_NULL;
+
 template <typename S, typename T,
           template <typename, typename> class E,
           template <typename, typename,
@@ -2084,6 +2813,12 @@ template <typename S, typename T,
                     template <typename, typename> class> class M>
 hpx_action_t DualTree<S, T, E, M>::instigate_dag_eval_ = HPX_ACTION_NULL;
 
+template <typename S, typename T,
+          template <typename, typename> class E,
+          template <typename, typename,
+                    template <typename, typename> class> class M>
+hpx_action_t DualTree<S, T, E, M>::fused_upward_ = HPX_ACTION_NULL;
+
 template <typename S, typename T,
           template <typename, typename> class E,
           template <typename, typename,
@@ -2091,6 +2826,12 @@ template <typename S, typename T,
 hpx_action_t DualTree<S, T, E, M>::instigate_dag_eval_remote_ =
     HPX_ACTION_NULL;
 
+template <typename S, typename T,
+          template <typename, typename> class E,
+          template <typename, typename,
+                    template <typename, typename> class> class M>
+hpx_action_t DualTree<S, T, E, M>::recv_DAG_halo_ = HPX_ACTION_NULL;
+
 
 } // dashmm
 
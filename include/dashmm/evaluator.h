@@ -27,7 +27,10 @@
 #include <libhpx/libhpx.h>
 
 #include "dashmm/array.h"
+#include "dashmm/arrayforeachaction.h"
 #include "dashmm/arrayref.h"
+#include "dashmm/bulkexecutor.h"
+#include "dashmm/costmodel.h"
 #include "dashmm/defaultpolicy.h"
 #include "dashmm/domaingeometry.h"
 #include "dashmm/dualtree.h"
@@ -36,6 +39,7 @@
 #include "dashmm/rankwise.h"
 #include "dashmm/registrar.h"
 #include "dashmm/targetlco.h"
+#include "dashmm/viewpool.h"
 
 
 namespace dashmm {
@@ -85,23 +89,45 @@ class Evaluator {
   using dualtree_t = DualTree<Source, Target, Expansion, Method>;
   using distropolicy_t = typename method_t::distropolicy_t;
 
+  /// The state of a prepared evaluation
+  ///
+  /// This holds the tree and the DAG of an evaluation, so that the
+  /// evaluation can be repeated for updated source data without creating
+  /// either of them again. See prepare(), reevaluate() and finish().
+  struct Prepared {
+    Array<source_t> sources;      /// the sources of the evaluation
+    Array<target_t> targets;      /// the targets of the evaluation
+    DualTreeHandle tree{HPX_NULL};
+    std::unique_ptr<DAG> dag{};
+    bool executed{false};         /// has the DAG been executed since reset
+
+    // The parameters given to prepare(), needed if update() has to rebuild
+    int refinement_limit{1};
+    method_t method{};
+    int n_digits{0};
+    std::vector<double> kernelparams{};
+    distropolicy_t distro{};
+  };
+
   /// The constuctor takes care of all action registration that DASHMM needs
   /// for one particular combination of Source, Target, Expansion and Method.
   /// Much of the registration occurs via Registrar objects, of which Evaluator
   /// had a number. Finally, a few Evaluator specific actions are registered
   /// in this constructor.
   Evaluator() : tlcoreg_{}, elcoreg_{}, snodereg_{}, tnodereg_{},
-                streereg_{}, ttreereg_{}, dtreereg_{} {
+                streereg_{}, ttreereg_{}, dtreereg_{}, bulkreg_{},
+                tree_partition_{TreePartition::Points}, coarsening_{0},
+                executor_{Executor::Dataflow} {
     HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
                         create_tree_, create_tree_handler,
-                        HPX_ADDR, HPX_ADDR, HPX_INT);
+                        HPX_ADDR, HPX_ADDR, HPX_INT, HPX_INT, HPX_DOUBLE);
     HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
                         create_DAG_, create_DAG_handler,
                         HPX_ADDR, HPX_INT, HPX_POINTER,
-                        HPX_POINTER, HPX_POINTER);
+                        HPX_POINTER, HPX_POINTER, HPX_ADDR, HPX_INT);
     HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
                         execute_DAG_, execute_DAG_handler,
-                        HPX_ADDR, HPX_POINTER);
+                        HPX_ADDR, HPX_POINTER, HPX_INT);
     HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
                         reset_DAG_, reset_DAG_handler,
                         HPX_POINTER);
@@ -111,12 +137,21 @@ class Evaluator {
     HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
                         destroy_tree_, destroy_tree_handler,
                         HPX_ADDR);
+    HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
+                        rebin_tree_, rebin_tree_handler,
+                        HPX_ADDR);
+    HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
+                        retarget_DAG_, retarget_DAG_handler,
+                        HPX_POINTER);
     HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
                         reset_expansion_LCOs_, reset_expansion_LCOs_handler,
                         HPX_POINTER, HPX_POINTER);
     HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
                         reset_target_LCOs_, reset_target_LCOs_handler,
                         HPX_POINTER, HPX_POINTER);
+    HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
+                        retarget_target_LCOs_, retarget_target_LCOs_handler,
+                        HPX_POINTER, HPX_POINTER);
   }
 
   /// Create a DualTree
@@ -127,23 +162,129 @@ class Evaluator {
   /// by DASHMM that can be referred to by the returned handle. To destroy
   /// the tree resulting from this method, see destroy_tree() below.
   ///
+  /// The uniform level of the tree is divided among the ranks as selected
+  /// with set_tree_partition().
+  ///
   /// \param sources - the Array of source data
   /// \param targets - the Array of target data
   /// \param refinement_limit - the refinement limit of the tree
+  /// \param padding - the fraction of the side of the bounding cube of the
+  ///                  records added to each side of the domain
   ///
   /// \returns - a handle to the DualTree
   DualTreeHandle create_tree(const Array<source_t> &sources,
                              const Array<target_t> &targets,
-                             int refinement_limit) {
+                             int refinement_limit,
+                             double padding = 0.0) {
     hpx_addr_t sources_addr{sources.data()};
     hpx_addr_t targets_addr{targets.data()};
     hpx_addr_t rwaddr{HPX_NULL};
+    int partition = static_cast<int>(tree_partition_);
     hpx_run(&create_tree_, &rwaddr, &sources_addr, &targets_addr,
-            &refinement_limit);
+            &refinement_limit, &partition, &padding);
 
     return rwaddr;
   }
 
+  /// Select how the trees created later are divided among the ranks
+  ///
+  /// By default, each rank receives an equal number of points. With
+  /// TreePartition::Work, each rank instead receives an equal share of the
+  /// work estimated from the number of points in each part of the domain,
+  /// which is divided more finely for this purpose. This balances clustered
+  /// distributions better, where the work of a point depends on its
+  /// neighborhood. This applies to create_tree(), and so also to evaluate()
+  /// and prepare(). It should be set the same on every rank.
+  ///
+  /// \param partition - how to divide the trees
+  void set_tree_partition(TreePartition partition) {
+    tree_partition_ = partition;
+  }
+
+  /// Select how the contributions to the targets are accumulated
+  ///
+  /// By default, the contributions to the targets of a leaf are applied one
+  /// at a time under the lock of the leaf's TargetLCO. With
+  /// TargetAccumulation::Concurrent, each worker applies its contributions to
+  /// its own copy of the targets outside of the lock, and the copies are
+  /// added to the targets once the last contribution arrives. This removes
+  /// the serialization on leaves with many neighbors, at the cost of some
+  /// memory. Selecting it requires the Expansion to provide clear_targets()
+  /// and add_targets(), which is checked at compile time. The order in which
+  /// contributions are summed changes, so the results may differ in the last
+  /// bits between the two modes.
+  ///
+  /// This applies to the DAGs created afterwards, by create_DAG(), evaluate()
+  /// or prepare(). It should be set the same on every rank.
+  ///
+  /// \tparam mode - the accumulation mode
+  template <TargetAccumulation mode>
+  void set_target_accumulation() {
+    targetlco_t::template set_accumulation<mode>();
+  }
+
+  /// Fuse the small rank-local subtrees of the upward pass
+  ///
+  /// Each node of the DAG is normally served by its own LCO. Near the leaves
+  /// of the source tree, the S->M and M->M work of a node can be smaller than
+  /// the cost of the LCO. With a positive @p threshold, each largest subtree
+  /// of the source tree that is held by a single rank, and whose DAG edges
+  /// weigh at most @p threshold in total, is computed by a single task,
+  /// without LCOs for its nodes. The weights are those of the DAG edges, so
+  /// either the estimates given by the Expansion, or the measured costs (see
+  /// measure_costs()).
+  ///
+  /// This is disabled by default, and applies to the DAGs created afterwards.
+  /// It should be set the same on every rank.
+  ///
+  /// \param threshold - the largest weight of a fused subtree
+  void set_DAG_coarsening(int threshold) {
+    coarsening_ = threshold;
+  }
+
+  /// Select how the DAG is executed
+  ///
+  /// By default, each node of the DAG is computed by its LCO once all of its
+  /// inputs have arrived. With Executor::Bulk, the DAG is instead computed
+  /// one stage at a time, from the sources to the targets, with a parallel
+  /// loop over the nodes of each stage (see BulkExecutor). This avoids the
+  /// overhead of the LCOs, at the cost of waiting for the slowest node of
+  /// each stage. The bulk executor needs the whole DAG at one rank, and so
+  /// the dataflow executor is used whenever there is more than one rank.
+  ///
+  /// This applies to the executions that follow, and the same DAG may be
+  /// executed either way. It should be set the same on every rank.
+  ///
+  /// \param executor - the executor to use
+  void set_executor(Executor executor) {
+    executor_ = executor;
+  }
+
+  /// Weight the DAG with measured operation costs
+  ///
+  /// When enabled, the operations of each evaluation are timed. Each later
+  /// creation of a DAG combines the measurements so far from every rank into
+  /// a CostModel, and uses it for the weights of the DAG edges in place of
+  /// the estimates given by the Expansion. The distribution policy then sees
+  /// the measured costs.
+  ///
+  /// Only the placement of policies that read the edge weights follows the
+  /// measurements. PartitionDistro balances the measured work between the
+  /// ranks. BHDistro and FMM97Distro only use the weights to place the nodes
+  /// not fixed by the tree close to their heaviest consumers, which does not
+  /// balance the work. BHPartialDistro, FMM97PartialDistro, RandomDistro and
+  /// SingleLocality ignore the weights. The measured weights also set the
+  /// execution priorities, and the subtrees fused by set_DAG_coarsening(),
+  /// whatever the policy.
+  ///
+  /// This is disabled by default. As with the other calls of the Evaluator,
+  /// this should be called on every rank.
+  ///
+  /// \param measure - whether to measure the operations
+  void measure_costs(bool measure) {
+    cost_model<Source, Target, Expansion, Method>().set_measuring(measure);
+  }
+
   /// Create the DAG given a tree
   ///
   /// This will create both the explicit and implicit DAG given the tree and
@@ -170,9 +311,17 @@ class Evaluator {
                                   const method_t *method,
                                   distropolicy_t distro = distropolicy_t{}) {
     const distropolicy_t *distro_ptr{&distro};
+    hpx_addr_t costs{HPX_NULL};
+    if (cost_model<Source, Target, Expansion, Method>().measuring()) {
+      hpx_run(&cost_reducer_new_action, &costs);
+    }
     DAG *dag{nullptr};
+    int coarsening = coarsening_;
     hpx_run_spmd(&create_DAG_, &dag, &tree, &n_digits, &kernel_params,
-                 &method, &distro_ptr);
+                 &method, &distro_ptr, &costs, &coarsening);
+    if (costs != HPX_NULL) {
+      hpx_run(&cost_reducer_delete_action, nullptr, &costs);
+    }
     return std::unique_ptr<DAG>{dag};
   }
 
@@ -196,7 +345,9 @@ class Evaluator {
   ///            runtime.
   ReturnCode execute_DAG(DualTreeHandle tree,
                          DAG *dag) {
-    if (HPX_SUCCESS == hpx_run_spmd(&execute_DAG_, nullptr, &tree, &dag)) {
+    int executor = static_cast<int>(executor_);
+    if (HPX_SUCCESS == hpx_run_spmd(&execute_DAG_, nullptr, &tree, &dag,
+                                    &executor)) {
       return kSuccess;
     } else {
       return kRuntimeError;
@@ -208,7 +359,8 @@ class Evaluator {
   /// This will allow the given DAG to be reused for iterative methods.
   /// This will typically require a change in source data to be effective,
   /// but not in the positions of the sources. In the latter case, a new
-  /// tree would be called for.
+  /// tree would be called for. The expansion and target LCOs of the DAG are
+  /// all reset concurrently. See also prepare() and reevaluate().
   ///
   /// \param dag - the DAG to reset
   ///
@@ -257,6 +409,213 @@ class Evaluator {
     }
   }
 
+  /// Prepare an evaluation for repeated use
+  ///
+  /// This creates the tree and the DAG for the given sources and targets,
+  /// taking the same arguments as evaluate(). The evaluation itself is
+  /// performed by reevaluate(), which can be called any number of times. This
+  /// suits iterative methods that apply the same geometry many times with
+  /// different source strengths. When the prepared evaluation is no longer
+  /// needed, it should be released with finish().
+  ///
+  /// As with evaluate(), the source and target Arrays are likely to be
+  /// reordered by this call. The domain of the tree is padded on each side by
+  /// kRebinDomainPadding, so that records near its boundary can move outward
+  /// without forcing update() to rebuild the tree.
+  ///
+  /// \param sources - a DASHMM Array of the source points
+  /// \param targets - a DASHMM Array of the target points
+  /// \param refinement_limit - the domain refinement limit
+  /// \param method - a prototype of the method to use.
+  /// \param n_digits - the number of digits of accuracy required
+  /// \param kernelparams - the parameters needed by the kernel
+  /// \param prepared [out] - the prepared evaluation
+  /// \param distro - an instance of the distribution policy to use for this
+  ///                 execution.
+  ///
+  /// \returns - kSuccess on success; kRuntimeError if there is an error with
+  ///            the runtime.
+  ReturnCode prepare(const Array<source_t> &sources,
+                     const Array<target_t> &targets,
+                     int refinement_limit,
+                     const method_t *method,
+                     int n_digits,
+                     const std::vector<double> *kernelparams,
+                     Prepared &prepared,
+                     distropolicy_t distro = distropolicy_t{}) {
+    prepared.sources = sources;
+    prepared.targets = targets;
+    prepared.refinement_limit = refinement_limit;
+    prepared.method = *method;
+    prepared.n_digits = n_digits;
+    prepared.kernelparams = *kernelparams;
+    prepared.distro = distro;
+    prepared.tree = create_tree(sources, targets, refinement_limit,
+                                kRebinDomainPadding);
+    if (prepared.tree == HPX_NULL) {
+      return kRuntimeError;
+    }
+    prepared.dag = create_DAG(prepared.tree, n_digits, kernelparams,
+                              method, distro);
+    prepared.executed = false;
+    return kSuccess;
+  }
+
+  /// Perform a prepared evaluation
+  ///
+  /// This evaluates the DAG of a prepared evaluation using the current
+  /// contents of the source Array. If the DAG has already been executed, its
+  /// LCOs are reset first. The tree is not rebuilt, so if the source or target
+  /// positions have changed since prepare() was called, update() must be
+  /// called first; other source data, such as the charges, may be freely
+  /// modified in place.
+  ///
+  /// The results are added to the target records, as with evaluate(). If the
+  /// targets should receive only the results of this evaluation, the relevant
+  /// members of the target records should be cleared beforehand.
+  ///
+  /// The source leaves sent to other ranks for the direct interactions are
+  /// kept by those ranks. Leaves whose records have not changed since the
+  /// last evaluation are not sent again.
+  ///
+  /// \param prepared - the prepared evaluation
+  ///
+  /// \returns - kSuccess on success; kRuntimeError if there is an error with
+  ///            the runtime.
+  ReturnCode reevaluate(Prepared &prepared) {
+    assert(prepared.dag != nullptr);
+    if (prepared.executed) {
+      if (kRuntimeError == reset_DAG(prepared.dag.get())) {
+        return kRuntimeError;
+      }
+      prepared.executed = false;
+    }
+    if (kRuntimeError == execute_DAG(prepared.tree, prepared.dag.get())) {
+      return kRuntimeError;
+    }
+    prepared.executed = true;
+    return kSuccess;
+  }
+
+  /// Update the sources and perform a prepared evaluation
+  ///
+  /// This first applies @p update to the records of the source Array, and
+  /// then performs the evaluation as reevaluate() above. The update is
+  /// applied to the source records in place, so the tree leaves see the new
+  /// data without being rebuilt. The update must not change the positions of
+  /// the sources; for that, see update().
+  ///
+  /// \param prepared - the prepared evaluation
+  /// \param update - the action that updates the source records
+  /// \param env - the environment passed to @p update
+  ///
+  /// \returns - kSuccess on success; kRuntimeError if there is an error with
+  ///            the runtime.
+  template <typename E, int F>
+  ReturnCode reevaluate(Prepared &prepared,
+                        const ArrayForEachAction<source_t, E, F> &update,
+                        const E *env) {
+    prepared.sources.forEach(update, env);
+    return reevaluate(prepared);
+  }
+
+  /// Update a prepared evaluation after the records have moved
+  ///
+  /// When the positions of the sources or targets have changed, this brings
+  /// the tree of the prepared evaluation up to date. Where possible, each
+  /// rank only moves its records among the existing leaves of all the
+  /// branches it owns, in which case the DAG and its LCOs are kept and the
+  /// next reevaluate() uses them as they are. If the structure of the tree
+  /// would need to change, because records have moved out of the padded
+  /// domain, into a uniform level node owned by another rank, into a part of
+  /// the domain with no leaf, or have overcrowded a leaf, the tree and DAG are
+  /// instead rebuilt with the parameters given to prepare().
+  ///
+  /// For slowly moving records, as in a time stepping code, most updates are
+  /// expected to take the former route; records only force a rebuild by
+  /// crossing to another rank or out of the padding around the domain.
+  ///
+  /// \param prepared - the prepared evaluation
+  ///
+  /// \returns - kSuccess on success; kRuntimeError if there is an error with
+  ///            the runtime.
+  ReturnCode update(Prepared &prepared) {
+    assert(prepared.tree != HPX_NULL);
+    int rebinned{0};
+    if (HPX_SUCCESS != hpx_run(&rebin_tree_, &rebinned, &prepared.tree)) {
+      return kRuntimeError;
+    }
+    if (rebinned) {
+      // Otherwise the next reset will bring the target LCOs up to date
+      if (!prepared.executed) {
+        DAG *dag = prepared.dag.get();
+        if (HPX_SUCCESS != hpx_run_spmd(&retarget_DAG_, nullptr, &dag)) {
+          return kRuntimeError;
+        }
+      }
+      return kSuccess;
+    }
+
+    fprintf(stdout, "Evaluate: records left the tree structure; rebuilding\n");
+    Array<source_t> sources = prepared.sources;
+    Array<target_t> targets = prepared.targets;
+    int refinement_limit = prepared.refinement_limit;
+    method_t method = prepared.method;
+    int n_digits = prepared.n_digits;
+    std::vector<double> kernelparams = prepared.kernelparams;
+    distropolicy_t distro = prepared.distro;
+    if (kRuntimeError == finish(prepared)) {
+      return kRuntimeError;
+    }
+    return prepare(sources, targets, refinement_limit, &method, n_digits,
+                   &kernelparams, prepared, distro);
+  }
+
+  /// Move the sources and update a prepared evaluation
+  ///
+  /// This first applies @p move to the records of the source Array, and then
+  /// updates the prepared evaluation as update() above. For S == T
+  /// evaluations, this moves the targets as well.
+  ///
+  /// \param prepared - the prepared evaluation
+  /// \param move - the action that updates the source records
+  /// \param env - the environment passed to @p move
+  ///
+  /// \returns - kSuccess on success; kRuntimeError if there is an error with
+  ///            the runtime.
+  template <typename E, int F>
+  ReturnCode update(Prepared &prepared,
+                    const ArrayForEachAction<source_t, E, F> &move,
+                    const E *env) {
+    prepared.sources.forEach(move, env);
+    return update(prepared);
+  }
+
+  /// Release a prepared evaluation
+  ///
+  /// This destroys the DAG and the tree of the prepared evaluation.
+  ///
+  /// \param prepared - the prepared evaluation
+  ///
+  /// \returns - kSuccess on success; kRuntimeError if there is an error with
+  ///            the runtime.
+  ReturnCode finish(Prepared &prepared) {
+    if (prepared.dag != nullptr) {
+      if (kRuntimeError == destroy_DAG(prepared.tree,
+                                       std::move(prepared.dag))) {
+        return kRuntimeError;
+      }
+    }
+    if (prepared.tree != HPX_NULL) {
+      if (kRuntimeError == destroy_tree(prepared.tree)) {
+        return kRuntimeError;
+      }
+      prepared.tree = HPX_NULL;
+    }
+    prepared.executed = false;
+    return kSuccess;
+  }
+
   /// Perform a multipole moment evaluation
   ///
   /// Given source, targets, a refinement_limit, a method, the accuracy
@@ -336,6 +695,16 @@ class Evaluator {
   DualTreeRegistrar<Source, Target, Expansion, Method> dtreereg_;
   ArrayRegistrar<Source> sarrreg_;
   ArrayRegistrar<Target> tarrreg_;
+  BulkExecutorRegistrar<Source, Target, Expansion, Method> bulkreg_;
+
+  /// How the trees are divided among the ranks
+  TreePartition tree_partition_;
+
+  /// The largest weight of a fused subtree of the DAG
+  int coarsening_;
+
+  /// How the DAG is executed
+  Executor executor_;
 
   // The actions for evaluate
   static hpx_action_t create_tree_;
@@ -344,19 +713,24 @@ class Evaluator {
   static hpx_action_t reset_DAG_;
   static hpx_action_t destroy_DAG_;
   static hpx_action_t destroy_tree_;
+  static hpx_action_t rebin_tree_;
+  static hpx_action_t retarget_DAG_;
   static hpx_action_t reset_expansion_LCOs_;
   static hpx_action_t reset_target_LCOs_;
+  static hpx_action_t retarget_target_LCOs_;
 
   static int create_tree_handler(hpx_addr_t sources_addr,
                                  hpx_addr_t targets_addr,
-                                 int refinement_limit) {
+                                 int refinement_limit,
+                                 int partition,
+                                 double padding) {
     Array<source_t> sources{sources_addr};
     Array<target_t> targets{targets_addr};
 
     hpx_time_t creation_begin = hpx_time_now();
-    RankWise<dualtree_t> global_tree = dualtree_t::create(refinement_limit,
-                                                          sources,
-                                                          targets);
+    RankWise<dualtree_t> global_tree =
+        dualtree_t::create(refinement_limit, sources, targets,
+                           static_cast<TreePartition>(partition), padding);
 
     hpx_addr_t partitiondone = dualtree_t::partition(global_tree);
     hpx_lco_wait(partitiondone);
@@ -373,7 +747,9 @@ class Evaluator {
                                 int n_digits,
                                 const std::vector<double> *kernel_params,
                                 const method_t *method_ptr,
-                                const distropolicy_t *distro_ptr) {
+                                const distropolicy_t *distro_ptr,
+                                hpx_addr_t costs_reducer,
+                                int coarsening) {
     RankWise<dualtree_t> global_tree{rwaddr};
     auto tree = global_tree.here();
     method_t method{*method_ptr};
@@ -381,16 +757,37 @@ class Evaluator {
     double domain_size = tree->domain()->size();
     expansion_t::update_table(n_digits, domain_size, *kernel_params);
 
+    // Bring the measured costs up to date
+    CostModel &costs = cost_model<Source, Target, Expansion, Method>();
+    if (costs_reducer != HPX_NULL) {
+      costs.calibrate(costs_reducer);
+      if (hpx_get_my_rank() == 0) {
+        costs.print(stdout);
+      }
+    }
+
     // This creates and distributes the explicit DAG
     hpx_time_t distribute_begin = hpx_time_now();
     DAG *dag = tree->create_DAG();
+    if (costs.calibrated()) {
+      dag->reweight([&costs](const DAGNode *from, const DAGEdge &edge,
+                             const DAGNode *to) -> int {
+        return costs.weight(edge.op(), operation_size(from, edge.op(), to),
+                            edge.weight());
+      });
+    }
     distropolicy_t distro{*distro_ptr};
     distro.compute_distribution(*dag);
+    dag->prioritize();
+    tree->coarsen_DAG(dag, coarsening);
     hpx_time_t distribute_end = hpx_time_now();
     double distribute_deltat = hpx_time_diff_us(distribute_begin,
                                                 distribute_end);
     fprintf(stdout, "Evaluate: DAG creation and distribution: %7.6e [us]\n",
             distribute_deltat);
+    if (hpx_get_my_rank() == 0) {
+      dag->print_memory_usage(stdout);
+    }
 
     // Here we sort the DAG edges by here / remote
     dag->partitionLocal(hpx_get_my_rank());
@@ -409,7 +806,7 @@ class Evaluator {
   }
 
   static int execute_DAG_handler(hpx_addr_t rwaddr,
-                                 DAG *dag) {
+                                 DAG *dag, int executor) {
     RankWise<dualtree_t> global_tree{rwaddr};
     auto tree = global_tree.here();
 
@@ -423,26 +820,45 @@ class Evaluator {
     EVENT_TRACE_DASHMM_ZEROREF();
 #endif
 
+    size_t rss_begin = ViewPool::peak_resident_kb();
     hpx_time_t evaluate_begin = hpx_time_now();
-    tree->start_DAG_evaluation(global_tree, dag);
-    hpx_addr_t heredone = tree->setup_termination_detection(dag);
-    hpx_lco_wait(heredone);
+    hpx_addr_t heredone{HPX_NULL};
+    if (static_cast<Executor>(executor) == Executor::Bulk
+        && hpx_get_num_ranks() == 1) {
+      BulkExecutor<Source, Target, Expansion, Method>::execute(
+          *tree->domain(), dag);
+    } else {
+      tree->start_DAG_evaluation(global_tree, dag);
+      heredone = tree->setup_termination_detection(dag);
+      hpx_lco_wait(heredone);
+    }
     hpx_time_t evaluate_end = hpx_time_now();
     double evaluate_deltat = hpx_time_diff_us(evaluate_begin, evaluate_end);
     fprintf(stdout, "Evaluate: DAG evaluation: %7.6e [us]\n", evaluate_deltat);
+    fprintf(stdout, "Evaluate: peak RSS before/after DAG evaluation: "
+            "%zu/%zu [kB]\n", rss_begin, ViewPool::peak_resident_kb());
 
 #ifdef DASHMM_INSTRUMENTATION
     libhpx_inst_phase_end();
 #endif
 
-    hpx_lco_delete_sync(heredone);
+    if (heredone != HPX_NULL) {
+      hpx_lco_delete_sync(heredone);
+    }
     hpx_exit(0, nullptr);
   }
 
   static int reset_DAG_handler(DAG *dag) {
-    reset_expansion_LCOs(dag->source_nodes);
-    reset_expansion_LCOs(dag->target_nodes);
-    reset_target_LCOs(dag->target_leaves);
+    // Each of the three resets contributes n_workers inputs to done, so that
+    // they all proceed concurrently.
+    int n_workers = hpx_get_num_threads();
+    hpx_addr_t done = hpx_lco_and_new(3 * n_workers);
+    assert(done != HPX_NULL);
+    reset_expansion_LCOs(dag->source_nodes, done);
+    reset_expansion_LCOs(dag->target_nodes, done);
+    reset_target_LCOs(dag->target_leaves, done);
+    hpx_lco_wait(done);
+    hpx_lco_delete_sync(done);
     hpx_exit(0, nullptr);
   }
 
@@ -460,17 +876,47 @@ class Evaluator {
     hpx_exit(0, nullptr);
   }
 
-  static void reset_expansion_LCOs(std::vector<DAGNode *> &nodes) {
-    reset_something_LCOs(nodes, reset_expansion_LCOs_);
+  static int rebin_tree_handler(hpx_addr_t rwaddr) {
+    RankWise<dualtree_t> global_tree{rwaddr};
+    hpx_time_t rebin_begin = hpx_time_now();
+    int rebinned = dualtree_t::rebin(global_tree) ? 1 : 0;
+    hpx_time_t rebin_end = hpx_time_now();
+    double rebin_deltat = hpx_time_diff_us(rebin_begin, rebin_end);
+    fprintf(stdout, "Evaluate: tree re-binning %7.6e [us]\n", rebin_deltat);
+    hpx_exit(sizeof(int), &rebinned);
   }
 
-  static void reset_target_LCOs(std::vector<DAGNode *> &nodes) {
-    reset_something_LCOs(nodes, reset_target_LCOs_);
+  static int retarget_DAG_handler(DAG *dag) {
+    int n_workers = hpx_get_num_threads();
+    hpx_addr_t done = hpx_lco_and_new(n_workers);
+    assert(done != HPX_NULL);
+    reset_something_LCOs(dag->target_leaves, retarget_target_LCOs_, done);
+    hpx_lco_wait(done);
+    hpx_lco_delete_sync(done);
+    hpx_exit(0, nullptr);
   }
 
+  static void reset_expansion_LCOs(std::vector<DAGNode *> &nodes,
+                                   hpx_addr_t done) {
+    reset_something_LCOs(nodes, reset_expansion_LCOs_, done);
+  }
+
+  static void reset_target_LCOs(std::vector<DAGNode *> &nodes,
+                                hpx_addr_t done) {
+    reset_something_LCOs(nodes, reset_target_LCOs_, done);
+  }
+
+  /// Spawn the reset of the local LCOs among the given nodes
+  ///
+  /// This does not wait for the resets to complete. Instead, exactly one
+  /// input per scheduler thread is contributed to @p done.
   static void reset_something_LCOs(std::vector<DAGNode *> &nodes,
-                                   hpx_action_t act) {
-    if (nodes.size() == 0) return;
+                                   hpx_action_t act, hpx_addr_t done) {
+    int n_workers = hpx_get_num_threads();
+    if (nodes.size() == 0) {
+      hpx_lco_and_set_num(done, n_workers, HPX_NULL);
+      return;
+    }
 
     int rank = hpx_get_my_rank();
     auto loc_comp = [&rank](const DAGNode * a) -> bool {
@@ -481,10 +927,8 @@ class Evaluator {
                                            loc_comp);
     size_t count = part_point - nodes.begin();
 
-    int n_workers = hpx_get_num_threads();
     size_t delta = count / n_workers;
     size_t remainder = count % n_workers;
-    hpx_addr_t done = hpx_lco_and_new(n_workers);
     DAGNode **data = nodes.data();
 
     for (size_t i = 0; i < remainder; ++i) {
@@ -507,14 +951,32 @@ class Evaluator {
     } else {
       hpx_lco_and_set_num(done, n_workers - remainder, HPX_NULL);
     }
+  }
 
-    hpx_lco_wait(done);
-    hpx_lco_delete_sync(done);
+  /// The size of the operation of a DAG edge, as measured by CostModel
+  static size_t operation_size(const DAGNode *from, Operation op,
+                               const DAGNode *to) {
+    switch (op) {
+      case Operation::StoM:
+      case Operation::StoL:
+        return static_cast<sourcenode_t *>(from->tree_node())->num_parts();
+      case Operation::StoT:
+        return static_cast<sourcenode_t *>(from->tree_node())->num_parts()
+               * static_cast<targetnode_t *>(to->tree_node())->num_parts();
+      case Operation::MtoT:
+      case Operation::LtoT:
+        return static_cast<targetnode_t *>(to->tree_node())->num_parts();
+      default:
+        return 1;
+    }
   }
 
   static int reset_expansion_LCOs_handler(DAGNode **start, DAGNode **end) {
     for (DAGNode **iter = start; iter != end; ++iter) {
       DAGNode *node = *iter;
+      if (node->fused) {
+        continue;
+      }
       expansionlco_t elco{node->global_addx};
       elco.reset();
     }
@@ -525,8 +987,20 @@ class Evaluator {
   static int reset_target_LCOs_handler(DAGNode **start, DAGNode **end) {
     for (DAGNode **iter = start; iter != end; ++iter) {
       DAGNode *node = *iter;
+      targetnode_t *tnode = static_cast<targetnode_t *>(node->tree_node());
+      targetlco_t tlco{node->global_addx};
+      tlco.reset(tnode->parts);
+    }
+
+    return HPX_SUCCESS;
+  }
+
+  static int retarget_target_LCOs_handler(DAGNode **start, DAGNode **end) {
+    for (DAGNode **iter = start; iter != end; ++iter) {
+      DAGNode *node = *iter;
+      targetnode_t *tnode = static_cast<targetnode_t *>(node->tree_node());
       targetlco_t tlco{node->global_addx};
-      tlco.reset();
+      tlco.set_targets(tnode->parts);
     }
 
     return HPX_SUCCESS;
@@ -570,6 +1044,18 @@ template <typename S, typename T,
                     template <typename, typename> class> class M>
 hpx_action_t Evaluator<S, T, E, M>::destroy_tree_ = HPX_ACTION_NULL;
 
+template <typename S, typename T,
+          template <typename, typename> class E,
+          template <typename, typename,
+                    template <typename, typename> class> class M>
+hpx_action_t Evaluator<S, T, E, M>::rebin_tree_ = HPX_ACTION_NULL;
+
+template <typename S, typename T,
+          template <typename, typename> class E,
+          template <typename, typename,
+                    template <typename, typename> class> class M>
+hpx_action_t Evaluator<S, T, E, M>::retarget_DAG_ = HPX_ACTION_NULL;
+
 template <typename S, typename T,
           template <typename, typename> class E,
           template <typename, typename,
@@ -582,6 +1068,12 @@ template <typename S, typename T,
                     template <typename, typename> class> class M>
 hpx_action_t Evaluator<S, T, E, M>::reset_target_LCOs_ = HPX_ACTION_NULL;
 
+template <typename S, typename T,
+          template <typename, typename> class E,
+          template <typename, typename,
+                    template <typename, typename> class> class M>
+hpx_action_t Evaluator<S, T, E, M>::retarget_target_LCOs_ = HPX_ACTION_NULL;
+
 } // namespace dashmm
 
 
@@ -28,6 +28,8 @@
 #include <hpx/hpx.h>
 
 #include "dashmm/buffer.h"
+#include "dashmm/coalescer.h"
+#include "dashmm/costmodel.h"
 #include "dashmm/dag.h"
 #include "dashmm/domaingeometry.h"
 #include "dashmm/index.h"
@@ -130,6 +132,7 @@ class ExpansionLCO {
     ldata->scale = scale;
     ldata->role = role;
     ldata->data = nullptr;
+    ldata->spawn_pending = (dagnode->out_count() != 0);
 
     hpx_gas_unpin(data_);
 
@@ -140,21 +143,42 @@ class ExpansionLCO {
   }
 
   void reset() {
+    void *lva{nullptr};
+    assert(hpx_gas_try_pin(data_, &lva));
+    Header *ldata = static_cast<Header *>(hpx_lco_user_get_user_data(lva));
+
+    // An LCO that has not triggered since it was set up, as after an
+    // execution by the BulkExecutor, is still waiting for all of its inputs,
+    // and still has its out edges registered.
+    if (ldata->spawn_pending) {
+      hpx_gas_unpin(data_);
+      return;
+    }
+    hpx_gas_unpin(data_);
+
     // We use the synchronous version because this is called to from
     // a parallel region, so we can assume that other threads make progress
     // while this happens.
     hpx_lco_reset_sync(data_);
 
-    void *lva{nullptr};
     assert(hpx_gas_try_pin(data_, &lva));
-    Header *ldata = static_cast<Header *>(hpx_lco_user_get_user_data(lva));
+    ldata = static_cast<Header *>(hpx_lco_user_get_user_data(lva));
 
     // According to HPX-5 docs, the reset does nothing to the underlying
     // LCO buffer, except in the case of UserLCO where it reruns the original
     // initialization action. In this case, that action only sets the
     // yet_to_arrive counter, so all the other data should be good to go.
+    //
+    // The expansion data is normally released once the out edges are
+    // spawned. Anything left over would be accumulated into by the next
+    // evaluation, so it is dropped here.
+    if (ldata->data != nullptr) {
+      delete ldata->data;
+      ldata->data = nullptr;
+    }
     if (ldata->node->out_count() != 0) {
       hpx_call_when(data_, data_, spawn_out_edges_, HPX_NULL);
+      ldata->spawn_pending = true;
     }
 
     hpx_gas_unpin(data_);
@@ -202,7 +226,9 @@ class ExpansionLCO {
     double scale = expansion_t::compute_scale(idx);
     ViewSet views{kNoRoleNeeded, center, scale};
     expansion_t local{views};
+    CostModel::Timer timer{costs()};
     auto multi = local.S_to_M(sources, &sources[n_src]);
+    timer.stop(Operation::StoM, n_src);
     contribute(std::move(multi));
     EVENT_TRACE_DASHMM_STOM_END();
   }
@@ -227,7 +253,9 @@ class ExpansionLCO {
     double scale = expansion_t::compute_scale(idx);
     ViewSet views{kNoRoleNeeded, center, scale};
     expansion_t local{views};
+    CostModel::Timer timer{costs()};
     auto multi = local.S_to_L(sources, &sources[n_src]);
+    timer.stop(Operation::StoL, n_src);
     contribute(std::move(multi));
     EVENT_TRACE_DASHMM_STOL_END();
   }
@@ -252,10 +280,23 @@ class ExpansionLCO {
   /// This will call the appropriate set operation on the referred LCO. This
   /// will result in the add_expansion method of the expansion being called.
   ///
+  /// If the LCO is at this locality, which is the case for all the edges
+  /// served by DASHMM, the expansion itself is handed to the LCO, which adds
+  /// it and then deletes it. Otherwise the expansion is serialized into a
+  /// parcel sent to the LCO.
+  ///
   /// \param expand - the expansion to contribute
   void contribute(std::unique_ptr<expansion_t> &&expand) {
+    void *lva{nullptr};
+    if (hpx_gas_try_pin(data_, &lva)) {
+      hpx_gas_unpin(data_);
+      SetInput input{expand.release()};
+      hpx_lco_set(data_, sizeof(input), &input, HPX_NULL, HPX_NULL);
+      return;
+    }
+
     ViewSet views = expand->get_all_views();
-    size_t bytes = views.bytes();
+    size_t bytes = sizeof(SetInput) + views.bytes();
 
     hpx_parcel_t *parc = hpx_parcel_acquire(nullptr, bytes);
     assert(parc != nullptr);
@@ -263,7 +304,10 @@ class ExpansionLCO {
     hpx_parcel_set_action(parc, hpx_lco_set_action);
     hpx_parcel_set_target(parc, data_);
 
-    WriteBuffer parcbuf{(char *)hpx_parcel_get_data(parc), bytes};
+    char *parcdata = static_cast<char *>(hpx_parcel_get_data(parc));
+    SetInput input{nullptr};
+    memcpy(parcdata, &input, sizeof(input));
+    WriteBuffer parcbuf{parcdata + sizeof(input), bytes - sizeof(input)};
     views.serialize(parcbuf);
 
     // We do not need local completion because we do not own this parcel, so
@@ -275,6 +319,37 @@ class ExpansionLCO {
     // point, and the data will be freed.
   }
 
+  /// Serve the out edges of a DAG node computed without an LCO
+  ///
+  /// The nodes of a fused subtree have no LCO; see DualTree::coarsen_DAG().
+  /// The task computing the subtree serves the out edges of each of its nodes
+  /// with this, as the LCO of the node would have once triggered. The edges
+  /// to other nodes of the fused subtree are left to the task.
+  ///
+  /// \param node - the DAG node
+  /// \param index - the index of the node containing the expansion
+  /// \param center - the center of the expansion
+  /// \param scale - the scale of the expansion
+  /// \param rwtree - the global address of the dual tree
+  /// \param expansion - the expansion of the node, which remains owned by the
+  ///                    caller
+  static void serve_fused(DAGNode *node, Index index, Point center,
+                          double scale, hpx_addr_t rwtree,
+                          expansion_t *expansion) {
+    Header head{};
+    head.node = node;
+    head.expansion_size = expansion->get_all_views().bytes();
+    head.rwaddr = rwtree;
+    head.index = index;
+    head.center = center;
+    head.scale = scale;
+    head.data = expansion;
+    head.role = expansion->role();
+    head.yet_to_arrive = 0;
+    head.spawn_pending = false;
+    serve_out_edges(&head);
+  }
+
  private:
   // Give the registrar access so that it might register our actions
   friend class ExpansionLCORegistrar<Source, Target, Expansion, Method>;
@@ -303,6 +378,16 @@ class ExpansionLCO {
     expansion_t *data;
     ExpansionRole role;
     int yet_to_arrive;
+    bool spawn_pending;     /// the out edges wait on the LCO
+  };
+
+  /// The start of the input to the set operation of the LCO
+  ///
+  /// Contributions made at the locality of the LCO give the expansion to
+  /// add, and the LCO takes ownership of it. Otherwise, this is null and is
+  /// followed by the serialized expansion.
+  struct SetInput {
+    expansion_t *local;
   };
 
   /// Initialization handler for Expansion LCOs
@@ -321,15 +406,13 @@ class ExpansionLCO {
 
   /// The set operation handler for the Expansion LCO
   ///
-  /// Set will either add the input expansion to the expansion referenced in
-  /// this LCO, or simply decrement the counter that monitors the status of the
-  /// LCO
+  /// Set adds the input expansion to the expansion referenced in this LCO,
+  /// and decrements the counter that monitors the status of the LCO.
   ///
-  /// In both cases, @p rhs begins with an integer indicating which sort of set
-  /// was called. If the set is to accumulate expansion, then there is a
-  /// serialized ViewSet following the integer code. This buffer is deserialized
-  /// into an expansion, and then added to the expansion referenced by this
-  /// LCO.
+  /// The input @p rhs begins with a SetInput. For local contributions, this
+  /// gives the expansion to add, which is deleted once added. Otherwise, there
+  /// is a serialized ViewSet following it. This buffer is deserialized into an
+  /// expansion, and then added to the expansion referenced by this LCO.
   ///
   /// \param lhs - the address of this LCO's data
   /// \param rhs - the input buffer
@@ -346,16 +429,23 @@ class ExpansionLCO {
     assert(lhs->yet_to_arrive >= 0);
 
     EVENT_TRACE_DASHMM_ELCO_BEGIN();
-    ReadBuffer input{static_cast<char *>(rhs), bytes};
-    ViewSet views{};
-    views.interpret(input);
-    expansion_t incoming{views};
-
-    // add the one to the other
-    lhs->data->add_expansion(&incoming);
-
-    // release the data, because these objects do not actually own it
-    incoming.release();
+    SetInput *input = static_cast<SetInput *>(rhs);
+    if (input->local != nullptr) {
+      lhs->data->add_expansion(input->local);
+      delete input->local;
+    } else {
+      ReadBuffer serialized{static_cast<char *>(rhs) + sizeof(SetInput),
+                            bytes - sizeof(SetInput)};
+      ViewSet views{};
+      views.interpret(serialized);
+      expansion_t incoming{views};
+
+      // add the one to the other
+      lhs->data->add_expansion(&incoming);
+
+      // release the data, because these objects do not actually own it
+      incoming.release();
+    }
     EVENT_TRACE_DASHMM_ELCO_END();
   }
 
@@ -370,12 +460,7 @@ class ExpansionLCO {
   /// Spawn the work at the out edges of this LCO
   ///
   /// Once the LCO is triggered, it will perform the actions required by the
-  /// out edges of that LCO. This happens typically in two steps. The first is
-  /// bundling of the out edges that go to LCOs at the same locality together
-  /// and sending the data across the network a single time. Then at the
-  /// remote side, the addresses are looked up and the work is performed.
-  /// See spawn_out_edges_from_remote_handler and spawn_out_edges_work for
-  /// more details.
+  /// out edges of that LCO. See serve_out_edges.
   ///
   /// \returns - HPX_SUCCESS
   static int spawn_out_edges_handler() {
@@ -384,30 +469,62 @@ class ExpansionLCO {
     // whatever as the size and things are okay...
     Header *head{nullptr};
     hpx_lco_getref(lco_, 1, (void **)&head);
+    head->spawn_pending = false;
+
+    serve_out_edges(head);
 
+    // Once we make it here, this data is no longer needed. So we can delete
+    // the expansion_t object saved in this LCO.
+    delete head->data;
+    head->data = nullptr;
+    hpx_lco_release(lco_, head);
+
+    // done
+    return HPX_SUCCESS;
+  }
+
+  /// Perform the work at the out edges of an expansion
+  ///
+  /// This happens typically in two steps. The first is bundling of the out
+  /// edges that go to LCOs at the same locality together and sending the data
+  /// across the network a single time. Then at the remote side, the addresses
+  /// are looked up and the work is performed. See
+  /// spawn_out_edges_from_remote_handler and spawn_out_edges_work for more
+  /// details.
+  ///
+  /// The messages to other localities go through the Coalescer, so that those
+  /// of many LCOs triggering together travel in a few larger parcels.
+  ///
+  /// \param head - the data of the expansion; this is not modified
+  static void serve_out_edges(Header *head) {
     // We put the edge data into the record form that we will be using, being
-    // sure to sort the edges by locality before doing so.
-    int out_edge_count = head->node->out_count();
-    OutEdgeRecord *out_edges = new OutEdgeRecord[out_edge_count];
-    std::sort(head->node->out_edges.begin(), head->node->out_edges.end(),
-              DAG::compare_edge_locality);
-    for (int i = 0; i < out_edge_count; ++i) {
-      out_edges[i].op = head->node->out_edges[i].op;
-      out_edges[i].target = head->node->out_edges[i].target->global_addx;
-      out_edges[i].tidx = head->node->out_edges[i].target->index();
-      out_edges[i].locality = head->node->out_edges[i].target->locality;
+    // sure to sort the edges by locality before doing so. The edges inside a
+    // fused subtree are served by the task computing the subtree.
+    DAGNode *node = head->node;
+    OutEdgeRecord *out_edges = new OutEdgeRecord[node->out_count()];
+    node->sort_out_edges_by_locality();
+    int out_edge_count = 0;
+    for (size_t i = 0; i < node->out_count(); ++i) {
+      DAGNode *target = node->out_target(i);
+      if (target->fused) {
+        continue;
+      }
+      out_edges[out_edge_count].op = node->out_edge(i).op();
+      out_edges[out_edge_count].target = target->global_addx;
+      out_edges[out_edge_count].tidx = target->index();
+      out_edges[out_edge_count].locality = target->locality;
+      ++out_edge_count;
     }
 
     // Shortcut to the work in the case of a single locality
     if (hpx_get_num_ranks() == 1) {
       spawn_out_edges_work(head, out_edges, 0, out_edge_count - 1);
-      delete head->data;
-      head->data = nullptr;
-      hpx_lco_release(lco_, head);
       delete [] out_edges;
-      return HPX_SUCCESS;
+      return;
     }
 
+    Coalescer::Scope sending{coalescer()};
+
     // Make a scratch space for the sends
     size_t edgeless = sizeof(Header) + head->expansion_size;
     size_t edge_size = sizeof(OutEdgeRecord) * out_edge_count;
@@ -427,9 +544,12 @@ class ExpansionLCO {
     OutEdgeRecord *scratch_edges =
         reinterpret_cast<OutEdgeRecord *>(temp + edgeless);
 
-    // Loop over the sorted edges
+    // Loop over the sorted edges. The edges of this locality are served after
+    // the messages for the others are on their way.
     int my_rank = hpx_get_my_rank();
     int begin = 0;
+    int local_begin = 0;
+    int local_end = 0;
 
     while (begin != out_edge_count) {
       int curr_rank = out_edges[begin].locality;
@@ -441,8 +561,8 @@ class ExpansionLCO {
       }
 
       if (curr_rank == my_rank) {
-        // Short cut to do work
-        spawn_out_edges_work(head, out_edges, begin, curr - 1);
+        local_begin = begin;
+        local_end = curr;
       } else {
         int curr_rank_out_edge_count = curr - begin;
 
@@ -454,29 +574,23 @@ class ExpansionLCO {
         size_t message_size = edgeless +
           sizeof(OutEdgeRecord) * curr_rank_out_edge_count;
 
-        hpx_parcel_t *parc = hpx_parcel_acquire(temp, message_size);
-        hpx_parcel_set_action(parc, spawn_out_edges_from_remote_);
-        hpx_parcel_set_target(parc, HPX_THERE(curr_rank));
-
-        // NOTE: we need to wait for local completion because we are going to
-        // modify the buffer in place for the next locality
-        hpx_parcel_send_sync(parc);
+        // The coalescer copies the message, so the buffer can be modified in
+        // place for the next locality
+        coalescer().send(curr_rank, spawn_out_edges_from_remote_, temp,
+                         message_size);
       }
 
       // Advance
       begin = curr;
     }
 
-    // Once we make it here, this data is no longer needed. So we can delete
-    // the expansion_t object saved in this LCO.
+    // Short cut to do work
+    if (local_begin != local_end) {
+      spawn_out_edges_work(head, out_edges, local_begin, local_end - 1);
+    }
+
     delete [] temp;
-    delete head->data;
-    head->data = nullptr;
-    hpx_lco_release(lco_, head);
     delete [] out_edges;
-
-    // done
-    return HPX_SUCCESS;
   }
 
   /// Action to handle incoming edges from a remote
@@ -587,7 +701,9 @@ class ExpansionLCO {
                               hpx_addr_t target) {
     EVENT_TRACE_DASHMM_MTOM_BEGIN();
     int from_child = head->index.which_child();
+    CostModel::Timer timer{costs()};
     auto translated = head->data->M_to_M(from_child);
+    timer.stop(Operation::MtoM, 1);
     expansionlco_t destination{target};
     destination.contribute(std::move(translated));
     EVENT_TRACE_DASHMM_MTOM_END();
@@ -602,7 +718,9 @@ class ExpansionLCO {
                               hpx_addr_t target,
                               Index tidx) {
     EVENT_TRACE_DASHMM_MTOL_BEGIN();
+    CostModel::Timer timer{costs()};
     auto translated = head->data->M_to_L(head->index, tidx);
+    timer.stop(Operation::MtoL, 1);
     expansionlco_t lco{target};
     lco.contribute(std::move(translated));
     EVENT_TRACE_DASHMM_MTOL_END();
@@ -618,7 +736,9 @@ class ExpansionLCO {
                               Index tidx) {
     EVENT_TRACE_DASHMM_LTOL_BEGIN();
     int to_child = tidx.which_child();
+    CostModel::Timer timer{costs()};
     auto translated = head->data->L_to_L(to_child);
+    timer.stop(Operation::LtoL, 1);
     expansionlco_t total{target};
     total.contribute(std::move(translated));
     EVENT_TRACE_DASHMM_LTOL_END();
@@ -652,7 +772,9 @@ class ExpansionLCO {
   /// \param target - global address of target LCO
   static void m_to_i_out_edge(Header *head, hpx_addr_t target) {
     EVENT_TRACE_DASHMM_MTOI_BEGIN();
+    CostModel::Timer timer{costs()};
     auto translated = head->data->M_to_I();
+    timer.stop(Operation::MtoI, 1);
     expansionlco_t lco{target};
     lco.contribute(std::move(translated));
     EVENT_TRACE_DASHMM_MTOI_END();
@@ -665,7 +787,9 @@ class ExpansionLCO {
   /// \param tidx - index of target LCO
   static void i_to_i_out_edge(Header *head, hpx_addr_t target, Index tidx) {
     EVENT_TRACE_DASHMM_ITOI_BEGIN();
+    CostModel::Timer timer{costs()};
     auto translated = head->data->I_to_I(head->index, tidx);
+    timer.stop(Operation::ItoI, 1);
     expansionlco_t lco{target};
     lco.contribute(std::move(translated));
     EVENT_TRACE_DASHMM_ITOI_END();
@@ -678,13 +802,20 @@ class ExpansionLCO {
   /// \param tidx - index of target LCO
   static void i_to_l_out_edge(Header *head, hpx_addr_t target, Index tidx) {
     EVENT_TRACE_DASHMM_ITOL_BEGIN();
+    CostModel::Timer timer{costs()};
     auto translated = head->data->I_to_L(tidx);
+    timer.stop(Operation::ItoL, 1);
     expansionlco_t lco{target};
     lco.contribute(std::move(translated));
     EVENT_TRACE_DASHMM_ITOL_END();
   }
 
 
+  /// The cost model of evaluations with this type of LCO
+  static CostModel &costs() {
+    return cost_model<Source, Target, Expansion, Method>();
+  }
+
   // The functions implementing the user LCO
   static hpx_action_t init_;
   static hpx_action_t operation_;
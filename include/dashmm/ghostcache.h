@@ -0,0 +1,187 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+#ifndef __DASHMM_GHOST_CACHE_H__
+#define __DASHMM_GHOST_CACHE_H__
+
+
+/// \file
+/// \brief Cache of the source leaves received from other ranks
+
+
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "dashmm/index.h"
+
+
+namespace dashmm {
+
+
+/// Cache of the source leaves received from other ranks
+///
+/// To start an evaluation, each source leaf sends its records to every rank
+/// holding the other end of one of its out edges. The same leaf is usually
+/// sent to the same ranks in every evaluation with the same tree. The
+/// GhostCache lets each rank keep the records it received, and lets the
+/// sending rank know which ranks already hold an up to date copy, so that
+/// only the edge records need to be sent to them.
+///
+/// A copy is identified by the Index of the leaf and a fingerprint of the
+/// serialized records. Any change to the records of the leaf, from moving the
+/// sources, or from updating them in place, changes the fingerprint, and the
+/// records are sent again.
+///
+/// Each rank holds one GhostCache per DualTree. As each source leaf is sent
+/// only by its home rank, which does not change for the life of the tree,
+/// the sending side knows exactly what each receiving side holds. A leaf is
+/// sent to a given rank at most once per evaluation, so a cached copy is not
+/// replaced while it is in use.
+template <typename Source>
+class GhostCache {
+ public:
+  GhostCache() {lock_.clear();}
+
+  GhostCache(const GhostCache &other) = delete;
+  GhostCache &operator=(const GhostCache &other) = delete;
+
+  /// Compute the fingerprint of the serialized records of a leaf
+  ///
+  /// \param data - the serialized records
+  /// \param bytes - the size of the serialized records
+  ///
+  /// \returns - the fingerprint
+  static uint64_t fingerprint(const char *data, size_t bytes) {
+    // 64 bit FNV-1a
+    uint64_t hash{14695981039346656037ULL};
+    for (size_t i = 0; i < bytes; ++i) {
+      hash ^= static_cast<unsigned char>(data[i]);
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  /// Note that a leaf is being sent to a rank
+  ///
+  /// This is used by the rank sending the leaf.
+  ///
+  /// \param leaf - the index of the source leaf
+  /// \param rank - the destination rank
+  /// \param print - the fingerprint of the records of the leaf
+  ///
+  /// \returns - true if @p rank already holds these records, in which case
+  ///            they need not be sent; otherwise the records must be sent,
+  ///            and are noted as held by @p rank from now on.
+  bool sent(const Index &leaf, int rank, uint64_t print) {
+    Guard guard{lock_};
+    Sent &entry = sent_[leaf];
+    if (entry.print != print) {
+      entry.print = print;
+      entry.ranks.clear();
+    }
+    for (int r : entry.ranks) {
+      if (r == rank) {
+        return true;
+      }
+    }
+    entry.ranks.push_back(rank);
+    return false;
+  }
+
+  /// Keep the records of a leaf received from another rank
+  ///
+  /// Any earlier copy of the leaf is replaced.
+  ///
+  /// \param leaf - the index of the source leaf
+  /// \param print - the fingerprint of the records
+  /// \param sources - the records
+  ///
+  /// \returns - the kept records, which remain valid until they are replaced
+  ///            or the cache is destroyed
+  Source *store(const Index &leaf, uint64_t print,
+                std::unique_ptr<Source[]> sources) {
+    Guard guard{lock_};
+    Held &entry = held_[leaf];
+    entry.print = print;
+    entry.sources = std::move(sources);
+    return entry.sources.get();
+  }
+
+  /// Find the records of a leaf received earlier
+  ///
+  /// \param leaf - the index of the source leaf
+  /// \param print - the fingerprint of the records
+  ///
+  /// \returns - the records, or nullptr if there is no copy with the given
+  ///            fingerprint
+  Source *find(const Index &leaf, uint64_t print) {
+    Guard guard{lock_};
+    auto entry = held_.find(leaf);
+    if (entry == held_.end() || entry->second.print != print) {
+      return nullptr;
+    }
+    return entry->second.sources.get();
+  }
+
+ private:
+  /// The ranks holding the current records of a leaf sent by this rank
+  struct Sent {
+    uint64_t print{0};
+    std::vector<int> ranks{};
+  };
+
+  /// The records of a leaf received by this rank
+  struct Held {
+    uint64_t print{0};
+    std::unique_ptr<Source[]> sources{};
+  };
+
+  /// Hash of an Index for the maps
+  struct IndexHash {
+    size_t operator()(const Index &idx) const {
+      uint64_t key = static_cast<uint64_t>(idx.level());
+      key = key * 0x9E3779B97F4A7C15ULL + static_cast<uint32_t>(idx.x());
+      key = key * 0x9E3779B97F4A7C15ULL + static_cast<uint32_t>(idx.y());
+      key = key * 0x9E3779B97F4A7C15ULL + static_cast<uint32_t>(idx.z());
+      return static_cast<size_t>(key ^ (key >> 32));
+    }
+  };
+
+  /// Holds the lock of the cache for a scope
+  class Guard {
+   public:
+    explicit Guard(std::atomic_flag &lock) : lock_(lock) {
+      while (lock_.test_and_set(std::memory_order_acquire)) { }
+    }
+    ~Guard() {lock_.clear(std::memory_order_release);}
+
+   private:
+    std::atomic_flag &lock_;
+  };
+
+  std::atomic_flag lock_;
+  std::unordered_map<Index, Sent, IndexHash> sent_;
+  std::unordered_map<Index, Held, IndexHash> held_;
+};
+
+
+} // namespace dashmm
+
+
+#endif // __DASHMM_GHOST_CACHE_H__
@@ -16,6 +16,11 @@
 #define __DASHMM_HILBERT_H__
 
 
+#include <cstdint>
+
+#include <vector>
+
+
 namespace dashmm {
 
 ;
@@ -31,6 +36,74 @@ int *distribute_points_hilbert(int num_ranks,
                                int lvl);
 
 
+/// The uniform level is this much finer when dividing the tree by work
+///
+/// Dividing by work only helps if the uniform nodes resolve the clustering of
+/// the points, so that the curve can be cut inside the clusters. Each extra
+/// level multiplies the number of uniform nodes by eight.
+constexpr int kWorkPartitionLevels = 2;
+
+
+/// The estimated far field work of one tree node
+///
+/// This is in units of one source-target interaction. A node takes part in
+/// on the order of a hundred translations, each costing roughly as much as
+/// some tens of interactions.
+constexpr int kFarFieldWorkPerNode = 2000;
+
+
+/// Estimate the work of each uniform node
+///
+/// The work is estimated from the counts alone, assuming that the points are
+/// spread evenly inside each uniform node. The tree under a uniform node is
+/// then refined until its leaves hold no more than @p limit points. Each
+/// target interacts directly with the sources in the 27 neighboring leaves,
+/// and each node of the source and target trees adds kFarFieldWorkPerNode for
+/// the far field.
+///
+/// \param global - the global counts of sources and targets per uniform node
+/// \param len - the number of uniform nodes
+/// \param lvl - the uniform refinement level
+/// \param limit - the refinement limit of the tree
+///
+/// \returns - the estimated work of each uniform node
+std::vector<int64_t> estimate_work_uniform(const int *global,
+                                           int len,
+                                           int lvl,
+                                           int limit);
+
+
+/// Distribute the nodes according to a Hilbert space filling curve by work
+///
+/// This cuts the curve into segments of equal estimated work, as given by
+/// estimate_work_uniform(), instead of equal numbers of points.
+///
+/// \param num_ranks - the number of ranks over which to distribute
+/// \param global - the global counts of sources and targets per uniform node
+/// \param len - the number of uniform nodes
+/// \param lvl - the uniform refinement level
+/// \param limit - the refinement limit of the tree
+int *distribute_work_hilbert(int num_ranks,
+                             const int *global,
+                             int len,
+                             int lvl,
+                             int limit);
+
+
+/// The imbalance of the estimated work of a distribution of the nodes
+///
+/// \param num_ranks - the number of ranks
+/// \param rank_map - the rank of each uniform node
+/// \param work - the estimated work of each uniform node
+/// \param len - the number of uniform nodes
+///
+/// \returns - the largest work of any rank divided by the mean work
+double work_imbalance(int num_ranks,
+                      const int *rank_map,
+                      const std::vector<int64_t> &work,
+                      int len);
+
+
 } // dashmm
 
 
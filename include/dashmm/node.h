@@ -364,6 +364,16 @@ class Node {
     assert(found);
   }
 
+  /// Is the given node a child of this node
+  bool is_child(const node_t *target) const {
+    for (int i = 0; i < 8; ++i) {
+      if (child[i] == target) {
+        return true;
+      }
+    }
+    return false;
+  }
+
   /// This will recurse down to the uniform level and remove pointless nodes
   ///
   /// This returns true if this node has no children after the work is
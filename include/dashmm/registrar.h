@@ -20,6 +20,7 @@
 /// \brief Registrar objects for HPX-5 active objects
 
 
+#include "dashmm/bulkexecutor.h"
 #include "dashmm/dualtree.h"
 #include "dashmm/expansionlco.h"
 #include "dashmm/node.h"
@@ -162,6 +163,24 @@ class ExpansionLCORegistrar {
 };
 
 
+/// Object that handles action registration for BulkExecutor
+template <typename Source, typename Target,
+          template <typename, typename> class Expansion,
+          template <typename, typename,
+                    template <typename, typename> class> class Method>
+class BulkExecutorRegistrar {
+ public:
+  using executor_t = BulkExecutor<Source, Target, Expansion, Method>;
+
+  BulkExecutorRegistrar() {
+    HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
+                        executor_t::stage_chunk_,
+                        executor_t::stage_chunk_handler,
+                        HPX_POINTER, HPX_POINTER, HPX_POINTER);
+  }
+};
+
+
 /// Object that handles action registration for Node
 template <typename Record>
 class NodeRegistrar {
@@ -222,6 +241,10 @@ class TreeRegistrar {
                         HPX_POINTER, HPX_INT, HPX_POINTER,
                         HPX_DOUBLE, HPX_DOUBLE, HPX_DOUBLE, HPX_DOUBLE,
                         HPX_INT);
+    HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
+                        tree_t::rebin_branch_,
+                        tree_t::rebin_branch_handler,
+                        HPX_POINTER, HPX_POINTER);
   }
 };
 
@@ -251,8 +274,9 @@ class DualTreeRegistrar {
     HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
                         dualtree_t::init_partition_,
                         dualtree_t::init_partition_handler,
-                        HPX_ADDR, HPX_ADDR, HPX_INT, HPX_ADDR, HPX_INT,
-                        HPX_ADDR, HPX_ADDR, HPX_ADDR, HPX_ADDR);
+                        HPX_ADDR, HPX_ADDR, HPX_INT, HPX_INT, HPX_DOUBLE,
+                        HPX_ADDR, HPX_INT, HPX_ADDR, HPX_ADDR, HPX_ADDR,
+                        HPX_ADDR);
     HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_MARSHALLED,
                         dualtree_t::recv_points_,
                         dualtree_t::recv_points_handler,
@@ -271,6 +295,10 @@ class DualTreeRegistrar {
                         dualtree_t::finalize_partition_,
                         dualtree_t::finalize_partition_handler,
                         HPX_ADDR);
+    HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
+                        dualtree_t::rebin_,
+                        dualtree_t::rebin_handler,
+                        HPX_ADDR, HPX_ADDR);
     HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
                         dualtree_t::source_apply_method_,
                         dualtree_t::source_apply_method_handler,
@@ -309,6 +337,14 @@ class DualTreeRegistrar {
                         dualtree_t::instigate_dag_eval_remote_,
                         dualtree_t::instigate_dag_eval_remote_handler,
                         HPX_POINTER, HPX_SIZE_T);
+    HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
+                        dualtree_t::fused_upward_,
+                        dualtree_t::fused_upward_handler,
+                        HPX_POINTER, HPX_POINTER, HPX_ADDR);
+    HPX_REGISTER_ACTION(HPX_DEFAULT, HPX_MARSHALLED,
+                        dualtree_t::recv_DAG_halo_,
+                        dualtree_t::recv_DAG_halo_handler,
+                        HPX_POINTER, HPX_SIZE_T);
   }
 };
 
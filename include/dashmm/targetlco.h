@@ -22,10 +22,15 @@
 
 #include <cstring>
 
+#include <algorithm>
+#include <type_traits>
+
 #include <hpx/hpx.h>
 
 #include "dashmm/arrayref.h"
+#include "dashmm/costmodel.h"
 #include "dashmm/traceevents.h"
+#include "dashmm/types.h"
 #include "dashmm/viewset.h"
 
 
@@ -40,6 +45,26 @@ template <typename Source, typename Target,
 class TargetLCORegistrar;
 
 
+/// Does an Expansion support the concurrent accumulation of target results
+///
+/// clear_targets() and add_targets() are optional members of an Expansion.
+/// They are only needed to select TargetAccumulation::Concurrent.
+template <typename Expansion>
+class ConcurrentTargetSupport {
+  template <typename E>
+  static constexpr bool test(decltype(&E::clear_targets),
+                             decltype(&E::add_targets)) {
+    return true;
+  }
+
+  template <typename E>
+  static constexpr bool test(...) {return false;}
+
+ public:
+  static constexpr bool value = test<Expansion>(nullptr, nullptr);
+};
+
+
 /// Target LCO
 ///
 /// This LCO manages the concurrent contribution to the target data. In
@@ -55,6 +80,17 @@ class TargetLCORegistrar;
 /// interact with the object very often. Mostly they will pass objects of this
 /// type to ExpansionLCO objects.
 ///
+/// By default, the contributions are applied to the targets inside the set
+/// operation of the LCO, and so one at a time. For leaves with many
+/// contributions this serializes a large amount of work. LCOs created after
+/// set_accumulation() selects TargetAccumulation::Concurrent instead have each
+/// worker apply its contributions to a private copy of the targets, without
+/// holding the lock of the LCO. The copies are added to the targets when the
+/// last contribution arrives. This requires the Expansion to provide
+/// clear_targets() and add_targets(), and costs up to one copy of the targets
+/// per worker for each leaf being contributed to. While Locked is selected,
+/// contributions go straight to the set operation of the LCO.
+///
 /// This is a template class parameterized by the Source, Target, Expansion,
 /// and Method types for a particular evaluation of DASHMM.
 template <typename Source, typename Target,
@@ -70,6 +106,10 @@ class TargetLCO {
 
   using targetref_t = ArrayRef<Target>;
 
+  /// Can the LCOs accumulate the contributions concurrently
+  static constexpr bool kConcurrentCapable =
+      ConcurrentTargetSupport<expansion_t>::value;
+
   /// Construct a default object
   TargetLCO() : lco_{HPX_NULL} { }
 
@@ -85,12 +125,37 @@ class TargetLCO {
   /// \param targets - ArrayRef indicating the global memory that the LCO is
   ///                  representing
   TargetLCO(size_t n_inputs, const targetref_t &targets) {
-    Data init{static_cast<int>(n_inputs), targets};
-    lco_ = hpx_lco_user_new(sizeof(init), init_, operation_,
+    int n_workers{0};
+    if (accumulation_ == TargetAccumulation::Concurrent) {
+      n_workers = hpx_get_num_threads();
+    }
+    Data init{static_cast<int>(n_inputs), n_workers, targets};
+    size_t bytes = sizeof(Data) + sizeof(target_t *) * n_workers;
+    lco_ = hpx_lco_user_new(bytes, init_, operation_,
                             predicate_, &init, sizeof(init));
     assert(lco_ != HPX_NULL);
   }
 
+  /// Select how contributions are accumulated by the LCOs created later
+  ///
+  /// LCOs created in the concurrent mode keep their private copies, but
+  /// once Locked is selected all contributions are made under the lock.
+  /// This should be called on every rank, and not while LCOs of this type
+  /// are being created or contributed to.
+  ///
+  /// \tparam mode - the accumulation mode
+  template <TargetAccumulation mode>
+  static void set_accumulation() {
+    static_assert(mode != TargetAccumulation::Concurrent
+                  || kConcurrentCapable,
+                  "Concurrent target accumulation requires the Expansion to "
+                  "provide clear_targets() and add_targets()");
+    accumulation_ = mode;
+  }
+
+  /// The accumulation mode of the LCOs created from now on
+  static TargetAccumulation accumulation() {return accumulation_;}
+
   void reset() {
     // We use the synchronous version because this is called to from
     // a parallel region, so we can assume that other threads make progress
@@ -98,6 +163,33 @@ class TargetLCO {
     hpx_lco_reset_sync(lco_);
   }
 
+  /// Reset the LCO, and have it refer to a new range of targets
+  ///
+  /// This is needed once the records of the tree have been re-binned, which
+  /// changes the segment of a leaf without changing the leaf itself.
+  ///
+  /// \param targets - the targets the LCO now represents
+  void reset(const targetref_t &targets) {
+    // The reset reruns the initialization with the original data, so the
+    // new target range is written afterwards.
+    reset();
+    set_targets(targets);
+  }
+
+  /// Have the LCO refer to a new range of targets
+  ///
+  /// This must only be called on an LCO local to the calling rank, and not
+  /// while contributions are being made to the LCO.
+  ///
+  /// \param targets - the targets the LCO now represents
+  void set_targets(const targetref_t &targets) {
+    void *lva{nullptr};
+    assert(hpx_gas_try_pin(lco_, &lva));
+    Data *ldata = static_cast<Data *>(hpx_lco_user_get_user_data(lva));
+    ldata->targets = targets;
+    hpx_gas_unpin(lco_);
+  }
+
   /// Destroy the LCO
   void destroy() {
     if (lco_ != HPX_NULL) {
@@ -114,24 +206,51 @@ class TargetLCO {
   /// \param n - the number of sources
   /// \param sources - the sources themselves
   void contribute_S_to_T(size_t n, const source_t *sources) const {
-    StoT input{kStoT, n, sources};
-    hpx_lco_set_rsync(lco_, sizeof(StoT), &input);
+    target_t *first{nullptr};
+    target_t *last{nullptr};
+    if (private_targets(&first, &last)) {
+      if (first != last) {
+        apply_S_to_T(n, sources, first, last);
+      }
+      arrive();
+    } else {
+      StoT input{kStoT, n, sources};
+      hpx_lco_set_rsync(lco_, sizeof(StoT), &input);
+    }
   }
 
   /// Contribute a M->T operation to the referred targets
   ///
   /// \param expand - the expansion containing the M
   void contribute_M_to_T(const expansion_t *expand) const {
-    MtoT input{kMtoT, expand};
-    hpx_lco_set_rsync(lco_, sizeof(input), &input);
+    target_t *first{nullptr};
+    target_t *last{nullptr};
+    if (private_targets(&first, &last)) {
+      if (first != last) {
+        apply_M_to_T(expand, first, last);
+      }
+      arrive();
+    } else {
+      MtoT input{kMtoT, expand};
+      hpx_lco_set_rsync(lco_, sizeof(input), &input);
+    }
   }
 
   /// Contribute a L->T operation to the referred targets
   ///
   /// \param expand - the expansion containing the L
   void contribute_L_to_T(const expansion_t *expand) const {
-    LtoT input{kLtoT, expand};
-    hpx_lco_set_rsync(lco_, sizeof(input), &input);
+    target_t *first{nullptr};
+    target_t *last{nullptr};
+    if (private_targets(&first, &last)) {
+      if (first != last) {
+        apply_L_to_T(expand, first, last);
+      }
+      arrive();
+    } else {
+      LtoT input{kLtoT, expand};
+      hpx_lco_set_rsync(lco_, sizeof(input), &input);
+    }
   }
 
  private:
@@ -139,8 +258,13 @@ class TargetLCO {
   friend class TargetLCORegistrar<Source, Target, Expansion, Method>;
 
   /// LCO data type
+  ///
+  /// In the concurrent mode, this is followed by the private copies of the
+  /// targets, one pointer for each worker, which are null until the worker
+  /// contributes.
   struct Data {
     int yet_to_arrive;
+    int n_workers;          // zero if contributions are made under the lock
     targetref_t targets;
   };
 
@@ -168,50 +292,54 @@ class TargetLCO {
     kStoT = 0,
     kMtoT = 1,
     kLtoT = 2,
+    kArrive = 3,
   };
 
   /// Initialize the LCO
   static void init_handler(Data *i, size_t bytes,
                            Data *init, size_t init_bytes) {
     *i = *init;
+    target_t **copies = private_copies(i);
+    for (int w = 0; w < i->n_workers; ++w) {
+      copies[w] = nullptr;
+    }
   }
 
   /// The 'set' operation on the LCO
   ///
-  /// This takes a number of forms based on the input code.
+  /// This takes a number of forms based on the input code. kArrive marks a
+  /// contribution already made to a private copy of the targets.
   static void operation_handler(Data *lhs, void *rhs, size_t bytes) {
     int *code = reinterpret_cast<int *>(rhs);
 
     lhs->yet_to_arrive -= 1;
     assert(lhs->yet_to_arrive >= 0);
 
-    if (lhs->targets.data() == nullptr) {
-      return;
+    // The contributions made under the lock may be mixed with those made to
+    // private copies, so the copies are added once the last of either kind
+    // arrives.
+    if (*code != kArrive && lhs->targets.data() != nullptr) {
+      apply_locked(lhs, rhs);
+    }
+    if (lhs->yet_to_arrive == 0 && lhs->n_workers > 0) {
+      reduce_private_copies(lhs, concurrent_t{});
     }
+  }
 
+  /// Apply a contribution made under the lock of the LCO
+  static void apply_locked(Data *lhs, void *rhs) {
+    int *code = reinterpret_cast<int *>(rhs);
+    target_t *first{lhs->targets.data()};
+    target_t *last{&first[lhs->targets.n()]};
     if (*code == kStoT) {
-      EVENT_TRACE_DASHMM_STOT_BEGIN();
       StoT *input = static_cast<StoT *>(rhs);
-
-      if (input->count) {
-        target_t *targets{lhs->targets.data()};
-        expansion_t expand(ViewSet{});
-        expand.S_to_T(input->sources, &input->sources[input->count],
-                       targets, &targets[lhs->targets.n()]);
-      }
-      EVENT_TRACE_DASHMM_STOT_END();
+      apply_S_to_T(input->count, input->sources, first, last);
     } else if (*code == kMtoT) {
-      EVENT_TRACE_DASHMM_MTOT_BEGIN();
       MtoT *input = static_cast<MtoT *>(rhs);
-      target_t *targets{lhs->targets.data()};
-      input->exp->M_to_T(targets, &targets[lhs->targets.n()]);
-      EVENT_TRACE_DASHMM_MTOT_END();
+      apply_M_to_T(input->exp, first, last);
     } else if (*code == kLtoT) {
-      EVENT_TRACE_DASHMM_LTOT_BEGIN();
       LtoT *input = static_cast<LtoT *>(rhs);
-      target_t *targets{lhs->targets.data()};
-      input->exp->L_to_T(targets, &targets[lhs->targets.n()]);
-      EVENT_TRACE_DASHMM_LTOT_END();
+      apply_L_to_T(input->exp, first, last);
     } else {
       assert(0 && "Incorrect code to TargetLCO");
     }
@@ -222,6 +350,126 @@ class TargetLCO {
     return (i->yet_to_arrive == 0);
   }
 
+  /// Apply a S->T operation to the given targets
+  static void apply_S_to_T(size_t count, const source_t *sources,
+                           target_t *first, target_t *last) {
+    EVENT_TRACE_DASHMM_STOT_BEGIN();
+    if (count) {
+      expansion_t expand(ViewSet{});
+      CostModel::Timer timer{costs()};
+      expand.S_to_T(sources, &sources[count], first, last);
+      timer.stop(Operation::StoT, count * (last - first));
+    }
+    EVENT_TRACE_DASHMM_STOT_END();
+  }
+
+  /// Apply a M->T operation to the given targets
+  static void apply_M_to_T(const expansion_t *exp,
+                           target_t *first, target_t *last) {
+    EVENT_TRACE_DASHMM_MTOT_BEGIN();
+    CostModel::Timer timer{costs()};
+    exp->M_to_T(first, last);
+    timer.stop(Operation::MtoT, last - first);
+    EVENT_TRACE_DASHMM_MTOT_END();
+  }
+
+  /// Apply a L->T operation to the given targets
+  static void apply_L_to_T(const expansion_t *exp,
+                           target_t *first, target_t *last) {
+    EVENT_TRACE_DASHMM_LTOT_BEGIN();
+    CostModel::Timer timer{costs()};
+    exp->L_to_T(first, last);
+    timer.stop(Operation::LtoT, last - first);
+    EVENT_TRACE_DASHMM_LTOT_END();
+  }
+
+  /// The private copies of the targets that follow the LCO data
+  static target_t **private_copies(Data *data) {
+    return reinterpret_cast<target_t **>(data + 1);
+  }
+
+  /// Whether the Expansion supports the concurrent mode, as a type
+  using concurrent_t = std::integral_constant<bool, kConcurrentCapable>;
+
+  /// Find the private copy of the targets for the calling worker
+  ///
+  /// The copy is made on the first contribution of the worker to this LCO,
+  /// with its results cleared. No other worker uses the copy, and the
+  /// operations applied to it do not suspend the calling thread, so it needs
+  /// no lock. The contributions must be made at the locality of the LCO, as
+  /// is already required by the pointers they pass.
+  ///
+  /// While Locked is selected, this returns without pinning the LCO.
+  ///
+  /// \param first [out] - the first target of the copy
+  /// \param last [out] - one past the last target of the copy
+  ///
+  /// \returns - false if the contribution is to be made under the lock
+  bool private_targets(target_t **first, target_t **last) const {
+    if (accumulation_ != TargetAccumulation::Concurrent) {
+      return false;
+    }
+    return private_targets(first, last, concurrent_t{});
+  }
+
+  /// Without clear_targets(), the concurrent mode cannot be selected
+  bool private_targets(target_t **first, target_t **last,
+                       std::false_type) const {
+    return false;
+  }
+
+  /// Find the private copy of the targets in the concurrent mode
+  bool private_targets(target_t **first, target_t **last,
+                       std::true_type) const {
+    void *lva{nullptr};
+    assert(hpx_gas_try_pin(lco_, &lva));
+    Data *ldata = static_cast<Data *>(hpx_lco_user_get_user_data(lva));
+    bool concurrent = ldata->n_workers > 0;
+    if (concurrent && ldata->targets.data() != nullptr) {
+      int worker = hpx_get_my_thread_id();
+      assert(worker >= 0 && worker < ldata->n_workers);
+      size_t n = ldata->targets.n();
+      target_t *&copy = private_copies(ldata)[worker];
+      if (copy == nullptr) {
+        copy = new target_t[n];
+        std::copy(ldata->targets.data(), &ldata->targets.data()[n], copy);
+        expansion_t::clear_targets(copy, &copy[n]);
+      }
+      *first = copy;
+      *last = &copy[n];
+    }
+    hpx_gas_unpin(lco_);
+    return concurrent;
+  }
+
+  /// Mark a contribution made to a private copy of the targets
+  void arrive() const {
+    int code{kArrive};
+    hpx_lco_set_rsync(lco_, sizeof(code), &code);
+  }
+
+  /// Without add_targets(), there are never any private copies
+  static void reduce_private_copies(Data *data, std::false_type) { }
+
+  /// Add the private copies to the targets, and free them
+  static void reduce_private_copies(Data *data, std::true_type) {
+    target_t **copies = private_copies(data);
+    size_t n = data->targets.n();
+    for (int w = 0; w < data->n_workers; ++w) {
+      if (copies[w] != nullptr) {
+        expansion_t::add_targets(copies[w], &copies[w][n],
+                                 data->targets.data());
+        delete [] copies[w];
+        copies[w] = nullptr;
+      }
+    }
+  }
+
+  /// The cost model of evaluations with this type of LCO
+  static CostModel &costs() {
+    return cost_model<Source, Target, Expansion, Method>();
+  }
+
   /// The global address of the LCO
   hpx_addr_t lco_;
 
@@ -231,6 +479,9 @@ class TargetLCO {
   static hpx_action_t operation_;
   /// HPX function for LCO predicate
   static hpx_action_t predicate_;
+
+  /// The accumulation mode of the LCOs created from now on
+  static TargetAccumulation accumulation_;
 };
 
 
@@ -252,6 +503,13 @@ template <typename S, typename T,
                     template <typename, typename> class> class M>
 hpx_action_t TargetLCO<S, T, E, M>::predicate_ = HPX_ACTION_NULL;
 
+template <typename S, typename T,
+          template <typename, typename> class E,
+          template <typename, typename,
+                    template <typename, typename> class> class M>
+TargetAccumulation TargetLCO<S, T, E, M>::accumulation_ =
+    TargetAccumulation::Locked;
+
 
 } // namespace dashmm
 
@@ -29,7 +29,9 @@
 
 // C++ library
 #include <algorithm>
+#include <atomic>
 #include <functional>
+#include <unordered_map>
 #include <vector>
 
 // HPX-5
@@ -446,14 +448,14 @@ class Tree {
     }
   }
 
-  /// Find the LCO address for a given index and a given operation
+  /// Find the node with the given index
+  ///
+  /// The node must be present in the local copy of the tree.
   ///
   /// \param idx - the Index of the node in question
-  /// \param op - the edge type connecting to the index in question
   ///
-  /// \returns - global address of the LCO serving as target of the edge
-  hpx_addr_t lookup_lco_addx(Index idx, Operation op) {
-    // This should walk to the node containing the LCO we care about
+  /// \returns - the node with index @p idx
+  node_t *lookup_node(Index idx) const {
     node_t *curr = root_;
     bool not_found = true;
     while (not_found) {
@@ -465,8 +467,21 @@ class Tree {
       assert(curr->idx == idx.parent(dlevel));
       int which = idx.parent(dlevel - 1).which_child();
       curr = curr->child[which];
+      assert(curr != nullptr);
     }
     assert(curr->idx == idx);
+    return curr;
+  }
+
+  /// Find the LCO address for a given index and a given operation
+  ///
+  /// \param idx - the Index of the node in question
+  /// \param op - the edge type connecting to the index in question
+  ///
+  /// \returns - global address of the LCO serving as target of the edge
+  hpx_addr_t lookup_lco_addx(Index idx, Operation op) {
+    // This should walk to the node containing the LCO we care about
+    node_t *curr = lookup_node(idx);
 
     hpx_addr_t retval{HPX_NULL};
     switch (op) {
@@ -534,6 +549,167 @@ class Tree {
     root_->removeDownwardLinks(unif_level - 1, 0);
   }
 
+  /// Re-bin the local records among the existing leaves of the tree
+  ///
+  /// After the positions of the records have changed, this will move each
+  /// record that has left its leaf into the leaf that now contains it, and
+  /// update the segments of the nodes accordingly. The branches owned by this
+  /// rank are contiguous in the local records, and so are handled together: a
+  /// record may move to any leaf of any of them. The structure of the tree is
+  /// not changed; no nodes are created or removed. The leaves of the records
+  /// are found concurrently for each branch. If no record has left its leaf,
+  /// the records are not reordered.
+  ///
+  /// This should be called from inside an HPX thread, and will block until
+  /// the local branches are done.
+  ///
+  /// \param geo - the domain geometry of the tree
+  /// \param unif_level - the uniform partitioning level
+  /// \param dim3 - the number of uniform level nodes
+  /// \param rank_map - the mapping from uniform level nodes to owning rank
+  /// \param limit - the largest number of records a leaf may hold
+  ///
+  /// \returns - true if every record found a leaf with room for it; false if
+  ///            some record has left the domain, has moved to a uniform level
+  ///            node owned by another rank or to a part of the domain with no
+  ///            leaf, or if a leaf would hold more than @p limit records. In
+  ///            that case the tree is left unchanged, and should be rebuilt.
+  bool rebin(const DomainGeometry *geo, int unif_level, int dim3,
+             const int *rank_map, int limit) {
+    int my_rank = hpx_get_my_rank();
+
+    // The local branches, in the order of their segments. Uniform level
+    // nodes that were empty when the tree was built have been pruned, and
+    // have no leaves.
+    std::vector<node_t *> branches{};
+    for (int i = 0; i < dim3; ++i) {
+      node_t *curr = &unif_grid_[i];
+      if (rank_map[i] == my_rank && curr->parent->is_child(curr)) {
+        branches.push_back(curr);
+      }
+    }
+    if (branches.empty()) {
+      return true;
+    }
+
+    RebinState state{};
+    state.geo = geo;
+    state.unif_level = unif_level;
+    state.rank_map = rank_map;
+    state.my_rank = my_rank;
+    state.unif_grid = unif_grid_;
+
+    // Collect the nodes in preorder. Children are visited in order, so the
+    // leaves appear in the order of their segments.
+    // NOTE: this is not recursive because HPX-5 has small default stacks.
+    std::vector<node_t *> nodes{};
+    std::vector<node_t *> leaves{};
+    for (auto branch : branches) {
+      std::vector<node_t *> stack{branch};
+      while (!stack.empty()) {
+        node_t *curr = stack.back();
+        stack.pop_back();
+        nodes.push_back(curr);
+        if (curr->is_leaf()) {
+          state.ordinal[curr] = leaves.size();
+          leaves.push_back(curr);
+        } else {
+          for (int i = 7; i >= 0; --i) {
+            if (curr->child[i]) {
+              stack.push_back(curr->child[i]);
+            }
+          }
+        }
+      }
+    }
+
+    record_t *p = branches.front()->parts.data();
+    size_t n{0};
+    for (auto branch : branches) {
+      assert(branch->parts.data() == p + n);
+      n += branch->parts.n();
+    }
+    if (n == 0) {
+      return true;
+    }
+    arrayref_t local{p, n};
+
+    // Find the leaf of each record
+    state.base = p;
+    state.bin.resize(n);
+    RebinState *state_ptr{&state};
+    hpx_addr_t done = hpx_lco_and_new(branches.size());
+    assert(done != HPX_NULL);
+    for (auto branch : branches) {
+      hpx_call(HPX_HERE, rebin_branch_, done, &branch, &state_ptr);
+    }
+    hpx_lco_wait(done);
+    hpx_lco_delete_sync(done);
+    if (state.failed.load()) {
+      return false;
+    }
+
+    // Count the records per leaf
+    std::vector<size_t> count(leaves.size(), 0);
+    bool moved{false};
+    size_t irec{0};
+    for (size_t l = 0; l < leaves.size(); ++l) {
+      for (size_t j = 0; j < leaves[l]->parts.n(); ++j, ++irec) {
+        size_t b = state.bin[irec];
+        count[b] += 1;
+        moved = moved || (b != l);
+      }
+    }
+    assert(irec == n);
+
+    if (!moved) {
+      return true;
+    }
+
+    for (size_t l = 0; l < leaves.size(); ++l) {
+      if (count[l] > (size_t)limit) {
+        return false;
+      }
+    }
+
+    // Stable counting sort of the records by leaf
+    std::vector<size_t> offset(leaves.size(), 0);
+    for (size_t l = 1; l < leaves.size(); ++l) {
+      offset[l] = offset[l - 1] + count[l - 1];
+    }
+    record_t *temp = new record_t[n];
+    std::vector<size_t> next{offset};
+    for (size_t i = 0; i < n; ++i) {
+      temp[next[state.bin[i]]++] = p[i];
+    }
+    std::copy(temp, temp + n, p);
+    delete [] temp;
+
+    // Leaves first, then each internal node spans its children, which are
+    // contiguous in child order.
+    for (size_t l = 0; l < leaves.size(); ++l) {
+      leaves[l]->parts = local.slice(offset[l], count[l]);
+    }
+    for (auto iter = nodes.rbegin(); iter != nodes.rend(); ++iter) {
+      node_t *curr = *iter;
+      if (curr->is_leaf()) {
+        continue;
+      }
+      size_t first{n};
+      size_t total{0};
+      for (int i = 0; i < 8; ++i) {
+        if (curr->child[i]) {
+          size_t start = curr->child[i]->parts.data() - p;
+          first = std::min(first, start);
+          total += curr->child[i]->parts.n();
+        }
+      }
+      curr->parts = local.slice(first, total);
+    }
+
+    return true;
+  }
+
 private:
   // NOTE: One of these is superfluous; likely some metaprogramming magic could
   //  remove the extraneous one.
@@ -915,6 +1091,96 @@ private:
     return HPX_SUCCESS;
   }
 
+  /// The state shared by the actions finding the leaves of the records
+  ///
+  /// See rebin() above.
+  struct RebinState {
+    const DomainGeometry *geo;
+    int unif_level;
+    const int *rank_map;
+    int my_rank;
+    node_t *unif_grid;
+    std::unordered_map<const node_t *, size_t> ordinal;  /// leaf -> bin
+    record_t *base;                 /// the first local record
+    std::vector<size_t> bin;        /// the bin of each local record
+    std::atomic<bool> failed{false};
+  };
+
+  /// Action finding the leaves of the records of one branch of the tree
+  ///
+  /// See rebin() above.
+  ///
+  /// \param branch - the uniform level node at the root of the branch
+  /// \param state - the state of the re-binning
+  ///
+  /// \returns - HPX_SUCCESS
+  static int rebin_branch_handler(node_t *branch, RebinState *state) {
+    record_t *p = branch->parts.data();
+    for (size_t i = 0; i < branch->parts.n(); ++i) {
+      node_t *leaf = find_leaf(p[i].position, *state);
+      if (leaf == nullptr) {
+        state->failed.store(true);
+        break;
+      }
+      state->bin[p + i - state->base] = state->ordinal.at(leaf);
+    }
+    return HPX_SUCCESS;
+  }
+
+  /// Find the local leaf that contains a given position
+  ///
+  /// The descent makes the same comparisons as the partitioning of the
+  /// nodes, so that records on the boundary between two boxes are placed
+  /// as they would be by a rebuild.
+  ///
+  /// \param pos - the position in question
+  /// \param state - the state of the re-binning
+  ///
+  /// \returns - the leaf containing @p pos, or nullptr if @p pos is outside
+  ///            the domain, in a uniform level node owned by another rank, or
+  ///            falls in a node that does not exist.
+  static node_t *find_leaf(const Point &pos, const RebinState &state) {
+    const DomainGeometry &geo = *state.geo;
+    Point corner = geo.low();
+    double scale = 1.0 / geo.size();
+    double sx = (pos.x() - corner.x()) * scale;
+    double sy = (pos.y() - corner.y()) * scale;
+    double sz = (pos.z() - corner.z()) * scale;
+    if (sx < 0.0 || sx > 1.0 || sy < 0.0 || sy > 1.0
+        || sz < 0.0 || sz > 1.0) {
+      return nullptr;
+    }
+
+    // The uniform grid assignment matches assign_points_to_unif_grid
+    int dim = pow(2, state.unif_level);
+    int xid = std::min(dim - 1, (int)(dim * sx));
+    int yid = std::min(dim - 1, (int)(dim * sy));
+    int zid = std::min(dim - 1, (int)(dim * sz));
+    uint64_t gid = simple_key(xid, yid, zid, dim);
+    if (state.rank_map[gid] != state.my_rank) {
+      return nullptr;
+    }
+
+    node_t *curr = &state.unif_grid[gid];
+    if (!curr->parent->is_child(curr)) {
+      return nullptr;
+    }
+    while (!curr->is_leaf()) {
+      double h = geo.size() / pow(2, curr->idx.level());
+      double center_x = corner.x() + (curr->idx.x() + 0.5) * h;
+      double center_y = corner.y() + (curr->idx.y() + 0.5) * h;
+      double center_z = corner.z() + (curr->idx.z() + 0.5) * h;
+      int which = (pos.x() < center_x ? 0 : 1)
+                  + (pos.y() < center_y ? 0 : 2)
+                  + (pos.z() < center_z ? 0 : 4);
+      curr = curr->child[which];
+      if (curr == nullptr) {
+        return nullptr;
+      }
+    }
+
+    return curr;
+  }
   node_t *root_;            /// Root of the tree
   node_t *unif_grid_;       /// The uniform grid
   hpx_addr_t unif_done_;    /// An LCO indicating that the uniform partition is
@@ -930,6 +1196,7 @@ private:
   static hpx_action_t group_points_;
   static hpx_action_t merge_points_;
   static hpx_action_t merge_points_same_s_and_t_;
+  static hpx_action_t rebin_branch_;
 };
 
 template <typename S, typename T, typename R>
@@ -956,6 +1223,9 @@ hpx_action_t Tree<S, T, R>::merge_points_ = HPX_ACTION_NULL;
 template <typename S, typename T, typename R>
 hpx_action_t Tree<S, T, R>::merge_points_same_s_and_t_ = HPX_ACTION_NULL;
 
+template <typename S, typename T, typename R>
+hpx_action_t Tree<S, T, R>::rebin_branch_ = HPX_ACTION_NULL;
+
 
 } // namespace dashmm
 
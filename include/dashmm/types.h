@@ -88,6 +88,44 @@ enum class Operation {
 };
 
 
+/// How the uniform level of the tree is divided among the ranks
+///
+/// In either case the uniform nodes are ordered along a space filling curve,
+/// which is cut into one segment per rank. Points gives each rank an equal
+/// number of sources and targets. Work gives each rank an equal estimated
+/// work on a finer uniform level, which balances better when the points are
+/// clustered.
+enum class TreePartition {
+  Points,
+  Work
+};
+
+
+/// How the contributions to the targets of a leaf are accumulated
+///
+/// Locked applies each contribution to the targets while holding the lock of
+/// the leaf's TargetLCO, so that the contributions are applied one at a time.
+/// Concurrent applies each contribution to a private copy of the targets
+/// owned by the contributing worker, outside of the lock, and adds the copies
+/// to the targets once every contribution has arrived.
+enum class TargetAccumulation {
+  Locked,
+  Concurrent
+};
+
+
+/// How the DAG is executed
+///
+/// Dataflow has each node of the DAG computed by its LCO as soon as all its
+/// inputs have arrived. Bulk computes the DAG one stage at a time, with a
+/// parallel loop over the nodes of each stage; see BulkExecutor. Bulk needs
+/// a single rank, and Dataflow is used in its place otherwise.
+enum class Executor {
+  Dataflow,
+  Bulk
+};
+
+
 } // namespace dashmm
 
 
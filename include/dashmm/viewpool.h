@@ -0,0 +1,82 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+#ifndef __DASHMM_VIEW_POOL_H__
+#define __DASHMM_VIEW_POOL_H__
+
+
+/// \file
+/// \brief Pooled storage for the views of expansions
+
+
+#include <cstddef>
+
+
+namespace dashmm {
+
+
+/// Pooled storage for the views of expansions
+///
+/// An evaluation creates and destroys a very large number of expansions,
+/// nearly all of whose views have one of a handful of sizes fixed by the
+/// kernel table. The ViewPool keeps the storage of freed views in per-worker
+/// free lists, one for each registered size, so that after the first
+/// evaluation the views are served without going through the system
+/// allocator.
+///
+/// The sizes are registered with add_size(), typically from the
+/// update_table() of an Expansion. Storage of other sizes is passed through
+/// to the system allocator. A view may be freed by a different worker than
+/// the one that allocated it; the storage then joins the free list of the
+/// worker freeing it.
+///
+/// The storage held in the free lists is returned to the system by trim(),
+/// which the DualTree calls once the LCOs of a DAG are destroyed.
+class ViewPool {
+ public:
+  /// Register a size of view storage to be pooled
+  ///
+  /// This must not be called while views are being allocated. Sizes that
+  /// are already registered are ignored, as are sizes beyond the capacity of
+  /// the pool.
+  ///
+  /// \param bytes - the size of the storage
+  static void add_size(size_t bytes);
+
+  /// Allocate storage for a view
+  ///
+  /// \param bytes - the size of the storage
+  ///
+  /// \returns - zero filled storage, to be freed with deallocate()
+  static char *allocate(size_t bytes);
+
+  /// Free storage allocated by allocate()
+  ///
+  /// \param data - the storage; may be nullptr
+  static void deallocate(char *data);
+
+  /// Return the storage in the free lists to the system
+  ///
+  /// This may be called while views are in use, which are unaffected.
+  static void trim();
+
+  /// The peak resident set size of this process in kB
+  static size_t peak_resident_kb();
+};
+
+
+} // namespace dashmm
+
+
+#endif // __DASHMM_VIEW_POOL_H__
@@ -72,6 +72,13 @@ class ViewSet {
   /// Clear the ViewSet
   void clear();
 
+  /// Reserve space for a number of views
+  ///
+  /// This avoids growing the set repeatedly when many views are added.
+  ///
+  /// \param count - the number of views
+  void reserve(int count) {views_.reserve(count);}
+
   /// Add a view to the set by index.
   ///
   /// This will indicate that the view at the given index is part of the set,
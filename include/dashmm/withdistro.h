@@ -0,0 +1,57 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+#ifndef __DASHMM_WITH_DISTRO_H__
+#define __DASHMM_WITH_DISTRO_H__
+
+
+/// \file
+/// \brief Select the distribution policy of an existing Method
+
+
+namespace dashmm {
+
+
+/// Use a Method with a different distribution policy
+///
+/// Each Method names the distribution policy used when evaluating with that
+/// Method. WithDistro<Method, Distro>::type is a Method that behaves exactly
+/// as Method, but which is distributed with Distro instead. For example,
+///
+///   Evaluator<Source, Target, Laplace,
+///             WithDistro<FMM97, PartitionDistro>::type>
+///
+/// evaluates with FMM97, placing the DAG with PartitionDistro.
+template <template <typename, typename,
+                    template <typename, typename> class> class Method,
+          typename Distro>
+struct WithDistro {
+  template <typename Source, typename Target,
+            template <typename, typename> class Expansion>
+  class type : public Method<Source, Target, Expansion> {
+   public:
+    using base_t = Method<Source, Target, Expansion>;
+    using method_t = type;
+    using distropolicy_t = Distro;
+
+    using base_t::base_t;
+    type() = default;
+  };
+};
+
+
+} // namespace dashmm
+
+
+#endif // __DASHMM_WITH_DISTRO_H__
@@ -20,14 +20,16 @@
 
 #include <algorithm>
 
+#include "builtins/placement.h"
+
 
 namespace dashmm {
 
 
 void BHDistro::compute_distribution(DAG &dag) {
   sort(dag);
-  assign_localities(dag.target_nodes);
-  assign_localities(dag.source_nodes);
+  place_by_out_edges(dag.target_nodes, false);
+  place_by_out_edges(dag.source_nodes, false);
 }
 
 
@@ -69,48 +71,6 @@ bool BHDistro::color_comparison(const DAGNode *a, const DAGNode *b) {
   return a->color > b->color;
 }
 
-void BHDistro::assign_localities(std::vector<DAGNode *> &nodes) {
-  // Upon entry, the nodes are sorted highest to lowest color
-  for (size_t i = 0; i < nodes.size(); ++i) {
-    compute_locality(nodes[i]);
-  }
-}
-
-void BHDistro::compute_locality(DAGNode *node) {
-  // It already has a locality
-  if (node->locality >= 0) return;
-
-  // A rare case where a node does not enter into the computation. So pick
-  // at random. A better idea might be to wait until all others are placed
-  // ignorning this node, and then pick the best given the localities of the
-  // upstream nodes, but for now, we do something simple.
-  if (node->out_edges.size() == 0) {
-    node->locality = 0;
-  }
-
-  // The typical case; count up weights to each locality
-  int n_ranks = hpx_get_num_ranks();
-  std::vector<int> bins(n_ranks, 0);    // Is there a better choice here?
-  for (size_t i = 0; i < node->out_edges.size(); ++i) {
-    int loc = node->out_edges[i].target->locality;
-    assert(loc >= 0 && loc < n_ranks);
-    bins[loc] += node->out_edges[i].weight;
-  }
-
-  // Find max - currently, the lowest locality in a tie will win.
-  int maxval{bins[0]};
-  size_t maxidx{0};
-  for (int i = 1; i < n_ranks; ++i) {
-    if (bins[i] > maxval) {
-      maxval = bins[i];
-      maxidx = i;
-    }
-  }
-
-  // Set this node to have locality that matches the bulk of outgoing work
-  node->locality = maxidx;
-}
-
 bool BHDistro::distribution_complete(DAG &dag) {
   for (size_t i = 0; i < dag.source_leaves.size(); ++i) {
     if (dag.source_leaves[i]->locality < 0) {
@@ -0,0 +1,203 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+/// \file src/coalescer.cc
+/// \brief Implementation of Coalescer
+
+
+#include "dashmm/coalescer.h"
+
+#include <cassert>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+
+
+namespace dashmm {
+
+
+namespace {
+
+/// Each message in a coalesced parcel follows one of these
+struct RecordHeader {
+  hpx_action_t action;
+  size_t bytes;
+};
+
+/// The records are padded to keep each message suitably aligned
+size_t padded(size_t bytes) {
+  return (bytes + 7) & ~size_t{7};
+}
+
+/// The current time in microseconds, never zero
+int64_t now_us() {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(now)
+                   .count();
+  return std::max(us, int64_t{1});
+}
+
+} // namespace
+
+
+/// Spawn each message of a coalesced parcel with its own action
+int coalesced_delivery_handler(char *data, size_t bytes) {
+  char *end = data + bytes;
+  while (data < end) {
+    RecordHeader head;
+    memcpy(&head, data, sizeof(head));
+    data += padded(sizeof(head));
+
+    hpx_parcel_t *parc = hpx_parcel_acquire(nullptr, head.bytes);
+    assert(parc != nullptr);
+    hpx_parcel_set_action(parc, head.action);
+    hpx_parcel_set_target(parc, HPX_HERE);
+    memcpy(hpx_parcel_get_data(parc), data, head.bytes);
+    hpx_parcel_send(parc, HPX_NULL);
+
+    data += padded(head.bytes);
+  }
+  return HPX_SUCCESS;
+}
+HPX_ACTION(HPX_DEFAULT, HPX_MARSHALLED,
+           coalesced_delivery_action, coalesced_delivery_handler,
+           HPX_POINTER, HPX_SIZE_T);
+
+
+Coalescer::Coalescer(int num_ranks)
+    : num_ranks_{num_ranks}, destinations_{new Destination[num_ranks]},
+      active_{0}, last_poll_{0} {
+  for (int r = 0; r < num_ranks_; ++r) {
+    destinations_[r].lock.clear();
+    destinations_[r].since.store(0);
+  }
+}
+
+
+void Coalescer::send(int rank, hpx_action_t action, const void *data,
+                     size_t bytes) {
+  assert(rank >= 0 && rank < num_ranks_);
+  assert(active_.load(std::memory_order_relaxed) > 0);
+  Destination &dest = destinations_[rank];
+  RecordHeader head{action, bytes};
+
+  while (dest.lock.test_and_set(std::memory_order_acquire)) { }
+  size_t offset = dest.buffer.size();
+  dest.buffer.resize(offset + padded(sizeof(head)) + padded(bytes));
+  memcpy(&dest.buffer[offset], &head, sizeof(head));
+  memcpy(&dest.buffer[offset + padded(sizeof(head))], data, bytes);
+  if (offset == 0) {
+    dest.since.store(now_us(), std::memory_order_relaxed);
+  }
+  bool full = dest.buffer.size() >= kFlushBytes;
+  dest.lock.clear(std::memory_order_release);
+
+  if (full) {
+    flush(rank);
+  } else {
+    poll();
+  }
+}
+
+
+void Coalescer::flush() {
+  for (int r = 0; r < num_ranks_; ++r) {
+    flush(r);
+  }
+}
+
+
+void Coalescer::leave() {
+  if (active_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    flush();
+  } else {
+    poll();
+  }
+}
+
+
+void Coalescer::flush(int rank) {
+  Destination &dest = destinations_[rank];
+  if (dest.since.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+
+  // The parcel is filled under the lock so that the buffer keeps its
+  // capacity for the next messages
+  hpx_parcel_t *parc{nullptr};
+  while (dest.lock.test_and_set(std::memory_order_acquire)) { }
+  if (!dest.buffer.empty()) {
+    parc = make_parcel(rank, dest.buffer);
+    dest.buffer.clear();
+    dest.since.store(0, std::memory_order_relaxed);
+  }
+  dest.lock.clear(std::memory_order_release);
+
+  if (parc != nullptr) {
+    hpx_parcel_send(parc, HPX_NULL);
+  }
+}
+
+
+void Coalescer::poll() {
+  int64_t now = now_us();
+  int64_t last = last_poll_.load(std::memory_order_relaxed);
+  if (now - last < kFlushMicroseconds
+      || !last_poll_.compare_exchange_strong(last, now,
+                                             std::memory_order_relaxed)) {
+    return;
+  }
+
+  for (int r = 0; r < num_ranks_; ++r) {
+    int64_t since = destinations_[r].since.load(std::memory_order_relaxed);
+    if (since != 0 && now - since >= kFlushMicroseconds) {
+      flush(r);
+    }
+  }
+}
+
+
+hpx_parcel_t *Coalescer::make_parcel(int rank,
+                                     const std::vector<char> &buffer) {
+  // A lone message is sent as it is
+  RecordHeader head;
+  memcpy(&head, buffer.data(), sizeof(head));
+  size_t first = padded(sizeof(head)) + padded(head.bytes);
+
+  hpx_parcel_t *parc{nullptr};
+  if (first == buffer.size()) {
+    parc = hpx_parcel_acquire(nullptr, head.bytes);
+    assert(parc != nullptr);
+    hpx_parcel_set_action(parc, head.action);
+    memcpy(hpx_parcel_get_data(parc), buffer.data() + padded(sizeof(head)),
+           head.bytes);
+  } else {
+    parc = hpx_parcel_acquire(nullptr, buffer.size());
+    assert(parc != nullptr);
+    hpx_parcel_set_action(parc, coalesced_delivery_action);
+    memcpy(hpx_parcel_get_data(parc), buffer.data(), buffer.size());
+  }
+  hpx_parcel_set_target(parc, HPX_THERE(rank));
+  return parc;
+}
+
+
+Coalescer &coalescer() {
+  static Coalescer instance{hpx_get_num_ranks()};
+  return instance;
+}
+
+
+} // namespace dashmm
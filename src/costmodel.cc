@@ -0,0 +1,163 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+/// \file src/costmodel.cc
+/// \brief Implementation of CostModel
+
+
+#include "dashmm/costmodel.h"
+
+#include <cassert>
+#include <cmath>
+
+#include <algorithm>
+#include <limits>
+
+#include "dashmm/reductionops.h"
+
+
+namespace dashmm {
+
+
+namespace {
+
+/// The names of the operations for printing
+const char *kOperationNames[CostModel::kNumOps] = {
+  "Nop", "StoM", "StoL", "MtoM", "MtoL", "LtoL",
+  "MtoT", "LtoT", "StoT", "MtoI", "ItoI", "ItoL"
+};
+
+} // namespace
+
+
+/// Create the reduction LCO for the calibration of a CostModel
+int cost_reducer_new_handler(void) {
+  size_t bytes = sizeof(uint64_t) * CostModel::kNumOps * CostModel::kNumSums;
+  hpx_addr_t reducer = hpx_lco_reduce_new(hpx_get_num_ranks(), bytes,
+                                          size_sum_ident, size_sum_op);
+  assert(reducer != HPX_NULL);
+  hpx_exit(sizeof(reducer), &reducer);
+}
+HPX_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
+           cost_reducer_new_action, cost_reducer_new_handler);
+
+
+/// Delete the reduction LCO for the calibration of a CostModel
+int cost_reducer_delete_handler(hpx_addr_t reducer) {
+  hpx_lco_delete_sync(reducer);
+  hpx_exit(0, nullptr);
+}
+HPX_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
+           cost_reducer_delete_action, cost_reducer_delete_handler,
+           HPX_ADDR);
+
+
+CostModel::CostModel() : measuring_{false}, calibrated_{false} {
+  static_assert(sizeof(uint64_t) == sizeof(size_t),
+                "CostModel reduces its sums as size_t");
+  for (int s = 0; s < kStripes; ++s) {
+    for (int op = 0; op < kNumOps; ++op) {
+      for (int i = 0; i < kNumSums; ++i) {
+        stripes_[s].sums[op][i].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+  for (int op = 0; op < kNumOps; ++op) {
+    samples_[op] = 0;
+    fixed_ns_[op] = 0.0;
+    per_size_ns_[op] = 0.0;
+  }
+}
+
+
+void CostModel::record(Operation op, size_t size, double us) {
+  uint64_t ns = static_cast<uint64_t>(std::max(0.0, us * 1000.0));
+  int stripe = std::max(0, hpx_get_my_thread_id()) % kStripes;
+  std::atomic<uint64_t> *sums = stripes_[stripe].sums[static_cast<int>(op)];
+  sums[0].fetch_add(1, std::memory_order_relaxed);
+  sums[1].fetch_add(size, std::memory_order_relaxed);
+  sums[2].fetch_add(ns, std::memory_order_relaxed);
+  sums[3].fetch_add(size * size, std::memory_order_relaxed);
+  sums[4].fetch_add(size * ns, std::memory_order_relaxed);
+}
+
+
+void CostModel::calibrate(hpx_addr_t reducer) {
+  uint64_t sums[kNumOps][kNumSums] = {};
+  for (int s = 0; s < kStripes; ++s) {
+    for (int op = 0; op < kNumOps; ++op) {
+      for (int i = 0; i < kNumSums; ++i) {
+        sums[op][i] += stripes_[s].sums[op][i].load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  hpx_lco_set_lsync(reducer, sizeof(sums), sums, HPX_NULL);
+  hpx_lco_get(reducer, sizeof(sums), sums);
+
+  // Fit time = fixed + per_size * size by least squares. If the sizes do not
+  // vary, or the fit is not physical, the time is instead taken to be either
+  // fixed, or proportional to the size.
+  calibrated_ = false;
+  for (int op = 0; op < kNumOps; ++op) {
+    samples_[op] = sums[op][0];
+    if (samples_[op] == 0) continue;
+    calibrated_ = true;
+
+    double n = sums[op][0];
+    double mean_size = sums[op][1] / n;
+    double mean_ns = sums[op][2] / n;
+    double var_size = sums[op][3] / n - mean_size * mean_size;
+    double cov = sums[op][4] / n - mean_size * mean_ns;
+
+    if (var_size <= 1.0e-6 * mean_size * mean_size) {
+      fixed_ns_[op] = mean_ns;
+      per_size_ns_[op] = 0.0;
+    } else {
+      per_size_ns_[op] = cov / var_size;
+      fixed_ns_[op] = mean_ns - per_size_ns_[op] * mean_size;
+      if (per_size_ns_[op] < 0.0 || fixed_ns_[op] < 0.0) {
+        fixed_ns_[op] = 0.0;
+        per_size_ns_[op] = mean_ns / mean_size;
+      }
+    }
+  }
+}
+
+
+int CostModel::weight(Operation op, size_t size, int estimate) const {
+  int idx = static_cast<int>(op);
+  if (samples_[idx] == 0) {
+    return estimate;
+  }
+  double ns = fixed_ns_[idx] + per_size_ns_[idx] * size;
+  double weight = std::round(ns / kNanosecondsPerWeight);
+  weight = std::min(weight,
+                    static_cast<double>(std::numeric_limits<int>::max()));
+  return std::max(1, static_cast<int>(weight));
+}
+
+
+void CostModel::print(FILE *fd) const {
+  for (int op = 0; op < kNumOps; ++op) {
+    if (samples_[op] == 0) continue;
+    fprintf(fd, "Cost model: %s: %7.6e + %7.6e * size [us] from %lu "
+            "operations\n", kOperationNames[op], fixed_ns_[op] / 1000.0,
+            per_size_ns_[op] / 1000.0,
+            static_cast<unsigned long>(samples_[op]));
+  }
+}
+
+
+} // namespace dashmm
@@ -18,8 +18,13 @@
 
 #include "dashmm/dag.h"
 
+#include <cassert>
 #include <cstdio>
 
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <unordered_set>
 #include <vector>
 
 
@@ -79,12 +84,19 @@ namespace {
 
   void collect_edges(edge_table_t &edges, const std::vector<DAGNode *> &nodes) {
     for (size_t i = 0; i < nodes.size(); ++i) {
-      for (size_t j = 0; j < nodes[i]->out_edges.size(); ++j) {
-        DAGEdge &e = nodes[i]->out_edges[j];
-        edges[optoint(e.op)][nodes[i]->locality][e.target->locality] += 1;
+      for (size_t j = 0; j < nodes[i]->out_count(); ++j) {
+        int op = optoint(nodes[i]->out_edge(j).op());
+        int loc = nodes[i]->out_target(j)->locality;
+        edges[op][nodes[i]->locality][loc] += 1;
       }
     }
   }
+
+  void delete_nodes(std::vector<DAGNode *> &nodes) {
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      delete nodes[i];
+    }
+  }
 }
 
 
@@ -108,6 +120,228 @@ void *DAGNode::tree_node() const {
   return parent_->tree_node();
 }
 
+void DAGNode::sort_out_edges_by_locality() {
+  const DAGNode *base = this - id_;
+  std::sort(edges_, edges_ + out_count_,
+            [base](const DAGEdge &a, const DAGEdge &b) -> bool {
+              const DAGNode &x = base[a.target()];
+              const DAGNode &y = base[b.target()];
+              if (x.locality != y.locality) {
+                return x.locality < y.locality;
+              }
+              return x.priority > y.priority;
+            });
+}
+
+DAGNode *DAGInfo::edge_source(Operation op) const {
+  switch (op) {
+    case Operation::StoM:   // NOTE: fall-through
+    case Operation::StoL:
+    case Operation::StoT:
+      return parts();
+    case Operation::ItoI:   // NOTE: fall-through
+    case Operation::ItoL:
+      return interm();
+    case Operation::Nop:
+      assert(0 && "Nop edges have no source");
+      return nullptr;
+    default:
+      return normal();
+  }
+}
+
+DAGNode *DAGInfo::add_edge_target(Operation op) {
+  switch (op) {
+    case Operation::MtoT:   // NOTE: fall-through
+    case Operation::LtoT:
+    case Operation::StoT:
+      return halo(parts_);
+    case Operation::MtoI:   // NOTE: fall-through
+    case Operation::ItoI:
+      return halo(interm_);
+    case Operation::Nop:
+      assert(0 && "Nop edges have no target");
+      return nullptr;
+    default:
+      return halo(normal_);
+  }
+}
+
+void DAG::prune_remote_edges(int locality) {
+  assert(!finalized());
+  for (auto list : {&source_leaves, &source_nodes,
+                    &target_nodes, &target_leaves}) {
+    for (size_t i = 0; i < list->size(); ++i) {
+      DAGNode *node = (*list)[i];
+      if (node->links_ == nullptr) {
+        continue;
+      }
+      std::vector<DAGLink> &links = *node->links_;
+      links.erase(std::remove_if(links.begin(), links.end(),
+                                 [locality](const DAGLink &link) -> bool {
+                                   return link.target->locality != locality;
+                                 }),
+                  links.end());
+      node->out_count_ = links.size();
+    }
+  }
+}
+
+void DAG::remove_halo(int locality) {
+  assert(!finalized());
+  std::vector<DAGNode *> *lists[4] = {&source_leaves, &source_nodes,
+                                      &target_nodes, &target_leaves};
+
+  // Find the halo nodes that local nodes send to
+  std::unordered_set<const DAGNode *> referenced{};
+  for (auto list : lists) {
+    for (size_t i = 0; i < list->size(); ++i) {
+      const DAGNode *node = (*list)[i];
+      if (node->locality != locality || node->links_ == nullptr) {
+        continue;
+      }
+      for (size_t j = 0; j < node->links_->size(); ++j) {
+        const DAGNode *target = (*node->links_)[j].target;
+        if (target->locality != locality) {
+          referenced.insert(target);
+        }
+      }
+    }
+  }
+
+  // The out edges of the halo belong to other localities, and the halo nodes
+  // that are not referred to are not needed at all
+  for (auto list : lists) {
+    auto last = std::remove_if(list->begin(), list->end(),
+        [locality, &referenced](DAGNode *node) -> bool {
+          if (node->locality == locality) {
+            return false;
+          }
+          delete node->links_;
+          node->links_ = nullptr;
+          node->out_count_ = 0;
+          if (referenced.count(node)) {
+            return false;
+          }
+          node->parent_->remove_node(node);
+          delete node;
+          return true;
+        });
+    list->erase(last, list->end());
+  }
+}
+
+DAG::~DAG() {
+  if (finalized()) {
+    return;
+  }
+  for (auto list : {&source_leaves, &source_nodes,
+                    &target_nodes, &target_leaves}) {
+    for (size_t i = 0; i < list->size(); ++i) {
+      delete (*list)[i]->links_;
+    }
+    delete_nodes(*list);
+  }
+}
+
+void DAG::finalize() {
+  assert(!finalized());
+  std::vector<DAGNode *> *lists[4] = {&source_leaves, &source_nodes,
+                                      &target_nodes, &target_leaves};
+
+  // Number the nodes in the order they will be stored, and measure the
+  // discovery form of the DAG
+  size_t n_nodes{0};
+  size_t n_edges{0};
+  discovery_bytes_ = 0;
+  for (auto list : lists) {
+    for (size_t i = 0; i < list->size(); ++i) {
+      DAGNode *node = (*list)[i];
+      node->id_ = n_nodes++;
+      n_edges += node->out_count_;
+      discovery_bytes_ += sizeof(DAGNode);
+      if (node->links_ != nullptr) {
+        discovery_bytes_ += sizeof(std::vector<DAGLink>)
+            + node->links_->capacity() * sizeof(DAGLink);
+      }
+    }
+  }
+  assert(n_nodes <= std::numeric_limits<uint32_t>::max());
+
+  // The edges of each node form a contiguous range of the edge array. The
+  // array is sized up front, so the ranges handed out remain valid.
+  edges_.reserve(n_edges);
+  for (auto list : lists) {
+    for (size_t i = 0; i < list->size(); ++i) {
+      DAGNode *node = (*list)[i];
+      std::vector<DAGLink> *links = node->links_;
+      node->edges_ = edges_.data() + edges_.size();
+      if (links != nullptr) {
+        for (size_t j = 0; j < links->size(); ++j) {
+          const DAGLink &link = (*links)[j];
+          edges_.push_back(DAGEdge{link.target->id_, link.op, link.weight});
+        }
+        delete links;
+      }
+    }
+  }
+  assert(edges_.size() == n_edges);
+
+  // Move the nodes into the node array, and redirect the DAGInfo objects
+  // and the node lists to their new location
+  nodes_.reserve(n_nodes);
+  for (auto list : lists) {
+    for (size_t i = 0; i < list->size(); ++i) {
+      DAGNode *node = (*list)[i];
+      nodes_.push_back(*node);
+      DAGNode *moved = &nodes_.back();
+      moved->parent_->relocate_node(node, moved);
+      (*list)[i] = moved;
+      delete node;
+    }
+  }
+}
+
+void DAG::prioritize() {
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    nodes_[i].priority = -1;
+  }
+
+  // The paths in the DAG are only a few times the depth of the tree long, so
+  // a recursive traversal is fine
+  std::function<int(DAGNode &)> longest = [&](DAGNode &node) -> int {
+    if (node.priority < 0) {
+      int64_t path{0};
+      for (size_t j = 0; j < node.out_count(); ++j) {
+        const DAGEdge &edge = node.edges_[j];
+        path = std::max(path, static_cast<int64_t>(edge.weight())
+                              + longest(nodes_[edge.target()]));
+      }
+      path += node.in_count();
+      node.priority = static_cast<int>(
+          std::min(path, static_cast<int64_t>(
+                             std::numeric_limits<int>::max())));
+    }
+    return node.priority;
+  };
+
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    longest(nodes_[i]);
+  }
+}
+
+void DAG::print_memory_usage(FILE *fd) const {
+  size_t n_nodes = node_count();
+  size_t n_edges = edge_count();
+  size_t before_edges = discovery_bytes_ - n_nodes * sizeof(DAGNode);
+  fprintf(fd, "DAG: %zu nodes, %zu edges\n", n_nodes, n_edges);
+  fprintf(fd, "DAG: discovery form %zu [bytes]: %zu per node, "
+          "%.1f per edge\n", discovery_bytes_, sizeof(DAGNode),
+          n_edges ? (double)before_edges / n_edges : 0.0);
+  fprintf(fd, "DAG: compact form %zu [bytes]: %zu per node, %zu per edge\n",
+          bytes(), sizeof(DAGNode), sizeof(DAGEdge));
+}
+
 void DAG::printedges(int n) {
   edge_table_t edges = zero_table(n);
   collect_edges(edges, source_leaves);
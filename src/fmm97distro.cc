@@ -22,6 +22,8 @@
 #include <map>
 #include <limits>
 
+#include "builtins/placement.h"
+
 
 namespace dashmm {
 
@@ -29,11 +31,7 @@ namespace dashmm {
 void FMM97Distro::compute_distribution(DAG &dag) {
   std::sort(dag.target_nodes.begin(), dag.target_nodes.end(),
             color_comparison);
-  for (size_t i = 0; i < dag.target_nodes.size(); ++i) {
-    if (dag.target_nodes[i]->is_interm()) {
-      compute_locality(dag.target_nodes[i]);
-    }
-  }
+  place_by_out_edges(dag.target_nodes, true);
 }
 
 void FMM97Distro::assign_for_source(DAGInfo &dag, int locality) {
@@ -66,39 +64,4 @@ bool FMM97Distro::color_comparison(const DAGNode *a, const DAGNode *b) {
   return a->color > b->color;
 }
 
-void FMM97Distro::compute_locality(DAGNode *node) {
-  // It already has a locality
-  if (node->locality >= 0) return;
-
-  // A rare case where a node does not enter into the computation. So pick
-  // at random. A better idea might be to wait until all others are placed
-  // ignorning this node, and then pick the best given the localities of the
-  // upstream nodes, but for now, we do something simple.
-  if (node->out_edges.size() == 0) {
-    node->locality = 0;
-  }
-
-  // The typical case; count up weights to each locality
-  int n_ranks = hpx_get_num_ranks();
-  std::vector<int> bins(n_ranks, 0);    // Is there a better choice here?
-  for (size_t i = 0; i < node->out_edges.size(); ++i) {
-    int loc = node->out_edges[i].target->locality;
-    assert(loc >= 0 && loc < n_ranks);
-    bins[loc] += node->out_edges[i].weight;
-  }
-
-  // Find max - currently, the lowest locality in a tie will win.
-  int maxval{bins[0]};
-  size_t maxidx{0};
-  for (int i = 1; i < n_ranks; ++i) {
-    if (bins[i] > maxval) {
-      maxval = bins[i];
-      maxidx = i;
-    }
-  }
-
-  // Set this node to have locality that matches the bulk of outgoing work
-  node->locality = maxidx;
-}
-
 } // dashmm
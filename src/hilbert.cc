@@ -86,28 +86,30 @@ namespace {
   
 #endif
 
-  std::vector<int> partition(const std::vector<int> &counts,
+  std::vector<int> partition(const std::vector<int64_t> &counts,
                              int np,
                              int len) {
     std::vector<int> retval(len);
 
-    int *cumulative = new int [len + 1];
+    int64_t *cumulative = new int64_t [len + 1];
     cumulative[0] = 0;
     for (int i = 1; i <= len; ++i) {
       cumulative[i] = counts[i - 1] + cumulative[i - 1];
     }
 
-    int target_share = cumulative[len] / np;
+    int64_t target_share = cumulative[len] / np;
 
     std::vector<int> cuts(np);
     for (int split = 1; split < np; ++split) {
-      int my_target = target_share * split;
-      auto fcn = [&my_target] (const int &a) -> bool {return a < my_target;};
-      int *splitter = std::partition_point(cumulative, &cumulative[len + 1],
-                                           fcn);
-      int upper_delta = *splitter - my_target;
+      int64_t my_target = target_share * split;
+      auto fcn = [&my_target] (const int64_t &a) -> bool {
+        return a < my_target;
+      };
+      int64_t *splitter = std::partition_point(cumulative,
+                                               &cumulative[len + 1], fcn);
+      int64_t upper_delta = *splitter - my_target;
       assert(upper_delta >= 0);
-      int lower_delta = my_target - *(splitter - 1);
+      int64_t lower_delta = my_target - *(splitter - 1);
       assert(lower_delta >= 0);
       int split_index = upper_delta < lower_delta
                           ? splitter - cumulative
@@ -133,6 +135,71 @@ namespace {
     return retval;
   }
 
+  // Map the uniform nodes into their order along the curve
+  //
+  // The returned vector gives the index of the uniform node at each position
+  // of the curve.
+  std::vector<int> curve_order(int len, int lvl) {
+    int klen = 1 << lvl;  // the number of nodes in one direction is 2^lvl
+
+    std::vector<int> origin(len);
+    for (int zidx = 0; zidx < klen; ++zidx) {
+      int zpart = zidx * klen * klen;
+      for (int yidx = 0; yidx < klen; ++yidx) {
+        int ypart = zpart + yidx * klen;
+        for (int xidx = 0; xidx < klen; ++xidx) {
+          int i = xidx + ypart;
+#ifndef USEMORTONKEYS
+          int hidx = hilbert_key(xidx, yidx, zidx, klen);
+#else
+          int hidx = morton_key(xidx, yidx, zidx);
+#endif
+          origin[hidx] = i;
+        }
+      }
+    }
+
+    return origin;
+  }
+
+  // Cut the curve into segments of equal weight
+  int *distribute_on_curve(int num_ranks,
+                           const std::vector<int64_t> &weights,
+                           int len,
+                           int lvl) {
+    std::vector<int> origin = curve_order(len, lvl);
+    std::vector<int64_t> counts(len);
+    for (int hidx = 0; hidx < len; ++hidx) {
+      counts[hidx] = weights[origin[hidx]];
+    }
+
+    // Break up the segments
+    std::vector<int> rm = partition(counts, num_ranks, len);
+
+    // Map back into the original index
+    int *retval = new int[len];
+    for (int hidx = 0; hidx < len; ++hidx) {
+      retval[origin[hidx]] = rm[hidx];
+    }
+
+    return retval;
+  }
+
+  // The depth below the uniform level of a tree holding n evenly spread
+  // points, refined until the leaves hold no more than limit points
+  int refined_depth(int64_t n, int limit) {
+    int depth = 0;
+    for (int64_t capacity = std::max(limit, 1); n > capacity; capacity *= 8) {
+      ++depth;
+    }
+    return depth;
+  }
+
+  // The number of nodes in a complete octree of the given depth
+  int64_t octree_nodes(int depth) {
+    return ((int64_t{1} << (3 * (depth + 1))) - 1) / 7;
+  }
+
 } // {anonymous}
 
 
@@ -140,41 +207,100 @@ int *distribute_points_hilbert(int num_ranks,
                                const int *global,
                                int len,
                                int lvl) {
-  int klen = 1 << lvl;  // the number of nodes in one direction is 2^lvl
+  const int *s = global; // Source counts
+  const int *t = &global[len]; // Target counts
+
+  std::vector<int64_t> counts(len);
+  for (int i = 0; i < len; ++i) {
+    counts[i] = s[i] + t[i];
+  }
+
+  return distribute_on_curve(num_ranks, counts, len, lvl);
+}
+
+
+std::vector<int64_t> estimate_work_uniform(const int *global,
+                                           int len,
+                                           int lvl,
+                                           int limit) {
+  int klen = 1 << lvl;
 
   const int *s = global; // Source counts
   const int *t = &global[len]; // Target counts
 
-  // accumulate the counts and setup an inverse mapping
-  std::vector<int> counts(len);
-  std::vector<int> origin(len);
+  std::vector<int64_t> retval(len);
   for (int zidx = 0; zidx < klen; ++zidx) {
-    int zpart = zidx * klen * klen;
     for (int yidx = 0; yidx < klen; ++yidx) {
-      int ypart = zpart + yidx * klen;
       for (int xidx = 0; xidx < klen; ++xidx) {
-        int i = xidx + ypart;
-#ifndef USEMORTONKEYS
-        int hidx = hilbert_key(xidx, yidx, zidx, klen);
-#else
-        int hidx = morton_key(xidx, yidx, zidx);
-#endif
-        counts[hidx] = s[i] + t[i];
-        origin[hidx] = i;
+        int i = xidx + yidx * klen + zidx * klen * klen;
+        int s_depth = refined_depth(s[i], limit);
+        int t_depth = refined_depth(t[i], limit);
+
+        // If the targets are not refined below the uniform level, they
+        // interact with every source of the neighboring uniform nodes.
+        // Otherwise the neighbors of each target leaf are inside this uniform
+        // node, and hold the share of its sources in 27 leaves.
+        int64_t near{0};
+        if (t_depth == 0) {
+          for (int dz = -1; dz <= 1; ++dz) {
+            int z = zidx + dz;
+            if (z < 0 || z >= klen) continue;
+            for (int dy = -1; dy <= 1; ++dy) {
+              int y = yidx + dy;
+              if (y < 0 || y >= klen) continue;
+              for (int dx = -1; dx <= 1; ++dx) {
+                int x = xidx + dx;
+                if (x < 0 || x >= klen) continue;
+                near += s[x + y * klen + z * klen * klen];
+              }
+            }
+          }
+        } else {
+          near = 27 * int64_t{s[i]} / (int64_t{1} << (3 * t_depth));
+        }
+
+        int64_t far{0};
+        if (s[i]) {
+          far += octree_nodes(s_depth);
+        }
+        if (t[i]) {
+          far += octree_nodes(t_depth);
+        }
+
+        retval[i] = t[i] * near + kFarFieldWorkPerNode * far;
       }
     }
   }
 
-  // Break up the segments
-  std::vector<int> rm = partition(counts, num_ranks, len);
+  return retval;
+}
 
-  // Map back into the original index
-  int *retval = new int[len];
-  for (int hidx = 0; hidx < len; ++hidx) {
-    retval[origin[hidx]] = rm[hidx];
-  }
 
-  return retval;
+int *distribute_work_hilbert(int num_ranks,
+                             const int *global,
+                             int len,
+                             int lvl,
+                             int limit) {
+  std::vector<int64_t> work = estimate_work_uniform(global, len, lvl, limit);
+  return distribute_on_curve(num_ranks, work, len, lvl);
+}
+
+
+double work_imbalance(int num_ranks,
+                      const int *rank_map,
+                      const std::vector<int64_t> &work,
+                      int len) {
+  std::vector<int64_t> per_rank(num_ranks, 0);
+  int64_t total{0};
+  for (int i = 0; i < len; ++i) {
+    per_rank[rank_map[i]] += work[i];
+    total += work[i];
+  }
+  if (total == 0) {
+    return 1.0;
+  }
+  int64_t most = *std::max_element(per_rank.begin(), per_rank.end());
+  return static_cast<double>(most) * num_ranks / total;
 }
 
 
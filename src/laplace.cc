@@ -16,7 +16,10 @@
 /// Implementation of Laplace kernel
 
 
+#include <algorithm>
+
 #include "builtins/laplace.h"
+#include "builtins/scratch.h"
 
 namespace dashmm {
 
@@ -65,6 +68,11 @@ void lap_rotate_sph_y(const dcomplex_t *M, const double *d, dcomplex_t *MR) {
   }  
 }
 
+void lap_m_to_l(const LaplaceM2L &op, const dcomplex_t *M, double scale,
+                dcomplex_t *L) {
+  builtin_laplace_table_->kernels()->m_to_l(op, M, scale, L);
+}
+
 void lap_s_to_m(Point dist, double q, double scale, dcomplex_t *M) {
   int p = builtin_laplace_table_->p();
   const double *sqf = builtin_laplace_table_->sqf();
@@ -142,136 +150,63 @@ void lap_s_to_l(Point dist, double q, double scale, dcomplex_t *L) {
   }
 }
 
-void lap_m_to_m(int from_child, const dcomplex_t *M, dcomplex_t *W) {
-  int p = builtin_laplace_table_->p();
-  const double *sqbinom = builtin_laplace_table_->sqbinom();
-
-  // Get precomputed Wigner d-matrix for rotation about the y-axis
-  const double *d1 = (from_child < 4 ?
-                      builtin_laplace_table_->dmat_plus(1.0 / sqrt(3.0)) :
-                      builtin_laplace_table_->dmat_plus(-1.0 / sqrt(3.0)));
-  const double *d2 = (from_child < 4 ?
-                      builtin_laplace_table_->dmat_minus(1.0 / sqrt(3.0)) :
-                      builtin_laplace_table_->dmat_minus(-1.0 / sqrt(3.0)));
-  
-  // Shift distance along the z-axis, combined with Y_n^0(pi, 0)
-  const double rho = -sqrt(3) / 2;
-
-  // Compute powers of rho
-  std::vector<double> powers_rho(p + 1); 
-  powers_rho[0] = 1.0;
-  for (int i = 1; i <= p; ++i) {
-    powers_rho[i] = powers_rho[i - 1] * rho;
-  }
+namespace {
 
-  std::vector<dcomplex_t> T((p + 1) * (p + 2) / 2); 
-
-  // Table of rotation angle about the z-axis, as an integer multiple of pi/4
-  const int tab_alpha[8] = {1, 3, 7, 5, 1, 3, 7, 5};
-  // Get rotation angle about the z-axis
-  double alpha = tab_alpha[from_child] * M_PI_4;
+// Shared part of the batched S->M and S->L. The tile is processed kSphLanes
+// sources at a time. With local false, the radial factor is q (r scale)^n;
+// with local true, it is q / r / (r scale)^n.
+void lap_s_to_expansion(const NearFieldSources &sources,
+                        const Point &center, double scale, bool local,
+                        dcomplex_t *E) {
+  constexpr int L = kSphLanes;
+  int p = builtin_laplace_table_->p();
+  const double *sqf = builtin_laplace_table_->sqf();
 
-  // Rotate the multipole expansion of the child box about z-axis
-  lap_rotate_sph_z(M, alpha, W); 
+  BuiltinScratch scratch{};
+  double *legendre = scratch.doubles((p + 1) * (p + 2) / 2 * L);
+  double *ephi_re = scratch.doubles((p + 1) * L);
+  double *ephi_im = scratch.doubles((p + 1) * L);
+  double *rad = scratch.doubles((p + 1) * L);
+  double dx[L], dy[L], dz[L], q[L], r[L], factor[L];
 
-  // Rotate the previous result further about the y-axis
-  lap_rotate_sph_y(W, d1, T.data());
+  auto coef = [sqf](int n, int m) { return sqf[n - m] / sqf[n + m]; };
 
-  // Offset to operate multipole expansion
-  int offset = 0;
+  for (int base = 0; base < sources.count; base += L) {
+    nf_source_lanes(sources, base, center, dx, dy, dz, q);
+    sph_coords_lanes(p, dx, dy, dz, -1.0, r, legendre, ephi_re, ephi_im);
 
-  // Shift along the z-axis by a distance of rho, write result in W
-  for (int n = 0; n <= p; ++n) {
-    for (int m = 0; m <= n; ++m) {
-      W[offset] = T[offset];
-      for (int k = 1; k <= n - m; ++k) {
-        W[offset] += T[midx(n - k, m)] * powers_rho[k] *
-          sqbinom[midx(n - m, k)] * sqbinom[midx(n + m, k)];
+    for (int k = 0; k < L; ++k) {
+      factor[k] = local ? 1.0 / (r[k] * scale) : r[k] * scale;
+      rad[k] = local ? q[k] / r[k] : q[k];
+    }
+    for (int n = 1; n <= p; ++n) {
+      for (int k = 0; k < L; ++k) {
+        rad[n * L + k] = rad[(n - 1) * L + k] * factor[k];
       }
-      offset++;
     }
-  }
-  
-  // Reverse rotate the shifted harmonic expansion about the y-axis
-  lap_rotate_sph_y(W, d2, T.data());
-
-  // Reverse rotate the previous result further about the z-axis
-  lap_rotate_sph_z(T.data(), -alpha, W);
 
-  double temp = 1;
-  offset = 0;
-  for (int n = 0; n <= p; ++n) {
-    for (int m = 0; m <= n; ++m) {
-      W[offset++] *= temp;
-    }
-    temp /= 2;
+    sph_accumulate_lanes(p, rad, legendre, ephi_re, ephi_im, coef, E);
   }
 }
 
-void lap_l_to_l(int to_child, const dcomplex_t *L, dcomplex_t *W) {
-  int p = builtin_laplace_table_->p();
-  const double *sqbinom = builtin_laplace_table_->sqbinom();
-
-  // Get precomputed Wigner d-matrix for rotation about the y-axis
-  const double *d1 = (to_child < 4 ?
-                      builtin_laplace_table_->dmat_plus(1.0 / sqrt(3.0)) :
-                      builtin_laplace_table_->dmat_plus(-1.0 / sqrt(3.0)));
-  const double *d2 = (to_child < 4 ?
-                      builtin_laplace_table_->dmat_minus(1.0 / sqrt(3.0)) :
-                      builtin_laplace_table_->dmat_minus(-1.0 / sqrt(3.0)));
-
-  // Shift distance along the z-axis, combined with Y_n^0(pi, 0)
-  const double rho = -sqrt(3) / 4;
-
-  // Compute powers of rho
-  std::vector<double> powers_rho(p + 1); 
-  powers_rho[0] = 1.0;
-  for (int i = 1; i <= p; ++i) {
-    powers_rho[i] = powers_rho[i - 1] * rho;
-  }
+} // anonymous namespace
 
-  std::vector<dcomplex_t> T((p + 1) * (p + 2) / 2);
+void lap_s_to_m(const NearFieldSources &sources, const Point &center,
+                double scale, dcomplex_t *M) {
+  lap_s_to_expansion(sources, center, scale, false, M);
+}
 
-  // Table of rotation angle about the z-axis as an integer multiple of pi / 4
-  const int tab_alpha[8] = {1, 3, 7, 5, 1, 3, 7, 5};
-  // Get rotation angle about the z-axis
-  double alpha = tab_alpha[to_child] * M_PI_4;
-  
-  // Rotate the local expansion of the parent box about z-axis
-  lap_rotate_sph_z(L, alpha, W);
+void lap_s_to_l(const NearFieldSources &sources, const Point &center,
+                double scale, dcomplex_t *L) {
+  lap_s_to_expansion(sources, center, scale, true, L);
+}
 
-  // Rotate the previous result further about the y-axis
-  lap_rotate_sph_y(W, d1, T.data());
+void lap_m_to_m(int from_child, const dcomplex_t *M, dcomplex_t *W) {
+  builtin_laplace_table_->kernels()->m_to_m(from_child, M, W);
+}
 
-  // Offset to operate local expansion
-  int offset = 0;
-  
-  // Shift along the z-axis by a distance of rho, write result in W1
-  for (int n = 0; n <= p; ++n) {
-    for (int m = 0; m <= n; ++m) {
-      W[offset] = T[offset];
-      for (int k = 1; k <= p - n; k++) {
-        W[offset] += T[midx(n + k, m)] * powers_rho[k] *
-          sqbinom[midx(n + k - m, k)] * sqbinom[midx(n + k + m, k)];
-      }
-      offset++;
-    }
-  }
-  
-  // Reverse rotate the shifted harmonic expansion about the y-axis
-  lap_rotate_sph_y(W, d2, T.data());
-  
-  // Reverse rotate the previous result further about the z-axis
-  lap_rotate_sph_z(T.data(), -alpha, W);
-  
-  double temp = 1;
-  offset = 0;
-  for (int n = 0; n <= p; ++n) {
-    for (int m = 0; m <= n; ++m) {
-      W[offset++] *= temp;
-    }
-    temp /= 2;
-  }
+void lap_l_to_l(int to_child, const dcomplex_t *L, dcomplex_t *W) {
+  builtin_laplace_table_->kernels()->l_to_l(to_child, L, W);
 }
 
 void lap_m_to_i(const dcomplex_t *M, ViewSet &views, int id) {
@@ -295,87 +230,81 @@ void lap_m_to_i(const dcomplex_t *M, ViewSet &views, int id) {
   const int *m_ = builtin_laplace_table_->m();
   const int *f_ = builtin_laplace_table_->f();
   const int *smf_ = builtin_laplace_table_->smf();
-  const double *d1 = builtin_laplace_table_->dmat_plus(0.0);
-  const double *d2 = builtin_laplace_table_->dmat_minus(0.0);
+  const double *d1 = builtin_laplace_table_->dmat_plus(kDMatEquator);
+  const double *d2 = builtin_laplace_table_->dmat_minus(kDMatEquator);
   const double *lambdaknm = builtin_laplace_table_->lambdaknm();
   const dcomplex_t *ealphaj = builtin_laplace_table_->ealphaj();
 
-  // Allocate scratch space to handle x- and y-direction
-  // exponential expansions
-  std::vector<dcomplex_t> W1((p + 1) * (p + 2) / 2);
-  std::vector<dcomplex_t> W2((p + 1) * (p + 2) / 2);
-  
+  // Scratch space for the x- and y-direction spherical harmonic expansions,
+  // and for the partial sums over n
+  int fmax = 0;
+  for (int k = 0; k < s; ++k) {
+    fmax = std::max(fmax, f_[k]);
+  }
+  BuiltinScratch scratch{};
+  dcomplex_t *W1 = scratch.complexes(nsh);
+  dcomplex_t *W2 = scratch.complexes(nsh);
+  dcomplex_t *z1 = scratch.complexes(fmax + 1);
+  dcomplex_t *z2 = scratch.complexes(fmax + 1);
+
   // Setup y-direction. Rotate the multipole expansion M about z-axis by -pi /
   // 2, making (x, y, z) frame (-y, x, z). Next, rotate it again about the new
   // y axis by -pi / 2. The (-y, x, z) in the first rotated frame becomes (z,
   // x, y) in the final frame.
-  lap_rotate_sph_z(M, -M_PI / 2, W1.data());
-  lap_rotate_sph_y(W1.data(), d2, W2.data());
+  lap_rotate_sph_z(M, -M_PI / 2, W1);
+  lap_rotate_sph_y(W1, d2, W2);
 
   // Setup x-direction. Rotate the multipole expansion M about y axis by pi /
   // 2. This makes (x, y, z) frame into (-z, y, x).
-  lap_rotate_sph_y(M, d1, W1.data());
+  lap_rotate_sph_y(M, d1, W1);
 
   // Addresses of the spherical harmonic expansions
-  const dcomplex_t *SH[3] = {W1.data(), W2.data(), M};
+  const dcomplex_t *SH[3] = {W1, W2, M};
 
   for (int dir = 0; dir <= 2; ++dir) {
     int offset = 0;
     for (int k = 0; k < s ; ++k) {
       double weight = weight_[k] / m_[k];
+      const double *lkn = &lambdaknm[k * nsh];
 
       // Compute sum_{n = m}^p M_n^m * lambda_k^n / sqrt((n+m)! * (n - m)!)
-      // z1 handles M_n^m where n is even
-      std::vector<dcomplex_t> z1(f_[k] + 1);
-      // z2 handles M_n^m where n is odd
-      std::vector<dcomplex_t> z2(f_[k] + 1);
-      
-      // Process M_n^0 terms
-      z1[0] = 0;
-      z2[0] = 0;
-      for (int n = 0; n <= p; n += 2) {
-        z1[0] += SH[dir][midx(n, 0)] * lambdaknm[k * nsh + midx(n, 0)];
-      }
-      for (int n = 1; n <= p; n += 2) {
-        z2[0] += SH[dir][midx(n, 0)] * lambdaknm[k * nsh + midx(n, 0)];
-      }
-
-      // Process M_n^m terms for nonzero m
-      for (int m = 1; m <= f_[k]; m += 2) {
-        z1[m] = 0;
-        z2[m] = 0;
+      // z1 handles M_n^m where n is even, z2 handles M_n^m where n is odd
+      for (int m = 0; m <= f_[k]; ++m) {
+        dcomplex_t from_m{0.0, 0.0};
+        dcomplex_t from_m1{0.0, 0.0};
         for (int n = m; n <= p; n += 2) {
-          z2[m] += SH[dir][midx(n, m)] * lambdaknm[k * nsh + midx(n, m)];
+          from_m += SH[dir][midx(n, m)] * lkn[midx(n, m)];
         }
         for (int n = m + 1; n <= p; n += 2) {
-          z1[m] += SH[dir][midx(n, m)] * lambdaknm[k * nsh + midx(n, m)];
+          from_m1 += SH[dir][midx(n, m)] * lkn[midx(n, m)];
         }
+        z1[m] = (m % 2 ? from_m1 : from_m);
+        z2[m] = (m % 2 ? from_m : from_m1);
       }
-      
-      for (int m = 2; m <= f_[k]; m += 2) {
-        z1[m] = 0;
-        z2[m] = 0;
-        for (int n = m; n <= p; n += 2) {
-          z1[m] += SH[dir][midx(n, m)] * lambdaknm[k * nsh + midx(n, m)];
-        }
-        for (int n = m + 1; n <= p; n += 2) {
-          z2[m] += SH[dir][midx(n, m)] * lambdaknm[k * nsh + midx(n, m)];
-        }
-      }
-      
-      // Compute W(k, j)
+
+      // Compute W(k, j). The terms for m > 0 are 2 Re(e^{i m alpha_j} z) i^m,
+      // which are real numbers rotated by a power of i. They are summed by
+      // m mod 4 and the rotation applied once at the end.
       for (int j = 1; j <= m_[k] / 2; ++j) {
-        dcomplex_t up = z1[0] + z2[0]; // accumulate +dir
-        dcomplex_t dn = z1[0] - z2[0]; // accumulate -dir
-        dcomplex_t power_I {0.0, 1.0};
+        const dcomplex_t *ea = &ealphaj[smf_[k] + (j - 1) * f_[k]];
+        double up[4] = {0.0, 0.0, 0.0, 0.0};
+        double dn[4] = {0.0, 0.0, 0.0, 0.0};
         for (int m = 1; m <= f_[k]; ++m) {
-          int idx = smf_[k] + (j - 1) * f_[k] + (m - 1);
-          up += 2 * real(ealphaj[idx] * (z1[m] + z2[m])) * power_I;
-          dn += 2 * real(ealphaj[idx] * (z1[m] - z2[m])) * power_I;
-          power_I *= dcomplex_t{0.0, 1.0};
+          double er = ea[m - 1].real();
+          double ei = ea[m - 1].imag();
+          double sr = z1[m].real() + z2[m].real();
+          double si = z1[m].imag() + z2[m].imag();
+          double dr = z1[m].real() - z2[m].real();
+          double di = z1[m].imag() - z2[m].imag();
+          up[m & 3] += er * sr - ei * si;
+          dn[m & 3] += er * dr - ei * di;
         }
-        EP[dir][offset] = weight * up;
-        EM[dir][offset] = weight * dn;
+        dcomplex_t u = z1[0] + z2[0];
+        dcomplex_t d = z1[0] - z2[0];
+        EP[dir][offset] = weight * dcomplex_t{
+          u.real() + 2 * (up[0] - up[2]), u.imag() + 2 * (up[1] - up[3])};
+        EM[dir][offset] = weight * dcomplex_t{
+          d.real() + 2 * (dn[0] - dn[2]), d.imag() + 2 * (dn[1] - dn[3])};
         offset++;
       }
     }
@@ -405,12 +334,12 @@ void lap_i_to_i(Index s_index, Index t_index, const ViewSet &s_views,
   // Each S is going to generate between 1 and 3 views of the exponential
   // expansions on the target side.
   size_t view_size = nexp * sizeof(dcomplex_t);
-  dcomplex_t *T1 = new dcomplex_t[nexp]();
-  dcomplex_t *T2 = new dcomplex_t[nexp]();
-  dcomplex_t *T3 = new dcomplex_t[nexp]();
-  char *C1 = reinterpret_cast<char *>(T1);
-  char *C2 = reinterpret_cast<char *>(T2);
-  char *C3 = reinterpret_cast<char *>(T3);
+  char *C1 = ViewPool::allocate(view_size);
+  char *C2 = ViewPool::allocate(view_size);
+  char *C3 = ViewPool::allocate(view_size);
+  dcomplex_t *T1 = reinterpret_cast<dcomplex_t *>(C1);
+  dcomplex_t *T2 = reinterpret_cast<dcomplex_t *>(C2);
+  dcomplex_t *T3 = reinterpret_cast<dcomplex_t *>(C3);
   dcomplex_t *T[3] = {T1, T2, T3};
   char *C[3] = {C1, C2, C3};
   bool used[3] = {false, false, false};
@@ -440,10 +369,10 @@ void lap_i_to_i(Index s_index, Index t_index, const ViewSet &s_views,
   }
   
   if (used[1] == false)
-    delete [] T2;
+    ViewPool::deallocate(C2);
   
   if (used[2] == false)
-    delete [] T3;
+    ViewPool::deallocate(C3);
 }
 
 void lap_i_to_l(const ViewSet &views, int id, Index t_index, 
@@ -483,7 +412,9 @@ void lap_i_to_l(const ViewSet &views, int id, Index t_index,
     (t_index.x() % 2);
   
   int nexp = builtin_laplace_table_->nexp();
-  dcomplex_t *S = new dcomplex_t[nexp * 6]();
+  BuiltinScratch scratch{};
+  dcomplex_t *S = scratch.complexes(nexp * 6);
+  std::fill(S, S + nexp * 6, dcomplex_t{0.0, 0.0});
   dcomplex_t *S_mz = S;
   dcomplex_t *S_pz = S + nexp;
   dcomplex_t *S_my = S + 2 * nexp;
@@ -632,8 +563,6 @@ void lap_i_to_l(const ViewSet &views, int id, Index t_index,
   lap_e_to_l(S_py, 'y', true, L);
   lap_e_to_l(S_mx, 'x', false, L);
   lap_e_to_l(S_px, 'x', true, L);
-  
-  delete [] S;
 }
 
 void lap_e_to_e(dcomplex_t *M, const dcomplex_t *W, int x, int y, int z) {
@@ -670,103 +599,104 @@ void lap_e_to_l(const dcomplex_t *E, char dir, bool sgn, dcomplex_t *L) {
   const int *smf_ = builtin_laplace_table_->smf();
   int p = builtin_laplace_table_->p();
   int s = builtin_laplace_table_->s();
+  int nsh = (p + 1) * (p + 2) / 2;
+
+  int fmax = 0;
+  for (int k = 0; k < s; ++k) {
+    fmax = std::max(fmax, f_[k]);
+  }
+  BuiltinScratch scratch{};
+  dcomplex_t *W1 = scratch.complexes(nsh);
+  dcomplex_t *W2 = scratch.complexes(nsh);
+  dcomplex_t *z = scratch.complexes(fmax + 1);
+  std::fill(W1, W1 + nsh, dcomplex_t{0.0, 0.0});
 
-  dcomplex_t *contrib = nullptr;
-  dcomplex_t *W1 = new dcomplex_t[(p + 1) * (p + 2) / 2];
-  dcomplex_t *W2 = new dcomplex_t[(p + 1) * (p + 2) / 2];
-  
   for (int k = 0; k < s; ++k) {
     int Mk2 = m_[k] / 2;
-    
-    // Compute sum_{j = 1}^{M(k)} W(k, j) exp(-i * m * alpha_j)
-    dcomplex_t *z = new dcomplex_t[f_[k] + 1];
-    
-    // m = 0
-    z[0] = 0.0;
-    for (int j = 1; j <= Mk2; ++j) {
-      int idx = sm_[k] + j - 1;
-      z[0] += (E[idx] + conj(E[idx]));
+    const dcomplex_t *Ek = &E[sm_[k]];
+
+    // Compute i^m sum_{j = 1}^{M(k)} W(k, j) exp(-i * m * alpha_j). The sum
+    // over the conjugate pairs of j leaves 2 Re(W) for even m and 2i Im(W)
+    // for odd m, so only real products are formed.
+    double z0 = 0.0;
+    for (int j = 0; j < Mk2; ++j) {
+      z0 += 2 * Ek[j].real();
     }
-    
-    // m = 1, ..., F(k), where m is odd
-    for (int m = 1; m <= f_[k]; m += 2) {
-      z[m] = 0.0;
-      for (int j = 1; j <= Mk2; ++j) {
-        int idx1 = sm_[k] + j - 1;
-        int idx2 = smf_[k] + (j - 1) * f_[k] + m - 1;
-        z[m] += (E[idx1] - conj(E[idx1])) * conj(ealphaj[idx2]);
+    z[0] = z0;
+
+    for (int m = 1; m <= f_[k]; ++m) {
+      const dcomplex_t *ea = &ealphaj[smf_[k] + m - 1];
+      double re = 0.0;
+      double im = 0.0;
+      if (m % 2) {
+        for (int j = 0; j < Mk2; ++j) {
+          double w = 2 * Ek[j].imag();
+          re += w * ea[j * f_[k]].imag();
+          im += w * ea[j * f_[k]].real();
+        }
+      } else {
+        for (int j = 0; j < Mk2; ++j) {
+          double w = 2 * Ek[j].real();
+          re += w * ea[j * f_[k]].real();
+          im -= w * ea[j * f_[k]].imag();
+        }
       }
-    }
-    
-    // m = 2, ..., F(k), where m is even
-    for (int m = 2; m <= f_[k]; m += 2) {
-      z[m] = 0.0;
-      for (int j = 1; j <= Mk2; ++j) {
-        int idx1 = sm_[k] + j - 1;
-        int idx2 = smf_[k] + (j - 1) * f_[k] + m - 1;
-        z[m] += (E[idx1] + conj(E[idx1])) * conj(ealphaj[idx2]);
+      switch (m & 3) {
+      case 0:
+        z[m] = dcomplex_t{re, im};
+        break;
+      case 1:
+        z[m] = dcomplex_t{-im, re};
+        break;
+      case 2:
+        z[m] = dcomplex_t{-re, -im};
+        break;
+      case 3:
+        z[m] = dcomplex_t{im, -re};
+        break;
       }
     }
 
-    // Compute lambda_k's contribution
-    double power_lambdak = 1.0; // (-lambda_k)^n
+    // Compute lambda_k's contribution. The factor is (-lambda_k)^n; if the
+    // exponential expansion is not along the positive direction of the axis
+    // with respect to the source, the terms with odd n change sign, leaving
+    // lambda_k^n.
+    double factor = (sgn ? -lambda[k] : lambda[k]);
+    double power_lambdak = 1.0;
     for (int n = 0; n <= p; ++n) {
-      int mmax = fmin(n, f_[k]);
+      int mmax = std::min(n, f_[k]);
+      dcomplex_t *Wn = &W1[midx(n, 0)];
       for (int m = 0; m <= mmax; ++m) {
-        W1[midx(n, m)] += power_lambdak * z[m];
-      }
-      power_lambdak *= -lambda[k];
-    }
-    delete [] z;
-  }
-  
-  if (!sgn) {
-    // If the exponential expansion is not along the positive direction of the
-    // axis with respect to the source, flip the sign of the converted L_n^m
-    // terms where n is odd.
-    int offset = 1; // address of L_1^0
-    for (int n = 1; n <= p; n += 2) {
-      for (int m = 0; m <= n; ++m) {
-        W1[offset++] *= -1;
+        Wn[m] += power_lambdak * z[m];
       }
-      offset += (n + 2); // skip the storage for the even value of n
+      power_lambdak *= factor;
     }
   }
-  
-  // Scale the local expansion by i^m / sqrt((n - m)!(n + m)!)
+
+  // Scale the local expansion by 1 / sqrt((n - m)!(n + m)!); the factor i^m
+  // was applied to z above.
   int offset = 0;
   for (int n = 0; n <= p; ++n) {
-    dcomplex_t power_I{1.0, 0.0};
     for (int m = 0; m <= n; ++m) {
-      W1[offset++] *= power_I / sqf[n - m] / sqf[n + m];
-      power_I *= dcomplex_t{0.0, 1.0};
+      W1[offset++] *= 1.0 / (sqf[n - m] * sqf[n + m]);
     }
   }
-  
-  if (dir == 'z') {
-    contrib = W1;
-  } else if (dir == 'y') {
-    const double *d = builtin_laplace_table_->dmat_plus(0.0);
+
+  const dcomplex_t *contrib = W1;
+  if (dir == 'y') {
+    const double *d = builtin_laplace_table_->dmat_plus(kDMatEquator);
     lap_rotate_sph_y(W1, d, W2);
     lap_rotate_sph_z(W2, M_PI / 2, W1);
-    contrib = W1;
   } else if (dir == 'x') {
-    const double *d = builtin_laplace_table_->dmat_minus(0.0);
+    const double *d = builtin_laplace_table_->dmat_minus(kDMatEquator);
     lap_rotate_sph_y(W1, d, W2);
     contrib = W2;
   }
-  
+
   // Merge converted local expansion with the stored one
-  offset = 0;
-  for (int n = 0; n <= p; ++n) {
-    for (int m = 0; m <= n; ++m) {
-      L[offset] += contrib[offset];
-      offset++;
-    }
+  for (int i = 0; i < nsh; ++i) {
+    L[i] += contrib[i];
   }
-  
-  delete [] W1;
-  delete [] W2;
 }
 
 std::vector<double> lap_m_to_t(Point dist, double scale, 
@@ -962,6 +892,172 @@ std::vector<double> lap_l_to_t(Point dist, double scale,
   return retval; 
 }
 
+namespace {
+
+// Shared part of the batched M->T and L->T. The tile is processed kSphLanes
+// targets at a time. The radial factor is 1 / r / (r scale)^n for the
+// multipole expansion and (r scale)^n for the local expansion.
+void lap_expansion_to_t(const NearFieldTargets &targets, const Point &center,
+                        double scale, const dcomplex_t *E, bool local,
+                        double *phi, double *field) {
+  constexpr int L = kSphLanes;
+  int p = builtin_laplace_table_->p();
+  const double *sqf = builtin_laplace_table_->sqf();
+  int nmax = (field ? p + 1 : p);
+
+  BuiltinScratch scratch{};
+  double *legendre = scratch.doubles((nmax + 1) * (nmax + 2) / 2 * L);
+  double *ephi_re = scratch.doubles((nmax + 1) * L);
+  double *ephi_im = scratch.doubles((nmax + 1) * L);
+  double *rad = scratch.doubles((nmax + 1) * L);
+  double dx[L], dy[L], dz[L], r[L], factor[L];
+  double pot[L], zr[3][L], zi[2][L], fz[L];
+
+  // Adds c * rad_n * P_n^m * exp(i m phi) to (zre, zim) in every lane
+  auto cterm = [&](double *zre, double *zim, dcomplex_t c, int n, int m) {
+    const double *rn = &rad[n * L];
+    const double *pnm = &legendre[midx(n, m) * L];
+    const double *er = &ephi_re[m * L];
+    const double *ei = &ephi_im[m * L];
+    for (int k = 0; k < L; ++k) {
+      double w = rn[k] * pnm[k];
+      zre[k] += w * (c.real() * er[k] - c.imag() * ei[k]);
+      zim[k] += w * (c.real() * ei[k] + c.imag() * er[k]);
+    }
+  };
+
+  // Adds Re(c * exp(i m phi)) * rad_n * P_n^m to f in every lane
+  auto pterm = [&](double *f, dcomplex_t c, int n, int m) {
+    const double *rn = &rad[n * L];
+    const double *pnm = &legendre[midx(n, m) * L];
+    const double *er = &ephi_re[m * L];
+    const double *ei = &ephi_im[m * L];
+    for (int k = 0; k < L; ++k) {
+      f[k] += rn[k] * pnm[k] * (c.real() * er[k] - c.imag() * ei[k]);
+    }
+  };
+
+  // Adds c * rad_n * P_n^m to f in every lane
+  auto rterm = [&](double *f, double c, int n, int m) {
+    const double *rn = &rad[n * L];
+    const double *pnm = &legendre[midx(n, m) * L];
+    for (int k = 0; k < L; ++k) {
+      f[k] += c * rn[k] * pnm[k];
+    }
+  };
+
+  for (int base = 0; base < targets.count; base += L) {
+    nf_target_lanes(targets, base, center, dx, dy, dz);
+    sph_coords_lanes(nmax, dx, dy, dz, 1.0, r, legendre, ephi_re, ephi_im);
+
+    for (int k = 0; k < L; ++k) {
+      factor[k] = local ? r[k] * scale : 1.0 / (r[k] * scale);
+      rad[k] = local ? 1.0 : 1.0 / r[k];
+    }
+    for (int n = 1; n <= nmax; ++n) {
+      for (int k = 0; k < L; ++k) {
+        rad[n * L + k] = rad[(n - 1) * L + k] * factor[k];
+      }
+    }
+
+    // Potential; only the real part of the sum is needed, and the m = 0
+    // coefficients are real.
+    std::fill(pot, pot + L, 0.0);
+    for (int n = 0; n <= p; ++n) {
+      rterm(pot, real(E[midx(n, 0)]), n, 0);
+      for (int m = 1; m <= n; ++m) {
+        pterm(pot, 2.0 * E[midx(n, m)] * sqf[n - m] / sqf[n + m], n, m);
+      }
+    }
+
+    int live = std::min(L, targets.count - base);
+    for (int k = 0; k < live; ++k) {
+      phi[base + k] += pot[k];
+    }
+
+    if (field == nullptr) {
+      continue;
+    }
+
+    for (int c = 0; c < 3; ++c) {
+      std::fill(zr[c], zr[c] + L, 0.0);
+    }
+    for (int c = 0; c < 2; ++c) {
+      std::fill(zi[c], zi[c] + L, 0.0);
+    }
+    std::fill(fz, fz + L, 0.0);
+
+    if (!local) {
+      cterm(zr[0], zi[0], real(E[midx(0, 0)]), 1, 1);
+      rterm(fz, real(E[midx(0, 0)]), 1, 0);
+
+      for (int n = 1; n <= p; ++n) {
+        cterm(zr[0], zi[0], real(E[midx(n, 0)]), n + 1, 1);
+        cterm(zr[1], zi[1], E[midx(n, 1)] * sqf[n + 1] / sqf[n - 1],
+              n + 1, 0);
+        rterm(fz, real(E[midx(n, 0)]) * (n + 1), n + 1, 0);
+      }
+
+      for (int n = 1; n <= p; ++n) {
+        for (int m = 1; m <= n; ++m) {
+          cterm(zr[0], zi[0], E[midx(n, m)] * sqf[n - m] / sqf[n + m],
+                n + 1, m + 1);
+          if (m > 1) {
+            cterm(zr[1], zi[1], E[midx(n, m)] * sqf[n - m + 2] / sqf[n - m] *
+                  sqf[n - m + 2] / sqf[n + m], n + 1, m - 1);
+          }
+          pterm(zr[2], E[midx(n, m)] * sqf[n - m + 1] / sqf[n - m] *
+                sqf[n - m + 1] / sqf[n + m], n + 1, m);
+        }
+      }
+    } else {
+      for (int n = 1; n <= p; ++n) {
+        cterm(zr[1], zi[1], E[midx(n, 1)] * sqf[n + 1] / sqf[n - 1],
+              n - 1, 0);
+        rterm(fz, real(E[midx(n, 0)]) * n, n - 1, 0);
+      }
+
+      for (int n = 1; n <= p; ++n) {
+        for (int m = 1; m <= n - 1; ++m) {
+          pterm(zr[2], E[midx(n, m)] * sqf[n - m] / sqf[n + m - 1] *
+                sqf[n + m] / sqf[n + m - 1], n - 1, m);
+        }
+        for (int m = 2; m <= n; ++m) {
+          cterm(zr[1], zi[1], E[midx(n, m)] * sqf[n - m] / sqf[n + m - 2] *
+                sqf[n + m] / sqf[n + m - 2], n - 1, m - 1);
+        }
+        for (int m = 0; m <= n - 2; ++m) {
+          cterm(zr[0], zi[0], E[midx(n, m)] * sqf[n - m] / sqf[n + m],
+                n - 1, m + 1);
+        }
+      }
+    }
+
+    double zsign = local ? -1.0 : 1.0;
+    for (int k = 0; k < live; ++k) {
+      int i = base + k;
+      field[i] += (zr[1][k] - zr[0][k]) * scale;
+      field[i + kNearFieldTile] -= (zi[1][k] + zi[0][k]) * scale;
+      field[i + 2 * kNearFieldTile] +=
+        zsign * (fz[k] + 2.0 * zr[2][k]) * scale;
+    }
+  }
+}
+
+} // anonymous namespace
+
+void lap_m_to_t(const NearFieldTargets &targets, const Point &center,
+                double scale, const dcomplex_t *M, double *phi,
+                double *field) {
+  lap_expansion_to_t(targets, center, scale, M, false, phi, field);
+}
+
+void lap_l_to_t(const NearFieldTargets &targets, const Point &center,
+                double scale, const dcomplex_t *L, double *phi,
+                double *field) {
+  lap_expansion_to_t(targets, center, scale, L, true, phi, field);
+}
+
 } // namespace dashmm
 
 
@@ -0,0 +1,391 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+/// \file
+/// \brief Laplace translation operators specialized on the expansion order
+
+
+#include <cmath>
+
+#include "builtins/laplace_table.h"
+#include "builtins/scratch.h"
+
+
+namespace dashmm {
+
+
+namespace {
+
+/// The expansion order: P if the operator is specialized, else the table's
+///
+/// With P fixed every loop bound below is a compile time constant, so the
+/// triangular loops over (n, m) can be unrolled and their midx() and didx()
+/// offsets folded.
+template <int P>
+inline int order() {
+  return P > 0 ? P : builtin_laplace_table_->p();
+}
+
+/// Rotate an expansion about the y axis, as lap_rotate_sph_y()
+///
+/// rot is in the form of LaplaceTable::rotation_plus(). The sums are
+/// accumulated one input coefficient at a time into all outputs of the same
+/// degree, which is unit stride and free of dependency chains. work must
+/// hold 2 * (p + 1) doubles.
+template <int P>
+void rotate_y_loop(const dcomplex_t *M, const double *rot, dcomplex_t *MR,
+                   double *work) {
+  const int p = order<P>();
+  double *re = work;
+  double *im = work + (p + 1);
+  for (int n = 0; n <= p; ++n) {
+    const int len = n + 1;
+    const double *A = rot;
+    const double *B = rot + len * len;
+    const dcomplex_t *Mn = &M[midx(n, 0)];
+    for (int mp = 0; mp < len; ++mp) {
+      re[mp] = 0.0;
+      im[mp] = 0.0;
+    }
+    for (int m = 0; m < len; ++m) {
+      const double mr = Mn[m].real();
+      const double mi = Mn[m].imag();
+      for (int mp = 0; mp < len; ++mp) {
+        re[mp] += mr * A[mp];
+        im[mp] += mi * B[mp];
+      }
+      A += len;
+      B += len;
+    }
+    dcomplex_t *MRn = &MR[midx(n, 0)];
+    for (int mp = 0; mp < len; ++mp) {
+      MRn[mp] = dcomplex_t{re[mp], im[mp]};
+    }
+    rot += 2 * len * len;
+  }
+}
+
+/// Multiply the coefficients of order m by ephi[m], or by its conjugate
+template <int P, bool conjugate>
+void rotate_z(const dcomplex_t *M, const dcomplex_t *ephi, double scale,
+              dcomplex_t *MR) {
+  const int p = order<P>();
+  int offset = 0;
+  for (int n = 0; n <= p; ++n) {
+    for (int m = 0; m <= n; ++m) {
+      MR[offset] = M[offset] * (conjugate ? conj(ephi[m]) : ephi[m]) * scale;
+      offset++;
+    }
+  }
+}
+
+/// Shift an expansion along z using coefficients from LaplaceM2L::shift
+///
+/// For each order k, the coefficients L_j^k are accumulated one M_n^k at a
+/// time, which is unit stride and free of dependency chains. work must hold
+/// 2 * (p + 1) doubles.
+template <int P>
+void shift_z_loop(const double *coef, const dcomplex_t *M, double scale,
+                  dcomplex_t *L, double *work) {
+  const int p = order<P>();
+  double *re = work;
+  double *im = work + (p + 1);
+  for (int k = 0; k <= p; ++k) {
+    const int len = p - k + 1;
+    for (int j = 0; j < len; ++j) {
+      re[j] = 0.0;
+      im[j] = 0.0;
+    }
+    for (int n = k; n <= p; ++n) {
+      const double mr = M[midx(n, k)].real();
+      const double mi = M[midx(n, k)].imag();
+      for (int j = 0; j < len; ++j) {
+        re[j] += mr * coef[j];
+        im[j] += mi * coef[j];
+      }
+      coef += len;
+    }
+    for (int j = 0; j < len; ++j) {
+      L[midx(j + k, k)] = dcomplex_t{re[j] * scale, im[j] * scale};
+    }
+  }
+}
+
+/// rotate_y_loop() for degree N of a fixed order, followed by higher degrees
+///
+/// Each degree is a separate instantiation, so that every loop has a
+/// constant trip count and the accumulators can live in registers.
+template <int P, int N>
+struct RotateDegree {
+  static void apply(const dcomplex_t *M, const double *rot, dcomplex_t *MR) {
+    constexpr int len = N + 1;
+    const double *A = rot;
+    const double *B = rot + len * len;
+    const dcomplex_t *Mn = &M[midx(N, 0)];
+    double re[len];
+    double im[len];
+    for (int mp = 0; mp < len; ++mp) {
+      re[mp] = 0.0;
+      im[mp] = 0.0;
+    }
+    for (int m = 0; m < len; ++m) {
+      const double mr = Mn[m].real();
+      const double mi = Mn[m].imag();
+      for (int mp = 0; mp < len; ++mp) {
+        re[mp] += mr * A[mp];
+        im[mp] += mi * B[mp];
+      }
+      A += len;
+      B += len;
+    }
+    dcomplex_t *MRn = &MR[midx(N, 0)];
+    for (int mp = 0; mp < len; ++mp) {
+      MRn[mp] = dcomplex_t{re[mp], im[mp]};
+    }
+    RotateDegree<P, N + 1>::apply(M, rot + 2 * len * len, MR);
+  }
+};
+
+template <int P>
+struct RotateDegree<P, P + 1> {
+  static void apply(const dcomplex_t *, const double *, dcomplex_t *) { }
+};
+
+/// shift_z_loop() for order K of a fixed order, followed by higher orders
+template <int P, int K>
+struct ShiftOrder {
+  static void apply(const double *coef, const dcomplex_t *M, double scale,
+                    dcomplex_t *L) {
+    constexpr int len = P - K + 1;
+    double re[len];
+    double im[len];
+    for (int j = 0; j < len; ++j) {
+      re[j] = 0.0;
+      im[j] = 0.0;
+    }
+    for (int n = 0; n < len; ++n) {
+      const double mr = M[midx(n + K, K)].real();
+      const double mi = M[midx(n + K, K)].imag();
+      for (int j = 0; j < len; ++j) {
+        re[j] += mr * coef[j];
+        im[j] += mi * coef[j];
+      }
+      coef += len;
+    }
+    for (int j = 0; j < len; ++j) {
+      L[midx(j + K, K)] = dcomplex_t{re[j] * scale, im[j] * scale};
+    }
+    ShiftOrder<P, K + 1>::apply(coef, M, scale, L);
+  }
+};
+
+template <int P>
+struct ShiftOrder<P, P + 1> {
+  static void apply(const double *, const dcomplex_t *, double,
+                    dcomplex_t *) { }
+};
+
+/// Rotation about y, unrolled over degree when the order is fixed
+template <int P>
+void rotate_y(const dcomplex_t *M, const double *rot, dcomplex_t *MR,
+              double *work) {
+  if (P > 0) {
+    RotateDegree<P, 0>::apply(M, rot, MR);
+  } else {
+    rotate_y_loop<P>(M, rot, MR, work);
+  }
+}
+
+/// Shift along z, unrolled over order when the order is fixed
+template <int P>
+void shift_z(const double *coef, const dcomplex_t *M, double scale,
+             dcomplex_t *L, double *work) {
+  if (P > 0) {
+    ShiftOrder<P, 0>::apply(coef, M, scale, L);
+  } else {
+    shift_z_loop<P>(coef, M, scale, L, work);
+  }
+}
+
+template <int P>
+void m_to_l(const LaplaceM2L &op, const dcomplex_t *M, double scale,
+            dcomplex_t *L) {
+  const int p = order<P>();
+  BuiltinScratch scratch;
+  const int nsh = (p + 1) * (p + 2) / 2;
+  double *work = scratch.doubles(2 * (p + 1));
+
+  if (op.r1 == nullptr) {
+    shift_z<P>(op.shift, M, scale, L, work);
+    return;
+  }
+
+  dcomplex_t *W1 = scratch.complexes(nsh);
+  dcomplex_t *W2 = scratch.complexes(nsh);
+  rotate_z<P, false>(M, op.ephi, 1.0, W1);
+  rotate_y<P>(W1, op.r1, W2, work);
+  shift_z<P>(op.shift, W2, 1.0, W1, work);
+  rotate_y<P>(W1, op.r2, W2, work);
+  rotate_z<P, true>(W2, op.ephi, scale, L);
+}
+
+/// Powers of exp(i alpha) for the rotation taking a child offset to the
+/// x-z plane, where alpha is tab_alpha[child] * pi / 4
+void child_phases(int child, int p, dcomplex_t *ephi) {
+  const int tab_alpha[8] = {1, 3, 7, 5, 1, 3, 7, 5};
+  double alpha = tab_alpha[child] * M_PI_4;
+  dcomplex_t ealpha{cos(alpha), sin(alpha)};
+  ephi[0] = dcomplex_t{1.0, 0.0};
+  for (int m = 1; m <= p; ++m) {
+    ephi[m] = ephi[m - 1] * ealpha;
+  }
+}
+
+/// Scale the coefficients of degree n by 2^-n
+template <int P>
+void halve_degrees(dcomplex_t *W) {
+  const int p = order<P>();
+  double temp = 1;
+  int offset = 0;
+  for (int n = 0; n <= p; ++n) {
+    for (int m = 0; m <= n; ++m) {
+      W[offset++] *= temp;
+    }
+    temp /= 2;
+  }
+}
+
+template <int P>
+void m_to_m(int from_child, const dcomplex_t *M, dcomplex_t *W) {
+  const int p = order<P>();
+  const double *sqbinom = builtin_laplace_table_->sqbinom();
+
+  // Get precomputed rotations about the y-axis
+  DMatSlot slot = (from_child < 4 ? kDMatDiagonal : kDMatAntiDiagonal);
+  const double *r1 = builtin_laplace_table_->rotation_plus(slot);
+  const double *r2 = builtin_laplace_table_->rotation_minus(slot);
+
+  BuiltinScratch scratch;
+  const int nsh = (p + 1) * (p + 2) / 2;
+  dcomplex_t *T = scratch.complexes(nsh);
+  dcomplex_t *ephi = scratch.complexes(p + 1);
+  double *powers_rho = scratch.doubles(p + 1);
+  double *work = scratch.doubles(2 * (p + 1));
+
+  // Shift distance along the z-axis, combined with Y_n^0(pi, 0)
+  const double rho = -sqrt(3) / 2;
+  powers_rho[0] = 1.0;
+  for (int i = 1; i <= p; ++i) {
+    powers_rho[i] = powers_rho[i - 1] * rho;
+  }
+
+  child_phases(from_child, p, ephi);
+  rotate_z<P, false>(M, ephi, 1.0, W);
+  rotate_y<P>(W, r1, T, work);
+
+  // Shift along the z-axis by a distance of rho, write result in W
+  int offset = 0;
+  for (int n = 0; n <= p; ++n) {
+    for (int m = 0; m <= n; ++m) {
+      dcomplex_t sum = T[offset];
+      for (int k = 1; k <= n - m; ++k) {
+        sum += T[midx(n - k, m)] * powers_rho[k] *
+          sqbinom[midx(n - m, k)] * sqbinom[midx(n + m, k)];
+      }
+      W[offset++] = sum;
+    }
+  }
+
+  rotate_y<P>(W, r2, T, work);
+  rotate_z<P, true>(T, ephi, 1.0, W);
+  halve_degrees<P>(W);
+}
+
+template <int P>
+void l_to_l(int to_child, const dcomplex_t *L, dcomplex_t *W) {
+  const int p = order<P>();
+  const double *sqbinom = builtin_laplace_table_->sqbinom();
+
+  // Get precomputed rotations about the y-axis
+  DMatSlot slot = (to_child < 4 ? kDMatDiagonal : kDMatAntiDiagonal);
+  const double *r1 = builtin_laplace_table_->rotation_plus(slot);
+  const double *r2 = builtin_laplace_table_->rotation_minus(slot);
+
+  BuiltinScratch scratch;
+  const int nsh = (p + 1) * (p + 2) / 2;
+  dcomplex_t *T = scratch.complexes(nsh);
+  dcomplex_t *ephi = scratch.complexes(p + 1);
+  double *powers_rho = scratch.doubles(p + 1);
+  double *work = scratch.doubles(2 * (p + 1));
+
+  // Shift distance along the z-axis, combined with Y_n^0(pi, 0)
+  const double rho = -sqrt(3) / 4;
+  powers_rho[0] = 1.0;
+  for (int i = 1; i <= p; ++i) {
+    powers_rho[i] = powers_rho[i - 1] * rho;
+  }
+
+  child_phases(to_child, p, ephi);
+  rotate_z<P, false>(L, ephi, 1.0, W);
+  rotate_y<P>(W, r1, T, work);
+
+  // Shift along the z-axis by a distance of rho, write result in W
+  int offset = 0;
+  for (int n = 0; n <= p; ++n) {
+    for (int m = 0; m <= n; ++m) {
+      dcomplex_t sum = T[offset];
+      for (int k = 1; k <= p - n; k++) {
+        sum += T[midx(n + k, m)] * powers_rho[k] *
+          sqbinom[midx(n + k - m, k)] * sqbinom[midx(n + k + m, k)];
+      }
+      W[offset++] = sum;
+    }
+  }
+
+  rotate_y<P>(W, r2, T, work);
+  rotate_z<P, true>(T, ephi, 1.0, W);
+  halve_degrees<P>(W);
+}
+
+template <int P>
+constexpr LaplaceKernels kernels_of_order() {
+  return LaplaceKernels{P, m_to_m<P>, l_to_l<P>, m_to_l<P>};
+}
+
+// The orders produced by LaplaceTable for 3, 6 and 9 digits, and the generic
+// fallback for any other.
+const LaplaceKernels kernels_generic = kernels_of_order<0>();
+const LaplaceKernels kernels_p9 = kernels_of_order<9>();
+const LaplaceKernels kernels_p18 = kernels_of_order<18>();
+const LaplaceKernels kernels_p29 = kernels_of_order<29>();
+
+} // anonymous namespace
+
+
+const LaplaceKernels *lap_kernels(int p) {
+  switch (p) {
+  case 9:
+    return &kernels_p9;
+  case 18:
+    return &kernels_p18;
+  case 29:
+    return &kernels_p29;
+  case 0:
+  default:
+    return &kernels_generic;
+  }
+}
+
+
+} // namespace dashmm
@@ -32,6 +32,7 @@ LaplaceTable::LaplaceTable(int n_digits, double size) {
   int expan_length[] = {0, 4, 7, 9, 13, 16, 18, 23, 26, 29,
                         33, 36, 40, 43, 46};
   p_ = expan_length[n_digits];
+  kernels_ = lap_kernels(p_);
   generate_sqf();
   generate_sqbinom();
   generate_wigner_dmatrix();
@@ -189,20 +190,15 @@ LaplaceTable::LaplaceTable(int n_digits, double size) {
   generate_zs();
   generate_lambdaknm();
   generate_ealphaj();
+  generate_m2l();
 }
 
 
 LaplaceTable::~LaplaceTable() {
   delete [] sqf_;
   delete [] sqbinom_;
-  for (auto it = dmat_plus_->begin(); it != dmat_plus_->end(); ++it) {
-    delete [] it->second;
-  }
-  for (auto it = dmat_minus_->begin(); it != dmat_minus_->end(); ++it) {
-    delete [] it->second;
-  }
-  delete dmat_plus_;
-  delete dmat_minus_;
+  delete [] dmat_plus_;
+  delete [] dmat_minus_;
 
   delete [] lambda_;
   delete [] weight_;
@@ -256,39 +252,50 @@ void LaplaceTable::generate_sqbinom() {
 }
 
 void LaplaceTable::generate_wigner_dmatrix() {
-  dmat_plus_ = new builtin_map_t;
-  dmat_minus_ = new builtin_map_t;
-
-  double cbeta[24] = {1.0 / sqrt(5.0), 1.0 / sqrt(6.0), 1.0 / sqrt(9.0),
-                      1.0 / sqrt(10.0), 1.0 / sqrt(11.0), 1.0 / sqrt(14.0),
-                      1.0 / sqrt(19.0), 2.0 / sqrt(5.0), sqrt(2.0 / 3.0),
-                      sqrt(1.0 / 2.0), sqrt(4.0 / 9.0), sqrt(1.0 / 3.0),
-                      sqrt(4.0 / 13.0), sqrt(2.0 / 7.0), sqrt(4.0 / 17.0),
-                      sqrt(2.0 / 11.0), sqrt(9.0 / 10.0), sqrt(9.0 / 11.0),
-                      sqrt(9.0 / 13.0), sqrt(9.0 / 14.0), sqrt(9.0 / 17.0),
-                      sqrt(9.0 / 19.0), sqrt(9.0 / 22.0), 0.0};
-  int nd = (p_ + 1) * (4 * p_ * p_ + 11 * p_ + 6) / 6;
-  for (int i = 0; i < 24; ++i) {
-    double beta = acos(cbeta[i]);
-    double *dp_data = new double[nd];
-    double *dm_data = new double[nd];
-    generate_dmatrix_of_beta(beta, dp_data, dm_data);
-    (*dmat_plus_)[cbeta[i]] = dp_data;
-    (*dmat_minus_)[cbeta[i]] = dm_data;
+  dmat_size_ = (p_ + 1) * (4 * p_ * p_ + 11 * p_ + 6) / 6;
+  dmat_plus_ = new double[kDMatSlots * dmat_size_];
+  dmat_minus_ = new double[kDMatSlots * dmat_size_];
+  rotation_size_ = (p_ + 1) * (p_ + 2) * (2 * p_ + 3) / 3;
+  rotation_plus_.resize(kDMatSlots * rotation_size_);
+  rotation_minus_.resize(kDMatSlots * rotation_size_);
+  for (int i = 0; i < kDMatSlots; ++i) {
+    double beta = acos(dmat_slot_cbeta(i));
+    generate_dmatrix_of_beta(beta, &dmat_plus_[i * dmat_size_],
+                             &dmat_minus_[i * dmat_size_]);
+    generate_rotation(&dmat_plus_[i * dmat_size_],
+                      &rotation_plus_[i * rotation_size_]);
+    generate_rotation(&dmat_minus_[i * dmat_size_],
+                      &rotation_minus_[i * rotation_size_]);
   }
+}
 
-  for (int i = 0; i < 23; i++) {
-    double beta = acos(-cbeta[i]);
-    double *dp_data = new double[nd];
-    double *dm_data = new double[nd];
-    generate_dmatrix_of_beta(beta, dp_data, dm_data);
-    (*dmat_plus_)[-cbeta[i]] = dp_data;
-    (*dmat_minus_)[-cbeta[i]] = dm_data;
+void LaplaceTable::generate_rotation(const double *d, double *rot) {
+  // With M_n^{-m} = conj(M_n^m), the rotated coefficient of degree n and
+  // order mp is a real combination of the real parts of M_n^m and another
+  // of the imaginary parts. Both are stored for each n as (n + 1) x (n + 1)
+  // blocks with mp varying fastest.
+  for (int n = 0; n <= p_; ++n) {
+    double *A = rot;
+    double *B = rot + (n + 1) * (n + 1);
+    for (int m = 0; m <= n; ++m) {
+      for (int mp = 0; mp <= n; ++mp) {
+        const double *coeff = &d[didx(n, mp, 0)];
+        double a = coeff[0];
+        double b = coeff[0];
+        if (m > 0) {
+          a = pow_m1(m) * coeff[m] + coeff[-m];
+          b = pow_m1(m) * coeff[m] - coeff[-m];
+        }
+        A[m * (n + 1) + mp] = pow_m1(mp) * a;
+        B[m * (n + 1) + mp] = pow_m1(mp) * b;
+      }
+    }
+    rot += 2 * (n + 1) * (n + 1);
   }
 }
 
 void LaplaceTable::generate_dmatrix_of_beta(double beta,
-                                            double *dp, double *dm) {
+                                            double *dp, double *dm) const {
   double cbeta = cos(beta);
   double sbeta = sin(beta);
   double s2beta2 = (1 - cbeta) / 2; // sin^2(beta / 2)
@@ -477,6 +484,117 @@ void LaplaceTable::generate_ealphaj() {
   }
 }
 
+void LaplaceTable::generate_m2l() {
+  // Offsets are grouped by the shift they need along z. This depends only on
+  // the squared distance, and for offsets along the z axis, on the direction.
+  const int nkey = 2 * (3 * kM2LRange * kM2LRange + 1);
+  int shift_len = 0;
+  for (int k = 0; k <= p_; ++k) {
+    shift_len += (p_ - k + 1) * (p_ - k + 1);
+  }
+
+  // The polar rotation depends on dz and the squared distance
+  const int nrot = kM2LWidth * (3 * kM2LRange * kM2LRange + 1);
+  std::vector<int> rot_slot(nrot, -1);
+  int nmat = 0;
+
+  std::vector<int> key_slot(nkey, -1);
+  int nshift = 0;
+  int nops = 0;
+  for (int dx = -kM2LRange; dx <= kM2LRange; ++dx) {
+    for (int dy = -kM2LRange; dy <= kM2LRange; ++dy) {
+      for (int dz = -kM2LRange; dz <= kM2LRange; ++dz) {
+        if (abs(dx) <= 1 && abs(dy) <= 1 && abs(dz) <= 1) continue;
+        bool zm = (dx == 0 && dy == 0 && dz < 0);
+        int key = 2 * (dx * dx + dy * dy + dz * dz) + (zm ? 1 : 0);
+        if (key_slot[key] < 0) {
+          key_slot[key] = nshift++;
+        }
+        int rot = (dx * dx + dy * dy + dz * dz) * kM2LWidth + dz + kM2LRange;
+        if ((dx != 0 || dy != 0) && rot_slot[rot] < 0) {
+          rot_slot[rot] = nmat++;
+        }
+        ++nops;
+      }
+    }
+  }
+
+  m2l_shift_.assign(nshift * shift_len, 0.0);
+  m2l_ephi_.assign(nops * (p_ + 1), dcomplex_t{0.0, 0.0});
+  m2l_rotation_.assign(2 * nmat * rotation_size_, 0.0);
+  std::vector<double> dp(dmat_size_);
+  std::vector<double> dm(dmat_size_);
+  std::vector<bool> filled(nshift, false);
+  std::vector<bool> rot_filled(nmat, false);
+  std::vector<double> powers_rho(2 * p_ + 1);
+
+  int iop = 0;
+  for (int dx = -kM2LRange; dx <= kM2LRange; ++dx) {
+    for (int dy = -kM2LRange; dy <= kM2LRange; ++dy) {
+      for (int dz = -kM2LRange; dz <= kM2LRange; ++dz) {
+        LaplaceM2L &op = m2l_[((dx + kM2LRange) * kM2LWidth + dy + kM2LRange)
+                              * kM2LWidth + dz + kM2LRange];
+        op = LaplaceM2L{nullptr, nullptr, nullptr, nullptr};
+        if (abs(dx) <= 1 && abs(dy) <= 1 && abs(dz) <= 1) continue;
+
+        int rho2 = dx * dx + dy * dy + dz * dz;
+        double rho = sqrt(rho2);
+        bool zm = (dx == 0 && dy == 0 && dz < 0);
+        int slot = key_slot[2 * rho2 + (zm ? 1 : 0)];
+        double *shift = &m2l_shift_[slot * shift_len];
+        op.shift = shift;
+
+        if (!filled[slot]) {
+          powers_rho[0] = 1.0 / rho;
+          for (int i = 1; i <= 2 * p_; ++i) {
+            powers_rho[i] = powers_rho[i - 1] / rho;
+          }
+
+          // L_j^k is a sum over M_n^k; for each order k the coefficients
+          // form a square block with j varying fastest.
+          int offset = 0;
+          for (int k = 0; k <= p_; ++k) {
+            for (int n = k; n <= p_; ++n) {
+              for (int j = k; j <= p_; ++j) {
+                shift[offset++] = (zm ? pow_m1(k + j) : pow_m1(n + k)) *
+                  powers_rho[j + n] * sqbinom_[midx(n + j, n - k)] *
+                  sqbinom_[midx(n + j, n + k)];
+              }
+            }
+          }
+          filled[slot] = true;
+        }
+
+        if (dx == 0 && dy == 0) continue;
+
+        // Rotation taking the offset onto the z axis
+        double proj = sqrt(dx * dx + dy * dy);
+        double beta = acos(dx / proj);
+        if (dy < 0) {
+          beta = 2 * M_PI - beta;
+        }
+        dcomplex_t *ephi = &m2l_ephi_[iop++ * (p_ + 1)];
+        for (int m = 0; m <= p_; ++m) {
+          ephi[m] = dcomplex_t{cos(m * beta), sin(m * beta)};
+        }
+        op.ephi = ephi;
+
+        int mat = rot_slot[rho2 * kM2LWidth + dz + kM2LRange];
+        double *r1 = &m2l_rotation_[2 * mat * rotation_size_];
+        double *r2 = r1 + rotation_size_;
+        if (!rot_filled[mat]) {
+          generate_dmatrix_of_beta(acos(dz / rho), dp.data(), dm.data());
+          generate_rotation(dp.data(), r1);
+          generate_rotation(dm.data(), r2);
+          rot_filled[mat] = true;
+        }
+        op.r1 = r1;
+        op.r2 = r2;
+      }
+    }
+  }
+}
+
 void update_laplace_table(int n_digits, double size) {
   // Once we are fully distrib, this must be wrapped up somehow in SharedData
   // or something similar.
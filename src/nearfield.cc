@@ -0,0 +1,404 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+/// \file src/nearfield.cc
+/// \brief Implementation of the tiled near-field kernels
+
+
+#include "builtins/nearfield.h"
+
+#include <cmath>
+
+#include <atomic>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define DASHMM_NEAR_FIELD_X86
+#include <immintrin.h>
+#endif
+
+
+namespace dashmm {
+
+
+namespace {
+
+/// The number of staged sources including the zero padding
+inline int padded_count(int n) {
+  return (n + kNearFieldLanes - 1) / kNearFieldLanes * kNearFieldLanes;
+}
+
+
+// The scalar versions are written without branches on the separation so that
+// the compiler is free to vectorize them for the baseline instruction set.
+
+void lap_potential_scalar(const NearFieldSources &s, const NearFieldTargets &t,
+                          double *phi) {
+  int ns = padded_count(s.count);
+  for (int i = 0; i < t.count; ++i) {
+    double sum = 0.0;
+    for (int j = 0; j < ns; ++j) {
+      double dx = t.x[i] - s.x[j];
+      double dy = t.y[i] - s.y[j];
+      double dz = t.z[i] - s.z[j];
+      double r2 = dx * dx + dy * dy + dz * dz;
+      double rinv = r2 > 0 ? 1.0 / sqrt(r2) : 0.0;
+      sum += s.q[j] * rinv;
+    }
+    phi[i] += sum;
+  }
+}
+
+void lap_field_scalar(const NearFieldSources &s, const NearFieldTargets &t,
+                      double *field) {
+  int ns = padded_count(s.count);
+  for (int i = 0; i < t.count; ++i) {
+    double sum[3] = {0.0, 0.0, 0.0};
+    for (int j = 0; j < ns; ++j) {
+      double dx = t.x[i] - s.x[j];
+      double dy = t.y[i] - s.y[j];
+      double dz = t.z[i] - s.z[j];
+      double r2 = dx * dx + dy * dy + dz * dz;
+      double rinv = r2 > 0 ? 1.0 / sqrt(r2) : 0.0;
+      double qr3 = s.q[j] * rinv * rinv * rinv;
+      sum[0] += qr3 * dx;
+      sum[1] += qr3 * dy;
+      sum[2] += qr3 * dz;
+    }
+    field[i] += sum[0];
+    field[i + kNearFieldTile] += sum[1];
+    field[i + 2 * kNearFieldTile] += sum[2];
+  }
+}
+
+// The separations are computed for a full tile first, and then the
+// exponentials are taken. This is shared with the vector versions, which only
+// replace the first pass.
+void yuk_exponential_pass(const NearFieldSources &s, int i, double lambda,
+                          const double *rinv, double *phi) {
+  int ns = padded_count(s.count);
+  double sum = 0.0;
+  for (int j = 0; j < ns; ++j) {
+    // rinv is zero for masked pairs, which makes the term vanish
+    double lr = rinv[j] > 0 ? lambda / rinv[j] : 0.0;
+    sum += s.q[j] * exp(-lr) * rinv[j];
+  }
+  phi[i] += sum / lambda;
+}
+
+void yuk_potential_scalar(const NearFieldSources &s, const NearFieldTargets &t,
+                          double lambda, double *phi) {
+  int ns = padded_count(s.count);
+  double rinv[kNearFieldTile];
+  for (int i = 0; i < t.count; ++i) {
+    for (int j = 0; j < ns; ++j) {
+      double dx = t.x[i] - s.x[j];
+      double dy = t.y[i] - s.y[j];
+      double dz = t.z[i] - s.z[j];
+      double r2 = dx * dx + dy * dy + dz * dz;
+      rinv[j] = r2 > 0 ? 1.0 / sqrt(r2) : 0.0;
+    }
+    yuk_exponential_pass(s, i, lambda, rinv, phi);
+  }
+}
+
+
+#ifdef DASHMM_NEAR_FIELD_X86
+
+__attribute__((target("avx2,fma")))
+inline double hsum_avx2(__m256d v) {
+  __m128d lo = _mm256_castpd256_pd128(v);
+  __m128d hi = _mm256_extractf128_pd(v, 1);
+  lo = _mm_add_pd(lo, hi);
+  __m128d swap = _mm_unpackhi_pd(lo, lo);
+  return _mm_cvtsd_f64(_mm_add_sd(lo, swap));
+}
+
+// Returns 1/r for each lane, or zero where the separation vanishes
+__attribute__((target("avx2,fma")))
+inline __m256d rinv_avx2(const NearFieldSources &s, int j,
+                         __m256d tx, __m256d ty, __m256d tz,
+                         __m256d *dx, __m256d *dy, __m256d *dz) {
+  *dx = _mm256_sub_pd(tx, _mm256_load_pd(&s.x[j]));
+  *dy = _mm256_sub_pd(ty, _mm256_load_pd(&s.y[j]));
+  *dz = _mm256_sub_pd(tz, _mm256_load_pd(&s.z[j]));
+  __m256d r2 = _mm256_mul_pd(*dx, *dx);
+  r2 = _mm256_fmadd_pd(*dy, *dy, r2);
+  r2 = _mm256_fmadd_pd(*dz, *dz, r2);
+  __m256d mask = _mm256_cmp_pd(r2, _mm256_setzero_pd(), _CMP_GT_OQ);
+  __m256d rinv = _mm256_div_pd(_mm256_set1_pd(1.0), _mm256_sqrt_pd(r2));
+  return _mm256_and_pd(mask, rinv);
+}
+
+__attribute__((target("avx2,fma")))
+void lap_potential_avx2(const NearFieldSources &s, const NearFieldTargets &t,
+                        double *phi) {
+  int ns = padded_count(s.count);
+  for (int i = 0; i < t.count; ++i) {
+    __m256d tx = _mm256_set1_pd(t.x[i]);
+    __m256d ty = _mm256_set1_pd(t.y[i]);
+    __m256d tz = _mm256_set1_pd(t.z[i]);
+    __m256d acc = _mm256_setzero_pd();
+    __m256d dx, dy, dz;
+    for (int j = 0; j < ns; j += 4) {
+      __m256d rinv = rinv_avx2(s, j, tx, ty, tz, &dx, &dy, &dz);
+      acc = _mm256_fmadd_pd(_mm256_load_pd(&s.q[j]), rinv, acc);
+    }
+    phi[i] += hsum_avx2(acc);
+  }
+}
+
+__attribute__((target("avx2,fma")))
+void lap_field_avx2(const NearFieldSources &s, const NearFieldTargets &t,
+                    double *field) {
+  int ns = padded_count(s.count);
+  for (int i = 0; i < t.count; ++i) {
+    __m256d tx = _mm256_set1_pd(t.x[i]);
+    __m256d ty = _mm256_set1_pd(t.y[i]);
+    __m256d tz = _mm256_set1_pd(t.z[i]);
+    __m256d ax = _mm256_setzero_pd();
+    __m256d ay = _mm256_setzero_pd();
+    __m256d az = _mm256_setzero_pd();
+    __m256d dx, dy, dz;
+    for (int j = 0; j < ns; j += 4) {
+      __m256d rinv = rinv_avx2(s, j, tx, ty, tz, &dx, &dy, &dz);
+      __m256d qr3 = _mm256_mul_pd(_mm256_load_pd(&s.q[j]), rinv);
+      qr3 = _mm256_mul_pd(qr3, _mm256_mul_pd(rinv, rinv));
+      ax = _mm256_fmadd_pd(qr3, dx, ax);
+      ay = _mm256_fmadd_pd(qr3, dy, ay);
+      az = _mm256_fmadd_pd(qr3, dz, az);
+    }
+    field[i] += hsum_avx2(ax);
+    field[i + kNearFieldTile] += hsum_avx2(ay);
+    field[i + 2 * kNearFieldTile] += hsum_avx2(az);
+  }
+}
+
+__attribute__((target("avx2,fma")))
+void yuk_potential_avx2(const NearFieldSources &s, const NearFieldTargets &t,
+                        double lambda, double *phi) {
+  int ns = padded_count(s.count);
+  alignas(64) double rinv[kNearFieldTile];
+  for (int i = 0; i < t.count; ++i) {
+    __m256d tx = _mm256_set1_pd(t.x[i]);
+    __m256d ty = _mm256_set1_pd(t.y[i]);
+    __m256d tz = _mm256_set1_pd(t.z[i]);
+    __m256d dx, dy, dz;
+    for (int j = 0; j < ns; j += 4) {
+      _mm256_store_pd(&rinv[j], rinv_avx2(s, j, tx, ty, tz, &dx, &dy, &dz));
+    }
+    yuk_exponential_pass(s, i, lambda, rinv, phi);
+  }
+}
+
+
+// Returns 1/r for each lane, or zero where the separation vanishes
+__attribute__((target("avx512f")))
+inline __m512d rinv_avx512(const NearFieldSources &s, int j,
+                           __m512d tx, __m512d ty, __m512d tz,
+                           __m512d *dx, __m512d *dy, __m512d *dz) {
+  *dx = _mm512_sub_pd(tx, _mm512_load_pd(&s.x[j]));
+  *dy = _mm512_sub_pd(ty, _mm512_load_pd(&s.y[j]));
+  *dz = _mm512_sub_pd(tz, _mm512_load_pd(&s.z[j]));
+  __m512d r2 = _mm512_mul_pd(*dx, *dx);
+  r2 = _mm512_fmadd_pd(*dy, *dy, r2);
+  r2 = _mm512_fmadd_pd(*dz, *dz, r2);
+  __mmask8 mask = _mm512_cmp_pd_mask(r2, _mm512_setzero_pd(), _CMP_GT_OQ);
+  __m512d r = _mm512_maskz_sqrt_pd(mask, r2);
+  return _mm512_maskz_div_pd(mask, _mm512_set1_pd(1.0), r);
+}
+
+__attribute__((target("avx512f")))
+inline double hsum_avx512(__m512d v) {
+  alignas(64) double lanes[8];
+  _mm512_store_pd(lanes, v);
+  return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3]))
+       + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+__attribute__((target("avx512f")))
+void lap_potential_avx512(const NearFieldSources &s, const NearFieldTargets &t,
+                          double *phi) {
+  int ns = padded_count(s.count);
+  for (int i = 0; i < t.count; ++i) {
+    __m512d tx = _mm512_set1_pd(t.x[i]);
+    __m512d ty = _mm512_set1_pd(t.y[i]);
+    __m512d tz = _mm512_set1_pd(t.z[i]);
+    __m512d acc = _mm512_setzero_pd();
+    __m512d dx, dy, dz;
+    for (int j = 0; j < ns; j += 8) {
+      __m512d rinv = rinv_avx512(s, j, tx, ty, tz, &dx, &dy, &dz);
+      acc = _mm512_fmadd_pd(_mm512_load_pd(&s.q[j]), rinv, acc);
+    }
+    phi[i] += hsum_avx512(acc);
+  }
+}
+
+__attribute__((target("avx512f")))
+void lap_field_avx512(const NearFieldSources &s, const NearFieldTargets &t,
+                      double *field) {
+  int ns = padded_count(s.count);
+  for (int i = 0; i < t.count; ++i) {
+    __m512d tx = _mm512_set1_pd(t.x[i]);
+    __m512d ty = _mm512_set1_pd(t.y[i]);
+    __m512d tz = _mm512_set1_pd(t.z[i]);
+    __m512d ax = _mm512_setzero_pd();
+    __m512d ay = _mm512_setzero_pd();
+    __m512d az = _mm512_setzero_pd();
+    __m512d dx, dy, dz;
+    for (int j = 0; j < ns; j += 8) {
+      __m512d rinv = rinv_avx512(s, j, tx, ty, tz, &dx, &dy, &dz);
+      __m512d qr3 = _mm512_mul_pd(_mm512_load_pd(&s.q[j]), rinv);
+      qr3 = _mm512_mul_pd(qr3, _mm512_mul_pd(rinv, rinv));
+      ax = _mm512_fmadd_pd(qr3, dx, ax);
+      ay = _mm512_fmadd_pd(qr3, dy, ay);
+      az = _mm512_fmadd_pd(qr3, dz, az);
+    }
+    field[i] += hsum_avx512(ax);
+    field[i + kNearFieldTile] += hsum_avx512(ay);
+    field[i + 2 * kNearFieldTile] += hsum_avx512(az);
+  }
+}
+
+__attribute__((target("avx512f")))
+void yuk_potential_avx512(const NearFieldSources &s,
+                          const NearFieldTargets &t,
+                          double lambda, double *phi) {
+  int ns = padded_count(s.count);
+  alignas(64) double rinv[kNearFieldTile];
+  for (int i = 0; i < t.count; ++i) {
+    __m512d tx = _mm512_set1_pd(t.x[i]);
+    __m512d ty = _mm512_set1_pd(t.y[i]);
+    __m512d tz = _mm512_set1_pd(t.z[i]);
+    __m512d dx, dy, dz;
+    for (int j = 0; j < ns; j += 8) {
+      _mm512_store_pd(&rinv[j], rinv_avx512(s, j, tx, ty, tz, &dx, &dy, &dz));
+    }
+    yuk_exponential_pass(s, i, lambda, rinv, phi);
+  }
+}
+
+#endif // DASHMM_NEAR_FIELD_X86
+
+
+/// The widest instruction set the processor supports
+NearFieldISA detect_isa() {
+#ifdef DASHMM_NEAR_FIELD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return NearFieldISA::kAVX512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return NearFieldISA::kAVX2;
+  }
+#endif
+  return NearFieldISA::kScalar;
+}
+
+/// The selected instruction set; -1 until the first kernel is invoked
+std::atomic<int> active_isa{-1};
+
+inline NearFieldISA current_isa() {
+  int isa = active_isa.load(std::memory_order_relaxed);
+  if (isa < 0) {
+    isa = static_cast<int>(detect_isa());
+    active_isa.store(isa, std::memory_order_relaxed);
+  }
+  return static_cast<NearFieldISA>(isa);
+}
+
+} // anonymous namespace
+
+
+NearFieldISA nf_isa() {
+  return current_isa();
+}
+
+
+NearFieldISA nf_force_isa(NearFieldISA isa) {
+  NearFieldISA widest = detect_isa();
+  if (static_cast<int>(isa) > static_cast<int>(widest)) {
+    isa = widest;
+  }
+  active_isa.store(static_cast<int>(isa), std::memory_order_relaxed);
+  return isa;
+}
+
+
+const char *nf_isa_name(NearFieldISA isa) {
+  switch (isa) {
+  case NearFieldISA::kAVX512:
+    return "avx512";
+  case NearFieldISA::kAVX2:
+    return "avx2";
+  default:
+    return "scalar";
+  }
+}
+
+
+void nf_lap_potential(const NearFieldSources &s, const NearFieldTargets &t,
+                      double *phi) {
+  switch (current_isa()) {
+#ifdef DASHMM_NEAR_FIELD_X86
+  case NearFieldISA::kAVX512:
+    lap_potential_avx512(s, t, phi);
+    break;
+  case NearFieldISA::kAVX2:
+    lap_potential_avx2(s, t, phi);
+    break;
+#endif
+  default:
+    lap_potential_scalar(s, t, phi);
+    break;
+  }
+}
+
+
+void nf_lap_field(const NearFieldSources &s, const NearFieldTargets &t,
+                  double *field) {
+  switch (current_isa()) {
+#ifdef DASHMM_NEAR_FIELD_X86
+  case NearFieldISA::kAVX512:
+    lap_field_avx512(s, t, field);
+    break;
+  case NearFieldISA::kAVX2:
+    lap_field_avx2(s, t, field);
+    break;
+#endif
+  default:
+    lap_field_scalar(s, t, field);
+    break;
+  }
+}
+
+
+void nf_yuk_potential(const NearFieldSources &s, const NearFieldTargets &t,
+                      double lambda, double *phi) {
+  switch (current_isa()) {
+#ifdef DASHMM_NEAR_FIELD_X86
+  case NearFieldISA::kAVX512:
+    yuk_potential_avx512(s, t, lambda, phi);
+    break;
+  case NearFieldISA::kAVX2:
+    yuk_potential_avx2(s, t, lambda, phi);
+    break;
+#endif
+  default:
+    yuk_potential_scalar(s, t, lambda, phi);
+    break;
+  }
+}
+
+
+} // namespace dashmm
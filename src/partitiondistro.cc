@@ -0,0 +1,477 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+/// \file src/partitiondistro.cc
+/// \brief Implementation of PartitionDistro
+
+
+#include "builtins/partitiondistro.h"
+
+#include <cassert>
+#include <cstdio>
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include <hpx/hpx.h>
+
+#include "builtins/placement.h"
+
+
+namespace dashmm {
+
+
+namespace {
+
+/// Coarsening stops once the graph has this many vertices per locality
+constexpr size_t kCoarsestPerRank = 32;
+
+/// The most refinement passes made at each level of the partitioner
+constexpr int kRefinePasses = 8;
+
+/// Marks a vertex that has not been matched during coarsening
+constexpr uint32_t kUnmatched = std::numeric_limits<uint32_t>::max();
+
+
+/// A weighted undirected graph in compressed sparse row form
+///
+/// The neighbors of each vertex are sorted and distinct, so that the result
+/// of the partitioner does not depend on the order of the edges in the DAG.
+struct Graph {
+  std::vector<size_t> xadj;
+  std::vector<uint32_t> adjncy;
+  std::vector<long> adjwgt;
+  std::vector<long> vwgt;
+  std::vector<int> fixed;           // the locality of a fixed vertex, or -1
+
+  size_t size() const {return vwgt.size();}
+};
+
+
+/// Sort the neighbors of each vertex, merging repeats and removing loops
+void sort_and_merge(Graph &g) {
+  std::vector<std::pair<uint32_t, long>> scratch;
+  size_t out{0};
+  size_t begin{g.xadj[0]};
+  for (size_t u = 0; u < g.size(); ++u) {
+    size_t end = g.xadj[u + 1];
+    scratch.clear();
+    for (size_t e = begin; e < end; ++e) {
+      if (g.adjncy[e] != u) {
+        scratch.push_back(std::make_pair(g.adjncy[e], g.adjwgt[e]));
+      }
+    }
+    std::sort(scratch.begin(), scratch.end());
+
+    g.xadj[u] = out;
+    for (size_t i = 0; i < scratch.size(); ++i) {
+      if (out > g.xadj[u] && g.adjncy[out - 1] == scratch[i].first) {
+        g.adjwgt[out - 1] += scratch[i].second;
+      } else {
+        g.adjncy[out] = scratch[i].first;
+        g.adjwgt[out] = scratch[i].second;
+        ++out;
+      }
+    }
+    begin = end;
+  }
+  g.xadj[g.size()] = out;
+  g.adjncy.resize(out);
+  g.adjwgt.resize(out);
+}
+
+
+/// Build the graph of the DAG
+///
+/// \param nodes - the nodes of the DAG in the order of their id
+/// \param node_cost - the cost of a node in addition to its incoming edges
+Graph dag_graph(const std::vector<DAGNode *> &nodes, long node_cost) {
+  size_t n = nodes.size();
+  Graph g{};
+  g.vwgt.assign(n, node_cost);
+  g.fixed.assign(n, -1);
+  g.xadj.assign(n + 1, 0);
+
+  for (size_t u = 0; u < n; ++u) {
+    const DAGNode *node = nodes[u];
+    g.fixed[u] = node->locality >= 0 ? node->locality : -1;
+    g.xadj[u + 1] += node->out_count();
+    for (size_t i = 0; i < node->out_count(); ++i) {
+      uint32_t v = node->out_edge(i).target();
+      g.xadj[v + 1] += 1;
+      g.vwgt[v] += node->out_edge(i).weight();
+    }
+  }
+  for (size_t u = 0; u < n; ++u) {
+    g.xadj[u + 1] += g.xadj[u];
+  }
+
+  // Each DAG edge is listed at both of its ends
+  std::vector<size_t> pos(g.xadj.begin(), g.xadj.end() - 1);
+  g.adjncy.resize(g.xadj[n]);
+  g.adjwgt.resize(g.xadj[n]);
+  for (size_t u = 0; u < n; ++u) {
+    const DAGNode *node = nodes[u];
+    for (size_t i = 0; i < node->out_count(); ++i) {
+      uint32_t v = node->out_edge(i).target();
+      long w = node->out_edge(i).weight();
+      g.adjncy[pos[u]] = v;
+      g.adjwgt[pos[u]++] = w;
+      g.adjncy[pos[v]] = u;
+      g.adjwgt[pos[v]++] = w;
+    }
+  }
+
+  sort_and_merge(g);
+  return g;
+}
+
+
+/// Coarsen the graph by heavy edge matching
+///
+/// Each vertex is matched with the unmatched neighbor sharing the heaviest
+/// edge, unless the pair would exceed the given weight or join vertices fixed
+/// to different localities.
+///
+/// \param g - the graph to coarsen
+/// \param max_vwgt - the largest weight of a coarse vertex
+/// \param cmap [out] - the coarse vertex of each vertex of g
+///
+/// \returns - the coarse graph
+Graph coarsen(const Graph &g, long max_vwgt, std::vector<uint32_t> &cmap) {
+  size_t n = g.size();
+  std::vector<uint32_t> match(n, kUnmatched);
+  for (uint32_t u = 0; u < n; ++u) {
+    if (match[u] != kUnmatched) continue;
+
+    uint32_t mate{u};
+    long heaviest{-1};
+    for (size_t e = g.xadj[u]; e < g.xadj[u + 1]; ++e) {
+      uint32_t v = g.adjncy[e];
+      if (match[v] != kUnmatched) continue;
+      if (g.fixed[u] >= 0 && g.fixed[v] >= 0 && g.fixed[u] != g.fixed[v]) {
+        continue;
+      }
+      if (g.vwgt[u] + g.vwgt[v] > max_vwgt) continue;
+      if (g.adjwgt[e] > heaviest) {
+        heaviest = g.adjwgt[e];
+        mate = v;
+      }
+    }
+    match[u] = mate;
+    match[mate] = u;
+  }
+
+  cmap.assign(n, kUnmatched);
+  uint32_t n_coarse{0};
+  for (size_t u = 0; u < n; ++u) {
+    if (cmap[u] == kUnmatched) {
+      cmap[u] = n_coarse;
+      cmap[match[u]] = n_coarse;
+      ++n_coarse;
+    }
+  }
+
+  Graph c{};
+  c.vwgt.assign(n_coarse, 0);
+  c.fixed.assign(n_coarse, -1);
+  c.xadj.assign(n_coarse + 1, 0);
+  for (size_t u = 0; u < n; ++u) {
+    c.vwgt[cmap[u]] += g.vwgt[u];
+    if (g.fixed[u] >= 0) {
+      c.fixed[cmap[u]] = g.fixed[u];
+    }
+    c.xadj[cmap[u] + 1] += g.xadj[u + 1] - g.xadj[u];
+  }
+  for (size_t u = 0; u < n_coarse; ++u) {
+    c.xadj[u + 1] += c.xadj[u];
+  }
+
+  std::vector<size_t> pos(c.xadj.begin(), c.xadj.end() - 1);
+  c.adjncy.resize(c.xadj[n_coarse]);
+  c.adjwgt.resize(c.xadj[n_coarse]);
+  for (size_t u = 0; u < n; ++u) {
+    uint32_t cu = cmap[u];
+    for (size_t e = g.xadj[u]; e < g.xadj[u + 1]; ++e) {
+      c.adjncy[pos[cu]] = cmap[g.adjncy[e]];
+      c.adjwgt[pos[cu]++] = g.adjwgt[e];
+    }
+  }
+
+  sort_and_merge(c);
+  return c;
+}
+
+
+/// The locality with the least load; the lowest wins a tie
+int lightest(const std::vector<long> &load) {
+  return std::min_element(load.begin(), load.end()) - load.begin();
+}
+
+
+/// Partition the coarsest graph by greedy growing
+///
+/// The fixed vertices are placed first. The remaining vertices are then taken
+/// in order of their connection to the vertices already placed, and each
+/// joins the locality it is most connected to that has room for it.
+///
+/// \param g - the graph to partition
+/// \param n_parts - the number of localities
+/// \param max_load - the largest load allowed for a locality
+/// \param load [out] - the load of each locality
+/// \param bins - scratch bins for n_parts localities
+///
+/// \returns - the locality of each vertex
+std::vector<int> initial_partition(const Graph &g, int n_parts, long max_load,
+                                   std::vector<long> &load,
+                                   LocalityBins &bins) {
+  size_t n = g.size();
+  std::vector<int> part(n, -1);
+  std::vector<long> conn(n, 0);
+  load.assign(n_parts, 0);
+
+  for (size_t v = 0; v < n; ++v) {
+    if (g.fixed[v] < 0) continue;
+    part[v] = g.fixed[v];
+    load[part[v]] += g.vwgt[v];
+    for (size_t e = g.xadj[v]; e < g.xadj[v + 1]; ++e) {
+      conn[g.adjncy[e]] += g.adjwgt[e];
+    }
+  }
+
+  // The queue holds the connection and the negated vertex, so that the
+  // lowest vertex wins a tie. Entries become stale when the connection grows.
+  std::priority_queue<std::pair<long, long>> queue;
+  for (size_t v = 0; v < n; ++v) {
+    if (part[v] < 0) {
+      queue.push(std::make_pair(conn[v], -static_cast<long>(v)));
+    }
+  }
+
+  while (!queue.empty()) {
+    std::pair<long, long> top = queue.top();
+    queue.pop();
+    size_t v = -top.second;
+    if (part[v] >= 0 || top.first != conn[v]) continue;
+
+    for (size_t e = g.xadj[v]; e < g.xadj[v + 1]; ++e) {
+      int p = part[g.adjncy[e]];
+      if (p >= 0) {
+        bins.add(p, g.adjwgt[e]);
+      }
+    }
+    int to{-1};
+    for (int p : bins.touched()) {
+      if (load[p] + g.vwgt[v] > max_load) continue;
+      if (to < 0 || bins.weight(p) > bins.weight(to)
+          || (bins.weight(p) == bins.weight(to)
+              && (load[p] < load[to] || (load[p] == load[to] && p < to)))) {
+        to = p;
+      }
+    }
+    bins.clear();
+    if (to < 0) {
+      to = lightest(load);
+    }
+
+    part[v] = to;
+    load[to] += g.vwgt[v];
+    for (size_t e = g.xadj[v]; e < g.xadj[v + 1]; ++e) {
+      uint32_t u = g.adjncy[e];
+      if (part[u] < 0) {
+        conn[u] += g.adjwgt[e];
+        queue.push(std::make_pair(conn[u], -static_cast<long>(u)));
+      }
+    }
+  }
+
+  return part;
+}
+
+
+/// Refine a partition with greedy boundary moves
+///
+/// Each free vertex is moved to the locality it is most connected to if that
+/// reduces the cut, or keeps the cut and improves the balance, without
+/// exceeding the allowed load. A vertex on an overloaded locality is moved
+/// to the best locality with room for it, even if that increases the cut.
+///
+/// \param g - the partitioned graph
+/// \param max_load - the largest load allowed for a locality
+/// \param part [in,out] - the locality of each vertex
+/// \param load [in,out] - the load of each locality
+/// \param bins - scratch bins for the localities
+void refine(const Graph &g, long max_load, std::vector<int> &part,
+            std::vector<long> &load, LocalityBins &bins) {
+  for (int pass = 0; pass < kRefinePasses; ++pass) {
+    size_t moves{0};
+    for (size_t v = 0; v < g.size(); ++v) {
+      if (g.fixed[v] >= 0) continue;
+
+      int from = part[v];
+      long w = g.vwgt[v];
+      for (size_t e = g.xadj[v]; e < g.xadj[v + 1]; ++e) {
+        bins.add(part[g.adjncy[e]], g.adjwgt[e]);
+      }
+      long internal = bins.weight(from);
+      bool overloaded = load[from] > max_load;
+
+      int to{from};
+      long to_gain{0};
+      auto consider = [&](int p) {
+        if (p == from || load[p] + w > max_load) return;
+        long gain = bins.weight(p) - internal;
+        if (to == from || gain > to_gain
+            || (gain == to_gain
+                && (load[p] < load[to] || (load[p] == load[to] && p < to)))) {
+          to = p;
+          to_gain = gain;
+        }
+      };
+      for (int p : bins.touched()) {
+        consider(p);
+      }
+      if (overloaded) {
+        consider(lightest(load));
+      }
+      bins.clear();
+
+      if (to == from) continue;
+      if (overloaded || to_gain > 0
+          || (to_gain == 0 && load[to] + w < load[from])) {
+        part[v] = to;
+        load[from] -= w;
+        load[to] += w;
+        ++moves;
+      }
+    }
+
+    if (moves == 0) break;
+  }
+}
+
+
+/// Print the predicted cut and load of each locality
+void print_report(const std::vector<DAGNode *> &nodes,
+                  const std::vector<int> &part, const std::vector<long> &load,
+                  long bytes_per_weight) {
+  int n_ranks = load.size();
+  std::vector<long> cut(n_ranks, 0);
+  for (size_t u = 0; u < nodes.size(); ++u) {
+    const DAGNode *node = nodes[u];
+    for (size_t i = 0; i < node->out_count(); ++i) {
+      if (part[node->out_edge(i).target()] != part[u]) {
+        cut[part[u]] += node->out_edge(i).weight() * bytes_per_weight;
+      }
+    }
+  }
+
+  long total_load{0};
+  long total_cut{0};
+  long max_load{0};
+  for (int r = 0; r < n_ranks; ++r) {
+    total_load += load[r];
+    total_cut += cut[r];
+    max_load = std::max(max_load, load[r]);
+  }
+  double mean = static_cast<double>(total_load) / n_ranks;
+
+  for (int r = 0; r < n_ranks; ++r) {
+    fprintf(stdout, "PartitionDistro: rank %d: load %ld (%5.3f of mean), "
+            "cut %ld [bytes]\n", r, load[r], load[r] / mean, cut[r]);
+  }
+  fprintf(stdout, "PartitionDistro: predicted cut %ld [bytes], "
+          "load imbalance %5.3f\n", total_cut, max_load / mean);
+}
+
+} // namespace
+
+
+void PartitionDistro::compute_distribution(DAG &dag) {
+  int n_ranks = hpx_get_num_ranks();
+
+  std::vector<DAGNode *> nodes(dag.node_count(), nullptr);
+  std::vector<DAGNode *> *lists[4] = {&dag.source_leaves, &dag.source_nodes,
+                                      &dag.target_nodes, &dag.target_leaves};
+  for (auto list : lists) {
+    for (size_t i = 0; i < list->size(); ++i) {
+      nodes[(*list)[i]->id()] = (*list)[i];
+    }
+  }
+
+  if (n_ranks == 1) {
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      nodes[i]->locality = 0;
+    }
+    return;
+  }
+
+  // Coarsen until the graph is small, or until a level no longer shrinks it
+  // by at least five percent
+  std::vector<Graph> levels{};
+  std::vector<std::vector<uint32_t>> cmaps{};
+  levels.push_back(dag_graph(nodes, node_cost_));
+
+  long total{0};
+  for (size_t i = 0; i < levels[0].size(); ++i) {
+    total += levels[0].vwgt[i];
+  }
+  size_t coarsest = kCoarsestPerRank * n_ranks;
+  long max_vwgt = std::max(1L, 3 * total / static_cast<long>(2 * coarsest));
+
+  while (levels.back().size() > coarsest) {
+    std::vector<uint32_t> cmap{};
+    Graph coarse = coarsen(levels.back(), max_vwgt, cmap);
+    if (20 * coarse.size() > 19 * levels.back().size()) break;
+    levels.push_back(std::move(coarse));
+    cmaps.push_back(std::move(cmap));
+  }
+
+  // Partition the coarsest graph, and refine while projecting it back
+  long mean = (total + n_ranks - 1) / n_ranks;
+  long max_load = mean + static_cast<long>(imbalance_ * mean);
+  LocalityBins bins{n_ranks};
+  std::vector<long> load{};
+  std::vector<int> part = initial_partition(levels.back(), n_ranks, max_load,
+                                            load, bins);
+  refine(levels.back(), max_load, part, load, bins);
+
+  for (size_t l = cmaps.size(); l-- > 0; ) {
+    levels.pop_back();
+    std::vector<int> fine(cmaps[l].size());
+    for (size_t i = 0; i < fine.size(); ++i) {
+      fine[i] = part[cmaps[l][i]];
+    }
+    part.swap(fine);
+    cmaps.pop_back();
+    refine(levels.back(), max_load, part, load, bins);
+  }
+
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (nodes[i]->locality < 0) {
+      nodes[i]->locality = part[i];
+    }
+    assert(nodes[i]->locality == part[i]);
+  }
+
+  if (report_ && hpx_get_my_rank() == 0) {
+    print_report(nodes, part, load, bytes_per_weight_);
+  }
+}
+
+
+} // dashmm
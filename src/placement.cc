@@ -0,0 +1,121 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+/// \file src/placement.cc
+/// \brief Implementation of the placement of DAG nodes by outgoing work
+
+
+#include "builtins/placement.h"
+
+#include <algorithm>
+
+
+namespace dashmm {
+
+
+/// The fewest nodes of one color worth handing to a separate thread
+constexpr size_t kMinPlacementRange = 256;
+
+
+int LocalityBins::best() {
+  long maxval{0};
+  int maxidx{0};
+  for (size_t i = 0; i < touched_.size(); ++i) {
+    int loc = touched_[i];
+    if (weight_[loc] > maxval || (weight_[loc] == maxval && maxval > 0
+                                  && loc < maxidx)) {
+      maxval = weight_[loc];
+      maxidx = loc;
+    }
+  }
+  clear();
+  return maxidx;
+}
+
+
+/// Place the nodes in [first, last) using the given bins
+static void place_node_range(DAGNode **first, DAGNode **last,
+                             bool interm_only, LocalityBins &bins) {
+  for (DAGNode **iter = first; iter != last; ++iter) {
+    DAGNode *node = *iter;
+
+    // It already has a locality
+    if (node->locality >= 0) continue;
+    if (interm_only && !node->is_interm()) continue;
+
+    // A rare case is a node that does not enter into the computation; the
+    // empty bins will place it on locality 0.
+    for (size_t i = 0; i < node->out_count(); ++i) {
+      int loc = node->out_target(i)->locality;
+      assert(loc >= 0 && loc < hpx_get_num_ranks());
+      bins.add(loc, node->out_edge(i).weight());
+    }
+
+    // Set this node to have locality that matches the bulk of outgoing work
+    node->locality = bins.best();
+  }
+}
+
+
+int place_node_range_handler(DAGNode **first, DAGNode **last,
+                             int interm_only) {
+  LocalityBins bins{hpx_get_num_ranks()};
+  place_node_range(first, last, interm_only, bins);
+  return HPX_SUCCESS;
+}
+HPX_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
+           place_node_range_action, place_node_range_handler,
+           HPX_POINTER, HPX_POINTER, HPX_INT);
+
+
+void place_by_out_edges(std::vector<DAGNode *> &nodes, bool interm_only) {
+  size_t n_workers = hpx_get_num_threads();
+  LocalityBins bins{hpx_get_num_ranks()};
+  DAGNode **data = nodes.data();
+  int flag = interm_only;
+
+  // Nodes of one color depend only on nodes of higher color, so each run of
+  // equal color can be placed in parallel once the previous run is done.
+  size_t begin = 0;
+  while (begin < nodes.size()) {
+    size_t end = begin + 1;
+    while (end < nodes.size() && nodes[end]->color == nodes[begin]->color) {
+      ++end;
+    }
+
+    size_t n_ranges = std::min(n_workers, (end - begin) / kMinPlacementRange);
+    if (n_ranges < 2) {
+      place_node_range(&data[begin], &data[end], interm_only, bins);
+    } else {
+      hpx_addr_t done = hpx_lco_and_new(n_ranges);
+      assert(done != HPX_NULL);
+      size_t delta = (end - begin) / n_ranges;
+      size_t remainder = (end - begin) % n_ranges;
+      DAGNode **first = &data[begin];
+      for (size_t i = 0; i < n_ranges; ++i) {
+        DAGNode **last = first + delta + (i < remainder ? 1 : 0);
+        hpx_call(HPX_HERE, place_node_range_action, done,
+                 &first, &last, &flag);
+        first = last;
+      }
+      hpx_lco_wait(done);
+      hpx_lco_delete_sync(done);
+    }
+
+    begin = end;
+  }
+}
+
+
+} // dashmm
@@ -0,0 +1,101 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+/// \file src/scratch.cc
+/// \brief Implementation of BuiltinScratch
+
+
+#include "builtins/scratch.h"
+
+#include <cassert>
+#include <cstdlib>
+
+#include <algorithm>
+#include <vector>
+
+
+namespace dashmm {
+
+
+namespace {
+
+/// Minimum size of a scratch block in doubles (256 kB)
+constexpr size_t kMinBlockSize = 32768;
+
+/// Allocations are rounded to this many doubles to keep them 64 byte aligned
+constexpr size_t kAlignDoubles = 8;
+
+struct ScratchBlock {
+  double *data;
+  size_t size;
+};
+
+/// The scratch stack of a worker thread
+///
+/// Blocks are never moved or freed while the worker is alive, so the
+/// addresses handed out remain valid until the owning frame is released.
+struct ScratchStack {
+  std::vector<ScratchBlock> blocks;
+  size_t block{0};
+  size_t offset{0};
+
+  ~ScratchStack() {
+    for (auto &b : blocks) {
+      free(b.data);
+    }
+  }
+};
+
+thread_local ScratchStack scratch_stack;
+
+} // anonymous namespace
+
+
+BuiltinScratch::BuiltinScratch()
+    : block_{scratch_stack.block}, offset_{scratch_stack.offset} { }
+
+
+BuiltinScratch::~BuiltinScratch() {
+  scratch_stack.block = block_;
+  scratch_stack.offset = offset_;
+}
+
+
+double *BuiltinScratch::doubles(size_t count) {
+  ScratchStack &s = scratch_stack;
+  count = (count + kAlignDoubles - 1) / kAlignDoubles * kAlignDoubles;
+
+  // Advance through existing blocks until one has room
+  while (s.block < s.blocks.size()
+         && s.offset + count > s.blocks[s.block].size) {
+    ++s.block;
+    s.offset = 0;
+  }
+
+  if (s.block == s.blocks.size()) {
+    size_t size = std::max(count, kMinBlockSize);
+    void *data{nullptr};
+    int err = posix_memalign(&data, 64, size * sizeof(double));
+    assert(err == 0 && data != nullptr);
+    s.blocks.push_back(ScratchBlock{static_cast<double *>(data), size});
+    s.offset = 0;
+  }
+
+  double *retval = s.blocks[s.block].data + s.offset;
+  s.offset += count;
+  return retval;
+}
+
+
+} // namespace dashmm
@@ -46,6 +46,71 @@ void legendre_Plm(int n, double x, double *P) {
   }
 }
 
+
+void sph_coords_lanes(int n, const double *dx, const double *dy,
+                      const double *dz, double sign, double *r, double *P,
+                      double *ephi_re, double *ephi_im) {
+  constexpr int L = kSphLanes;
+  double x[L], u[L], cphi[L], sphi[L];
+
+  for (int k = 0; k < L; ++k) {
+    double proj = sqrt(dx[k] * dx[k] + dy[k] * dy[k]);
+    r[k] = sqrt(proj * proj + dz[k] * dz[k]);
+    x[k] = (r[k] <= 1e-14 ? 1.0 : dz[k] / r[k]);
+    u[k] = -sqrt(1.0 - x[k] * x[k]);
+    bool axis = (proj <= 1e-14 * r[k]);
+    cphi[k] = (axis ? 1.0 : dx[k] / proj);
+    sphi[k] = (axis ? 0.0 : sign * dy[k] / proj);
+  }
+
+  // Powers of exp(i * sign * phi)
+  for (int k = 0; k < L; ++k) {
+    ephi_re[k] = 1.0;
+    ephi_im[k] = 0.0;
+  }
+  for (int m = 1; m <= n; ++m) {
+    const double *pre = &ephi_re[(m - 1) * L];
+    const double *pim = &ephi_im[(m - 1) * L];
+    for (int k = 0; k < L; ++k) {
+      ephi_re[m * L + k] = pre[k] * cphi[k] - pim[k] * sphi[k];
+      ephi_im[m * L + k] = pre[k] * sphi[k] + pim[k] * cphi[k];
+    }
+  }
+
+  // The recurrences of legendre_Plm, with the lanes innermost
+  for (int k = 0; k < L; ++k) {
+    P[k] = 1.0;
+  }
+  for (int i = 1; i <= n; ++i) {
+    const double *prev = &P[midx(i - 1, i - 1) * L];
+    double *curr = &P[midx(i, i) * L];
+    for (int k = 0; k < L; ++k) {
+      curr[k] = prev[k] * u[k] * (2 * i - 1);
+    }
+  }
+
+  for (int i = 0; i < n; ++i) {
+    const double *diag = &P[midx(i, i) * L];
+    double *next = &P[midx(i + 1, i) * L];
+    for (int k = 0; k < L; ++k) {
+      next[k] = diag[k] * x[k] * (2 * i + 1);
+    }
+  }
+
+  for (int m = 0; m <= n; ++m) {
+    for (int ell = m + 2; ell <= n; ++ell) {
+      const double *p1 = &P[midx(ell - 1, m) * L];
+      const double *p2 = &P[midx(ell - 2, m) * L];
+      double *curr = &P[midx(ell, m) * L];
+      double c1 = (2.0 * ell - 1) / (ell - m);
+      double c2 = (ell + m - 1.0) / (ell - m);
+      for (int k = 0; k < L; ++k) {
+        curr[k] = c1 * x[k] * p1[k] - c2 * p2[k];
+      }
+    }
+  }
+}
+
 void legendre_Plm_gt1_scaled(int nb, double x, double scale, double *P) {
   double v = scale * x;
   double w = scale * scale;
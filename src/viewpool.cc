@@ -0,0 +1,212 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+/// \file src/viewpool.cc
+/// \brief Implementation of ViewPool
+
+
+#include "dashmm/viewpool.h"
+
+#include <sys/resource.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+
+namespace dashmm {
+
+
+namespace {
+
+/// The largest number of registered sizes
+constexpr int kMaxSizeClasses = 128;
+
+/// The most blocks of one size kept in the free list of a worker
+constexpr int kMaxCachedBlocks = 4096;
+
+/// The header preceding each block, padded to keep the storage aligned as
+/// new char[] would
+struct BlockHeader {
+  int size_class;           /// -1 for storage from the system allocator
+  BlockHeader *next;        /// the next block in the free list
+};
+
+constexpr size_t kHeaderBytes = 16;
+static_assert(sizeof(BlockHeader) <= kHeaderBytes, "Header too large");
+
+/// The registered sizes
+///
+/// Sizes are only appended, so a reader seeing a count may read that many
+/// entries without a lock.
+std::atomic<size_t> class_bytes[kMaxSizeClasses];
+std::atomic<int> class_count{0};
+std::mutex class_mutex;
+
+/// The free lists of a worker
+///
+/// The lock is normally only taken by the owning worker. trim() also takes
+/// it, as may a thread that moved workers during an allocation.
+struct WorkerCache {
+  WorkerCache() : heads{}, count{} {lock.clear();}
+
+  std::atomic_flag lock;
+  BlockHeader *heads[kMaxSizeClasses];
+  int count[kMaxSizeClasses];
+};
+
+/// Holds the lock of a WorkerCache for a scope
+class Guard {
+ public:
+  explicit Guard(std::atomic_flag &lock) : lock_(lock) {
+    while (lock_.test_and_set(std::memory_order_acquire)) { }
+  }
+  ~Guard() {lock_.clear(std::memory_order_release);}
+
+ private:
+  std::atomic_flag &lock_;
+};
+
+/// Every WorkerCache created; they live as long as the process
+std::vector<WorkerCache *> caches;
+std::mutex caches_mutex;
+
+thread_local WorkerCache *worker_cache{nullptr};
+
+WorkerCache &local_cache() {
+  if (worker_cache == nullptr) {
+    worker_cache = new WorkerCache{};
+    std::lock_guard<std::mutex> guard{caches_mutex};
+    caches.push_back(worker_cache);
+  }
+  return *worker_cache;
+}
+
+int find_class(size_t bytes) {
+  int n = class_count.load(std::memory_order_acquire);
+  for (int i = 0; i < n; ++i) {
+    if (class_bytes[i].load(std::memory_order_relaxed) == bytes) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+char *storage(BlockHeader *block) {
+  return reinterpret_cast<char *>(block) + kHeaderBytes;
+}
+
+} // anonymous namespace
+
+
+void ViewPool::add_size(size_t bytes) {
+  std::lock_guard<std::mutex> guard{class_mutex};
+  if (find_class(bytes) != -1) {
+    return;
+  }
+  int n = class_count.load(std::memory_order_relaxed);
+  if (n < kMaxSizeClasses) {
+    class_bytes[n].store(bytes, std::memory_order_relaxed);
+    class_count.store(n + 1, std::memory_order_release);
+  }
+}
+
+
+char *ViewPool::allocate(size_t bytes) {
+  int size_class = find_class(bytes);
+
+  BlockHeader *block{nullptr};
+  if (size_class != -1) {
+    WorkerCache &cache = local_cache();
+    Guard guard{cache.lock};
+    block = cache.heads[size_class];
+    if (block != nullptr) {
+      cache.heads[size_class] = block->next;
+      --cache.count[size_class];
+    }
+  }
+
+  if (block == nullptr) {
+    block = static_cast<BlockHeader *>(malloc(kHeaderBytes + bytes));
+    assert(block != nullptr);
+    block->size_class = size_class;
+  }
+
+  char *retval = storage(block);
+  memset(retval, 0, bytes);
+  return retval;
+}
+
+
+void ViewPool::deallocate(char *data) {
+  if (data == nullptr) {
+    return;
+  }
+
+  BlockHeader *block = reinterpret_cast<BlockHeader *>(data - kHeaderBytes);
+  int size_class = block->size_class;
+  if (size_class != -1) {
+    WorkerCache &cache = local_cache();
+    Guard guard{cache.lock};
+    if (cache.count[size_class] < kMaxCachedBlocks) {
+      block->next = cache.heads[size_class];
+      cache.heads[size_class] = block;
+      ++cache.count[size_class];
+      return;
+    }
+  }
+
+  free(block);
+}
+
+
+void ViewPool::trim() {
+  std::lock_guard<std::mutex> guard{caches_mutex};
+  for (WorkerCache *cache : caches) {
+    BlockHeader *lists[kMaxSizeClasses];
+    {
+      Guard cache_guard{cache->lock};
+      for (int i = 0; i < kMaxSizeClasses; ++i) {
+        lists[i] = cache->heads[i];
+        cache->heads[i] = nullptr;
+        cache->count[i] = 0;
+      }
+    }
+
+    for (int i = 0; i < kMaxSizeClasses; ++i) {
+      while (lists[i] != nullptr) {
+        BlockHeader *next = lists[i]->next;
+        free(lists[i]);
+        lists[i] = next;
+      }
+    }
+  }
+}
+
+
+size_t ViewPool::peak_resident_kb() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  // Linux reports the maximum resident set size in kB
+  return static_cast<size_t>(usage.ru_maxrss);
+}
+
+
+} // namespace dashmm
@@ -16,7 +16,10 @@
 /// \brief Implementation of Yukawa kernel
 
 
+#include <algorithm>
+
 #include "builtins/yukawa.h"
+#include "builtins/scratch.h"
 
 
 namespace dashmm {
@@ -143,17 +146,71 @@ void yuk_s_to_l(Point dist, double q, double scale, dcomplex_t *L) {
   }
 }
 
+namespace {
+
+// Shared part of the batched S->M and S->L. The tile is processed kSphLanes
+// sources at a time. The radial factor is q i_n(lambda r) for the multipole
+// and q k_n(lambda r) for the local expansion, both scaled.
+void yuk_s_to_expansion(const NearFieldSources &sources,
+                        const Point &center, double scale, bool local,
+                        dcomplex_t *E) {
+  constexpr int L = kSphLanes;
+  int p = builtin_yukawa_table_->p();
+  const double *sqf = builtin_yukawa_table_->sqf();
+  double lambda = builtin_yukawa_table_->lambda();
+
+  BuiltinScratch scratch{};
+  double *legendre = scratch.doubles((p + 1) * (p + 2) / 2 * L);
+  double *ephi_re = scratch.doubles((p + 1) * L);
+  double *ephi_im = scratch.doubles((p + 1) * L);
+  double *rad = scratch.doubles((p + 1) * L);
+  double *bessel = scratch.doubles(p + 1);
+  double dx[L], dy[L], dz[L], q[L], r[L];
+
+  auto coef = [sqf](int n, int m) { return sqf[midx(n, m)]; };
+
+  for (int base = 0; base < sources.count; base += L) {
+    nf_source_lanes(sources, base, center, dx, dy, dz, q);
+    sph_coords_lanes(p, dx, dy, dz, -1.0, r, legendre, ephi_re, ephi_im);
+
+    for (int k = 0; k < L; ++k) {
+      if (local) {
+        bessel_kn_scaled(p, lambda * r[k], scale, bessel);
+      } else {
+        bessel_in_scaled(p, lambda * r[k], scale, bessel);
+      }
+      for (int n = 0; n <= p; ++n) {
+        rad[n * L + k] = q[k] * bessel[n];
+      }
+    }
+
+    sph_accumulate_lanes(p, rad, legendre, ephi_re, ephi_im, coef, E);
+  }
+}
+
+} // anonymous namespace
+
+void yuk_s_to_m(const NearFieldSources &sources, const Point &center,
+                double scale, dcomplex_t *M) {
+  yuk_s_to_expansion(sources, center, scale, false, M);
+}
+
+void yuk_s_to_l(const NearFieldSources &sources, const Point &center,
+                double scale, dcomplex_t *L) {
+  yuk_s_to_expansion(sources, center, scale, true, L);
+}
+
 void yuk_m_to_m(int from_child, const dcomplex_t *M, double scale, 
                 dcomplex_t *W) {
   int p = builtin_yukawa_table_->p();
 
   // Get precomputed Wigner d-matrix for rotation about the y-axis
   const double *d1 = (from_child < 4 ?
-                      builtin_yukawa_table_->dmat_plus(1.0 / sqrt(3.0)) :
-                      builtin_yukawa_table_->dmat_plus(-1.0 / sqrt(3.0)));
+                      builtin_yukawa_table_->dmat_plus(kDMatDiagonal) :
+                      builtin_yukawa_table_->dmat_plus(kDMatAntiDiagonal));
   const double *d2 = (from_child < 4 ?
-                      builtin_yukawa_table_->dmat_minus(1.0 / sqrt(3.0)) :
-                      builtin_yukawa_table_->dmat_minus(-1.0 / sqrt(3.0)));
+                      builtin_yukawa_table_->dmat_minus(kDMatDiagonal) :
+                      builtin_yukawa_table_->dmat_minus(kDMatAntiDiagonal));
   
   // Get precomputed coefficients for shifting along z-axis
   const double *coeff = builtin_yukawa_table_->m2m(scale);
@@ -189,11 +246,11 @@ void yuk_l_to_l(int to_child, const dcomplex_t *L, double scale,
 
   // Get precomputed Wigner d-matrix for rotation about the y-axis
   const double *d1 = (to_child < 4 ?
-                      builtin_yukawa_table_->dmat_plus(1.0 / sqrt(3)) :
-                      builtin_yukawa_table_->dmat_plus(-1.0 / sqrt(3)));
+                      builtin_yukawa_table_->dmat_plus(kDMatDiagonal) :
+                      builtin_yukawa_table_->dmat_plus(kDMatAntiDiagonal));
   const double *d2 = (to_child < 4 ?
-                      builtin_yukawa_table_->dmat_minus(1.0 / sqrt(3)) :
-                      builtin_yukawa_table_->dmat_minus(-1.0 / sqrt(3)));
+                      builtin_yukawa_table_->dmat_minus(kDMatDiagonal) :
+                      builtin_yukawa_table_->dmat_minus(kDMatAntiDiagonal));
   
   // Get precomputed coefficients for shifting along z-axis
   const double *coeff = builtin_yukawa_table_->l2l(scale);
@@ -224,16 +281,20 @@ void yuk_l_to_l(int to_child, const dcomplex_t *L, double scale,
 }
 
 
-std::vector<double> yuk_m_to_t(Point dist, double scale, 
-                               const dcomplex_t *M, bool g) {
-  std::vector<double> retval; 
+namespace {
+
+// Evaluate the multipole expansion at a single point. The potential is
+// stored in out[0] and, if g is true, the field in out[1] to out[3].
+void yuk_m_to_t_point(Point dist, double scale, const dcomplex_t *M, bool g,
+                      double *out) {
+  BuiltinScratch scratch{};
 
   int p = builtin_yukawa_table_->p();
   double lambda = builtin_yukawa_table_->lambda();
-  std::vector<double> legendre((p + 2) * (p + 3) / 2); 
-  std::vector<dcomplex_t> temp((p + 2) * (p + 3) / 2); 
-  std::vector<double> bessel(p + 2);  
-  std::vector<dcomplex_t> powers_ephi(p + 2); 
+  double *legendre = scratch.doubles((p + 2) * (p + 3) / 2);
+  dcomplex_t *temp = scratch.complexes((p + 2) * (p + 3) / 2);
+  double *bessel = scratch.doubles(p + 2);
+  dcomplex_t *powers_ephi = scratch.complexes(p + 2);
 
   // Compute potential first 
   dcomplex_t potential{0.0, 0.0};
@@ -253,10 +314,10 @@ std::vector<double> yuk_m_to_t(Point dist, double scale,
     powers_ephi[j] = powers_ephi[j - 1] * ephi;
 
   // Compute scaled modified spherical bessel function
-  bessel_kn_scaled(p + 1, lambda * r, scale, bessel.data());
+  bessel_kn_scaled(p + 1, lambda * r, scale, bessel);
 
   // Compute legendre polynomial
-  legendre_Plm(p + 1, ctheta, legendre.data());
+  legendre_Plm(p + 1, ctheta, legendre);
   
   // Evaluate M_n^0
   for (int n = 0; n <= p; ++n) {
@@ -272,7 +333,7 @@ std::vector<double> yuk_m_to_t(Point dist, double scale,
     }
   }
 
-  retval.push_back(real(potential)); 
+  out[0] = real(potential);
 
   if (g) {
     for (int m = 0; m <= p + 1; ++m) {
@@ -355,23 +416,24 @@ std::vector<double> yuk_m_to_t(Point dist, double scale,
     fy -= lambda * real((tx + tz) * dcomplex_t{0.0, 1.0}); 
     fz += 2.0 * lambda * real(ty);
 
-    retval.push_back(fx); 
-    retval.push_back(fy);
-    retval.push_back(fz); 
+    out[1] = fx;
+    out[2] = fy;
+    out[3] = fz;
   }
-  return retval;
 }
 
-std::vector<double> yuk_l_to_t(Point dist, double scale, 
-                               const dcomplex_t *L, bool g) {
-  std::vector<double> retval; 
+// Evaluate the local expansion at a single point. The outputs are as for
+// yuk_m_to_t_point.
+void yuk_l_to_t_point(Point dist, double scale, const dcomplex_t *L, bool g,
+                      double *out) {
+  BuiltinScratch scratch{};
 
   int p = builtin_yukawa_table_->p();
   double lambda = builtin_yukawa_table_->lambda();
-  std::vector<double> legendre((p + 2) * (p + 3) / 2);
-  std::vector<dcomplex_t> temp((p + 2) * (p + 3) / 2); 
-  std::vector<double> bessel(p + 2); 
-  std::vector<dcomplex_t> powers_ephi(p + 2); 
+  double *legendre = scratch.doubles((p + 2) * (p + 3) / 2);
+  dcomplex_t *temp = scratch.complexes((p + 2) * (p + 3) / 2);
+  double *bessel = scratch.doubles(p + 2);
+  dcomplex_t *powers_ephi = scratch.complexes(p + 2);
 
   // Compute potential first
   dcomplex_t potential{0.0, 0.0};
@@ -391,10 +453,10 @@ std::vector<double> yuk_l_to_t(Point dist, double scale,
     powers_ephi[j] = powers_ephi[j - 1] * ephi;
 
   // Compute scaled modified spherical bessel function
-  bessel_in_scaled(p + 1, lambda * r, scale, bessel.data());
+  bessel_in_scaled(p + 1, lambda * r, scale, bessel);
 
   // Compute legendre polynomial
-  legendre_Plm(p + 1, ctheta, legendre.data());
+  legendre_Plm(p + 1, ctheta, legendre);
 
   // Evaluate local expansion L_n^0
   for (int n = 0; n <= p; ++n) {
@@ -410,7 +472,7 @@ std::vector<double> yuk_l_to_t(Point dist, double scale,
     }
   }
 
-  retval.push_back(real(potential)); 
+  out[0] = real(potential);
 
   if (g) {
     for (int m = 0; m <= p + 1; ++m) {
@@ -497,12 +559,114 @@ std::vector<double> yuk_l_to_t(Point dist, double scale,
     fy -= lambda * real((tx + tz) * dcomplex_t{0.0, 1.0}); 
     fz += 2.0 * lambda * real(ty);
 
-    retval.push_back(fx); 
-    retval.push_back(fy);
-    retval.push_back(fz); 
+    out[1] = fx;
+    out[2] = fy;
+    out[3] = fz;
   }
+}
+
+} // anonymous namespace
+
+std::vector<double> yuk_m_to_t(Point dist, double scale,
+                               const dcomplex_t *M, bool g) {
+  double out[4];
+  yuk_m_to_t_point(dist, scale, M, g, out);
+  return std::vector<double>(out, out + (g ? 4 : 1));
+}
+
+std::vector<double> yuk_l_to_t(Point dist, double scale,
+                               const dcomplex_t *L, bool g) {
+  double out[4];
+  yuk_l_to_t_point(dist, scale, L, g, out);
+  return std::vector<double>(out, out + (g ? 4 : 1));
+}
+
+namespace {
+
+// Shared part of the batched M->T and L->T. The potential is evaluated
+// kSphLanes targets at a time. The field is evaluated one target at a time
+// with the point routines, which then also supply the potential.
+void yuk_expansion_to_t(const NearFieldTargets &targets, const Point &center,
+                        double scale, const dcomplex_t *E, bool local,
+                        double *phi, double *field) {
+  if (field != nullptr) {
+    double out[4];
+    for (int i = 0; i < targets.count; ++i) {
+      Point dist{targets.x[i] - center.x(), targets.y[i] - center.y(),
+                 targets.z[i] - center.z()};
+      if (local) {
+        yuk_l_to_t_point(dist, scale, E, true, out);
+      } else {
+        yuk_m_to_t_point(dist, scale, E, true, out);
+      }
+      phi[i] += out[0];
+      field[i] += out[1];
+      field[i + kNearFieldTile] += out[2];
+      field[i + 2 * kNearFieldTile] += out[3];
+    }
+    return;
+  }
+
+  constexpr int L = kSphLanes;
+  int p = builtin_yukawa_table_->p();
+  double lambda = builtin_yukawa_table_->lambda();
+
+  BuiltinScratch scratch{};
+  double *legendre = scratch.doubles((p + 1) * (p + 2) / 2 * L);
+  double *ephi_re = scratch.doubles((p + 1) * L);
+  double *ephi_im = scratch.doubles((p + 1) * L);
+  double *rad = scratch.doubles((p + 1) * L);
+  double *bessel = scratch.doubles(p + 1);
+  double dx[L], dy[L], dz[L], r[L], pot[L];
+
+  for (int base = 0; base < targets.count; base += L) {
+    nf_target_lanes(targets, base, center, dx, dy, dz);
+    sph_coords_lanes(p, dx, dy, dz, 1.0, r, legendre, ephi_re, ephi_im);
+
+    for (int k = 0; k < L; ++k) {
+      if (local) {
+        bessel_in_scaled(p, lambda * r[k], scale, bessel);
+      } else {
+        bessel_kn_scaled(p, lambda * r[k], scale, bessel);
+      }
+      for (int n = 0; n <= p; ++n) {
+        rad[n * L + k] = bessel[n];
+      }
+    }
+
+    std::fill(pot, pot + L, 0.0);
+    for (int n = 0; n <= p; ++n) {
+      const double *rn = &rad[n * L];
+      for (int m = 0; m <= n; ++m) {
+        dcomplex_t c = (m ? 2.0 : 1.0) * E[midx(n, m)];
+        const double *pnm = &legendre[midx(n, m) * L];
+        const double *er = &ephi_re[m * L];
+        const double *ei = &ephi_im[m * L];
+        for (int k = 0; k < L; ++k) {
+          pot[k] += rn[k] * pnm[k] * (c.real() * er[k] - c.imag() * ei[k]);
+        }
+      }
+    }
+
+    int live = std::min(L, targets.count - base);
+    for (int k = 0; k < live; ++k) {
+      phi[base + k] += pot[k];
+    }
+  }
+}
+
+} // anonymous namespace
+
+void yuk_m_to_t(const NearFieldTargets &targets, const Point &center,
+                double scale, const dcomplex_t *M, double *phi,
+                double *field) {
+  yuk_expansion_to_t(targets, center, scale, M, false, phi, field);
+}
 
-  return retval; 
+void yuk_l_to_t(const NearFieldTargets &targets, const Point &center,
+                double scale, const dcomplex_t *L, double *phi,
+                double *field) {
+  yuk_expansion_to_t(targets, center, scale, L, true, phi, field);
 }
 
 void yuk_m_to_i(const dcomplex_t *M, ViewSet &views, double scale, int id) {
@@ -524,8 +688,8 @@ void yuk_m_to_i(const dcomplex_t *M, ViewSet &views, double scale, int id) {
     builtin_yukawa_table_->size(scale);
 
   // Get precomputed Wigner d-matrix
-  const double *d1 = builtin_yukawa_table_->dmat_plus(0.0);
-  const double *d2 = builtin_yukawa_table_->dmat_minus(0.0);
+  const double *d1 = builtin_yukawa_table_->dmat_plus(kDMatEquator);
+  const double *d2 = builtin_yukawa_table_->dmat_minus(kDMatEquator);
   
   // Get number of Gaussian quadrature points
   int s = builtin_yukawa_table_->s();
@@ -645,12 +809,12 @@ void yuk_i_to_i(Index s_index, Index t_index, const ViewSet &s_views,
   // Each S is going to generate between 1 and 3 views of the exponential
   // expansions on the target side.
   size_t view_size = nexp * sizeof(dcomplex_t);
-  dcomplex_t *T1 = new dcomplex_t[nexp]();
-  dcomplex_t *T2 = new dcomplex_t[nexp]();
-  dcomplex_t *T3 = new dcomplex_t[nexp]();
-  char *C1 = reinterpret_cast<char *>(T1);
-  char *C2 = reinterpret_cast<char *>(T2);
-  char *C3 = reinterpret_cast<char *>(T3);
+  char *C1 = ViewPool::allocate(view_size);
+  char *C2 = ViewPool::allocate(view_size);
+  char *C3 = ViewPool::allocate(view_size);
+  dcomplex_t *T1 = reinterpret_cast<dcomplex_t *>(C1);
+  dcomplex_t *T2 = reinterpret_cast<dcomplex_t *>(C2);
+  dcomplex_t *T3 = reinterpret_cast<dcomplex_t *>(C3);
   dcomplex_t *T[3] = {T1, T2, T3};
   char *C[3] = {C1, C2, C3};
   bool used[3] = {false, false, false};
@@ -681,11 +845,11 @@ void yuk_i_to_i(Index s_index, Index t_index, const ViewSet &s_views,
   }
 
   if (used[1] == false) {
-    delete [] T2;
+    ViewPool::deallocate(C2);
   }
 
   if (used[2] == false) {
-    delete [] T3;
+    ViewPool::deallocate(C3);
   }
 }
 
@@ -994,12 +1158,12 @@ void yuk_e_to_l(const dcomplex_t *E, char dir, bool sgn, double scale,
   if (dir == 'z') {
     contrib = W1;
   } else if (dir == 'y') {
-    const double *d = builtin_yukawa_table_->dmat_plus(0.0);
+    const double *d = builtin_yukawa_table_->dmat_plus(kDMatEquator);
     yuk_rotate_sph_y(W1, d, W2);
     yuk_rotate_sph_z(W2, M_PI / 2, W1);
     contrib = W1;
   } else if (dir == 'x') {
-    const double *d = builtin_yukawa_table_->dmat_minus(0.0);
+    const double *d = builtin_yukawa_table_->dmat_minus(kDMatEquator);
     yuk_rotate_sph_y(W1, d, W2);
     contrib = W2;
   }
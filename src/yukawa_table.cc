@@ -274,14 +274,8 @@ YukawaTable::YukawaTable(int n_digits, double size, double lambda) {
 
 YukawaTable::~YukawaTable() {
   delete [] sqf_;
-  for (auto it = dmat_plus_->begin(); it != dmat_plus_->end(); ++it) {
-    delete [] it->second;
-  }
-  for (auto it = dmat_minus_->begin(); it != dmat_minus_->end(); ++it) {
-    delete [] it->second;
-  }
-  delete dmat_plus_;
-  delete dmat_minus_;
+  delete [] dmat_plus_;
+  delete [] dmat_minus_;
   delete [] m2m_;
   delete [] l2l_;
   delete [] x_;
@@ -324,21 +318,17 @@ void YukawaTable::generate_sqf() {
 }
 
 void YukawaTable::generate_scaled_wigner_dmat() {
-  dmat_plus_ = new builtin_map_t;
-  dmat_minus_ = new builtin_map_t;
-
-  double cbeta[3] = {sqrt(3) / 3, -sqrt(3) / 3, 0};
-  int nd = (p_ + 1) * (4 * p_ * p_ + 11 * p_ + 6) / 6;
-  for (int i = 0; i < 3; ++i) {
-    double beta = acos(cbeta[i]);
-    double *dp_data = new double[nd];
-    double *dm_data = new double[nd];
-    generate_scaled_dmat_of_beta(beta, dp_data, dm_data);
-    (*dmat_plus_)[cbeta[i]] = dp_data;
-    (*dmat_minus_)[cbeta[i]] = dm_data;
+  dmat_size_ = (p_ + 1) * (4 * p_ * p_ + 11 * p_ + 6) / 6;
+  dmat_plus_ = new double[kDMatSlots * dmat_size_];
+  dmat_minus_ = new double[kDMatSlots * dmat_size_];
+  for (int i = 0; i < kDMatSlots; ++i) {
+    double beta = acos(dmat_slot_cbeta(i));
+    generate_scaled_dmat_of_beta(beta, &dmat_plus_[i * dmat_size_],
+                                 &dmat_minus_[i * dmat_size_]);
   }
 }
 
+
 void YukawaTable::generate_scaled_dmat_of_beta(double beta, double *dp,
                                                double *dm) {
   double cbeta = cos(beta);
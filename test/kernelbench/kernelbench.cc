@@ -0,0 +1,891 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <getopt.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <complex>
+#include <string>
+#include <vector>
+
+#include "builtins/laplace.h"
+#include "builtins/nearfield.h"
+#include "builtins/yukawa.h"
+#include "dashmm/point.h"
+
+
+// Microbenchmark for the single-node kernels used by the builtin expansions.
+// None of the operations timed here require the runtime, so this program
+// does not initialize DASHMM.
+
+
+constexpr double kYukawaParam = 0.1;
+
+struct SourceData {
+  dashmm::Point position;
+  double charge;
+};
+
+struct TargetData {
+  dashmm::Point position;
+  std::complex<double> phi;
+  double acceleration[3];
+};
+
+// This type collects the input arguments to the program.
+struct InputArguments {
+  std::string op;
+  std::string kernel;
+  int accuracy;
+  int leaf_size;
+  int repeats;
+};
+
+// Print usage information.
+void print_usage(char *progname) {
+  fprintf(stdout, "Usage: %s [OPTIONS]\n\n"
+          "Options available: [possible/values] (default value)\n"
+          "--op=[s2t/s2m/s2l/m2t/l2t/m2l/m2i/e2l]  "
+          "operation to time (s2t)\n"
+          "--kernel=[laplace/laplaceacc/yukawa]  kernel to time (laplace)\n"
+          "--accuracy=num          number of digits of accuracy (3)\n"
+          "--leafsize=num          sources and targets per leaf (64)\n"
+          "--repeats=num           number of leaf pairs evaluated (20000)\n"
+          , progname);
+}
+
+// Parse the command line arguments, overiding any defaults at the request of
+// the user.
+int read_arguments(int argc, char **argv, InputArguments &retval) {
+  //Set defaults
+  retval.op = std::string{"s2t"};
+  retval.kernel = std::string{"laplace"};
+  retval.accuracy = 3;
+  retval.leaf_size = 64;
+  retval.repeats = 20000;
+
+  int opt = 0;
+  static struct option long_options[] = {
+    {"op", required_argument, 0, 'o'},
+    {"kernel", required_argument, 0, 'k'},
+    {"accuracy", required_argument, 0, 'a'},
+    {"leafsize", required_argument, 0, 'l'},
+    {"repeats", required_argument, 0, 'r'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  int long_index = 0;
+  while ((opt = getopt_long(argc, argv, "o:k:a:l:r:h",
+                            long_options, &long_index)) != -1) {
+    switch (opt) {
+    case 'o':
+      retval.op = optarg;
+      break;
+    case 'k':
+      retval.kernel = optarg;
+      break;
+    case 'a':
+      retval.accuracy = atoi(optarg);
+      break;
+    case 'l':
+      retval.leaf_size = atoi(optarg);
+      break;
+    case 'r':
+      retval.repeats = atoi(optarg);
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return -1;
+    case '?':
+      return -1;
+    }
+  }
+
+  //test the inputs
+  if (retval.op != "s2t" && retval.op != "s2m" && retval.op != "s2l"
+      && retval.op != "m2t" && retval.op != "l2t" && retval.op != "m2l"
+      && retval.op != "m2i" && retval.op != "e2l") {
+    fprintf(stderr, "Usage ERROR: unknown operation '%s'\n",
+            retval.op.c_str());
+    return -1;
+  }
+
+  if ((retval.op == "s2m" || retval.op == "s2l")
+      && retval.kernel == "laplaceacc") {
+    fprintf(stderr, "Usage ERROR: laplaceacc has no %s operation\n",
+            retval.op.c_str());
+    return -1;
+  }
+
+  if ((retval.op == "m2l" || retval.op == "m2i" || retval.op == "e2l")
+      && retval.kernel != "laplace") {
+    fprintf(stderr, "Usage ERROR: %s is only available for laplace\n",
+            retval.op.c_str());
+    return -1;
+  }
+
+  if (retval.accuracy != 3 && retval.accuracy != 6) {
+    fprintf(stderr, "Usage ERROR: only 3-/6-digit accuracy supported\n");
+    return -1;
+  }
+
+  if (retval.kernel != "laplace" && retval.kernel != "laplaceacc"
+      && retval.kernel != "yukawa") {
+    fprintf(stderr, "Usage ERROR: unknown kernel '%s'\n",
+            retval.kernel.c_str());
+    return -1;
+  }
+
+  if (retval.leaf_size < 1 || retval.repeats < 1) {
+    fprintf(stderr, "Usage ERROR: leafsize and repeats must be positive\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+// Used to time the execution
+inline double getticks(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double) (tv.tv_sec * 1e6 + tv.tv_usec);
+}
+
+// Pick the positions in a cube with a uniform distribution
+dashmm::Point pick_cube_position() {
+  double pos[3];
+  pos[0] = (double)rand() / RAND_MAX - 0.5;
+  pos[1] = (double)rand() / RAND_MAX - 0.5;
+  pos[2] = (double)rand() / RAND_MAX - 0.5;
+  return dashmm::Point{pos[0], pos[1], pos[2]};
+}
+
+// The pairwise loops as they were written before the tiled engine. These are
+// the baseline for the comparison.
+void reference_s_to_t(const std::string &kernel,
+                      const SourceData *s_first, const SourceData *s_last,
+                      TargetData *t_first, TargetData *t_last) {
+  for (auto i = t_first; i != t_last; ++i) {
+    std::complex<double> potential{0.0, 0.0};
+    double sum[3] = {0.0, 0.0, 0.0};
+    for (auto j = s_first; j != s_last; ++j) {
+      dashmm::Point s2t = dashmm::point_sub(i->position, j->position);
+      double dist = s2t.norm();
+      if (dist > 0) {
+        if (kernel == "laplace") {
+          potential += j->charge / dist;
+        } else if (kernel == "yukawa") {
+          double ldist = kYukawaParam * dist;
+          potential += j->charge * exp(-ldist) / ldist;
+        } else {
+          double dist3 = dist * dist * dist;
+          sum[0] += j->charge * s2t.x() / dist3;
+          sum[1] += j->charge * s2t.y() / dist3;
+          sum[2] += j->charge * s2t.z() / dist3;
+        }
+      }
+    }
+    i->phi += potential;
+    i->acceleration[0] += sum[0];
+    i->acceleration[1] += sum[1];
+    i->acceleration[2] += sum[2];
+  }
+}
+
+// The same interaction using the near-field engine
+void tiled_s_to_t(const std::string &kernel,
+                  const SourceData *s_first, const SourceData *s_last,
+                  TargetData *t_first, TargetData *t_last) {
+  if (kernel == "laplace") {
+    dashmm::nf_evaluate<1>(s_first, s_last, t_first, t_last,
+                           dashmm::nf_lap_potential,
+                           [](TargetData &targ, const double *phi, int i) {
+                             targ.phi += phi[i];
+                           });
+  } else if (kernel == "yukawa") {
+    dashmm::nf_evaluate<1>(s_first, s_last, t_first, t_last,
+                           [](const dashmm::NearFieldSources &s,
+                              const dashmm::NearFieldTargets &t,
+                              double *phi) {
+                             dashmm::nf_yuk_potential(s, t, kYukawaParam, phi);
+                           },
+                           [](TargetData &targ, const double *phi, int i) {
+                             targ.phi += phi[i];
+                           });
+  } else {
+    dashmm::nf_evaluate<3>(s_first, s_last, t_first, t_last,
+                           dashmm::nf_lap_field,
+                           [](TargetData &targ, const double *field, int i) {
+                             int n = dashmm::kNearFieldTile;
+                             targ.acceleration[0] += field[i];
+                             targ.acceleration[1] += field[i + n];
+                             targ.acceleration[2] += field[i + 2 * n];
+                           });
+  }
+}
+
+// Reset the outputs of the targets
+void clear_targets(std::vector<TargetData> &targets) {
+  for (auto &t : targets) {
+    t.phi = 0.0;
+    t.acceleration[0] = 0.0;
+    t.acceleration[1] = 0.0;
+    t.acceleration[2] = 0.0;
+  }
+}
+
+// Maximum relative difference between two sets of results
+double compare(const std::vector<TargetData> &a,
+               const std::vector<TargetData> &b) {
+  double maxrel = 0.0;
+  for (size_t i = 0; i < a.size(); ++i) {
+    double num = std::abs(a[i].phi - b[i].phi);
+    double den = std::abs(b[i].phi);
+    for (int d = 0; d < 3; ++d) {
+      num += fabs(a[i].acceleration[d] - b[i].acceleration[d]);
+      den += fabs(b[i].acceleration[d]);
+    }
+    if (den > 0 && num / den > maxrel) {
+      maxrel = num / den;
+    }
+  }
+  return maxrel;
+}
+
+// Time the S->T interaction between one source leaf and one target leaf. The
+// target leaf is the source leaf, so that the self-interaction is exercised.
+void time_s_to_t(InputArguments &args) {
+  int n = args.leaf_size;
+  std::vector<SourceData> sources(n);
+  std::vector<TargetData> targets(n);
+  std::vector<TargetData> expected(n);
+  for (int i = 0; i < n; ++i) {
+    sources[i].position = pick_cube_position();
+    sources[i].charge = (double)rand() / RAND_MAX + 1.0;
+    targets[i].position = sources[i].position;
+  }
+  clear_targets(targets);
+  expected = targets;
+
+  const SourceData *s_first = sources.data();
+  const SourceData *s_last = s_first + n;
+  double pairs = (double)n * n * args.repeats;
+
+  double t0 = getticks();
+  for (int r = 0; r < args.repeats; ++r) {
+    reference_s_to_t(args.kernel, s_first, s_last,
+                     expected.data(), expected.data() + n);
+  }
+  double tf = getticks();
+  fprintf(stdout, "%-10s %12.4e pairs/s\n", "reference",
+          pairs / (tf - t0) * 1e6);
+
+  dashmm::NearFieldISA widest = dashmm::nf_isa();
+  for (int isa = 0; isa <= static_cast<int>(widest); ++isa) {
+    dashmm::NearFieldISA used =
+        dashmm::nf_force_isa(static_cast<dashmm::NearFieldISA>(isa));
+    clear_targets(targets);
+
+    t0 = getticks();
+    for (int r = 0; r < args.repeats; ++r) {
+      tiled_s_to_t(args.kernel, s_first, s_last,
+                   targets.data(), targets.data() + n);
+    }
+    tf = getticks();
+    fprintf(stdout, "%-10s %12.4e pairs/s (max rel. diff %4.3e)\n",
+            dashmm::nf_isa_name(used), pairs / (tf - t0) * 1e6,
+            compare(targets, expected));
+  }
+  dashmm::nf_force_isa(widest);
+}
+
+// Maximum difference between two sets of expansion coefficients, relative to
+// the largest coefficient
+double compare_coefficients(const std::vector<dashmm::dcomplex_t> &a,
+                            const std::vector<dashmm::dcomplex_t> &b) {
+  double maxdiff = 0.0;
+  double maxcoef = 0.0;
+  for (size_t i = 0; i < a.size(); ++i) {
+    maxdiff = std::max(maxdiff, std::abs(a[i] - b[i]));
+    maxcoef = std::max(maxcoef, std::abs(b[i]));
+  }
+  return maxcoef > 0 ? maxdiff / maxcoef : maxdiff;
+}
+
+// Time the formation of the multipole (or local) expansion of one leaf. The
+// leaf is a box of side 1/8 at the origin. For the local expansion, the
+// sources are placed in a well separated box.
+void time_s_to_expansion(InputArguments &args) {
+  bool local = (args.op == "s2l");
+  bool laplace = (args.kernel == "laplace");
+  double scale{0.0};
+  int p{0};
+  if (laplace) {
+    dashmm::update_laplace_table(args.accuracy, 1.0);
+    scale = dashmm::builtin_laplace_table_->scale(3);
+    p = dashmm::builtin_laplace_table_->p();
+  } else {
+    dashmm::update_yukawa_table(args.accuracy, 1.0, kYukawaParam);
+    scale = dashmm::builtin_yukawa_table_->scale(3);
+    p = dashmm::builtin_yukawa_table_->p();
+  }
+
+  int n = args.leaf_size;
+  double offset = local ? 0.375 : 0.0;
+  std::vector<SourceData> sources(n);
+  for (int i = 0; i < n; ++i) {
+    dashmm::Point pos = pick_cube_position();
+    sources[i].position = dashmm::Point{pos.x() / 8 + offset,
+                                        pos.y() / 8 + offset,
+                                        pos.z() / 8 + offset};
+    sources[i].charge = (double)rand() / RAND_MAX + 1.0;
+  }
+  dashmm::Point center{0.0, 0.0, 0.0};
+
+  int nterms = (p + 1) * (p + 2) / 2;
+  std::vector<dashmm::dcomplex_t> expected(nterms);
+  std::vector<dashmm::dcomplex_t> computed(nterms);
+  double count = (double)n * args.repeats;
+
+  double t0 = getticks();
+  for (int r = 0; r < args.repeats; ++r) {
+    for (int i = 0; i < n; ++i) {
+      dashmm::Point dist = dashmm::point_sub(sources[i].position, center);
+      if (laplace && local) {
+        dashmm::lap_s_to_l(dist, sources[i].charge, scale, expected.data());
+      } else if (laplace) {
+        dashmm::lap_s_to_m(dist, sources[i].charge, scale, expected.data());
+      } else if (local) {
+        dashmm::yuk_s_to_l(dist, sources[i].charge, scale, expected.data());
+      } else {
+        dashmm::yuk_s_to_m(dist, sources[i].charge, scale, expected.data());
+      }
+    }
+  }
+  double tf = getticks();
+  fprintf(stdout, "%-10s %12.4e sources/s\n", "reference",
+          count / (tf - t0) * 1e6);
+
+  dashmm::NearFieldSources tile;
+  const SourceData *s_first = sources.data();
+  const SourceData *s_last = s_first + n;
+  t0 = getticks();
+  for (int r = 0; r < args.repeats; ++r) {
+    for (auto i = s_first; i < s_last; i += dashmm::kNearFieldTile) {
+      dashmm::nf_stage_sources(i, s_last, tile);
+      if (laplace && local) {
+        dashmm::lap_s_to_l(tile, center, scale, computed.data());
+      } else if (laplace) {
+        dashmm::lap_s_to_m(tile, center, scale, computed.data());
+      } else if (local) {
+        dashmm::yuk_s_to_l(tile, center, scale, computed.data());
+      } else {
+        dashmm::yuk_s_to_m(tile, center, scale, computed.data());
+      }
+    }
+  }
+  tf = getticks();
+  fprintf(stdout, "%-10s %12.4e sources/s (max rel. diff %4.3e)\n", "batched",
+          count / (tf - t0) * 1e6, compare_coefficients(computed, expected));
+}
+
+// Time the evaluation of a multipole (or local) expansion at the targets of a
+// leaf. The expansion is about the origin; either the sources or the targets
+// are in a well separated box. With --kernel=laplaceacc the Laplace field is
+// evaluated as well as the potential.
+void time_expansion_to_t(InputArguments &args) {
+  bool local = (args.op == "l2t");
+  bool yukawa = (args.kernel == "yukawa");
+  bool grad = (args.kernel == "laplaceacc");
+  double scale{0.0};
+  int p{0};
+  if (!yukawa) {
+    dashmm::update_laplace_table(args.accuracy, 1.0);
+    scale = dashmm::builtin_laplace_table_->scale(3);
+    p = dashmm::builtin_laplace_table_->p();
+  } else {
+    dashmm::update_yukawa_table(args.accuracy, 1.0, kYukawaParam);
+    scale = dashmm::builtin_yukawa_table_->scale(3);
+    p = dashmm::builtin_yukawa_table_->p();
+  }
+
+  int n = args.leaf_size;
+  double s_offset = local ? 0.375 : 0.0;
+  double t_offset = local ? 0.0 : 0.375;
+  dashmm::Point center{0.0, 0.0, 0.0};
+  std::vector<dashmm::dcomplex_t> E((p + 1) * (p + 2) / 2);
+  for (int i = 0; i < n; ++i) {
+    dashmm::Point pos = pick_cube_position();
+    dashmm::Point dist{pos.x() / 8 + s_offset, pos.y() / 8 + s_offset,
+                       pos.z() / 8 + s_offset};
+    double q = (double)rand() / RAND_MAX + 1.0;
+    if (yukawa && local) {
+      dashmm::yuk_s_to_l(dist, q, scale, E.data());
+    } else if (yukawa) {
+      dashmm::yuk_s_to_m(dist, q, scale, E.data());
+    } else if (local) {
+      dashmm::lap_s_to_l(dist, q, scale, E.data());
+    } else {
+      dashmm::lap_s_to_m(dist, q, scale, E.data());
+    }
+  }
+
+  std::vector<TargetData> targets(n);
+  for (int i = 0; i < n; ++i) {
+    dashmm::Point pos = pick_cube_position();
+    targets[i].position = dashmm::Point{pos.x() / 8 + t_offset,
+                                        pos.y() / 8 + t_offset,
+                                        pos.z() / 8 + t_offset};
+  }
+  std::vector<TargetData> expected = targets;
+  clear_targets(targets);
+  clear_targets(expected);
+  double count = (double)n * args.repeats;
+
+  double t0 = getticks();
+  for (int r = 0; r < args.repeats; ++r) {
+    for (auto &t : expected) {
+      dashmm::Point dist = dashmm::point_sub(t.position, center);
+      std::vector<double> result;
+      if (yukawa && local) {
+        result = dashmm::yuk_l_to_t(dist, scale, E.data(), grad);
+      } else if (yukawa) {
+        result = dashmm::yuk_m_to_t(dist, scale, E.data(), grad);
+      } else if (local) {
+        result = dashmm::lap_l_to_t(dist, scale, E.data(), grad);
+      } else {
+        result = dashmm::lap_m_to_t(dist, scale, E.data(), grad);
+      }
+      t.phi += result[0];
+      if (grad) {
+        t.acceleration[0] += result[1];
+        t.acceleration[1] += result[2];
+        t.acceleration[2] += result[3];
+      }
+    }
+  }
+  double tf = getticks();
+  fprintf(stdout, "%-10s %12.4e targets/s\n", "reference",
+          count / (tf - t0) * 1e6);
+
+  dashmm::NearFieldTargets tile;
+  double phi[dashmm::kNearFieldTile];
+  double field[3 * dashmm::kNearFieldTile];
+  double *fptr = grad ? field : nullptr;
+  t0 = getticks();
+  for (int r = 0; r < args.repeats; ++r) {
+    for (size_t b = 0; b < targets.size(); b += dashmm::kNearFieldTile) {
+      TargetData *first = &targets[b];
+      dashmm::nf_stage_targets(first, targets.data() + n, tile);
+      std::fill(phi, phi + dashmm::kNearFieldTile, 0.0);
+      std::fill(field, field + 3 * dashmm::kNearFieldTile, 0.0);
+      if (yukawa && local) {
+        dashmm::yuk_l_to_t(tile, center, scale, E.data(), phi, fptr);
+      } else if (yukawa) {
+        dashmm::yuk_m_to_t(tile, center, scale, E.data(), phi, fptr);
+      } else if (local) {
+        dashmm::lap_l_to_t(tile, center, scale, E.data(), phi, fptr);
+      } else {
+        dashmm::lap_m_to_t(tile, center, scale, E.data(), phi, fptr);
+      }
+      for (int i = 0; i < tile.count; ++i) {
+        first[i].phi += phi[i];
+        first[i].acceleration[0] += field[i];
+        first[i].acceleration[1] += field[i + dashmm::kNearFieldTile];
+        first[i].acceleration[2] += field[i + 2 * dashmm::kNearFieldTile];
+      }
+    }
+  }
+  tf = getticks();
+  fprintf(stdout, "%-10s %12.4e targets/s (max rel. diff %4.3e)\n",
+          "batched", count / (tf - t0) * 1e6, compare(targets, expected));
+}
+
+// The Laplace M->L translation as it was written before the per-offset
+// operators were cached in LaplaceTable. This is the baseline for the
+// comparison. The table no longer keeps d-matrices by angle, so those for
+// the offset are passed in.
+void reference_m_to_l(int t2s_x, int t2s_y, int t2s_z,
+                      const double *d1, const double *d2,
+                      const dashmm::dcomplex_t *M, double scale,
+                      dashmm::dcomplex_t *L) {
+  int p = dashmm::builtin_laplace_table_->p();
+  const double *sqbinom = dashmm::builtin_laplace_table_->sqbinom();
+  double rho = sqrt(t2s_x * t2s_x + t2s_y * t2s_y + t2s_z * t2s_z);
+
+  double *powers_rho = new double[p * 2 + 1];
+  powers_rho[0] = 1.0 / rho;
+  for (int i = 1; i <= p * 2; i++) {
+    powers_rho[i] = powers_rho[i - 1] / rho;
+  }
+
+  auto shift = [&](const dashmm::dcomplex_t *in, bool zm,
+                   dashmm::dcomplex_t *out) {
+    int offset = 0;
+    for (int j = 0; j <= p; ++j) {
+      for (int k = 0; k <= j; ++k) {
+        out[offset] = 0;
+        for (int n = k; n <= p; ++n) {
+          out[offset] += in[dashmm::midx(n, k)] *
+            dashmm::pow_m1(zm ? k + j : n + k) * powers_rho[j + n] *
+            sqbinom[dashmm::midx(n + j, n - k)] *
+            sqbinom[dashmm::midx(n + j, n + k)];
+        }
+        out[offset] *= scale;
+        offset++;
+      }
+    }
+  };
+
+  dashmm::dcomplex_t *W2 = new dashmm::dcomplex_t[(p + 1) * (p + 2) / 2];
+  const double proj = sqrt(t2s_x * t2s_x + t2s_y * t2s_y);
+  if (proj < 1e-14) {
+    shift(M, t2s_z < 0, L);
+  } else {
+    double beta = acos(t2s_x / proj);
+    if (t2s_y < 0) {
+      beta = 2 * M_PI - beta;
+    }
+    dashmm::lap_rotate_sph_z(M, beta, L);
+    dashmm::lap_rotate_sph_y(L, d1, W2);
+    shift(W2, false, L);
+    dashmm::lap_rotate_sph_y(L, d2, W2);
+    dashmm::lap_rotate_sph_z(W2, -beta, L);
+  }
+
+  delete [] W2;
+  delete [] powers_rho;
+}
+
+// Time the Laplace M->L translation. Each repeat translates one multipole
+// expansion, cycling through all the offsets of the interaction list.
+void time_m_to_l(InputArguments &args) {
+  dashmm::update_laplace_table(args.accuracy, 1.0);
+  double scale = dashmm::builtin_laplace_table_->scale(3);
+  int p = dashmm::builtin_laplace_table_->p();
+  int nterms = (p + 1) * (p + 2) / 2;
+
+  std::vector<dashmm::dcomplex_t> M(nterms);
+  for (int i = 0; i < args.leaf_size; ++i) {
+    dashmm::Point pos = pick_cube_position();
+    dashmm::Point dist{pos.x() / 8, pos.y() / 8, pos.z() / 8};
+    double q = (double)rand() / RAND_MAX + 1.0;
+    dashmm::lap_s_to_m(dist, q, scale, M.data());
+  }
+
+  std::vector<int> offsets;
+  for (int dx = -3; dx <= 3; ++dx) {
+    for (int dy = -3; dy <= 3; ++dy) {
+      for (int dz = -3; dz <= 3; ++dz) {
+        if (abs(dx) > 1 || abs(dy) > 1 || abs(dz) > 1) {
+          offsets.push_back(dx);
+          offsets.push_back(dy);
+          offsets.push_back(dz);
+        }
+      }
+    }
+  }
+  int noffsets = offsets.size() / 3;
+
+  // The d-matrices for each offset, as they used to be held by the table
+  int nd = (p + 1) * (4 * p * p + 11 * p + 6) / 6;
+  std::vector<double> dmat(2 * nd * noffsets);
+  for (int i = 0; i < noffsets; ++i) {
+    const int *o = &offsets[3 * i];
+    double rho = sqrt(o[0] * o[0] + o[1] * o[1] + o[2] * o[2]);
+    dashmm::builtin_laplace_table_->dmatrix_of_beta(
+        acos(o[2] / rho), &dmat[2 * i * nd], &dmat[(2 * i + 1) * nd]);
+  }
+
+  std::vector<dashmm::dcomplex_t> L(nterms);
+  std::vector<dashmm::dcomplex_t> expected(nterms * noffsets);
+  std::vector<dashmm::dcomplex_t> computed(nterms * noffsets);
+
+  double t0 = getticks();
+  for (int r = 0; r < args.repeats; ++r) {
+    int i = r % noffsets;
+    const int *o = &offsets[3 * i];
+    reference_m_to_l(o[0], o[1], o[2], &dmat[2 * i * nd],
+                     &dmat[(2 * i + 1) * nd], M.data(), scale, L.data());
+  }
+  double tf = getticks();
+  fprintf(stdout, "p = %d\n", p);
+  fprintf(stdout, "%-11s %12.4e M2L/s\n", "reference",
+          args.repeats / (tf - t0) * 1e6);
+
+  // Time the operators for any order, and those specialized for this order
+  const dashmm::LaplaceKernels *variants[2] = {
+    dashmm::lap_kernels(0), dashmm::builtin_laplace_table_->kernels()
+  };
+  const char *names[2] = {"generic", "specialized"};
+  for (int v = 0; v < 2; ++v) {
+    if (v == 1 && variants[1]->p == 0) {
+      break;
+    }
+
+    t0 = getticks();
+    for (int r = 0; r < args.repeats; ++r) {
+      const int *o = &offsets[3 * (r % noffsets)];
+      variants[v]->m_to_l(
+          dashmm::builtin_laplace_table_->m2l(o[0], o[1], o[2]),
+          M.data(), scale, L.data());
+    }
+    tf = getticks();
+
+    for (int i = 0; i < noffsets; ++i) {
+      const int *o = &offsets[3 * i];
+      reference_m_to_l(o[0], o[1], o[2], &dmat[2 * i * nd],
+                       &dmat[(2 * i + 1) * nd], M.data(), scale,
+                       &expected[i * nterms]);
+      variants[v]->m_to_l(
+          dashmm::builtin_laplace_table_->m2l(o[0], o[1], o[2]),
+          M.data(), scale, &computed[i * nterms]);
+    }
+    fprintf(stdout, "%-11s %12.4e M2L/s (max rel. diff %4.3e)\n", names[v],
+            args.repeats / (tf - t0) * 1e6,
+            compare_coefficients(computed, expected));
+  }
+}
+
+// The Laplace M->I conversion as it was written before it was reduced to real
+// arithmetic. This is the baseline for the comparison. The six exponential
+// expansions are written to E in the order +x, -x, +y, -y, +z, -z.
+void reference_m_to_i(const dashmm::dcomplex_t *M, dashmm::dcomplex_t *E) {
+  using dashmm::dcomplex_t;
+  using dashmm::midx;
+  const dashmm::LaplaceTable *table = dashmm::builtin_laplace_table_.get();
+  int p = table->p();
+  int s = table->s();
+  int nexp = table->nexp();
+  int nsh = (p + 1) * (p + 2) / 2;
+  const double *weight_ = table->weight();
+  const int *m_ = table->m();
+  const int *f_ = table->f();
+  const int *smf_ = table->smf();
+  const double *lambdaknm = table->lambdaknm();
+  const dcomplex_t *ealphaj = table->ealphaj();
+
+  dcomplex_t *EP[3] = {E, E + 2 * nexp, E + 4 * nexp};
+  dcomplex_t *EM[3] = {E + nexp, E + 3 * nexp, E + 5 * nexp};
+
+  std::vector<dcomplex_t> W1(nsh);
+  std::vector<dcomplex_t> W2(nsh);
+  dashmm::lap_rotate_sph_z(M, -M_PI / 2, W1.data());
+  dashmm::lap_rotate_sph_y(W1.data(), table->dmat_minus(dashmm::kDMatEquator),
+                           W2.data());
+  dashmm::lap_rotate_sph_y(M, table->dmat_plus(dashmm::kDMatEquator),
+                           W1.data());
+  const dcomplex_t *SH[3] = {W1.data(), W2.data(), M};
+
+  for (int dir = 0; dir <= 2; ++dir) {
+    int offset = 0;
+    for (int k = 0; k < s ; ++k) {
+      double weight = weight_[k] / m_[k];
+      const double *lkn = &lambdaknm[k * nsh];
+      std::vector<dcomplex_t> z1(f_[k] + 1);
+      std::vector<dcomplex_t> z2(f_[k] + 1);
+      for (int n = 0; n <= p; n += 2) {
+        z1[0] += SH[dir][midx(n, 0)] * lkn[midx(n, 0)];
+      }
+      for (int n = 1; n <= p; n += 2) {
+        z2[0] += SH[dir][midx(n, 0)] * lkn[midx(n, 0)];
+      }
+      for (int m = 1; m <= f_[k]; ++m) {
+        dcomplex_t *za = (m % 2 ? &z2[m] : &z1[m]);
+        dcomplex_t *zb = (m % 2 ? &z1[m] : &z2[m]);
+        for (int n = m; n <= p; n += 2) {
+          *za += SH[dir][midx(n, m)] * lkn[midx(n, m)];
+        }
+        for (int n = m + 1; n <= p; n += 2) {
+          *zb += SH[dir][midx(n, m)] * lkn[midx(n, m)];
+        }
+      }
+
+      for (int j = 1; j <= m_[k] / 2; ++j) {
+        dcomplex_t up = z1[0] + z2[0];
+        dcomplex_t dn = z1[0] - z2[0];
+        dcomplex_t power_I {0.0, 1.0};
+        for (int m = 1; m <= f_[k]; ++m) {
+          int idx = smf_[k] + (j - 1) * f_[k] + (m - 1);
+          up += 2 * real(ealphaj[idx] * (z1[m] + z2[m])) * power_I;
+          dn += 2 * real(ealphaj[idx] * (z1[m] - z2[m])) * power_I;
+          power_I *= dcomplex_t{0.0, 1.0};
+        }
+        EP[dir][offset] = weight * up;
+        EM[dir][offset] = weight * dn;
+        offset++;
+      }
+    }
+  }
+}
+
+// The Laplace E->L conversion as it was written before it was reduced to real
+// arithmetic, for an exponential expansion along the z axis.
+void reference_e_to_l(const dashmm::dcomplex_t *E, bool sgn,
+                      dashmm::dcomplex_t *L) {
+  using dashmm::dcomplex_t;
+  using dashmm::midx;
+  const dashmm::LaplaceTable *table = dashmm::builtin_laplace_table_.get();
+  const double *sqf = table->sqf();
+  const dcomplex_t *ealphaj = table->ealphaj();
+  const double *lambda = table->lambda();
+  const int *m_ = table->m();
+  const int *sm_ = table->sm();
+  const int *f_ = table->f();
+  const int *smf_ = table->smf();
+  int p = table->p();
+  int s = table->s();
+
+  std::vector<dcomplex_t> W1((p + 1) * (p + 2) / 2);
+  for (int k = 0; k < s; ++k) {
+    int Mk2 = m_[k] / 2;
+    std::vector<dcomplex_t> z(f_[k] + 1);
+    for (int j = 1; j <= Mk2; ++j) {
+      int idx = sm_[k] + j - 1;
+      z[0] += (E[idx] + conj(E[idx]));
+    }
+    for (int m = 1; m <= f_[k]; ++m) {
+      for (int j = 1; j <= Mk2; ++j) {
+        int idx1 = sm_[k] + j - 1;
+        int idx2 = smf_[k] + (j - 1) * f_[k] + m - 1;
+        dcomplex_t e = (m % 2 ? E[idx1] - conj(E[idx1])
+                              : E[idx1] + conj(E[idx1]));
+        z[m] += e * conj(ealphaj[idx2]);
+      }
+    }
+    double power_lambdak = 1.0;
+    for (int n = 0; n <= p; ++n) {
+      int mmax = std::min(n, f_[k]);
+      for (int m = 0; m <= mmax; ++m) {
+        W1[midx(n, m)] += power_lambdak * z[m];
+      }
+      power_lambdak *= -lambda[k];
+    }
+  }
+
+  for (int n = 0; n <= p; ++n) {
+    dcomplex_t power_I{1.0, 0.0};
+    double sign = (!sgn && n % 2 ? -1.0 : 1.0);
+    for (int m = 0; m <= n; ++m) {
+      L[midx(n, m)] += sign * W1[midx(n, m)] * power_I / sqf[n - m] /
+        sqf[n + m];
+      power_I *= dcomplex_t{0.0, 1.0};
+    }
+  }
+}
+
+// Time the Laplace conversions between multipole, exponential and local
+// expansions used by the merge-and-shift path of FMM97. With --op=m2i each
+// repeat converts one multipole expansion to its six exponential expansions;
+// with --op=e2l each repeat converts one exponential expansion along z to a
+// local expansion.
+void time_exponential(InputArguments &args) {
+  dashmm::update_laplace_table(args.accuracy, 1.0);
+  double scale = dashmm::builtin_laplace_table_->scale(3);
+  int p = dashmm::builtin_laplace_table_->p();
+  int nexp = dashmm::builtin_laplace_table_->nexp();
+  int nterms = (p + 1) * (p + 2) / 2;
+  bool m2i = (args.op == "m2i");
+
+  std::vector<dashmm::dcomplex_t> M(nterms);
+  for (int i = 0; i < args.leaf_size; ++i) {
+    dashmm::Point pos = pick_cube_position();
+    dashmm::Point dist{pos.x() / 8, pos.y() / 8, pos.z() / 8};
+    double q = (double)rand() / RAND_MAX + 1.0;
+    dashmm::lap_s_to_m(dist, q, scale, M.data());
+  }
+
+  // The exponential expansions of M are the input to E->L
+  std::vector<dashmm::dcomplex_t> E(6 * nexp);
+  reference_m_to_i(M.data(), E.data());
+  const dashmm::dcomplex_t *E_pz = &E[4 * nexp];
+
+  size_t nout = (m2i ? 6 * nexp : nterms);
+  std::vector<dashmm::dcomplex_t> expected(nout);
+  std::vector<dashmm::dcomplex_t> computed(nout);
+
+  double t0 = getticks();
+  for (int r = 0; r < args.repeats; ++r) {
+    if (m2i) {
+      reference_m_to_i(M.data(), expected.data());
+    } else {
+      reference_e_to_l(E_pz, r % 2, expected.data());
+    }
+  }
+  double tf = getticks();
+  fprintf(stdout, "p = %d, %d exponential terms\n", p, nexp);
+  fprintf(stdout, "%-10s %12.4e %s/s\n", "reference",
+          args.repeats / (tf - t0) * 1e6, m2i ? "M2I" : "E2L");
+
+  dashmm::ViewSet views{dashmm::kSourceIntermediate};
+  for (int i = 0; i < 6; ++i) {
+    views.add_view(i, nexp * sizeof(dashmm::dcomplex_t),
+                   reinterpret_cast<char *>(&computed[i * nexp]));
+  }
+  t0 = getticks();
+  for (int r = 0; r < args.repeats; ++r) {
+    if (m2i) {
+      dashmm::lap_m_to_i(M.data(), views, 0);
+    } else {
+      dashmm::lap_e_to_l(E_pz, 'z', r % 2, computed.data());
+    }
+  }
+  tf = getticks();
+
+  std::fill(expected.begin(), expected.end(), 0.0);
+  std::fill(computed.begin(), computed.end(), 0.0);
+  if (m2i) {
+    reference_m_to_i(M.data(), expected.data());
+    dashmm::lap_m_to_i(M.data(), views, 0);
+  } else {
+    reference_e_to_l(E_pz, false, expected.data());
+    reference_e_to_l(E_pz, true, expected.data());
+    dashmm::lap_e_to_l(E_pz, 'z', false, computed.data());
+    dashmm::lap_e_to_l(E_pz, 'z', true, computed.data());
+  }
+  fprintf(stdout, "%-10s %12.4e %s/s (max rel. diff %4.3e)\n", "real",
+          args.repeats / (tf - t0) * 1e6, m2i ? "M2I" : "E2L",
+          compare_coefficients(computed, expected));
+}
+
+// Program entrypoint
+int main(int argc, char **argv) {
+  InputArguments args;
+  if (read_arguments(argc, argv, args)) {
+    return -1;
+  }
+
+  srand(123456);
+
+  fprintf(stdout, "%s %s, leaf size %d, %d repeats\n", args.op.c_str(),
+          args.kernel.c_str(), args.leaf_size, args.repeats);
+  if (args.op == "s2t") {
+    time_s_to_t(args);
+  } else if (args.op == "m2t" || args.op == "l2t") {
+    time_expansion_to_t(args);
+  } else if (args.op == "m2l") {
+    time_m_to_l(args);
+  } else if (args.op == "m2i" || args.op == "e2l") {
+    time_exponential(args);
+  } else {
+    time_s_to_expansion(args);
+  }
+
+  return 0;
+}
@@ -0,0 +1,409 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstdint>
+#include <getopt.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "dashmm/hilbert.h"
+#include "dashmm/point.h"
+
+
+// Benchmark of the division of the uniform level of the tree among the ranks.
+//
+// The points are generated as in the basic demo, and counted on the uniform
+// grid as DualTree does for the given number of ranks. The grid is divided by
+// points, and a grid kWorkPartitionLevels finer is divided by estimated work,
+// as with TreePartition::Points and TreePartition::Work. To judge each
+// division, the source and target trees under each uniform node are built as
+// DASHMM would build them, and the work of each rank is counted from those
+// trees: the source-target pairs of each target leaf with the sources of its
+// 27 neighbors of the same size, and kFarFieldWorkPerNode for each tree node.
+//
+// None of this requires the runtime, so this program does not initialize
+// DASHMM.
+
+
+// The finest level of the keys used to build the trees
+constexpr int kKeyLevel = 20;
+
+// This type collects the input arguments to the program.
+struct InputArguments {
+  int point_count;
+  std::string data_type;
+  int ranks;
+  int refinement_limit;
+  double radius;
+};
+
+// Print usage information.
+void print_usage(char *progname) {
+  fprintf(stdout, "Usage: %s [OPTIONS]\n\n"
+          "Options available: [possible/values] (default value)\n"
+          "--npoints=num           "
+          "number of sources and of targets to generate (100000)\n"
+          "--data=[cube/sphere/plummer]\n"
+          "                        point distribution type (plummer)\n"
+          "--ranks=num             number of ranks to divide among (64)\n"
+          "--threshold=num         "
+          "source and target tree partition refinement limit (40)\n"
+          "--radius=num            "
+          "largest radius of the plummer distribution (unlimited)\n"
+          , progname);
+}
+
+// Parse the command line arguments, overiding any defaults at the request of
+// the user.
+int read_arguments(int argc, char **argv, InputArguments &retval) {
+  //Set defaults
+  retval.point_count = 100000;
+  retval.data_type = std::string{"plummer"};
+  retval.ranks = 64;
+  retval.refinement_limit = 40;
+  retval.radius = 0.0;
+
+  int opt = 0;
+  static struct option long_options[] = {
+    {"npoints", required_argument, 0, 'n'},
+    {"data", required_argument, 0, 'd'},
+    {"ranks", required_argument, 0, 'r'},
+    {"threshold", required_argument, 0, 'l'},
+    {"radius", required_argument, 0, 'a'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  int long_index = 0;
+  while ((opt = getopt_long(argc, argv, "n:d:r:l:a:h",
+                            long_options, &long_index)) != -1) {
+    switch (opt) {
+    case 'n':
+      retval.point_count = atoi(optarg);
+      break;
+    case 'd':
+      retval.data_type = optarg;
+      break;
+    case 'r':
+      retval.ranks = atoi(optarg);
+      break;
+    case 'l':
+      retval.refinement_limit = atoi(optarg);
+      break;
+    case 'a':
+      retval.radius = atof(optarg);
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return -1;
+    case '?':
+      return -1;
+    }
+  }
+
+  //test the inputs
+  if (retval.data_type != "cube" && retval.data_type != "sphere"
+      && retval.data_type != "plummer") {
+    fprintf(stderr, "Usage ERROR: unknown data type '%s'\n",
+            retval.data_type.c_str());
+    return -1;
+  }
+
+  if (retval.point_count < 1 || retval.ranks < 1
+      || retval.refinement_limit < 1) {
+    fprintf(stderr, "Usage ERROR: npoints, ranks and threshold must be "
+            "positive\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+// Pick the positions in a cube with a uniform distribution
+dashmm::Point pick_cube_position() {
+  double pos[3];
+  pos[0] = (double)rand() / RAND_MAX - 0.5;
+  pos[1] = (double)rand() / RAND_MAX - 0.5;
+  pos[2] = (double)rand() / RAND_MAX - 0.5;
+  return dashmm::Point{pos[0], pos[1], pos[2]};
+}
+
+// Pick a point from the surface of the sphere, with a uniform distribution
+dashmm::Point pick_sphere_position() {
+  double r = 1.0;
+  double ctheta = 2.0 * (double)rand() / RAND_MAX - 1.0;
+  double stheta = sqrt(1.0 - ctheta * ctheta);
+  double phi = 2.0 * 3.1415926535 * (double)rand() / RAND_MAX;
+  double pos[3];
+  pos[0] = r * stheta * cos(phi);
+  pos[1] = r * stheta * sin(phi);
+  pos[2] = r * ctheta;
+  return dashmm::Point{pos[0], pos[1], pos[2]};
+}
+
+// Pick a position in the plummer distribution, within the given radius if it
+// is positive
+dashmm::Point pick_plummer_position(double radius) {
+  //NOTE: This is using a = 1
+  double r{0.0};
+  do {
+    double unif = (double)rand() / RAND_MAX;
+    r = 1.0 / sqrt(pow(unif, -2.0 / 3.0) - 1);
+  } while (radius > 0.0 && r > radius);
+  double ctheta = 2.0 * (double)rand() / RAND_MAX - 1.0;
+  double stheta = sqrt(1.0 - ctheta * ctheta);
+  double phi = 2.0 * 3.1415926535 * (double)rand() / RAND_MAX;
+  double pos[3];
+  pos[0] = r * stheta * cos(phi);
+  pos[1] = r * stheta * sin(phi);
+  pos[2] = r * ctheta;
+  return dashmm::Point{pos[0], pos[1], pos[2]};
+}
+
+// Generate the points
+std::vector<dashmm::Point> make_points(int count, const std::string &type,
+                                       double radius) {
+  std::vector<dashmm::Point> retval;
+  retval.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    if (type == "cube") {
+      retval.push_back(pick_cube_position());
+    } else if (type == "sphere") {
+      retval.push_back(pick_sphere_position());
+    } else {
+      retval.push_back(pick_plummer_position(radius));
+    }
+  }
+  return retval;
+}
+
+// Split the bits of an integer to be used in a Morton Key
+uint64_t split(unsigned k) {
+  uint64_t split = k & 0x1fffff;
+  split = (split | split << 32) & 0x1f00000000ffff;
+  split = (split | split << 16) & 0x1f0000ff0000ff;
+  split = (split | split << 8)  & 0x100f00f00f00f00f;
+  split = (split | split << 4)  & 0x10c30c30c30c30c3;
+  split = (split | split << 2)  & 0x1249249249249249;
+  return split;
+}
+
+// Compute the Morton key for a gives set of indices
+uint64_t morton_key(unsigned x, unsigned y, unsigned z) {
+  return split(x) | split(y) << 1 | split(z) << 2;
+}
+
+// The points of one sort, as sorted Morton keys at kKeyLevel
+class KeyedPoints {
+ public:
+  KeyedPoints(const std::vector<dashmm::Point> &points,
+              const double *low, double length) {
+    int dim = 1 << kKeyLevel;
+    keys_.reserve(points.size());
+    for (auto &p : points) {
+      unsigned idx[3];
+      for (int d = 0; d < 3; ++d) {
+        int i = static_cast<int>((p[d] - low[d]) / length * dim);
+        idx[d] = std::min(std::max(i, 0), dim - 1);
+      }
+      keys_.push_back(morton_key(idx[0], idx[1], idx[2]));
+    }
+    std::sort(keys_.begin(), keys_.end());
+  }
+
+  // The number of points in the box with the given index at the given level
+  int64_t count(int level, int64_t x, int64_t y, int64_t z) const {
+    int64_t dim = int64_t{1} << level;
+    if (x < 0 || y < 0 || z < 0 || x >= dim || y >= dim || z >= dim) {
+      return 0;
+    }
+    return count(level, morton_key(x, y, z));
+  }
+
+  // The number of points in the box with the given key at the given level
+  int64_t count(int level, uint64_t key) const {
+    int shift = 3 * (kKeyLevel - level);
+    auto first = std::lower_bound(keys_.begin(), keys_.end(), key << shift);
+    auto last = std::lower_bound(first, keys_.end(), (key + 1) << shift);
+    return last - first;
+  }
+
+ private:
+  std::vector<uint64_t> keys_;
+};
+
+// Decode the index of a box from its Morton key
+void box_index(uint64_t key, int64_t *idx) {
+  idx[0] = idx[1] = idx[2] = 0;
+  for (int b = 0; key; ++b, key >>= 3) {
+    idx[0] |= int64_t(key & 1) << b;
+    idx[1] |= int64_t((key >> 1) & 1) << b;
+    idx[2] |= int64_t((key >> 2) & 1) << b;
+  }
+}
+
+// The number of nodes of the tree under the given box
+int64_t tree_nodes(const KeyedPoints &points, int level, uint64_t key,
+                   int limit) {
+  int64_t n = points.count(level, key);
+  if (n == 0) {
+    return 0;
+  }
+  int64_t retval = 1;
+  if (n > limit && level < kKeyLevel) {
+    for (uint64_t c = 0; c < 8; ++c) {
+      retval += tree_nodes(points, level + 1, (key << 3) | c, limit);
+    }
+  }
+  return retval;
+}
+
+// The source-target pairs of the target leaves under the given box
+int64_t near_pairs(const KeyedPoints &sources, const KeyedPoints &targets,
+                   int level, uint64_t key, int limit) {
+  int64_t n = targets.count(level, key);
+  if (n == 0) {
+    return 0;
+  }
+  if (n > limit && level < kKeyLevel) {
+    int64_t retval = 0;
+    for (uint64_t c = 0; c < 8; ++c) {
+      retval += near_pairs(sources, targets, level + 1, (key << 3) | c, limit);
+    }
+    return retval;
+  }
+
+  int64_t idx[3];
+  box_index(key, idx);
+  int64_t neighbors = 0;
+  for (int dz = -1; dz <= 1; ++dz) {
+    for (int dy = -1; dy <= 1; ++dy) {
+      for (int dx = -1; dx <= 1; ++dx) {
+        neighbors += sources.count(level, idx[0] + dx, idx[1] + dy,
+                                   idx[2] + dz);
+      }
+    }
+  }
+  return n * neighbors;
+}
+
+// Divide the uniform grid at the given level and print the balance
+void report(const char *name, const InputArguments &args,
+            const KeyedPoints &sources, const KeyedPoints &targets,
+            int lvl, bool by_work) {
+  int klen = 1 << lvl;
+  int len = klen * klen * klen;
+  std::vector<int> counts(2 * len);
+  std::vector<int64_t> work(len);
+  for (int z = 0; z < klen; ++z) {
+    for (int y = 0; y < klen; ++y) {
+      for (int x = 0; x < klen; ++x) {
+        int i = x + y * klen + z * klen * klen;
+        uint64_t key = morton_key(x, y, z);
+        counts[i] = sources.count(lvl, key);
+        counts[i + len] = targets.count(lvl, key);
+        int64_t nodes = tree_nodes(sources, lvl, key, args.refinement_limit)
+                        + tree_nodes(targets, lvl, key, args.refinement_limit);
+        work[i] = near_pairs(sources, targets, lvl, key, args.refinement_limit)
+                  + dashmm::kFarFieldWorkPerNode * nodes;
+      }
+    }
+  }
+
+  std::vector<int64_t> estimate =
+      dashmm::estimate_work_uniform(counts.data(), len, lvl,
+                                    args.refinement_limit);
+  int *rank_map{nullptr};
+  if (by_work) {
+    rank_map = dashmm::distribute_work_hilbert(args.ranks, counts.data(),
+                                               len, lvl,
+                                               args.refinement_limit);
+  } else {
+    rank_map = dashmm::distribute_points_hilbert(args.ranks, counts.data(),
+                                                 len, lvl);
+  }
+
+  std::vector<int64_t> points(args.ranks, 0);
+  int64_t total{0};
+  for (int i = 0; i < len; ++i) {
+    points[rank_map[i]] += counts[i] + counts[i + len];
+    total += counts[i] + counts[i + len];
+  }
+  int64_t most = *std::max_element(points.begin(), points.end());
+
+  fprintf(stdout, "%-8s %6d %12.3f %12.3f %12.3f\n", name, lvl,
+          static_cast<double>(most) * args.ranks / total,
+          dashmm::work_imbalance(args.ranks, rank_map, estimate, len),
+          dashmm::work_imbalance(args.ranks, rank_map, work, len));
+
+  delete [] rank_map;
+}
+
+int main(int argc, char **argv) {
+  InputArguments args;
+  if (read_arguments(argc, argv, args)) {
+    return -1;
+  }
+
+  srand(123456);
+  std::vector<dashmm::Point> sources = make_points(args.point_count,
+                                                   args.data_type,
+                                                   args.radius);
+  std::vector<dashmm::Point> targets = make_points(args.point_count,
+                                                   args.data_type,
+                                                   args.radius);
+
+  // The domain, as DualTree computes it
+  double lo[3] = {sources[0][0], sources[0][1], sources[0][2]};
+  double hi[3] = {lo[0], lo[1], lo[2]};
+  for (auto points : {&sources, &targets}) {
+    for (auto &p : *points) {
+      for (int d = 0; d < 3; ++d) {
+        lo[d] = std::min(lo[d], p[d]);
+        hi[d] = std::max(hi[d], p[d]);
+      }
+    }
+  }
+  double length = std::max(hi[0] - lo[0],
+                           std::max(hi[1] - lo[1], hi[2] - lo[2]));
+  double low[3];
+  for (int d = 0; d < 3; ++d) {
+    low[d] = (hi[d] + lo[d] - length) / 2;
+  }
+  length *= 1.0 + 1.0e-9;
+
+  KeyedPoints skeys{sources, low, length};
+  KeyedPoints tkeys{targets, low, length};
+
+  // The uniform level, as DualTree sets it up for this many ranks
+  int lvl = ceil(log(args.ranks) / log(8)) + 1;
+
+  fprintf(stdout, "%d sources and %d targets in a %s distribution\n",
+          args.point_count, args.point_count, args.data_type.c_str());
+  fprintf(stdout, "%d ranks, threshold %d, domain size %lg\n\n",
+          args.ranks, args.refinement_limit, length);
+  fprintf(stdout, "Imbalance (largest rank / mean)\n");
+  fprintf(stdout, "%-8s %6s %12s %12s %12s\n", "division", "level",
+          "points", "estimated", "tree work");
+  report("points", args, skeys, tkeys, lvl, false);
+  report("work", args, skeys, tkeys, lvl + dashmm::kWorkPartitionLevels,
+         true);
+
+  return 0;
+}
@@ -0,0 +1,362 @@
+// =============================================================================
+//  Dynamic Adaptive System for Hierarchical Multipole Methods (DASHMM)
+//
+//  Copyright (c) 2015-2017, Trustees of Indiana University,
+//  All rights reserved.
+//
+//  This software may be modified and distributed under the terms of the BSD
+//  license. See the LICENSE file for details.
+//
+//  This software was created at the Indiana University Center for Research in
+//  Extreme Scale Technologies (CREST).
+// =============================================================================
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <getopt.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <hpx/hpx.h>
+
+#include "builtins/bhdistro.h"
+#include "dashmm/dag.h"
+#include "dashmm/hilbert.h"
+#include "dashmm/index.h"
+
+
+// Benchmark of the placement of the DAG nodes by BHDistro.
+//
+// The DAG the FMM method would discover is built for complete source and
+// target octrees of the given depth, with unit weights as for the Laplace
+// kernel. The uniform level is divided among the ranks as DualTree divides
+// it for uniformly distributed points, and the particle nodes and the normal
+// nodes of the leaves are placed with their branch, as DualTree places them.
+// The remaining nodes are placed by BHDistro, which is timed.
+//
+// The placement is compared with leaving every node with the branch of the
+// tree it belongs to, and the nodes above the uniform level on rank 0, which
+// is what BHPartialDistro does. For each, the fraction of the edge weight
+// that crosses ranks, and the largest weight of the edges into the nodes of
+// a rank relative to the average, are printed.
+//
+// The number of ranks modelled is that of the run, so the program is started
+// with as many ranks as are to be modelled. Only rank 0 does any work.
+
+
+// This type collects the input arguments to the program.
+struct InputArguments {
+  int levels;
+};
+
+// Print usage information.
+void print_usage(char *progname) {
+  fprintf(stdout, "Usage: %s [OPTIONS]\n\n"
+          "Options available: [possible/values] (default value)\n"
+          "--levels=num            depth of the source and target trees (5)\n"
+          , progname);
+}
+
+// Parse the command line arguments, overiding any defaults at the request of
+// the user.
+int read_arguments(int argc, char **argv, InputArguments &retval) {
+  //Set defaults
+  retval.levels = 5;
+
+  int opt = 0;
+  static struct option long_options[] = {
+    {"levels", required_argument, 0, 'l'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  int long_index = 0;
+  while ((opt = getopt_long(argc, argv, "l:h",
+                            long_options, &long_index)) != -1) {
+    switch (opt) {
+    case 'l':
+      retval.levels = atoi(optarg);
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return -1;
+    case '?':
+      return -1;
+    }
+  }
+
+  //test the inputs
+  if (retval.levels < 2 || retval.levels > 7) {
+    fprintf(stderr, "Usage ERROR: levels must be between 2 and 7\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+// Used to time the execution
+inline double getticks(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double) (tv.tv_sec * 1e6 + tv.tv_usec);
+}
+
+// The DAGInfo objects of a complete octree, level by level
+class Octree {
+ public:
+  explicit Octree(int levels) : levels_{levels}, nodes_(levels + 1) {
+    for (int l = 0; l <= levels; ++l) {
+      int dim = 1 << l;
+      for (int z = 0; z < dim; ++z) {
+        for (int y = 0; y < dim; ++y) {
+          for (int x = 0; x < dim; ++x) {
+            nodes_[l].emplace_back(
+                new dashmm::DAGInfo{nullptr, dashmm::Index{x, y, z, l}});
+          }
+        }
+      }
+    }
+  }
+
+  int levels() const {return levels_;}
+
+  // The node with the given index; nullptr if it is outside the domain
+  dashmm::DAGInfo *at(int x, int y, int z, int l) const {
+    int dim = 1 << l;
+    if (x < 0 || y < 0 || z < 0 || x >= dim || y >= dim || z >= dim) {
+      return nullptr;
+    }
+    return nodes_[l][x + y * dim + z * dim * dim].get();
+  }
+
+ private:
+  int levels_;
+  std::vector<std::vector<std::unique_ptr<dashmm::DAGInfo>>> nodes_;
+};
+
+// Build the DAG of the FMM method, as it would be discovered
+void discover(const Octree &source, const Octree &target) {
+  int levels = source.levels();
+
+  for (int l = levels; l >= 0; --l) {
+    int dim = 1 << l;
+    for (int z = 0; z < dim; ++z) {
+      for (int y = 0; y < dim; ++y) {
+        for (int x = 0; x < dim; ++x) {
+          dashmm::DAGInfo *s = source.at(x, y, z, l);
+          s->add_normal();
+          if (l == levels) {
+            s->add_parts();
+            s->StoM(s, 1);
+          } else {
+            for (int c = 0; c < 8; ++c) {
+              s->MtoM(source.at(2 * x + (c & 1), 2 * y + ((c >> 1) & 1),
+                                2 * z + (c >> 2), l + 1), 1);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  for (int l = 0; l <= levels; ++l) {
+    int dim = 1 << l;
+    for (int z = 0; z < dim; ++z) {
+      for (int y = 0; y < dim; ++y) {
+        for (int x = 0; x < dim; ++x) {
+          dashmm::DAGInfo *t = target.at(x, y, z, l);
+          t->add_normal();
+          if (l > 0) {
+            t->LtoL(target.at(x / 2, y / 2, z / 2, l - 1), 1);
+          }
+
+          // The children of the neighbors of the parent that are not
+          // adjacent to this node
+          for (int dz = -2; dz <= 3; ++dz) {
+            for (int dy = -2; dy <= 3; ++dy) {
+              for (int dx = -2; dx <= 3; ++dx) {
+                int sx = 2 * (x / 2) + dx;
+                int sy = 2 * (y / 2) + dy;
+                int sz = 2 * (z / 2) + dz;
+                dashmm::DAGInfo *s = source.at(sx, sy, sz, l);
+                if (s == nullptr || (abs(sx - x) <= 1 && abs(sy - y) <= 1
+                                     && abs(sz - z) <= 1)) {
+                  continue;
+                }
+                t->MtoL(s, 1);
+              }
+            }
+          }
+
+          if (l == levels) {
+            t->add_parts();
+            t->LtoT(t, 1);
+            for (int dz = -1; dz <= 1; ++dz) {
+              for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                  dashmm::DAGInfo *s = source.at(x + dx, y + dy, z + dz, l);
+                  if (s != nullptr) {
+                    t->StoT(s, 1);
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Place the leaves with their branch, and collect the nodes into the DAG
+void collect(const Octree &tree, bool is_source, const int *rank_map,
+             int unif_level, dashmm::DAG &dag) {
+  int levels = tree.levels();
+  int unif_dim = 1 << unif_level;
+  for (int l = 0; l <= levels; ++l) {
+    int dim = 1 << l;
+    for (int z = 0; z < dim; ++z) {
+      for (int y = 0; y < dim; ++y) {
+        for (int x = 0; x < dim; ++x) {
+          dashmm::DAGInfo *info = tree.at(x, y, z, l);
+          int loc{0};
+          if (l >= unif_level) {
+            int shift = l - unif_level;
+            loc = rank_map[(x >> shift) + (y >> shift) * unif_dim
+                           + (z >> shift) * unif_dim * unif_dim];
+          }
+          if (l == levels) {
+            info->set_parts_locality(loc);
+            info->set_normal_locality(loc);
+          }
+          if (is_source) {
+            dashmm::BHDistro::assign_for_source(*info, loc);
+            info->collect_DAG_nodes(dag.source_leaves, dag.source_nodes);
+          } else {
+            dashmm::BHDistro::assign_for_target(*info, loc);
+            info->collect_DAG_nodes(dag.target_leaves, dag.target_nodes);
+          }
+        }
+      }
+    }
+  }
+}
+
+// The rank of the branch of the tree the given node belongs to
+int branch_rank(const dashmm::DAGNode *node, const int *rank_map,
+                int unif_level) {
+  dashmm::Index idx = node->index();
+  if (idx.level() < unif_level) {
+    return 0;
+  }
+  int unif_dim = 1 << unif_level;
+  dashmm::Index unif = idx.parent(idx.level() - unif_level);
+  return rank_map[unif.x() + unif.y() * unif_dim
+                  + unif.z() * unif_dim * unif_dim];
+}
+
+// Print the cut and the imbalance of the given placement
+template <typename Locality>
+void report(const char *name, const dashmm::DAG &dag, int n_ranks,
+            Locality locality) {
+  std::vector<long> load(n_ranks, 0);
+  long total{0};
+  long cut{0};
+  const std::vector<dashmm::DAGNode *> *lists[4] = {
+    &dag.source_leaves, &dag.source_nodes,
+    &dag.target_nodes, &dag.target_leaves};
+  for (auto list : lists) {
+    for (auto node : *list) {
+      int from = locality(node);
+      for (size_t i = 0; i < node->out_count(); ++i) {
+        int to = locality(node->out_target(i));
+        long weight = node->out_edge(i).weight();
+        load[to] += weight;
+        total += weight;
+        if (from != to) {
+          cut += weight;
+        }
+      }
+    }
+  }
+  long most = *std::max_element(load.begin(), load.end());
+  fprintf(stdout, "%-8s %12.4f %12.3f\n", name,
+          static_cast<double>(cut) / total,
+          static_cast<double>(most) * n_ranks / total);
+}
+
+int placement_bench_handler(int levels) {
+  int n_ranks = hpx_get_num_ranks();
+  int unif_level = ceil(log(n_ranks) / log(8)) + 1;
+  unif_level = std::min(unif_level, levels);
+
+  // Uniform points divide the uniform level as evenly as they can
+  int unif_dim = 1 << unif_level;
+  int len = unif_dim * unif_dim * unif_dim;
+  std::vector<int> counts(2 * len, 1);
+  int *rank_map = dashmm::distribute_points_hilbert(n_ranks, counts.data(),
+                                                    len, unif_level);
+
+  Octree source{levels};
+  Octree target{levels};
+  discover(source, target);
+
+  dashmm::DAG dag{};
+  collect(source, true, rank_map, unif_level, dag);
+  collect(target, false, rank_map, unif_level, dag);
+  dag.finalize();
+
+  size_t unplaced{0};
+  for (auto list : {&dag.source_nodes, &dag.target_nodes}) {
+    for (auto node : *list) {
+      if (node->locality < 0) {
+        ++unplaced;
+      }
+    }
+  }
+
+  fprintf(stdout, "%d ranks, %d levels, uniform level %d\n",
+          n_ranks, levels, unif_level);
+  fprintf(stdout, "%zu nodes, %zu edges, %zu placed by BHDistro\n",
+          dag.node_count(), dag.edge_count(), unplaced);
+
+  dashmm::BHDistro distro{};
+  double t0 = getticks();
+  distro.compute_distribution(dag);
+  double tf = getticks();
+  fprintf(stdout, "placement time: %lg [us]\n\n", tf - t0);
+
+  fprintf(stdout, "%-8s %12s %12s\n", "policy", "cut", "imbalance");
+  report("bh", dag, n_ranks,
+         [](const dashmm::DAGNode *node) {return node->locality;});
+  report("branch", dag, n_ranks,
+         [rank_map, unif_level](const dashmm::DAGNode *node) {
+           return branch_rank(node, rank_map, unif_level);
+         });
+
+  delete [] rank_map;
+  hpx_exit(0, nullptr);
+}
+HPX_ACTION(HPX_DEFAULT, HPX_ATTR_NONE,
+           placement_bench_action, placement_bench_handler, HPX_INT);
+
+int main(int argc, char **argv) {
+  if (HPX_SUCCESS != hpx_init(&argc, &argv)) {
+    return -1;
+  }
+
+  InputArguments args;
+  if (read_arguments(argc, argv, args)) {
+    hpx_finalize();
+    return -1;
+  }
+
+  int err = hpx_run(&placement_bench_action, nullptr, &args.levels);
+  hpx_finalize();
+  return err;
+}